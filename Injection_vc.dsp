@@ -69,7 +69,7 @@ LINK32=link.exe
 # PROP Ignore_Export_Lib 0
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /MTd /W3 /Gm /GX /ZI /Od /D "WIN32" /D "_DEBUG" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "INJECTION_VC_EXPORTS" /YX /FD /GZ /c
-# ADD CPP /nologo /MTd /W3 /Gm /GX /ZI /Od /I ".\script\\" /D "_DEBUG" /D VERSION=0.3.30.2 /D "WIN32" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "INJECTION_VC_EXPORTS" /FR /YX /J /FD /GZ /c
+# ADD CPP /nologo /MTd /W3 /Gm /GX /ZI /Od /I ".\script\\" /D "_DEBUG" /D "USE_BENCHMARKS" /D VERSION=0.3.30.2 /D "WIN32" /D "_WINDOWS" /D "_MBCS" /D "_USRDLL" /D "INJECTION_VC_EXPORTS" /FR /YX /J /FD /GZ /c
 # ADD BASE MTL /nologo /D "_DEBUG" /mktyplib203 /win32
 # ADD MTL /nologo /D "_DEBUG" /mktyplib203 /win32
 # ADD BASE RSC /l 0x419 /d "_DEBUG"
@@ -92,6 +92,14 @@ LINK32=link.exe
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\autoreply.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\cmdqueue.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\common.cpp
 # End Source File
 # Begin Source File
@@ -109,6 +117,10 @@ SOURCE=.\equipment.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\events.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\extdll.cpp
 # End Source File
 # Begin Source File
@@ -153,6 +165,10 @@ SOURCE=.\injection.def
 # End Source File
 # Begin Source File
 
+SOURCE=.\journal.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\ld_main.cpp
 # End Source File
 # Begin Source File
@@ -161,6 +177,14 @@ SOURCE=.\menus.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\movequeue.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\packets.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\patch.cpp
 # End Source File
 # Begin Source File
@@ -169,18 +193,38 @@ SOURCE=.\runebook.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\sharedstats.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\skills.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\snapshot.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\spells.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\stats.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\target.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\textmatch.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\timers.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\TWOFISH2.C
 # SUBTRACT CPP /YX
 # End Source File
@@ -196,16 +240,28 @@ SOURCE=.\vendor.cpp
 
 SOURCE=.\world.cpp
 # End Source File
+# Begin Source File
+
+SOURCE=.\worldfeed.cpp
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
 # PROP Default_Filter "h;hpp;hxx;hm;inl"
 # Begin Source File
 
+SOURCE=.\autoreply.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\client.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\cmdqueue.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\common.h
 # End Source File
 # Begin Source File
@@ -218,6 +274,10 @@ SOURCE=.\equipment.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\events.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\extdll.h
 # End Source File
 # Begin Source File
@@ -258,10 +318,26 @@ SOURCE=.\injection.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\journal.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\livestats.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\menus.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\movequeue.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\packets.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\patch.h
 # End Source File
 # Begin Source File
@@ -274,18 +350,38 @@ SOURCE=.\runebook.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\sharedstats.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\skills.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\snapshot.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\spells.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\stats.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\target.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\textmatch.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\timers.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\uo_huffman.h
 # End Source File
 # Begin Source File
@@ -296,6 +392,10 @@ SOURCE=.\vendor.h
 
 SOURCE=.\world.h
 # End Source File
+# Begin Source File
+
+SOURCE=.\worldfeed.h
+# End Source File
 # End Group
 # Begin Group "Resource Files"
 
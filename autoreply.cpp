@@ -0,0 +1,199 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// autoreply.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Answers target cursors, menus and gumps from a queue
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "client.h"
+#include "stats.h"      // for read_tsc()
+#include "autoreply.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+AutoReplyQueue::AutoReplyQueue(ClientInterface & client, TimerWheel & timers)
+: m_client(client), m_timers(timers), m_armed(0)
+{
+}
+
+// private
+// Starts the timeout for the answer at the front.
+void AutoReplyQueue::arm()
+{
+    cancel();
+    if(m_replies.empty())
+        return;
+    m_armed = GetTickCount();
+    if(m_replies.front().m_timeout != 0)
+        m_timers.schedule(this, m_replies.front().m_timeout);
+}
+
+// private
+// Counts the front answer as sent and moves on to the next.
+void AutoReplyQueue::done(uint64 start)
+{
+    uint64 cycles = read_tsc() - start;
+    uint32 wait = GetTickCount() - m_armed;
+    AutoReplyStats & st = m_stats[m_replies.front().m_kind];
+    st.m_replies++;
+    st.m_wait_total += wait;
+    if(wait > st.m_wait_max)
+        st.m_wait_max = wait;
+    st.m_handler_cycles += cycles;
+    if(cycles > st.m_handler_max)
+        st.m_handler_max = cycles;
+    m_replies.pop_front();
+    arm();
+}
+
+// private
+void AutoReplyQueue::expired()
+{
+    if(m_replies.empty())
+        return;
+    const AutoReply & reply = m_replies.front();
+    m_stats[reply.m_kind].m_timeouts++;
+    m_client.client_print(string("Auto reply timed out waiting for ") +
+        get_kind_name(reply.m_kind));
+    m_replies.pop_front();
+    arm();
+}
+
+void AutoReplyQueue::push(const AutoReply & reply)
+{
+    m_replies.push_back(reply);
+    if(m_replies.size() == 1)
+        arm();
+}
+
+void AutoReplyQueue::clear()
+{
+    m_replies.clear();
+    cancel();
+}
+
+// This function is called for 0x6c messages
+bool AutoReplyQueue::handle_target(uint8 * buf, int size)
+{
+    if(m_replies.empty() || m_replies.front().m_kind != REPLY_TARGET ||
+            size < 19)
+        return false;
+    uint64 start = read_tsc();
+    uint8 reply[19];
+    memcpy(reply, buf, 19);
+    pack_big_uint32(reply + 7, m_replies.front().m_serial);
+    reply[18] = 0x0f;
+    m_client.send_server(reply, sizeof(reply));
+    done(start);
+    return true;
+}
+
+// This function is called for 0x7c messages
+bool AutoReplyQueue::handle_menu(uint8 * buf, int size)
+{
+    if(m_replies.empty() || m_replies.front().m_kind != REPLY_MENU ||
+            size < 11)
+        return false;
+    uint64 start = read_tsc();
+    const AutoReply & reply = m_replies.front();
+    int prompt_length = buf[9];
+    if(10 + prompt_length >= size ||
+            !reply.m_prompt.find(buf + 10, prompt_length))
+        return false;
+
+    uint8 * end = buf + size;
+    uint8 * ptr = buf + 10 + prompt_length;
+    int num_options = *ptr++;
+    int index = -1;
+    uint16 graphic = 0;
+    for(int i = 0; i < num_options && ptr + 5 <= end; i++)
+    {
+        int desc_len = ptr[4];
+        if(ptr + 5 + desc_len > end)
+            break;
+        if(reply.m_choice.find(ptr + 5, desc_len))
+        {
+            index = i;
+            graphic = unpack_big_uint16(ptr);
+            break;
+        }
+        ptr += 5 + desc_len;
+    }
+    if(index == -1)
+        m_client.client_print("Auto reply: menu choice not found, menu cancelled");
+
+    uint8 choice[13];
+    choice[0] = CODE_MENU_CHOICE;
+    memcpy(choice + 1, buf + 3, 6);     // menu id and gump
+    pack_big_uint16(choice + 7, index + 1);
+    pack_big_uint16(choice + 9, graphic);
+    pack_big_uint16(choice + 11, 0);
+    m_client.send_server(choice, sizeof(choice));
+    done(start);
+    return true;
+}
+
+// This function is called for 0xb0 messages
+bool AutoReplyQueue::handle_gump(uint8 * buf, int size)
+{
+    if(m_replies.empty() || m_replies.front().m_kind != REPLY_GUMP ||
+            size < 11)
+        return false;
+    const AutoReply & reply = m_replies.front();
+    if(reply.m_gump_id != 0 && unpack_big_uint32(buf + 7) != reply.m_gump_id)
+        return false;
+    uint64 start = read_tsc();
+    uint8 button[0x17];
+    button[0] = 0xb1;
+    pack_big_uint16(button + 1, sizeof(button));
+    memcpy(button + 3, buf + 3, 8);     // serial and gump id
+    pack_big_uint32(button + 11, reply.m_button);
+    pack_big_uint32(button + 15, 0);    // switches
+    pack_big_uint32(button + 19, 0);    // text entries
+    m_client.send_server(button, sizeof(button));
+    done(start);
+    return true;
+}
+
+void AutoReplyQueue::reset_stats()
+{
+    for(int i = 0; i < NUM_REPLY_KINDS; i++)
+        m_stats[i] = AutoReplyStats();
+}
+
+// static
+const char * AutoReplyQueue::get_kind_name(auto_reply_t kind)
+{
+    static const char * const names[NUM_REPLY_KINDS] =
+        { "target", "menu", "gump" };
+    return names[kind];
+}
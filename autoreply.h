@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// autoreply.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  A queue of answers for target cursors, menus and gumps the server is
+//  expected to send, so that a chain of them is answered as each one
+//  arrives.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _AUTOREPLY_H_
+#define _AUTOREPLY_H_
+
+#include <deque>
+#include <string>
+using std::string;
+
+#include "common.h"
+#include "textmatch.h"
+#include "timers.h"
+
+class ClientInterface;
+
+// Default for how long an answer waits for its question, in ms:
+const uint32 AUTO_REPLY_TIMEOUT = 10000;
+
+enum auto_reply_t
+{
+    REPLY_TARGET,   // 0x6c
+    REPLY_MENU,     // 0x7c
+    REPLY_GUMP,     // 0xb0
+    NUM_REPLY_KINDS
+};
+
+class AutoReply
+{
+public:
+    auto_reply_t m_kind;
+    uint32 m_timeout;       // 0 to wait for ever
+    uint32 m_serial;        // the target
+    TextMatcher m_prompt;   // part of the menu prompt
+    TextMatcher m_choice;   // part of the option's description
+    uint32 m_gump_id;
+    uint32 m_button;
+
+    AutoReply(auto_reply_t kind, uint32 timeout)
+    : m_kind(kind), m_timeout(timeout), m_serial(0), m_gump_id(0),
+      m_button(0)
+    {
+    }
+};
+
+class AutoReplyStats
+{
+public:
+    uint32 m_replies, m_timeouts;
+    // From when the answer reached the front of the queue until its
+    // question arrived, in ms:
+    uint32 m_wait_total, m_wait_max;
+    // From the question arriving to the answer being sent:
+    uint64 m_handler_cycles, m_handler_max;
+
+    AutoReplyStats()
+    : m_replies(0), m_timeouts(0), m_wait_total(0), m_wait_max(0),
+      m_handler_cycles(0), m_handler_max(0)
+    {
+    }
+};
+
+// Only the front answer is used; a question it does not match goes to the
+// client as usual. An answer that waits longer than its timeout is
+// dropped and the next one waits in its place.
+//
+// Only the client thread uses it.
+class AutoReplyQueue : private Timer
+{
+private:
+    ClientInterface & m_client;
+    TimerWheel & m_timers;
+    std::deque<AutoReply> m_replies;
+    uint32 m_armed;     // GetTickCount() when the front answer started
+    AutoReplyStats m_stats[NUM_REPLY_KINDS];
+
+    void arm();
+    void done(uint64 start);
+    virtual void expired();
+
+public:
+    AutoReplyQueue(ClientInterface & client, TimerWheel & timers);
+
+    void push(const AutoReply & reply);
+    void clear();
+    int size() const { return m_replies.size(); }
+    const AutoReply & get(int i) const { return m_replies[i]; }
+
+    // These return true if the message was answered and should not be
+    // sent to the client.
+    bool handle_target(uint8 * buf, int size);
+    bool handle_menu(uint8 * buf, int size);
+    bool handle_gump(uint8 * buf, int size);
+
+    const AutoReplyStats & get_stats(auto_reply_t kind) const
+    { return m_stats[kind]; }
+    void reset_stats();
+    static const char * get_kind_name(auto_reply_t kind);
+};
+
+#endif
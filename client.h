@@ -35,6 +35,31 @@
 #include <string>
 using std::string;
 
+#include <deque>
+
+typedef std::deque<string> arglist_t;
+
+// Item moves are sent one at a time. Bulk moves wait until no others are
+// queued.
+enum move_priority_t
+{
+    MOVE_NORMAL,    // what the player just asked for, e.g. dressing
+    MOVE_BULK,      // emptying containers and the like
+    NUM_MOVE_PRIORITIES
+};
+
+// A command that has been looked up and split into words once, so that it
+// can be run many times without parsing it again.
+class BoundCommand
+{
+public:
+    string m_text;
+    int m_command;      // index in the command table, or -1 if unknown
+    arglist_t m_args;
+
+    BoundCommand() : m_command(-1) {}
+};
+
 // Abstract class
 class ClientInterface
 {
@@ -48,15 +73,21 @@ public:
     // Print a string to the client in the form of a server talk message
     virtual void client_print(const char * text) = 0;
     virtual void client_print(const string & text) = 0;
+    // The moves are queued, and sent as fast as the server allows.
     // Pick up an item and move it into a container:
     virtual void move_container(uint32 serial, uint32 cserial) = 0;
-    virtual void move_container(uint32 serial, uint16 quantity, uint32 cserial) = 0;
+    virtual void move_container(uint32 serial, uint16 quantity, uint32 cserial,
+        move_priority_t priority = MOVE_NORMAL) = 0;
     // Pick up an item and move it into the player's backpack:
     virtual void move_backpack(uint32 serial) = 0;
     virtual void move_backpack(uint32 serial, uint16 quantity) = 0;
     // Pick up an item and move it onto the player's body:
-    virtual void move_equip(uint32 serial, int layer) = 0;
+    virtual void move_equip(uint32 serial, int layer,
+        move_priority_t priority = MOVE_NORMAL) = 0;
     virtual void do_command(const char * cmd) = 0;
+    // Returns false if the command is empty.
+    virtual bool bind_command(const char * cmd, BoundCommand & bound) = 0;
+    virtual void run_command(const BoundCommand & bound) = 0;
 };
 
 #endif
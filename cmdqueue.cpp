@@ -0,0 +1,118 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// cmdqueue.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "cmdqueue.h"
+#include "events.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+CommandFuture::CommandFuture()
+: m_refs(1), m_board(0), m_script(0)
+{
+    m_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+// private
+CommandFuture::~CommandFuture()
+{
+    CloseHandle(m_event);
+}
+
+void CommandFuture::add_ref()
+{
+    InterlockedIncrement(&m_refs);
+}
+
+void CommandFuture::release()
+{
+    if(InterlockedDecrement(&m_refs) == 0)
+        delete this;
+}
+
+void CommandFuture::set()
+{
+    SetEvent(m_event);
+    if(m_board != 0)
+        m_board->wake_script(m_script);
+}
+
+bool CommandFuture::wait(DWORD timeout)
+{
+    return WaitForSingleObject(m_event, timeout) == WAIT_OBJECT_0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CommandQueue::CommandQueue()
+: m_head(0)
+{
+}
+
+CommandQueue::~CommandQueue()
+{
+    // Wake up anyone still waiting rather than leave them blocked forever.
+    QueuedCommand * cmd = take_all();
+    while(cmd != 0)
+    {
+        QueuedCommand * next = cmd->m_next;
+        if(cmd->m_future != 0)
+            cmd->m_future->set();
+        delete cmd;     // releases the future
+        cmd = next;
+    }
+}
+
+bool CommandQueue::push(QueuedCommand * cmd)
+{
+    PVOID old;
+    do
+    {
+        old = m_head;
+        cmd->m_next = static_cast<QueuedCommand *>(old);
+    } while(InterlockedCompareExchange((PVOID *)&m_head, cmd, old) != old);
+    return old == 0;
+}
+
+QueuedCommand * CommandQueue::take_all()
+{
+    if(m_head == 0)     // the usual case, so avoid the locked instruction
+        return 0;
+    QueuedCommand * cmd = reinterpret_cast<QueuedCommand *>(
+        InterlockedExchange((LPLONG)&m_head, 0));
+
+    // The producers push onto the front, so reverse the list.
+    QueuedCommand * first = 0;
+    while(cmd != 0)
+    {
+        QueuedCommand * next = cmd->m_next;
+        cmd->m_next = first;
+        first = cmd;
+        cmd = next;
+    }
+    return first;
+}
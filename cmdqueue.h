@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// cmdqueue.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  A queue that passes commands from script threads to the client thread.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _CMDQUEUE_H_
+#define _CMDQUEUE_H_
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "client.h"     // for arglist_t
+
+class EventBoard;
+
+// How long a thread waits for its queued commands before giving up.
+const DWORD COMMAND_WAIT_TIMEOUT = 10000;
+
+// Lets the thread that queued a command wait until it has been run. The
+// waiter may give up before then, so a future is allocated on the heap and
+// shared: the command holds one reference and the waiter another.
+class CommandFuture
+{
+private:
+    HANDLE m_event;
+    LONG m_refs;
+    EventBoard * m_board;
+    void * m_script;
+
+    // Use release() instead.
+    ~CommandFuture();
+
+public:
+    // Starts with one reference, which belongs to the caller.
+    CommandFuture();
+
+    void add_ref();
+    // Deletes the future when the last reference is released.
+    void release();
+
+    // Makes set() wake a script that waits by yielding to other scripts
+    // instead of blocking on wait().
+    void set_script(EventBoard & board, void * script)
+    { m_board = &board; m_script = script; }
+
+    // Called on the client thread once the command has run.
+    void set();
+    // Returns false if the command did not run within 'timeout' ms.
+    bool wait(DWORD timeout = COMMAND_WAIT_TIMEOUT);
+};
+
+class QueuedCommand
+{
+public:
+    QueuedCommand * m_next;
+    // An index into Injection::m_commands, or -1 if m_args[0] is a whole
+    // command line for do_command().  An empty -1 command does nothing, and
+    // is used to wait until the commands before it have run.
+    int m_command;
+    arglist_t m_args;
+    CommandFuture * m_future;   // may be 0
+
+    QueuedCommand(int command, CommandFuture * future)
+    : m_next(0), m_command(command), m_future(future)
+    {
+        if(m_future != 0)
+            m_future->add_ref();
+    }
+    ~QueuedCommand()
+    {
+        if(m_future != 0)
+            m_future->release();
+    }
+};
+
+// Any number of threads may push() without locking. Only the client thread
+// takes the commands off again, all at once, so the list is never changed
+// under a pointer that another thread is still reading.
+class CommandQueue
+{
+private:
+    QueuedCommand * volatile m_head;    // newest first
+
+public:
+    CommandQueue();
+    ~CommandQueue();
+
+    // Takes ownership of 'cmd'. Returns true if the queue was empty, in which
+    // case the client thread may need waking up.
+    bool push(QueuedCommand * cmd);
+    // Returns all the queued commands, oldest first, or 0. The caller must
+    // delete them.
+    QueuedCommand * take_all();
+    bool is_empty() const { return m_head == 0; }
+};
+
+#endif
@@ -358,4 +358,15 @@ bool string_to_int(const char * s, int & n)
     return end == s + strlen(s);
 }
 
+bool replace_file(const char * temp_filename, const char * filename)
+{
+    if(MoveFileEx(temp_filename, filename, MOVEFILE_REPLACE_EXISTING))
+        return true;
+    // Windows 95/98 do not have MoveFileEx(), so the old file has to be
+    // removed first.
+    if(GetLastError() != ERROR_CALL_NOT_IMPLEMENTED)
+        return false;
+    remove(filename);
+    return rename(temp_filename, filename) == 0;
+}
 
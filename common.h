@@ -42,6 +42,13 @@ typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef unsigned long uint32;
 typedef signed long sint32;
+#ifdef __GNUC__
+typedef unsigned long long uint64;
+typedef signed long long sint64;
+#else
+typedef unsigned __int64 uint64;
+typedef signed __int64 sint64;
+#endif
 
 // Given a buffer of 4 bytes, extract a big endian 32 bit unsigned integer
 inline uint32 unpack_big_uint32(uint8 * buf)
@@ -203,6 +210,11 @@ bool string_to_bool(const char * s, bool & b);
 bool string_to_serial(const char * s, uint32 & serial);
 bool string_to_int(const char * s, int & n);
 
+// Moves a completely written temporary file over 'filename', so that
+// readers see either the old or the new contents. Returns true if
+// successful.
+bool replace_file(const char * temp_filename, const char * filename);
+
 extern bool g_FixUnicodeCaption;
 
 #endif
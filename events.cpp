@@ -0,0 +1,225 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// events.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#include <string.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "events.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Every event gets a sequence number. A waiting thread first looks through
+//  the recent history for a matching event newer than its mark; if there is
+//  none it puts itself on the waiter list, and signal() wakes it.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+EventBoard::EventBoard()
+: m_seq(0), m_mark_source(0), m_script_source(0), m_script_waker(0)
+{
+    InitializeCriticalSection(&m_lock);
+    memset(m_history, 0, sizeof(m_history));
+    {for(int i = 0; i < NUM_SCRIPT_EVENTS; i++)
+        m_active[i] = false;}
+    m_mark_index = TlsAlloc();
+}
+
+EventBoard::~EventBoard()
+{
+    // Anyone still waiting will time out; there is nothing to wake them for.
+    TlsFree(m_mark_index);
+    DeleteCriticalSection(&m_lock);
+}
+
+void EventBoard::set_script_source(mark_source_t mark, script_source_t script,
+    script_waker_t waker)
+{
+    m_mark_source = mark;
+    m_script_source = script;
+    m_script_waker = waker;
+}
+
+void * EventBoard::get_current_script()
+{
+    return m_script_source != 0 ? m_script_source() : 0;
+}
+
+void EventBoard::wake_script(void * script)
+{
+    script_waker_t waker = m_script_waker;
+    if(waker != 0 && script != 0)
+        waker(script);
+}
+
+// private
+uint32 EventBoard::get_mark()
+{
+    uint32 * slot = m_mark_source != 0 ? m_mark_source() : 0;
+    uint32 mark = slot != 0 ? *slot :
+        reinterpret_cast<uint32>(TlsGetValue(m_mark_index));
+    if(mark == 0)
+        return m_seq;
+    return mark - 1;
+}
+
+// private
+void EventBoard::set_mark(uint32 seq)
+{
+    uint32 * slot = m_mark_source != 0 ? m_mark_source() : 0;
+    if(slot != 0)
+        *slot = seq + 1;
+    else
+        TlsSetValue(m_mark_index, reinterpret_cast<LPVOID>(seq + 1));
+}
+
+// private static
+bool EventBoard::matches(const ScriptEvent & event, script_event_t type,
+    uint32 arg, const char * text)
+{
+    if(event.m_type != type)
+        return false;
+    if(arg != 0 && event.m_arg != arg)
+        return false;
+    if(text != 0 && strstr(event.m_text, text) == 0)
+        return false;
+    return true;
+}
+
+void EventBoard::signal(script_event_t type, uint32 arg, const char * text)
+{
+    EnterCriticalSection(&m_lock);
+    m_seq++;
+    ScriptEvent & event = m_history[m_seq % EVENT_HISTORY_SIZE];
+    event.m_seq = m_seq;
+    event.m_type = type;
+    event.m_arg = arg;
+    if(text != 0)
+    {
+        strncpy(event.m_text, text, EVENT_TEXT_SIZE - 1);
+        event.m_text[EVENT_TEXT_SIZE - 1] = '\0';
+    }
+    else
+        event.m_text[0] = '\0';
+
+    for(std::vector<EventWaiter *>::iterator i = m_waiters.begin();
+        i != m_waiters.end(); i++)
+    {
+        EventWaiter * waiter = *i;
+        if(waiter->m_seq == 0 &&
+            matches(event, waiter->m_type, waiter->m_arg, waiter->m_text))
+        {
+            waiter->m_seq = m_seq;
+            SetEvent(waiter->m_event);
+            wake_script(waiter->m_script);
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+void EventBoard::set_active(script_event_t type, bool active)
+{
+    m_active[type] = active;
+}
+
+void EventBoard::mark()
+{
+    EnterCriticalSection(&m_lock);
+    set_mark(m_seq);
+    LeaveCriticalSection(&m_lock);
+}
+
+bool EventBoard::wait(script_event_t type, uint32 arg, const char * text,
+    DWORD timeout, ScriptYield * yield)
+{
+    if(m_active[type])
+        return true;
+
+    EnterCriticalSection(&m_lock);
+    // Events older than the history are lost, but they are also too old to
+    // be what the script is waiting for.
+    uint32 seq = get_mark();
+    if(m_seq - seq > uint32(EVENT_HISTORY_SIZE))
+        seq = m_seq - EVENT_HISTORY_SIZE;
+    while(seq != m_seq)
+    {
+        seq++;
+        if(matches(m_history[seq % EVENT_HISTORY_SIZE], type, arg, text))
+        {
+            set_mark(seq);
+            LeaveCriticalSection(&m_lock);
+            return true;
+        }
+    }
+
+    if(timeout == 0)
+    {
+        LeaveCriticalSection(&m_lock);
+        return false;
+    }
+
+    EventWaiter waiter;
+    waiter.m_type = type;
+    waiter.m_arg = arg;
+    waiter.m_text = text;
+    waiter.m_seq = 0;
+    waiter.m_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    waiter.m_script = yield != 0 ? get_current_script() : 0;
+    m_waiters.push_back(&waiter);
+    LeaveCriticalSection(&m_lock);
+
+    if(waiter.m_script != 0)
+    {
+        // signal() wakes the script, so this only goes round again after
+        // an unrelated wake-up.
+        DWORD start = GetTickCount();
+        for(;;)
+        {
+            if(WaitForSingleObject(waiter.m_event, 0) == WAIT_OBJECT_0)
+                break;
+            DWORD waited = GetTickCount() - start;
+            if(waited >= timeout || !yield->yield(timeout - waited))
+                break;
+        }
+    }
+    else
+        WaitForSingleObject(waiter.m_event, timeout);
+
+    EnterCriticalSection(&m_lock);
+    {for(std::vector<EventWaiter *>::iterator i = m_waiters.begin();
+        i != m_waiters.end(); i++)
+        if(*i == &waiter)
+        {
+            m_waiters.erase(i);
+            break;
+        }}
+    // The event may have come after the timeout but before the lock.
+    if(waiter.m_seq != 0)
+        set_mark(waiter.m_seq);
+    LeaveCriticalSection(&m_lock);
+    CloseHandle(waiter.m_event);
+    return waiter.m_seq != 0;
+}
@@ -0,0 +1,144 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// events.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Lets script threads sleep until the client thread sees something happen,
+//  instead of polling with Wait().
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <vector>
+
+#include "common.h"
+
+enum script_event_t
+{
+    EVENT_TARGET,           // the server opened a target cursor
+    EVENT_GUMP,             // the server opened a gump
+    EVENT_MENU,             // the server opened a menu
+    EVENT_CONTAINER_ITEM,   // an item was put in a container (arg: container)
+    EVENT_JOURNAL,          // the server printed some text (text: the line)
+    EVENT_JOURNAL_MATCH,    // a journal pattern was found (arg: its number)
+    NUM_SCRIPT_EVENTS
+};
+
+// How many recent events are kept for scripts that start waiting late:
+const int EVENT_HISTORY_SIZE = 32;
+const int EVENT_TEXT_SIZE = 128;
+
+class ScriptEvent
+{
+public:
+    uint32 m_seq;
+    script_event_t m_type;
+    uint32 m_arg;
+    char m_text[EVENT_TEXT_SIZE];
+};
+
+// A thread or script blocked in EventBoard::wait().
+class EventWaiter
+{
+public:
+    script_event_t m_type;
+    uint32 m_arg;               // 0 matches any
+    const char * m_text;        // 0 matches any
+    uint32 m_seq;               // of the matching event, 0 until found
+    HANDLE m_event;
+    void * m_script;            // woken as well, if not 0
+};
+
+// Returns where the running script keeps its mark, or 0 if the thread runs
+// only one script.
+typedef uint32 * (__cdecl * mark_source_t)();
+// Returns the running script, or 0 if the thread runs only one script.
+typedef void * (__cdecl * script_source_t)();
+// Makes a waiting script run again. Scripts that have ended are ignored.
+typedef void (__cdecl * script_waker_t)(void * script);
+
+// Lets a script that shares its thread with other scripts wait without
+// blocking them.
+class ScriptYield
+{
+public:
+    virtual ~ScriptYield() {}
+    // Runs the other scripts for up to 'msec' ms, or until this one is
+    // woken. Returns false if the script is being stopped.
+    virtual bool yield(DWORD msec) = 0;
+};
+
+class EventBoard
+{
+private:
+    CRITICAL_SECTION m_lock;
+    uint32 m_seq;               // of the newest event
+    ScriptEvent m_history[EVENT_HISTORY_SIZE];  // indexed by m_seq
+    bool m_active[NUM_SCRIPT_EVENTS];
+    std::vector<EventWaiter *> m_waiters;
+    // Each thread's mark, plus one so that 0 means none:
+    DWORD m_mark_index;
+    mark_source_t m_mark_source;
+    script_source_t m_script_source;
+    script_waker_t m_script_waker;
+
+    uint32 get_mark();
+    void set_mark(uint32 seq);
+    static bool matches(const ScriptEvent & event, script_event_t type,
+        uint32 arg, const char * text);
+
+public:
+    EventBoard();
+    ~EventBoard();
+
+    // These are called on the client thread.
+    void signal(script_event_t type, uint32 arg = 0, const char * text = 0);
+    // While an event is active, waits for it return at once.
+    void set_active(script_event_t type, bool active);
+
+    // Set by the script DLL, which runs many scripts on each of its threads.
+    void set_script_source(mark_source_t mark, script_source_t script,
+        script_waker_t waker);
+    // The script running on this thread, or 0.
+    void * get_current_script();
+    // May be called from any thread.
+    void wake_script(void * script);
+
+    // Later waits by this thread will also accept events that happen after
+    // this call but before the wait starts.
+    void mark();
+    // Blocks until an event of 'type' matching 'arg' and 'text' happens, and
+    // returns false if it didn't within 'timeout' ms. With a timeout of 0
+    // this only checks. A script given 'yield' lets the other scripts of
+    // its thread run meanwhile, and the event wakes it.
+    bool wait(script_event_t type, uint32 arg, const char * text,
+        DWORD timeout, ScriptYield * yield = 0);
+};
+
+#endif
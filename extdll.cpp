@@ -48,10 +48,13 @@ extern int g_Life, g_STR, g_Mana, g_INT, g_Stamina, g_DEX,
     g_H, g_C, g_M, g_L, g_B,
     g_AR, g_BT;
 
+// The script functions below are called from script threads. Commands are
+// queued for the client thread, so that they don't race with the message
+// handlers and the script does not have to wait for them.
 void __cdecl DoCommand(const char *cmd)
 {
     if(g_injection)
-        g_injection->do_command(cmd);
+        g_injection->queue_command_line(cmd);
 }
 
 void __cdecl ClientPrint(const char *str)
@@ -77,93 +80,124 @@ int __cdecl count_object_type_color(const char *str, const char *color)
         return -1;
 }
 
-// Internal function that converts script function parameters to string
-string ConvertParamsToStr(LibraryFunctions *Table,
-    ParserVariable *Result, ParserVariable *Params[], int ParamCount, ParserObject *Parser)
+int __cdecl RunCommand(const char *name, int argc, const char * const *argv)
 {
-    string Parm="";
-    for(int i=0; i<ParamCount-1; i++)   // the Params[last] is a class var
+    if(!g_injection)
+        return 0;
+    int command=Injection::find_command(name,strlen(name));
+    if(command==-1)
+        return 0;
+    arglist_t args;
+    args.push_back(name);
+    for(int i=0; i<argc; i++)
+        args.push_back(argv[i]);
+    // Callers of this one expect the command to have run when it returns.
+    CommandFuture *done=new CommandFuture;
+    g_injection->queue_command(command,args,done);
+    bool ran=done->wait();
+    done->release();
+    if(!ran)
     {
-        if(i)
-            Parm+=" ";
+        warning_printf("RunCommand(%s): the client did not run it in time\n",
+            name);
+        return 0;
+    }
+    return 1;
+}
 
-        if(Table->GetType(Params[i])==T_Number) // convert numbers to string
-        {
-            char Buff[128];
-            double t=Table->GetNumber(Params[i]);
+int __cdecl OpenWorldFeed(int capacity)
+{
+    if(!g_injection)
+        return 0;
+    return g_injection->get_world_feed().subscribe(
+        capacity>0?capacity:DEFAULT_FEED_CAPACITY);
+}
 
-            if(t!=(int)t)   // float number
-            {
-                _gcvt(t,8,Buff);
-                if(Buff[strlen(Buff)-1]=='.')       // remove trailing dot
-                    Buff[strlen(Buff)-1]=0;
-            } else          // normal (hex) number
-            {
-                strcpy(Buff,"0x");
-                _itoa(t,Buff+2,16);
-            }
-            Parm+=Buff;
-        }
-        else
-        {
-            const char *str=Table->GetString(Params[i]);    // quote strings with spaces
-            if(strchr(str,' '))
-                Parm+=string("'")+str+"'";
-            else
-                Parm+=str;
-        }
-    }
-//  ClientPrint(Parm.c_str());
-    return Parm;
+int __cdecl ReadWorldFeed(int id, WorldChange *changes, int max_changes)
+{
+    if(!g_injection)
+        return -1;
+    return g_injection->get_world_feed().read(id,changes,max_changes);
 }
 
-const char * ScriptFunc_CountOnGround(LibraryFunctions *Table,                                      \
-    ParserVariable *Result, ParserVariable *Params[], int ParamCount, ParserObject *Parser)
+void __cdecl CloseWorldFeed(int id)
 {
-    string Parm1="";
-    string Parm2="";
-    int count=0;
+    if(g_injection)
+        g_injection->get_world_feed().unsubscribe(id);
+}
+
+// The script DLL calls this as it frees each script, with the pointer
+// ScriptCurrent returned for it, to close the feeds the script left open.
+void __cdecl ScriptEnded(void *script)
+{
+    if(g_injection)
+        g_injection->get_world_feed().unsubscribe_owner(script);
+}
 
-    if(Table->GetType(Params[0])==T_Number) // convert numbers to string
+// Internal function that converts a script function parameter to a command
+// word. Whole numbers are written in hex, which is what the commands expect
+// for serials, graphics and colours.
+static void ConvertParam(LibraryFunctions *Table, ParserVariable *Param,
+    string &Word)
+{
+    if(Table->GetType(Param)==T_Number)
     {
         char Buff[128];
-        double t=Table->GetNumber(Params[0]);
+        double t=Table->GetNumber(Param);
 
         if(t!=(int)t)   // float number
         {
-        	_gcvt(t,8,Buff);
+            _gcvt(t,8,Buff);
             if(Buff[strlen(Buff)-1]=='.')       // remove trailing dot
-            	Buff[strlen(Buff)-1]=0;
-		} else          // normal (hex) number
+                Buff[strlen(Buff)-1]=0;
+        } else          // normal (hex) number
         {
-        	strcpy(Buff,"0x");
+            strcpy(Buff,"0x");
             _itoa(t,Buff+2,16);
         }
-        Parm1=Buff;
-	} else
-		Parm1=Table->GetString(Params[0]);
+        Word=Buff;
+    }
+    else
+        Word=Table->GetString(Param);
+}
 
-    if(ParamCount>2)
+// Internal function that runs a command with the script function parameters
+// as its words. They used to be joined into one string that do_command()
+// split again, which also broke strings containing quotes.
+static void RunScriptCommand(const char *Name, int &Command,
+    LibraryFunctions *Table, ParserVariable *Params[], int ParamCount)
+{
+    if(!g_injection)
+        return;
+    if(Command==-1)     // look it up on the first call only
+        Command=Injection::find_command(Name,strlen(Name));
+    ASSERT(Command!=-1);
+
+    arglist_t args;
+    args.push_back(Name);
+    for(int i=0; i<ParamCount-1; i++)   // the Params[last] is a class var
     {
-	    if(Table->GetType(Params[1])==T_Number) // convert numbers to string
-    	{
-        	char Buff[128];
-	        double t=Table->GetNumber(Params[1]);
-
-    	    if(t!=(int)t)   // float number
-        	{
-	        	_gcvt(t,8,Buff);
-    	        if(Buff[strlen(Buff)-1]=='.')       // remove trailing dot
-        	    	Buff[strlen(Buff)-1]=0;
-			} else          // normal (hex) number
-    	    {
-        		strcpy(Buff,"0x");
-            	_itoa(t,Buff+2,16);
-	        }
-    	    Parm2=Buff;
-       	} else
-			Parm2=Table->GetString(Params[1]);
+        args.push_back(string());
+        ConvertParam(Table,Params[i],args.back());
+        // An empty string used to vanish when the words were joined and
+        // split again, and existing scripts count on that.
+        if(args.back().empty())
+            args.pop_back();
+    }
+    g_injection->queue_command(Command,args);
+}
+
+const char * ScriptFunc_CountOnGround(LibraryFunctions *Table,                                      \
+    ParserVariable *Result, ParserVariable *Params[], int ParamCount, ParserObject *Parser)
+{
+    string Parm1;
+    string Parm2;
+    int count=0;
 
+    ConvertParam(Table,Params[0],Parm1);
+    if(ParamCount>2)
+    {
+        ConvertParam(Table,Params[1],Parm2);
         count=g_injection->count_on_ground(Parm1.c_str(),Parm2.c_str());
 	} else
 	    count=g_injection->count_on_ground(Parm1.c_str());
@@ -174,6 +208,308 @@ const char * ScriptFunc_CountOnGround(LibraryFunctions *Table,
     return 0;
 }
 
+// Lets the other scripts of the worker run while a script waits. The wait
+// ends early when the script is woken through EventBoard::wake_script().
+class LibraryYield : public ScriptYield
+{
+private:
+    LibraryFunctions *Table;
+    ParserObject *Parser;
+public:
+    LibraryYield(LibraryFunctions *T, ParserObject *P) : Table(T),Parser(P) {}
+    // Returns false if the script DLL can't do that, and then the caller
+    // has to block instead.
+    bool CanYield()
+    {
+        return Table->Size>=(int)sizeof(LibraryFunctions) &&
+            g_injection->get_events().get_current_script()!=0;
+    }
+    virtual bool yield(DWORD msec)
+    {
+        Table->Wait(Parser,msec>0x7fffffff?0x7fffffff:(int)msec);
+        return !Table->IsTerminated(Parser);
+    }
+};
+
+// Waits until the commands the script has issued so far have run, for
+// scripts that look at their results. The result is 1, or 0 if the client
+// did not get round to them in time.
+const char * ScriptFunc_Sync(LibraryFunctions *Table,
+    ParserVariable *Result, ParserVariable * /*Params*/[],
+    int /*ParamCount*/, ParserObject *Parser)
+{
+    bool Ran=false;
+    if(g_injection)
+    {
+        LibraryYield Yield(Table,Parser);
+        CommandFuture *Done=new CommandFuture;
+        if(Yield.CanYield())
+        {
+            EventBoard &Events=g_injection->get_events();
+            Done->set_script(Events,Events.get_current_script());
+        }
+        g_injection->queue_command(-1,arglist_t(),Done);
+        if(Yield.CanYield())
+        {
+            // The command queue wakes the script once the command has run
+            DWORD Start=GetTickCount();
+            for(;;)
+            {
+                Ran=Done->wait(0);
+                DWORD Waited=GetTickCount()-Start;
+                if(Ran || Waited>=COMMAND_WAIT_TIMEOUT ||
+                        !Yield.yield(COMMAND_WAIT_TIMEOUT-Waited))
+                    break;
+            }
+        }
+        else
+            Ran=Done->wait();
+        Done->release();
+    }
+    Table->SetType(Result,T_Number);
+    Table->SetNumber(Result,Ran?1:0);
+    return 0;
+}
+
+// Internal function that reads a serial or id parameter, given either as a
+// number or as a string such as "0x40001234".
+static uint32 GetSerialParam(LibraryFunctions *Table, ParserVariable *Param)
+{
+    if(Table->GetType(Param)==T_Number)
+        return (uint32)Table->GetNumber(Param);
+    return strtoul(Table->GetString(Param),0,0);
+}
+
+// Internal function that reads a journal pattern parameter, given either as
+// the number from JournalPattern or as the text itself.
+static int GetPatternParam(LibraryFunctions *Table, ParserVariable *Param)
+{
+    if(Table->GetType(Param)==T_Number)
+        return (int)Table->GetNumber(Param);
+    if(!g_injection)
+        return 0;
+    return g_injection->get_journal().add_pattern(Table->GetString(Param));
+}
+
+// Scripts wait this long for an event if they give no timeout.
+const DWORD DEFAULT_EVENT_TIMEOUT=10000;
+
+// Internal function shared by the Wait* script functions. The parameters
+// are ([arg,] [timeout]) or, for the journal, (text [,timeout]) or
+// (pattern [,timeout]). The result is 1 if the event happened and 0 on
+// timeout.
+static void WaitScriptEvent(script_event_t Type, bool HasArg,
+    LibraryFunctions *Table, ParserVariable *Result,
+    ParserVariable *Params[], int ParamCount, ParserObject *Parser)
+{
+    int Count=ParamCount-1;     // the Params[last] is a class var
+    int Next=0;
+    uint32 Arg=0;
+    string Text;
+    if(HasArg && Next<Count)
+    {
+        if(Type==EVENT_JOURNAL)
+            Text=Table->GetString(Params[Next]);
+        else if(Type==EVENT_JOURNAL_MATCH)
+            Arg=GetPatternParam(Table,Params[Next]);
+        else
+            Arg=GetSerialParam(Table,Params[Next]);
+        Next++;
+    }
+    DWORD Timeout=DEFAULT_EVENT_TIMEOUT;
+    if(Next<Count)
+        Timeout=(DWORD)Table->GetNumber(Params[Next]);
+
+    bool Happened=false;
+    if(g_injection)
+    {
+        EventBoard & Events=g_injection->get_events();
+        const char *Match=Type==EVENT_JOURNAL?Text.c_str():0;
+        LibraryYield Yield(Table,Parser);
+        Happened=Events.wait(Type,Arg,Match,Timeout,
+            Yield.CanYield()?&Yield:0);
+    }
+    Table->SetType(Result,T_Number);
+    Table->SetNumber(Result,Happened?1:0);
+}
+
+#define MAKE_WAIT_BODY(name,type,hasarg)                                                    \
+const char * ScriptFunc_##name(LibraryFunctions *Table,                                     \
+    ParserVariable *Result, ParserVariable *Params[], int ParamCount, ParserObject *Parser) \
+{                                                                                           \
+    WaitScriptEvent(type,hasarg,Table,Result,Params,ParamCount,Parser);                     \
+    return 0;                                                                               \
+}
+
+MAKE_WAIT_BODY(WaitTarget,EVENT_TARGET,false)
+MAKE_WAIT_BODY(WaitGump,EVENT_GUMP,true)
+MAKE_WAIT_BODY(WaitMenu,EVENT_MENU,false)
+MAKE_WAIT_BODY(WaitItem,EVENT_CONTAINER_ITEM,true)
+MAKE_WAIT_BODY(WaitJournal,EVENT_JOURNAL,true)
+MAKE_WAIT_BODY(WaitPattern,EVENT_JOURNAL_MATCH,true)
+
+// JournalPattern(text) returns the number of a pattern that the journal
+// looks for in every line, for JournalFind and WaitPattern. Those also take
+// the text itself, but looking the number up first saves searching the
+// pattern list each time.
+const char * ScriptFunc_JournalPattern(LibraryFunctions *Table,
+    ParserVariable *Result, ParserVariable *Params[], int ParamCount,
+    ParserObject * /*Parser*/)
+{
+    int Count=ParamCount-1;     // the Params[last] is a class var
+    int Id=0;
+    if(Count>=1)
+        Id=GetPatternParam(Table,Params[0]);
+    Table->SetType(Result,T_Number);
+    Table->SetNumber(Result,Id);
+    return 0;
+}
+
+// JournalFind(pattern[,after]) returns the number of the oldest line after
+// 'after' (0 if not given) that contains the pattern, or 0 if there is
+// none. Lines are numbered from 1 and the newest few hundred are kept.
+const char * ScriptFunc_JournalFind(LibraryFunctions *Table,
+    ParserVariable *Result, ParserVariable *Params[], int ParamCount,
+    ParserObject * /*Parser*/)
+{
+    int Count=ParamCount-1;     // the Params[last] is a class var
+    uint32 Seq=0;
+    if(g_injection && Count>=1)
+    {
+        int Id=GetPatternParam(Table,Params[0]);
+        uint32 After=Count>=2?GetSerialParam(Table,Params[1]):0;
+        Seq=g_injection->get_journal().find(Id,After);
+    }
+    Table->SetType(Result,T_Number);
+    Table->SetNumber(Result,Seq);
+    return 0;
+}
+
+// JournalText(line) returns the text of a line, or "" if it is no longer
+// kept.
+const char * ScriptFunc_JournalText(LibraryFunctions *Table,
+    ParserVariable *Result, ParserVariable *Params[], int ParamCount,
+    ParserObject * /*Parser*/)
+{
+    int Count=ParamCount-1;     // the Params[last] is a class var
+    JournalLine Line;
+    if(!g_injection || Count<1 ||
+        !g_injection->get_journal().get_line(GetSerialParam(Table,Params[0]),Line))
+        Line.m_text[0]='\0';
+    Table->SetType(Result,T_String);
+    Table->SetString(Result,Line.m_text);
+    return 0;
+}
+
+// JournalSeq() returns the number of the newest line, so that a script can
+// look for lines that come after it.
+const char * ScriptFunc_JournalSeq(LibraryFunctions *Table,
+    ParserVariable *Result, ParserVariable * /*Params*/[],
+    int /*ParamCount*/, ParserObject * /*Parser*/)
+{
+    Table->SetType(Result,T_Number);
+    Table->SetNumber(Result,g_injection?g_injection->get_journal().get_seq():0);
+    return 0;
+}
+
+// The change each world feed subscriber read last, for WorldFeedGet.
+static WorldChange FeedCurrent[MAX_FEED_SUBSCRIBERS];
+
+// WorldFeedOpen([capacity]) starts a feed of changes to the world and
+// returns its number, or 0 if too many are open. The feed first reports
+// every object already known as added.
+const char * ScriptFunc_WorldFeedOpen(LibraryFunctions *Table,
+    ParserVariable *Result, ParserVariable *Params[], int ParamCount,
+    ParserObject * /*Parser*/)
+{
+    int Count=ParamCount-1;     // the Params[last] is a class var
+    int Capacity=Count>=1?(int)Table->GetNumber(Params[0]):0;
+    int Id=0;
+    if(g_injection)
+    {
+        // ScriptEnded closes it if the script does not
+        void *Owner=g_injection->get_events().get_current_script();
+        Id=g_injection->get_world_feed().subscribe(
+            Capacity>0?Capacity:DEFAULT_FEED_CAPACITY,Owner);
+    }
+    if(Id!=0)
+        memset(&FeedCurrent[Id-1],0,sizeof(WorldChange));
+    Table->SetType(Result,T_Number);
+    Table->SetNumber(Result,Id);
+    return 0;
+}
+
+// WorldFeedClose(feed) stops a feed.
+const char * ScriptFunc_WorldFeedClose(LibraryFunctions *Table,
+    ParserVariable *Result, ParserVariable *Params[], int ParamCount,
+    ParserObject * /*Parser*/)
+{
+    int Count=ParamCount-1;     // the Params[last] is a class var
+    if(Count>=1)
+        CloseWorldFeed((int)Table->GetNumber(Params[0]));
+    Table->SetType(Result,T_Number);
+    Table->SetNumber(Result,0);
+    return 0;
+}
+
+// WorldFeedNext(feed) reads the next change, for WorldFeedGet, and returns
+// 1, or 0 if there are none yet.
+const char * ScriptFunc_WorldFeedNext(LibraryFunctions *Table,
+    ParserVariable *Result, ParserVariable *Params[], int ParamCount,
+    ParserObject * /*Parser*/)
+{
+    int Count=ParamCount-1;     // the Params[last] is a class var
+    int Read=0;
+    if(Count>=1)
+    {
+        int Id=(int)Table->GetNumber(Params[0]);
+        if(Id>=1 && Id<=MAX_FEED_SUBSCRIBERS)
+            Read=ReadWorldFeed(Id,&FeedCurrent[Id-1],1)==1;
+    }
+    Table->SetType(Result,T_Number);
+    Table->SetNumber(Result,Read);
+    return 0;
+}
+
+// WorldFeedGet(feed,field) returns a field of the change WorldFeedNext read
+// last: "serial", "what" (the CHANGE_ flags), "container", "graphic",
+// "colour", "quantity", "x", "y", "z" or "layer".
+const char * ScriptFunc_WorldFeedGet(LibraryFunctions *Table,
+    ParserVariable *Result, ParserVariable *Params[], int ParamCount,
+    ParserObject * /*Parser*/)
+{
+    int Count=ParamCount-1;     // the Params[last] is a class var
+    double Value=0;
+    int Id=Count>=1?(int)Table->GetNumber(Params[0]):0;
+    if(Count>=2 && Id>=1 && Id<=MAX_FEED_SUBSCRIBERS)
+    {
+        const WorldChange &Change=FeedCurrent[Id-1];
+        const char *Field=Table->GetString(Params[1]);
+        if(stricmp(Field,"serial")==0)
+            Value=Change.m_serial;
+        else if(stricmp(Field,"what")==0)
+            Value=Change.m_what;
+        else if(stricmp(Field,"container")==0)
+            Value=Change.m_container;
+        else if(stricmp(Field,"graphic")==0)
+            Value=Change.m_graphic;
+        else if(stricmp(Field,"colour")==0 || stricmp(Field,"color")==0)
+            Value=Change.m_colour;
+        else if(stricmp(Field,"quantity")==0)
+            Value=Change.m_quantity;
+        else if(stricmp(Field,"x")==0)
+            Value=Change.m_x;
+        else if(stricmp(Field,"y")==0)
+            Value=Change.m_y;
+        else if(stricmp(Field,"z")==0)
+            Value=Change.m_z;
+        else if(stricmp(Field,"layer")==0)
+            Value=Change.m_layer;
+    }
+    Table->SetType(Result,T_Number);
+    Table->SetNumber(Result,Value);
+    return 0;
+}
 
 // Stringification antics
 #define STRINGIFY(x) STRINGIFY2(x)
@@ -183,7 +519,8 @@ const char * ScriptFunc_CountOnGround(LibraryFunctions *Table,
 const char * ScriptFunc_##cmd(LibraryFunctions *Table,                                      \
     ParserVariable *Result, ParserVariable *Params[], int ParamCount, ParserObject *Parser) \
 {                                                                                           \
-    DoCommand((string(STRINGIFY(cmd)) + " " + ConvertParamsToStr(Table,Result,Params,ParamCount,Parser)).c_str());                  \
+    static int Command=-1;                                                                  \
+    RunScriptCommand(STRINGIFY(cmd),Command,Table,Params,ParamCount);                       \
     return 0;                                                                               \
 }
 #define DEFINE_COMMAND(cmd) {STRINGIFY(cmd),ScriptFunc_##cmd,-1},
@@ -253,6 +590,21 @@ CFuncTable FuncTable[]=
 {
 	{"CountGround",ScriptFunc_CountOnGround,-1},
 	{"CountOnGround",ScriptFunc_CountOnGround,-1},
+	{"Sync",ScriptFunc_Sync,-1},
+	{"WaitTarget",ScriptFunc_WaitTarget,-1},
+	{"WaitGump",ScriptFunc_WaitGump,-1},
+	{"WaitMenu",ScriptFunc_WaitMenu,-1},
+	{"WaitItem",ScriptFunc_WaitItem,-1},
+	{"WaitJournal",ScriptFunc_WaitJournal,-1},
+	{"WaitPattern",ScriptFunc_WaitPattern,-1},
+	{"JournalPattern",ScriptFunc_JournalPattern,-1},
+	{"JournalFind",ScriptFunc_JournalFind,-1},
+	{"JournalText",ScriptFunc_JournalText,-1},
+	{"JournalSeq",ScriptFunc_JournalSeq,-1},
+	{"WorldFeedOpen",ScriptFunc_WorldFeedOpen,-1},
+	{"WorldFeedClose",ScriptFunc_WorldFeedClose,-1},
+	{"WorldFeedNext",ScriptFunc_WorldFeedNext,-1},
+	{"WorldFeedGet",ScriptFunc_WorldFeedGet,-1},
 
 // This are the normal commands:
 DEFINE_COMMAND(fixwalk)
@@ -332,7 +684,10 @@ DllInterface Intrf={
     &g_BM, &g_BP, &g_GA, &g_GS, &g_MR, &g_NS, &g_SA, &g_SS, 
     &g_VA, &g_EN, &g_WH, &g_FD, &g_BR,
     &g_H, &g_C, &g_M, &g_L, &g_B,
-    &g_AR, &g_BT 
+    &g_AR, &g_BT,
+    RunCommand,
+    OpenWorldFeed, ReadWorldFeed, CloseWorldFeed,
+    ScriptEnded
 };
 
 void InitExternalDll(HWND Tab)
@@ -351,11 +706,20 @@ void InitExternalDll(HWND Tab)
         F(&Intrf);
     else
         error_printf("Error %d loading %s",GetLastError(),Buff);
+    // The script DLL runs many scripts on each thread, so their event marks
+    // can't be kept per thread, and a waiting script is woken by itself.
+    if(g_injection)
+        g_injection->get_events().set_script_source(
+            (mark_source_t)GetProcAddress(DLL,"_ScriptEventMark"),
+            (script_source_t)GetProcAddress(DLL,"_ScriptCurrent"),
+            (script_waker_t)GetProcAddress(DLL,"_ScriptWake"));
 }
 
 void UnloadExternalDll()
 {
     HINSTANCE DLL=GetModuleHandle("script.dll");
+    if(g_injection)
+        g_injection->get_events().set_script_source(0,0,0);
     typedef void __cdecl Func();
     Func *F=(Func*)GetProcAddress(DLL,"_Cleanup");
     if(F)
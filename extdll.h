@@ -45,6 +45,12 @@ typedef void __cdecl CharFunc(const char*);
 typedef int __cdecl CharFuncInt(const char*);
 typedef int __cdecl Char2FuncInt(const char*,const char*);
 typedef void __cdecl AddClassesFun(ParserObject* , const struct LibraryFunctions *);
+typedef int __cdecl ArgvFuncInt(const char*,int,const char* const*);
+struct WorldChange;     // see worldfeed.h
+typedef int __cdecl IntFuncInt(int);
+typedef int __cdecl FeedReadFunc(int,WorldChange*,int);
+typedef void __cdecl IntFunc(int);
+typedef void __cdecl PtrFunc(void*);
 
 struct DllInterface // This struct should be equal in both DLLs
 {
@@ -69,6 +75,23 @@ struct DllInterface // This struct should be equal in both DLLs
         *H, *C, *M, *L, *B,
         *AR, *BT;
 #endif
+
+    // Runs a built-in command with its arguments already split, so that
+    // they are not quoted and parsed again. Returns 0 if there is no such
+    // command.
+    ArgvFuncInt *RunCommand;
+
+    // The world change feed. OpenWorldFeed(capacity) returns a subscriber
+    // number, or 0 if there are too many. ReadWorldFeed returns the number
+    // of changes copied, or -1 if the subscriber is not open. Each
+    // subscriber must only be read by one thread.
+    IntFuncInt *OpenWorldFeed;
+    FeedReadFunc *ReadWorldFeed;
+    IntFunc *CloseWorldFeed;
+
+    // Called as each script is freed, with what ScriptCurrent returned
+    // for it, so that feeds it left open are closed.
+    PtrFunc *ScriptEnded;
 };
 
 #endif
@@ -36,6 +36,11 @@
 
 #include "common.h"
 #include "hooks.h"
+#include "stats.h"
+#ifdef USE_BENCHMARKS
+#include <vector>
+#include "client.h"
+#endif
 
 bool g_FixUnicodeCaption=false;
 
@@ -136,42 +141,48 @@ void BufferQueue::push_move(char * buf, int size)
 
 ////////////////////////////////////////////////////////////////////////////////
 
-class MessageFragment
+MessageFragment::MessageFragment()
+: m_buf_size(FRAGMENT_BUF_SIZE), m_size(0), m_msg_size(0), m_active(false),
+  m_allocations(1)
 {
-private:
-    uint8 * m_buf;
-    int m_size, m_msg_size;
+    m_buf = new uint8[m_buf_size];
+}
 
-public:
-    // The constructor allocates memory for a copy of the given buffer.
-    // msg_size should be zero if the fragment is not large enough to
-    // determine the actual message size.
-    MessageFragment(uint8 * buf, int size, int msg_size);
-    ~MessageFragment()
-    {
-        delete /*[]*/ m_buf;
-    }
-
-    // Extracts data from the beginning of the given buffer on the fragment
-    // buffer. Returns the number of bytes extracted.
-    int append(uint8 * buf, int size);
-    bool is_complete() const
-    { return m_size == m_msg_size && m_msg_size != 0; }
-    uint8 * get_buf() { return m_buf; }
-    int get_size() { return m_size; }
-};
+MessageFragment::~MessageFragment()
+{
+    delete [] m_buf;
+}
 
-MessageFragment::MessageFragment(uint8 * buf, int size, int msg_size)
-: m_size(size), m_msg_size(msg_size)
+// private
+void MessageFragment::reserve(int size)
 {
-    if(m_msg_size == 0)
-        m_buf = new uint8[3];
-    else
-        m_buf = new uint8[msg_size];
-    memcpy(m_buf, buf, m_size);
+    if(size <= m_buf_size)
+        return;
+    // Grow geometrically so that a run of large messages only reallocates
+    // a few times.
+    int new_size = m_buf_size;
+    while(new_size < size)
+        new_size *= 2;
+    uint8 * newbuf = new uint8[new_size];
+    memcpy(newbuf, m_buf, m_size);
+    delete [] m_buf;
+    m_buf = newbuf;
+    m_buf_size = new_size;
+    m_allocations++;
 }
 
-int MessageFragment::append(uint8 * buf, int size)
+void MessageFragment::start(const uint8 * buf, int size, int msg_size)
+{
+    ASSERT(!m_active);
+    m_size = 0;
+    m_msg_size = msg_size;
+    m_active = true;
+    reserve(msg_size != 0 ? msg_size : size);
+    memcpy(m_buf, buf, size);
+    m_size = size;
+}
+
+int MessageFragment::append(const uint8 * buf, int size)
 {
     if(m_msg_size == 0) // Size is not yet known
     {
@@ -187,13 +198,15 @@ int MessageFragment::append(uint8 * buf, int size)
             m_msg_size = (m_buf[1] << 8) | buf[0];
         else // m_size == 1
             m_msg_size = (buf[0] << 8) | buf[1];
+        if(m_msg_size < 3)
+        {
+            error_printf("Invalid length %d for message 0x%02X\n",
+                m_msg_size, m_buf[0]);
+            m_msg_size = 3;
+        }
         // Now that the size is known, make the buffer big enough for the
         // whole message.
-        uint8 * newbuf = new uint8[m_msg_size];
-        // Move the existing data into the new buffer.
-        memcpy(newbuf, m_buf, m_size);
-        delete /*[]*/ m_buf;
-        m_buf = newbuf;
+        reserve(m_msg_size);
     }
     int append_size = m_msg_size - m_size;
     if(append_size > size)
@@ -207,14 +220,12 @@ int MessageFragment::append(uint8 * buf, int size)
 ////////////////////////////////////////////////////////////////////////////////
 
 SocketHook::SocketHook(HookCallbackInterface & callback, SOCKET s)
-: m_callback(callback), m_s(s), m_disconnected(false), m_recv_error(false),
-  m_compressed(false), m_first_send(true),
-  m_send_fragment(0), m_receive_fragment(0), m_game_crypt(0)
-{
-    // With a fairly large decompression buffer it is unlikely to require
-    // reallocation.
-    m_dec_buf_size = sizeof(m_recv_buf) * 2;
-    m_dec_buf = new char[m_dec_buf_size];
+: m_callback(callback), m_lengths(callback.get_packet_lengths()), m_s(s),
+  m_disconnected(false), m_recv_error(false),
+  m_compressed(false), m_first_send(true), m_msg_len(0), m_msg_size(0),
+  m_unknown_size(false), m_message_cycles(0),
+  m_game_crypt(0)
+{
     m_send_buf_size = sizeof(m_recv_buf);
     m_send_buf = new uint8[m_send_buf_size];
 }
@@ -222,28 +233,12 @@ SocketHook::SocketHook(HookCallbackInterface & callback, SOCKET s)
 SocketHook::~SocketHook()
 {
     m_callback.disconnected(this);
-    if(m_send_fragment)
-        delete /*[]*/ m_send_fragment;
-    if(m_receive_fragment)
-        delete /*[]*/ m_receive_fragment;
 
-    delete /*[]*/ m_dec_buf;
     delete m_send_buf;
     if(m_game_crypt)
         delete m_game_crypt;
 }
 
-// private
-void SocketHook::alloc_dec_buf(int size)
-{
-    if(m_dec_buf_size < size)
-    {
-        delete /*[]*/ m_dec_buf;
-        m_dec_buf = new char[size];
-        m_dec_buf_size = size;
-    }
-}
-
 // private
 void SocketHook::alloc_send_buf(int size)
 {
@@ -273,33 +268,35 @@ void SocketHook::recv_ready()
     else    // got some data
     {
         trace_printf(">> recv() got %d bytes\n", n);
-        if(m_compressed)
+        received(m_recv_buf, n);
+    }
+}
+
+void SocketHook::received(char * buf, int size)
+{
+    if(m_compressed)
+    {
+        //trace_printf("Compressed:\n");
+        //trace_dump(reinterpret_cast<uint8 *>(buf), size);
+        uint8 * data = reinterpret_cast<uint8 *>(buf);
+        uint64 start = read_tsc();
+        if(m_game_crypt)
         {
-            //trace_printf("Compressed:\n");
-            //trace_dump(reinterpret_cast<uint8 *>(m_recv_buf), n);
-            // NOTE: the shortest bit string in the Huffman tree is 2 bits,
-            // so decompression will output a maximum of 4 times the size
-            // of the input.
-            alloc_dec_buf(n * 4 + 2);
-            int in_bytes = n, out_bytes = m_dec_buf_size;
-
-            if(m_game_crypt)
-	            m_game_crypt->decrypt((uint8*)m_recv_buf,(uint8*)m_recv_buf,in_bytes);
-
-            m_decompressor(m_dec_buf, m_recv_buf, out_bytes, in_bytes);
-            if(in_bytes != n)   // Shouldn't happen
-            {
-                error_printf("decompression buffer too small\n");
-                m_recv_error = true;
-                m_last_error = WSAECONNRESET;
-                return;
-            }
-            trace_printf(">> decompressed into %d bytes\n", out_bytes);
-            handle_receive_data(m_dec_buf, out_bytes);
+            m_game_crypt->decrypt(data, data, size);
+            uint64 now = read_tsc();
+            g_traffic_stats.add_stage(STAGE_DECRYPT, size, now - start);
+            start = now;
         }
-        else
-            handle_receive_data(m_recv_buf, n);
+        // Decompress straight into message framing; there is no
+        // intermediate buffer for the decompressed stream.
+        m_message_cycles = 0;
+        handle_compressed_data(data, size);
+        // The message handlers are counted per opcode instead.
+        g_traffic_stats.add_stage(STAGE_DECOMPRESS, size,
+            read_tsc() - start - m_message_cycles);
     }
+    else
+        handle_receive_data(buf, size);
 }
 
 bool SocketHook::is_ready() const
@@ -332,52 +329,58 @@ int SocketHook::send(char * buf, int size)
     int total_sent = 0;
 
     // Last send ended in a partial message
-    if(m_send_fragment != 0)
+    if(m_send_fragment.is_active())
     {
-        ptr += m_send_fragment->append(ptr, size);
+        ptr += m_send_fragment.append(ptr, size);
         // If still not a complete message, nothing else to do.
-        if(!m_send_fragment->is_complete())
+        if(!m_send_fragment.is_complete())
             return size;
         // Analyse and send message
-        if(m_callback.handle_send_message(this, m_send_fragment->get_buf(),
-                m_send_fragment->get_size()))
+        m_send_fragment.clear();
+        if(m_callback.handle_send_message(this, m_send_fragment.get_buf(),
+                m_send_fragment.get_size()))
         {
-            int ret = send_server(m_send_fragment->get_buf(),
-                m_send_fragment->get_size());
+            int ret = send_server(m_send_fragment.get_buf(),
+                m_send_fragment.get_size());
             if(ret == SOCKET_ERROR)
-            {
-                delete /*[]*/ m_send_fragment;
                 return SOCKET_ERROR;
-            }
             total_sent += ret;
         }
         else
-            total_sent += m_send_fragment->get_size();  // required
-        delete /*[]*/ m_send_fragment;
-        m_send_fragment = 0;
+            total_sent += m_send_fragment.get_size();  // required
     }
 
     while(ptr < end)
     {
-        int msg_size = m_callback.get_message_size(*ptr);
+        int msg_size = m_lengths.get(*ptr);
         // Determine message boundaries.
-        if(msg_size == -1)
+        if(msg_size == PACKET_UNKNOWN)
         {
-            error_printf("Length unknown for message 0x%02X\n", *ptr);
-            msg_size = 1;
+            // Find the next message if the length can be guessed; otherwise
+            // pass the rest on as it is rather than one byte at a time.
+            m_lengths.report_unknown(*ptr);
+            msg_size = m_lengths.guess_size(ptr, end - ptr);
         }
         else
         {
             // The message code might be the last byte of the buffer
-            if(msg_size == 0 && ptr + 3 <= end)
+            if(msg_size == PACKET_VARIABLE && ptr + 3 <= end)
+            {
                 msg_size = (ptr[1] << 8) | ptr[2];
+                if(msg_size < 3)
+                {
+                    error_printf("Invalid length %d for message 0x%02X\n",
+                        msg_size, *ptr);
+                    msg_size = 3;
+                }
+            }
         }
         // If data ends in an incomplete message, buffer it.
         if(msg_size == 0 || ptr + msg_size > end)
         {
             trace_printf("send: message fragment code 0x%02X: got %d of %d bytes\n",
                 *ptr, end - ptr, msg_size);
-            m_send_fragment = new MessageFragment(ptr, end - ptr, msg_size);
+            m_send_fragment.start(ptr, end - ptr, msg_size);
             ptr = end;
         }
         else
@@ -410,9 +413,12 @@ int SocketHook::recv(char *buf, int len)
     }
     if(m_compressed)
     {
+        uint64 start = read_tsc();
         int n = m_receive_queue.get(buf, len, m_compressor);
         int out_bytes = len - n;
         m_compressor.flush(buf + n, out_bytes);
+        g_traffic_stats.add_stage(STAGE_RECOMPRESS, n + out_bytes,
+            read_tsc() - start);
         //trace_printf("Recompressed:\n");
         //trace_dump(reinterpret_cast<uint8 *>(buf), n + out_bytes);
         return n + out_bytes;
@@ -431,35 +437,42 @@ void SocketHook::handle_receive_data(char * buf, int size)
     uint8 * end = ptr + size;
 
     // Last receive ended in a partial message
-    if(m_receive_fragment != 0)
+    if(m_receive_fragment.is_active())
     {
-        ptr += m_receive_fragment->append(ptr, size);
+        ptr += m_receive_fragment.append(ptr, size);
         // If still not a complete message, nothing else to do.
-        if(!m_receive_fragment->is_complete())
+        if(!m_receive_fragment.is_complete())
             return;
-        // Analyse and queue message
-        if(m_callback.handle_receive_message(this,
-                m_receive_fragment->get_buf(), m_receive_fragment->get_size()))
-            m_receive_queue.push_copy(m_receive_fragment->get_buf(),
-                m_receive_fragment->get_size());
-        delete m_receive_fragment;
-        m_receive_fragment = 0;
+        // Analyse and queue message, straight from the fragment buffer
+        m_receive_fragment.clear();
+        receive_message(m_receive_fragment.get_buf(),
+            m_receive_fragment.get_size());
     }
 
     while(ptr < end)
     {
-        int msg_size = m_callback.get_message_size(*ptr);
+        int msg_size = m_lengths.get(*ptr);
         // Determine message boundaries.
-        if(msg_size == -1)
+        if(msg_size == PACKET_UNKNOWN)
         {
-            error_printf("Length unknown for message 0x%02X\n", *ptr);
-            msg_size = 1;
+            // Find the next message if the length can be guessed; otherwise
+            // pass the rest on as it is rather than one byte at a time.
+            m_lengths.report_unknown(*ptr);
+            msg_size = m_lengths.guess_size(ptr, end - ptr);
         }
         else
         {
             // The message code might be the last byte of the buffer
-            if(msg_size == 0 && ptr + 3 <= end)
+            if(msg_size == PACKET_VARIABLE && ptr + 3 <= end)
+            {
                 msg_size = (ptr[1] << 8) | ptr[2];
+                if(msg_size < 3)
+                {
+                    error_printf("Invalid length %d for message 0x%02X\n",
+                        msg_size, *ptr);
+                    msg_size = 3;
+                }
+            }
         }
 
         // If data ends in an incomplete message, buffer it.
@@ -467,21 +480,105 @@ void SocketHook::handle_receive_data(char * buf, int size)
         {
             trace_printf("recv: message fragment code 0x%02X: got %d of %d bytes\n",
                 *ptr, end - ptr, msg_size);
-            m_receive_fragment = new MessageFragment(ptr, end - ptr, msg_size);
+            m_receive_fragment.start(ptr, end - ptr, msg_size);
             ptr = end;
         }
         else
         {
-            if(m_callback.handle_receive_message(this, ptr, msg_size))
-                // Enqueue message.
-                m_receive_queue.push_copy(ptr, msg_size);
+            receive_message(ptr, msg_size);
             ptr += msg_size;
         }
     }   // while(ptr < end)
 }
 
+// private
+void SocketHook::receive_message(uint8 * buf, int size)
+{
+    uint64 start = read_tsc();
+    if(m_callback.handle_receive_message(this, buf, size))
+        // Enqueue message.
+        m_receive_queue.push_copy(buf, size);
+    m_message_cycles += read_tsc() - start;
+}
+
+// private
+void SocketHook::handle_compressed_data(const uint8 * src, int size)
+{
+    // m_msg_len bytes of the current message have been decompressed so far.
+    // m_msg_size is zero until the size of the message is known.
+    while(true)
+    {
+        if(m_unknown_size)
+        {
+            bool flushed;
+            m_msg_len += m_decompressor.decompress(m_msg_buf + m_msg_len,
+                MAX_MESSAGE_SIZE - m_msg_len, src, size, &flushed);
+            if(!flushed)
+            {
+                if(m_msg_len < MAX_MESSAGE_SIZE)
+                    return;     // Need more data from the server
+                error_printf("No end found for message 0x%02X\n",
+                    m_msg_buf[0]);
+            }
+            receive_message(m_msg_buf, m_msg_len);
+            m_unknown_size = false;
+            m_msg_len = m_msg_size = 0;
+            continue;
+        }
+
+        int want;
+        if(m_msg_len == 0)
+            want = 1;   // message code
+        else if(m_msg_size == 0)
+            want = 3 - m_msg_len;   // rest of the variable size header
+        else
+            want = m_msg_size - m_msg_len;
+
+        int got = m_decompressor.decompress(m_msg_buf + m_msg_len, want,
+            src, size);
+        m_msg_len += got;
+        if(got < want)  // Need more data from the server
+            return;
+
+        if(m_msg_size == 0)
+        {
+            if(m_msg_len == 1)
+            {
+                m_msg_size = m_lengths.get(m_msg_buf[0]);
+                if(m_msg_size == PACKET_UNKNOWN)
+                {
+                    // The server flushes the compressor after every
+                    // message, so this one ends at the next flush code.
+                    m_lengths.report_unknown(m_msg_buf[0]);
+                    m_unknown_size = true;
+                    continue;
+                }
+                if(m_msg_size == PACKET_VARIABLE)   // read the length
+                    continue;
+            }
+            else    // m_msg_len == 3
+            {
+                m_msg_size = (m_msg_buf[1] << 8) | m_msg_buf[2];
+                if(m_msg_size < 3)
+                {
+                    error_printf("Invalid length %d for message 0x%02X\n",
+                        m_msg_size, m_msg_buf[0]);
+                    m_msg_size = 3;
+                }
+            }
+        }
+
+        if(m_msg_len == m_msg_size)
+        {
+            receive_message(m_msg_buf, m_msg_size);
+            m_msg_len = m_msg_size = 0;
+        }
+    }
+}
+
 int SocketHook::send_server(uint8 * buf, int size)
 {
+    uint64 start = read_tsc();
     if(m_crypt_mode == CRYPT_LOGIN)
     {
         alloc_send_buf(size);
@@ -496,6 +593,8 @@ int SocketHook::send_server(uint8 * buf, int size)
         m_game_crypt->encrypt(buf, m_send_buf, size);
         buf = m_send_buf;
     }
+    if(m_crypt_mode != CRYPT_NONE)
+        g_traffic_stats.add_stage(STAGE_ENCRYPT, size, read_tsc() - start);
 
     int ret = ::send(m_s, reinterpret_cast<char *>(buf), size, 0);
     if(ret == SOCKET_ERROR)
@@ -534,6 +633,352 @@ void SocketHook::set_game_encryption(int version)
     m_game_crypt->init();
 }
 
+#ifdef USE_BENCHMARKS
+
+typedef std::vector<string> message_list_t;
+
+// Keeps the messages a SocketHook frames instead of passing them on.
+class FrameRecorder : public HookCallbackInterface
+{
+public:
+    PacketLengths m_lengths;
+    message_list_t m_messages;
+
+    virtual PacketLengths & get_packet_lengths() { return m_lengths; }
+    virtual void disconnected(SocketHook * /*hook*/) {}
+    virtual void handle_key(SocketHook * /*hook*/, uint8 /*key*/[4]) {}
+    virtual bool handle_send_message(SocketHook * /*hook*/, uint8 * buf,
+        int size)
+    {
+        m_messages.push_back(string(reinterpret_cast<char *>(buf), size));
+        return false;
+    }
+    virtual bool handle_receive_message(SocketHook * hook, uint8 * buf,
+        int size)
+    {
+        return handle_send_message(hook, buf, size);
+    }
+    virtual void idle() {}
+};
+
+// Only counts the messages, for timing.
+class MessageCounter : public HookCallbackInterface
+{
+public:
+    PacketLengths m_lengths;
+    int m_messages;
+
+    MessageCounter() : m_messages(0) {}
+    virtual PacketLengths & get_packet_lengths() { return m_lengths; }
+    virtual void disconnected(SocketHook * /*hook*/) {}
+    virtual void handle_key(SocketHook * /*hook*/, uint8 /*key*/[4]) {}
+    virtual bool handle_send_message(SocketHook * /*hook*/, uint8 * /*buf*/,
+        int /*size*/)
+    {
+        m_messages++;
+        return false;
+    }
+    virtual bool handle_receive_message(SocketHook * hook, uint8 * buf,
+        int size)
+    {
+        return handle_send_message(hook, buf, size);
+    }
+    virtual void idle() {}
+};
+
+// The codes of the made-up streams and their sizes, 0 for variable size.
+static const int CHECK_CODES[][2] =
+{
+    { 0x1a, 0 }, { 0x11, 0 }, { 0xae, 0 }, { 0x1d, 5 }, { 0x20, 19 },
+    { 0x22, 3 }, { 0x77, 17 }, { 0x07, 7 }
+};
+const int NUM_CHECK_CODES = sizeof(CHECK_CODES) / sizeof(CHECK_CODES[0]);
+// Has no size in the table, but carries its length like most new messages.
+const uint8 CHECK_UNKNOWN_CODE = 0xf3;
+
+static uint32 check_random(uint32 & seed, uint32 range)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % range;
+}
+
+static void set_check_lengths(PacketLengths & lengths)
+{
+    {for(int i = 0; i < NUM_CHECK_CODES; i++)
+        lengths.set(uint8(CHECK_CODES[i][0]), CHECK_CODES[i][1]);}
+}
+
+// Makes up 'count' messages, of at most 'max_size' bytes, and with one of
+// unknown length in the middle if 'unknown' is set.
+static void make_check_messages(int count, int max_size, bool unknown,
+    uint32 & seed, message_list_t & messages)
+{
+    {for(int i = 0; i < count; i++)
+    {
+        int code, size;
+        if(unknown && i == count / 2)
+        {
+            code = CHECK_UNKNOWN_CODE;
+            size = 0;
+        }
+        else
+        {
+            int k = check_random(seed, NUM_CHECK_CODES);
+            code = CHECK_CODES[k][0];
+            size = CHECK_CODES[k][1];
+        }
+        bool variable = size == 0;
+        if(variable)
+            size = 3 + check_random(seed, max_size - 2);
+        string msg(size, '\0');
+        msg[0] = char(code);
+        {for(int j = 1; j < size; j++)
+            msg[j] = char(check_random(seed, 256));}
+        if(variable)
+        {
+            msg[1] = char(size >> 8);
+            msg[2] = char(size & 0xff);
+        }
+        messages.push_back(msg);
+    }}
+}
+
+// Returns the number of messages framed the same as made up.
+static int count_framed(const message_list_t & made,
+    const message_list_t & framed)
+{
+    int same = 0;
+    while(same < int(made.size()) && same < int(framed.size()) &&
+            made[same] == framed[same])
+        same++;
+    return same;
+}
+
+// Whole messages at a time, as the client sends them and as an
+// uncompressed server does.
+static void feed_whole_messages(SocketHook & hook, bool send,
+    const message_list_t & messages, uint32 & seed)
+{
+    string batch;
+    message_list_t::size_type i = 0;
+    while(i < messages.size())
+    {
+        batch.erase();
+        int count = 1 + check_random(seed, 20);
+        for(; count > 0 && i < messages.size(); count--)
+            batch += messages[i++];
+        if(send)
+            hook.send(&batch[0], batch.size());
+        else
+            hook.received(&batch[0], batch.size());
+    }
+}
+
+// Compresses the messages as the server does, with a flush after each.
+static void compress_messages(const message_list_t & messages, string & wire)
+{
+    CompressingCopier compressor;
+    std::vector<char> out;
+    {for(message_list_t::size_type i = 0; i < messages.size(); i++)
+    {
+        // A byte compresses to at most 11 bits, and the flush to 4.
+        out.resize(messages[i].size() * 2 + 4);
+        int out_size = out.size(), in_size = messages[i].size();
+        compressor(&out[0], messages[i].data(), out_size, in_size);
+        wire.append(&out[0], out_size);
+        out_size = out.size();
+        compressor.flush(&out[0], out_size);
+        wire.append(&out[0], out_size);
+    }}
+}
+
+// Random pieces of 1 to 400 bytes, which end part way through most of the
+// messages. Returns the number of pieces.
+static int feed_pieces(SocketHook & hook, bool send, const string & stream,
+    uint32 & seed)
+{
+    char piece[400];
+    int pieces = 0;
+    string::size_type pos = 0;
+    while(pos < stream.size())
+    {
+        string::size_type size = 1 + check_random(seed, sizeof(piece));
+        if(size > stream.size() - pos)
+            size = stream.size() - pos;
+        memcpy(piece, stream.data() + pos, size);
+        if(send)
+            hook.send(piece, size);
+        else
+            hook.received(piece, size);
+        pos += size;
+        pieces++;
+    }
+    return pieces;
+}
+
+// static
+void SocketHook::check_framing(int messages, ClientInterface & client)
+{
+    uint32 seed = 1;
+    message_list_t made;
+    make_check_messages(messages, 300, true, seed, made);
+
+    // Compressed, and read in pieces of 1 to 400 bytes.
+    string wire;
+    compress_messages(made, wire);
+    FrameRecorder compressed;
+    set_check_lengths(compressed.m_lengths);
+    {
+        SocketHook hook(compressed, INVALID_SOCKET);
+        hook.set_compressed(true);
+        feed_pieces(hook, false, wire, seed);
+    }
+
+    FrameRecorder received;
+    set_check_lengths(received.m_lengths);
+    {
+        SocketHook hook(received, INVALID_SOCKET);
+        feed_whole_messages(hook, false, made, seed);
+    }
+
+    // The first send is the key, which goes straight to the socket.
+    FrameRecorder sent;
+    set_check_lengths(sent.m_lengths);
+    {
+        SocketHook hook(sent, INVALID_SOCKET);
+        char key[4] = { 0, 0, 0, 0 };
+        hook.send(key, sizeof(key));
+        feed_whole_messages(hook, true, made, seed);
+    }
+
+    char buf[200];
+    sprintf(buf, "%d messages framed: %d of %d compressed, %d of %d received, %d of %d sent",
+        messages,
+        count_framed(made, compressed.m_messages),
+        int(compressed.m_messages.size()),
+        count_framed(made, received.m_messages),
+        int(received.m_messages.size()),
+        count_framed(made, sent.m_messages),
+        int(sent.m_messages.size()));
+    client.client_print(buf);
+    trace_printf("framecheck: %s\n", buf);
+}
+
+// static
+void SocketHook::check_fragments(int messages, ClientInterface & client)
+{
+    // Up to 10000 bytes, so that the buffers have to grow twice.
+    uint32 seed = 1;
+    message_list_t made;
+    make_check_messages(messages, 10000, false, seed, made);
+    string stream;
+    {for(message_list_t::size_type i = 0; i < made.size(); i++)
+        stream += made[i];}
+
+    FrameRecorder received;
+    set_check_lengths(received.m_lengths);
+    int receive_pieces, receive_allocations;
+    {
+        SocketHook hook(received, INVALID_SOCKET);
+        receive_pieces = feed_pieces(hook, false, stream, seed);
+        receive_allocations = hook.m_receive_fragment.get_allocations();
+    }
+
+    // The first send is the key, which goes straight to the socket.
+    FrameRecorder sent;
+    set_check_lengths(sent.m_lengths);
+    int send_pieces, send_allocations;
+    {
+        SocketHook hook(sent, INVALID_SOCKET);
+        char key[4] = { 0, 0, 0, 0 };
+        hook.send(key, sizeof(key));
+        send_pieces = feed_pieces(hook, true, stream, seed);
+        send_allocations = hook.m_send_fragment.get_allocations();
+    }
+
+    char buf[250];
+    sprintf(buf, "%d messages: %d of %d received whole from %d pieces, %d allocations; %d of %d sent whole from %d pieces, %d allocations",
+        messages,
+        count_framed(made, received.m_messages),
+        int(received.m_messages.size()), receive_pieces, receive_allocations,
+        count_framed(made, sent.m_messages),
+        int(sent.m_messages.size()), send_pieces, send_allocations);
+    client.client_print(buf);
+    trace_printf("fragmentcheck: %s\n", buf);
+}
+
+// static
+void SocketHook::benchmark_decode(int messages, int read_size,
+    ClientInterface & client)
+{
+    const int PASSES = 20;
+    uint32 seed = 1;
+    message_list_t made;
+    make_check_messages(messages, 300, false, seed, made);
+    string wire;
+    compress_messages(made, wire);
+    uint32 bytes = 0;
+    {for(message_list_t::size_type i = 0; i < made.size(); i++)
+        bytes += made[i].size();}
+
+    // The old way: each read decompressed whole into a buffer 4 times its
+    // size, which the framing of uncompressed data then splits up.
+    MessageCounter staged;
+    set_check_lengths(staged.m_lengths);
+    uint64 staged_cycles = 0;
+    {
+        std::vector<char> dec_buf(read_size * 4 + 2);
+        {for(int pass = 0; pass < PASSES; pass++)
+        {
+            SocketHook hook(staged, INVALID_SOCKET);
+            DecompressingCopier decompressor;
+            uint64 start = read_tsc();
+            for(string::size_type pos = 0; pos < wire.size(); pos += read_size)
+            {
+                int src_size = read_size, dest_size = dec_buf.size();
+                if(string::size_type(src_size) > wire.size() - pos)
+                    src_size = wire.size() - pos;
+                decompressor(&dec_buf[0], wire.data() + pos, dest_size,
+                    src_size);
+                hook.handle_receive_data(&dec_buf[0], dest_size);
+            }
+            staged_cycles += read_tsc() - start;
+        }}
+    }
+
+    // Now: decompressed straight into the message buffer of the socket.
+    MessageCounter fused;
+    set_check_lengths(fused.m_lengths);
+    uint64 fused_cycles = 0;
+    {for(int pass = 0; pass < PASSES; pass++)
+    {
+        SocketHook hook(fused, INVALID_SOCKET);
+        const uint8 * data = reinterpret_cast<const uint8 *>(wire.data());
+        uint64 start = read_tsc();
+        for(string::size_type pos = 0; pos < wire.size(); pos += read_size)
+        {
+            int size = read_size;
+            if(string::size_type(size) > wire.size() - pos)
+                size = wire.size() - pos;
+            hook.handle_compressed_data(data + pos, size);
+        }
+        fused_cycles += read_tsc() - start;
+    }}
+
+    double staged_us = g_traffic_stats.to_us(staged_cycles) / PASSES;
+    double fused_us = g_traffic_stats.to_us(fused_cycles) / PASSES;
+    char buf[250];
+    sprintf(buf, "%d messages, %lu bytes in %d byte reads: staged %.0f us (%.1f MB/s), fused %.0f us (%.1f MB/s); %d and %d messages framed",
+        messages, bytes, read_size,
+        staged_us, staged_us > 0 ? bytes / staged_us : 0.0,
+        fused_us, fused_us > 0 ? bytes / fused_us : 0.0,
+        staged.m_messages / PASSES, fused.m_messages / PASSES);
+    client.client_print(buf);
+    trace_printf("decodebench: %s\n", buf);
+}
+
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 
 SocketHookSet * SocketHookSet::m_instance = 0;
@@ -816,6 +1261,7 @@ int SocketHookSet::select(int nfds, fd_set * readfds, fd_set * writefds,
         check_ready(0, readfds, ret);
         check_ready(1, readfds, ret);
     }
+    m_callback.idle();
     return ret;
 }
 
@@ -41,9 +41,13 @@
 #include "common.h"
 #include "uo_huffman.h"
 #include "crypt.h"
+#include "packets.h"
 #include "iconfig.h"
 
 class SocketHook;
+#ifdef USE_BENCHMARKS
+class ClientInterface;
+#endif
 
 // Abstract class
 class HookCallbackInterface
@@ -51,9 +55,8 @@ class HookCallbackInterface
 public:
     HookCallbackInterface() {}
     virtual ~HookCallbackInterface() {}
-    // Should return 0 for a variable sized message, or -1 if the message
-    // code is invalid.
-    virtual int get_message_size(int code) = 0;
+    // The table used to find message boundaries.
+    virtual PacketLengths & get_packet_lengths() = 0;
     virtual void disconnected(SocketHook * hook) = 0;
     // This method may only modify the key.
     virtual void handle_key(SocketHook * hook, uint8 key[4]) = 0;
@@ -65,11 +68,16 @@ public:
     // client.
     virtual bool handle_receive_message(SocketHook * hook, uint8 * buf,
         int size) = 0;
+    // Called on the client thread after every select(), which is a safe
+    // point to run work queued by other threads.
+    virtual void idle() = 0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
 const int RECV_BUF_SIZE = 65536;
+// The length field of a message is 16 bits.
+const int MAX_MESSAGE_SIZE = 65536;
 
 class Buffer
 {
@@ -118,12 +126,56 @@ public:
         { push_move(reinterpret_cast<char *>(buf), size); }
 };
 
-class MessageFragment;
+// The initial size of a MessageFragment buffer, which is enough for most
+// messages that span two reads.
+const int FRAGMENT_BUF_SIZE = 4096;
+
+// Collects a message that arrives in more than one piece. The buffer is
+// kept for the life of the socket and only grows, so reassembly does not
+// usually allocate memory.
+class MessageFragment
+{
+private:
+    uint8 * m_buf;
+    int m_buf_size;
+    int m_size, m_msg_size;
+    bool m_active;
+    int m_allocations;
+
+    void reserve(int size);
+
+    // The copy constructor and assignment operator are never defined.
+    MessageFragment(const MessageFragment & other);
+    void operator = (const MessageFragment & other);
+
+public:
+    MessageFragment();
+    ~MessageFragment();
+
+    // Starts a new message with a copy of the given data. msg_size should
+    // be zero if the data is not large enough to determine the actual
+    // message size.
+    void start(const uint8 * buf, int size, int msg_size);
+    // Extracts data from the beginning of the given buffer on the fragment
+    // buffer. Returns the number of bytes extracted.
+    int append(const uint8 * buf, int size);
+    // Forgets the message, keeping the buffer.
+    void clear() { m_active = false; }
+
+    bool is_active() const { return m_active; }
+    bool is_complete() const
+    { return m_size == m_msg_size && m_msg_size != 0; }
+    uint8 * get_buf() { return m_buf; }
+    int get_size() const { return m_size; }
+    // How many times the buffer has been allocated, the first time included.
+    int get_allocations() const { return m_allocations; }
+};
 
 class SocketHook
 {
 private:
     HookCallbackInterface & m_callback;
+    PacketLengths & m_lengths;
     SOCKET m_s;
     BufferQueue m_receive_queue;
     bool m_disconnected, m_recv_error;
@@ -131,11 +183,17 @@ private:
 
     char m_recv_buf[RECV_BUF_SIZE];
     bool m_compressed, m_first_send;
-    char * m_dec_buf;   // buffer for decompressed data
-    int m_dec_buf_size;
+    // The message currently being decompressed from the server.
+    uint8 m_msg_buf[MAX_MESSAGE_SIZE];
+    int m_msg_len, m_msg_size;
+    // Set while decompressing a message whose code has no known length.
+    bool m_unknown_size;
+    // Time spent handling received messages, which is not counted as
+    // decompression:
+    uint64 m_message_cycles;
     uint8 * m_send_buf;
     int m_send_buf_size;
-    MessageFragment * m_send_fragment, * m_receive_fragment;
+    MessageFragment m_send_fragment, m_receive_fragment;
     NormalCopier m_copier;
     CompressingCopier m_compressor;
     DecompressingCopier m_decompressor;
@@ -145,9 +203,10 @@ private:
     LoginCrypt m_login_crypt;
     GameCrypt *m_game_crypt;
 
-    void alloc_dec_buf(int size);
     void alloc_send_buf(int size);
     void handle_receive_data(char * buf, int size);
+    void handle_compressed_data(const uint8 * src, int size);
+    void receive_message(uint8 * buf, int size);
 
 public:
     SocketHook(HookCallbackInterface & callback, SOCKET s);
@@ -155,6 +214,9 @@ public:
 
     // Called when data is available to be received from the server.
     void recv_ready();
+    // Handles data as it was read from the server. recv_ready() calls this,
+    // and the self-test commands feed it recorded data.
+    void received(char * buf, int size);
     // Returns true if data is waiting to be sent to the client.
     bool is_ready() const;
     int close();
@@ -169,6 +231,22 @@ public:
 
     void set_login_encryption(uint32 k1, uint32 k2);
     void set_game_encryption(int version);
+
+#ifdef USE_BENCHMARKS
+    // Feeds made-up streams of 'messages' messages, one of them of unknown
+    // length, through the framing of each direction in random pieces, and
+    // reports whether every message came out whole.
+    static void check_framing(int messages, ClientInterface & client);
+    // Feeds 'messages' made-up messages in each direction, split at random
+    // points, and reports whether they were put back together and how
+    // often the fragment buffers were allocated.
+    static void check_fragments(int messages, ClientInterface & client);
+    // Times decompressing and framing a made-up stream of 'messages'
+    // messages, read 'read_size' bytes at a time, the old way, through a
+    // buffer, and the way recv_ready() does it now.
+    static void benchmark_decode(int messages, int read_size,
+        ClientInterface & client);
+#endif
 };
 
 class SocketHookSet
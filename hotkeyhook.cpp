@@ -47,6 +47,7 @@ HotkeyHook::HotkeyHook(ClientInterface & client, Hotkeys & hotkeys)
 {
     m_instance = this;
     m_hHook = 0;
+    bind_commands();
 }
 
 HotkeyHook::~HotkeyHook()
@@ -62,10 +63,24 @@ void HotkeyHook::remove_hook()
 {
 }
 
+// private
+void HotkeyHook::bind_commands()
+{
+    m_bound.clear();
+    Hotkeys::hotkey_map_t & list = m_hotkeys.get_hotkey_list();
+    for(Hotkeys::hotkey_map_t::const_iterator i = list.begin(); i != list.end(); i++)
+        m_client.bind_command((*i).second.c_str(), m_bound[(*i).first]);
+    m_bound_version = m_hotkeys.get_version();
+}
+
+// private
 void HotkeyHook::do_command(uint16 hash)
 {
-    if(m_hotkeys.exists(hash))
-        m_client.do_command(m_hotkeys.get_command(hash).c_str());
+    if(m_hotkeys.get_version() != m_bound_version)
+        bind_commands();
+    bound_map_t::const_iterator i = m_bound.find(hash);
+    if(i != m_bound.end())
+        m_client.run_command((*i).second);
 }
 
 BOOL HotkeyHook::KeyboardHook(WPARAM wParam, LPARAM lParam)
@@ -35,19 +35,28 @@
 #include <windows.h>
 
 
-class ClientInterface;
+#include "common.h"
+#include "hashstr.h"
+#include "client.h"
+
 class Hotkeys;
 
 class HotkeyHook
 {
 
 private:
+    typedef std::hash_map<uint16, BoundCommand> bound_map_t;
+
     ClientInterface & m_client;
     Hotkeys & m_hotkeys;
     HHOOK m_hHook;
+    // The hotkey commands, parsed when the hotkeys were last changed:
+    bound_map_t m_bound;
+    uint32 m_bound_version;
 
     static HotkeyHook * m_instance;
 
+    void bind_commands();
     void do_command(uint16 hash);
 public:
     static BOOL KeyboardHook(WPARAM wParam, LPARAM lParam);
@@ -31,6 +31,7 @@
 #include "common.h"
 #include "hashstr.h"
 #include "hotkeys.h"
+#include "snapshot.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 //
@@ -39,6 +40,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 Hotkeys::Hotkeys()
+: m_version(0)
 {
 //  m_hotkeys[0x006d] = string("bandageself");
 }
@@ -51,23 +53,50 @@ void Hotkeys::add(uint16 key_hash, const string & command)
 {
     ASSERT(!exists(key_hash));
     m_hotkeys.insert(hotkey_map_t::value_type(key_hash, command));
+    m_version++;
 }
 
 void Hotkeys::remove(uint16 key_hash)
 {
     m_hotkeys.erase(key_hash);
+    m_version++;
 }
 
-void Hotkeys::write_config(FILE * fp) const
+void Hotkeys::write_config(string & out) const
 {
     for(hotkey_map_t::const_iterator i = m_hotkeys.begin(); i != m_hotkeys.end(); i++)
     {
-        fprintf(fp,"\t\t\t\t<hotkey key_hash=\"0x%04x\" command=\"%s\"/>\n",
+        config_printf(out, "\t\t\t\t<hotkey key_hash=\"0x%04x\" command=\"%s\"/>\n",
             (*i).first,
             ConfigManager::escape_attribute((*i).second).c_str());
     }
 }
 
+void Hotkeys::write_snapshot(SnapshotWriter & writer) const
+{
+    writer.put_uint32(m_hotkeys.size());
+    for(hotkey_map_t::const_iterator i = m_hotkeys.begin(); i != m_hotkeys.end(); i++)
+    {
+        writer.put_uint32((*i).first);
+        writer.put_string((*i).second);
+    }
+}
+
+bool Hotkeys::read_snapshot(SnapshotReader & reader)
+{
+    uint32 count = reader.get_count();
+    for(uint32 i = 0; i < count; i++)
+    {
+        uint16 key_hash = reader.get_uint32();
+        string command(reader.get_string());
+        if(reader.failed())
+            return false;
+        if(!exists(key_hash))
+            add(key_hash, command);
+    }
+    return !reader.failed();
+}
+
 // private
 bool Hotkeys::exists(const uint16 hash)
 {
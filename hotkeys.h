@@ -292,6 +292,9 @@ const string KEY_TEXT[] = {     "0x00",         //0x00
                                 "0xff"          //0xff
                             };
 
+class SnapshotWriter;
+class SnapshotReader;
+
 class Hotkeys
 {
 public:
@@ -299,6 +302,8 @@ public:
 
 private:
     hotkey_map_t m_hotkeys;
+    // Changes whenever a hotkey is added or removed:
+    uint32 m_version;
 
     static inline uint8 get_key(uint16 key_hash) {return ((uint8)(key_hash & 0x00ff)); }
     static inline bool is_mod_ctrl(uint16 key_hash){ return 0!=(key_hash & 0x0100);}
@@ -313,7 +318,11 @@ public:
     void remove(uint16 key_hash);
     const string get_command(uint16 key_hash);
     bool exists(uint16 key_hash);
-    void write_config(FILE * fp) const;
+    uint32 get_version() const { return m_version; }
+    // Appends the XML elements for the hotkeys to 'out'.
+    void write_config(string & out) const;
+    void write_snapshot(SnapshotWriter & writer) const;
+    bool read_snapshot(SnapshotReader & reader);
     static inline uint16 get_key_hash(uint8 key, bool extended, bool ctrl, bool alt, bool shift)
     {
         uint16 hash = key;
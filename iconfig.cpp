@@ -22,13 +22,21 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <errno.h>
+#include <time.h>
+
+#include <utility>
+#include <vector>
 
 #include <expat.h>
 
+#include <windows.h>
+
 #include "common.h"
 #include "iconfig.h"
 #include "hotkeys.h"
+#include "snapshot.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -38,6 +46,33 @@
 
 const int BUFFER_SIZE = 4096;
 
+void config_printf(string & out, const char * format, ...)
+{
+    char buf[256];
+    va_list arg;
+    va_start(arg, format);
+    int len = _vsnprintf(buf, sizeof(buf), format, arg);
+    va_end(arg);
+    if(len >= 0 && len < int(sizeof(buf)))
+    {
+        out.append(buf, len);
+        return;
+    }
+    // Only long attribute values get here.
+    for(int size = 4 * sizeof(buf); ; size *= 2)
+    {
+        std::vector<char> big(size);
+        va_start(arg, format);
+        len = _vsnprintf(&big[0], size, format, arg);
+        va_end(arg);
+        if(len >= 0 && len < size)
+        {
+            out.append(&big[0], len);
+            return;
+        }
+    }
+}
+
 class ExpatParser
 {
 private:
@@ -406,6 +441,14 @@ void ConfigParser::begin_config(const XML_Char ** attrs)
             else
                 g_FixUnicodeCaption = b;
         }
+        else if(strcmp(key, "autosave") == 0)
+        {
+            int n;
+            if(!string_to_int(value, n) || n < 0)
+                warning_printf("Invalid autosave delay: %s\n", value);
+            else
+                m_config.set_autosave(n);
+        }
         else
             warning_printf("config attribute ignored: %s\n", key);
         attrs += 2;
@@ -416,7 +459,8 @@ void ConfigParser::begin_config(const XML_Char ** attrs)
 void ConfigParser::begin_server(const XML_Char ** attrs)
 {
     const XML_Char * server_name = 0, * fixwalk = 0, * fixtalk = 0,
-            * buy = 0, * sell = 0, * filter_weather = 0;
+            * buy = 0, * sell = 0, * filter_weather = 0, * move_delay = 0,
+            * live_stats = 0;
 
     while(*attrs != NULL)
     {
@@ -435,6 +479,10 @@ void ConfigParser::begin_server(const XML_Char ** attrs)
             sell = value;
         else if(strcmp(key, "filter_weather") == 0)
             filter_weather = value;
+        else if(strcmp(key, "move_delay") == 0)
+            move_delay = value;
+        else if(strcmp(key, "live_stats") == 0)
+            live_stats = value;
         else
             warning_printf("server attribute ignored: %s\n", key);
         attrs += 2;
@@ -445,6 +493,7 @@ void ConfigParser::begin_server(const XML_Char ** attrs)
     else
     {
         bool b;
+        int n;
 
         m_server = m_config.get(server_name);
         if(fixwalk != 0 && string_to_bool(fixwalk, b))
@@ -457,6 +506,10 @@ void ConfigParser::begin_server(const XML_Char ** attrs)
             m_server->set_sell_text(sell);
         if(filter_weather != 0 && string_to_bool(filter_weather, b))
             m_server->set_filter_weather(b);
+        if(move_delay != 0 && string_to_int(move_delay, n) && n >= 0)
+            m_server->set_move_delay(n);
+        if(live_stats != 0 && string_to_bool(live_stats, b))
+            m_server->set_live_stats(b);
     }
 }
 
@@ -550,11 +603,11 @@ void ConfigParser::begin_use(const XML_Char ** attrs)
         error_printf("config file: invalid use 'graphic' attribute\n");
     else
     {
+        // Replaces the default, without giving out a reference that would
+        // make the use list be rendered on every save.
         string name2(name);
-        if(m_config.use_exists(name2))
-            m_config.find_use(name2) = graphic;
-        else
-            m_config.add_use(name2, graphic);
+        m_config.delete_use(name2);
+        m_config.add_use(name2, graphic);
     }
 }
 
@@ -714,7 +767,7 @@ void ConfigParser::begin_character(const XML_Char ** attrs)
     {
         int n;
         bool bb;
-        m_character = m_account->get(serial);
+        m_character = m_account->load(serial);
         if(light != 0 && string_to_int(light, n))   m_character->set_light(n);
         if(bm != 0 && string_to_bool(bm, bb)) m_character->set_m_bm_display(bb);
         if(bp != 0 && string_to_bool(bp, bb)) m_character->set_m_bp_display(bb);
@@ -950,7 +1003,8 @@ CharacterConfig::CharacterConfig(uint32 serial)
   m_stamina_display(true),
   m_armor_display(true),
   m_weight_display(true),
-  m_gold_display(true)
+  m_gold_display(true),
+  m_in_use(false)
 {
 }
 
@@ -958,65 +1012,164 @@ CharacterConfig::~CharacterConfig()
 {
 }
 
-void CharacterConfig::save(FILE * fp) const
-{
-    fprintf(fp, "\t\t\t<character serial=\"%08lX\"\n", m_serial);
-    fprintf(fp, "\t\t\t\t\tlight=\"%d\"\n", m_light);
-    fprintf(fp, "\t\t\t\t\tdisplay_bm_count=\"%s\"\n", m_bm_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_bp_count=\"%s\"\n", m_bp_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_ga_count=\"%s\"\n", m_ga_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_gs_count=\"%s\"\n", m_gs_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_mr_count=\"%s\"\n", m_mr_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_ns_count=\"%s\"\n", m_ns_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_sa_count=\"%s\"\n", m_sa_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_ss_count=\"%s\"\n", m_ss_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_va_count=\"%s\"\n", m_va_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_en_count=\"%s\"\n", m_en_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_wh_count=\"%s\"\n", m_wh_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_fd_count=\"%s\"\n", m_fd_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_br_count=\"%s\"\n", m_br_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_h_count=\"%s\"\n",  m_h_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_c_count=\"%s\"\n",  m_c_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_m_count=\"%s\"\n",  m_m_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_l_count=\"%s\"\n",  m_l_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_b_count=\"%s\"\n",  m_b_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_ar_count=\"%s\"\n", m_ar_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_bt_count=\"%s\"\n", m_bt_display ? "true" : "false");
-
-    fprintf(fp, "\t\t\t\t\tdisplay_hitpoints=\"%s\"\n", m_hp_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_mana=\"%s\"\n", m_mana_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_stamina=\"%s\"\n", m_stamina_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_armor=\"%s\"\n", m_armor_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_weight=\"%s\"\n", m_weight_display ? "true" : "false");
-    fprintf(fp, "\t\t\t\t\tdisplay_gold=\"%s\"\n", m_gold_display ? "true" : "false");
-
-    fprintf(fp, "\t\t\t\t\t>\n");
+bool CharacterConfig::* const CharacterConfig::display_flags[] =
+{
+    &CharacterConfig::m_bm_display, &CharacterConfig::m_bp_display,
+    &CharacterConfig::m_ga_display, &CharacterConfig::m_gs_display,
+    &CharacterConfig::m_mr_display, &CharacterConfig::m_ns_display,
+    &CharacterConfig::m_sa_display, &CharacterConfig::m_ss_display,
+    &CharacterConfig::m_va_display, &CharacterConfig::m_en_display,
+    &CharacterConfig::m_wh_display, &CharacterConfig::m_fd_display,
+    &CharacterConfig::m_br_display, &CharacterConfig::m_h_display,
+    &CharacterConfig::m_c_display, &CharacterConfig::m_m_display,
+    &CharacterConfig::m_l_display, &CharacterConfig::m_b_display,
+    &CharacterConfig::m_ar_display, &CharacterConfig::m_bt_display,
+    &CharacterConfig::m_hp_display, &CharacterConfig::m_mana_display,
+    &CharacterConfig::m_stamina_display, &CharacterConfig::m_armor_display,
+    &CharacterConfig::m_weight_display, &CharacterConfig::m_gold_display,
+    0
+};
+
+void CharacterConfig::save(string & out) const
+{
+    if(m_in_use || m_xml.empty())
+    {
+        m_xml.erase();
+        render(m_xml);
+    }
+    out += m_xml;
+}
+
+// private
+void CharacterConfig::render(string & out) const
+{
+    config_printf(out, "\t\t\t<character serial=\"%08lX\"\n", m_serial);
+    config_printf(out, "\t\t\t\t\tlight=\"%d\"\n", m_light);
+    config_printf(out, "\t\t\t\t\tdisplay_bm_count=\"%s\"\n", m_bm_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_bp_count=\"%s\"\n", m_bp_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_ga_count=\"%s\"\n", m_ga_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_gs_count=\"%s\"\n", m_gs_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_mr_count=\"%s\"\n", m_mr_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_ns_count=\"%s\"\n", m_ns_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_sa_count=\"%s\"\n", m_sa_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_ss_count=\"%s\"\n", m_ss_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_va_count=\"%s\"\n", m_va_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_en_count=\"%s\"\n", m_en_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_wh_count=\"%s\"\n", m_wh_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_fd_count=\"%s\"\n", m_fd_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_br_count=\"%s\"\n", m_br_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_h_count=\"%s\"\n",  m_h_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_c_count=\"%s\"\n",  m_c_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_m_count=\"%s\"\n",  m_m_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_l_count=\"%s\"\n",  m_l_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_b_count=\"%s\"\n",  m_b_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_ar_count=\"%s\"\n", m_ar_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_bt_count=\"%s\"\n", m_bt_display ? "true" : "false");
+
+    config_printf(out, "\t\t\t\t\tdisplay_hitpoints=\"%s\"\n", m_hp_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_mana=\"%s\"\n", m_mana_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_stamina=\"%s\"\n", m_stamina_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_armor=\"%s\"\n", m_armor_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_weight=\"%s\"\n", m_weight_display ? "true" : "false");
+    config_printf(out, "\t\t\t\t\tdisplay_gold=\"%s\"\n", m_gold_display ? "true" : "false");
+
+    config_printf(out, "\t\t\t\t\t>\n");
 
     {for(dress_map_t::const_iterator i = m_dress.begin(); i != m_dress.end(); i++)
     {
-        fprintf(fp, "\t\t\t\t<dress key=\"%s\">\n",
+        config_printf(out, "\t\t\t\t<dress key=\"%s\">\n",
             ConfigManager::escape_attribute((*i).first).c_str());
         for(int j = 0; j < NUM_CLOTHES; j++)
             if((*i).second.has_layer(j))
-                fprintf(fp, "\t\t\t\t\t<item serial=\"%08lX\" layer=\"%d\"/>\n",
+                config_printf(out, "\t\t\t\t\t<item serial=\"%08lX\" layer=\"%d\"/>\n",
                     (*i).second[j], j);
-        fprintf(fp, "\t\t\t\t</dress>\n");
+        config_printf(out, "\t\t\t\t</dress>\n");
     }}
     {for(arm_map_t::const_iterator i = m_arm.begin(); i != m_arm.end(); i++)
     {
-        fprintf(fp, "\t\t\t\t<arm key=\"%s\">\n",
+        config_printf(out, "\t\t\t\t<arm key=\"%s\">\n",
             ConfigManager::escape_attribute((*i).first).c_str());
         for(int j = 0; j < NUM_ARM; j++)
             if((*i).second.has_layer(j))
-                fprintf(fp, "\t\t\t\t\t<item serial=\"%08lX\" layer=\"%d\"/>\n",
+                config_printf(out, "\t\t\t\t\t<item serial=\"%08lX\" layer=\"%d\"/>\n",
                     (*i).second[j], j);
-        fprintf(fp, "\t\t\t\t</arm>\n");
+        config_printf(out, "\t\t\t\t</arm>\n");
     }}
     for(objlist_t::const_iterator i = m_object.begin(); i != m_object.end(); i++)
-        fprintf(fp, "\t\t\t\t<object name=\"%s\" serial=\"0x%08lx\"/>\n",
+        config_printf(out, "\t\t\t\t<object name=\"%s\" serial=\"0x%08lx\"/>\n",
             ConfigManager::escape_attribute((*i).first).c_str(), (*i).second);
-    m_hotkeys.write_config(fp);
-    fprintf(fp, "\t\t\t</character>\n");
+    m_hotkeys.write_config(out);
+    config_printf(out, "\t\t\t</character>\n");
+}
+
+uint32 CharacterConfig::write_snapshot(SnapshotWriter & writer) const
+{
+    writer.begin_record();
+    writer.put_uint32(m_light);
+    uint32 flags = 0;
+    for(int f = 0; display_flags[f] != 0; f++)
+        if(this->*display_flags[f])
+            flags |= 1 << f;
+    writer.put_uint32(flags);
+
+    writer.put_uint32(m_dress.size());
+    {for(dress_map_t::const_iterator i = m_dress.begin(); i != m_dress.end(); i++)
+    {
+        writer.put_string((*i).first);
+        for(int j = 0; j < NUM_CLOTHES; j++)
+            if(DressSet::valid_layer(j))
+                writer.put_uint32((*i).second[j]);
+    }}
+    writer.put_uint32(m_arm.size());
+    {for(arm_map_t::const_iterator i = m_arm.begin(); i != m_arm.end(); i++)
+    {
+        writer.put_string((*i).first);
+        for(int j = 0; j < NUM_ARM; j++)
+            if(ArmSet::valid_layer(j))
+                writer.put_uint32((*i).second[j]);
+    }}
+    writer.put_uint32(m_object.size());
+    for(objlist_t::const_iterator i = m_object.begin(); i != m_object.end(); i++)
+    {
+        writer.put_string((*i).first);
+        writer.put_uint32((*i).second);
+    }
+    m_hotkeys.write_snapshot(writer);
+    return writer.end_record();
+}
+
+bool CharacterConfig::read_snapshot(SnapshotReader & reader)
+{
+    m_light = sint32(reader.get_uint32());
+    uint32 flags = reader.get_uint32();
+    for(int f = 0; display_flags[f] != 0; f++)
+        this->*display_flags[f] = (flags & (1 << f)) != 0;
+
+    uint32 count = reader.get_count();
+    {for(uint32 i = 0; i < count && !reader.failed(); i++)
+    {
+        DressSet & dress = m_dress[reader.get_string()];
+        for(int j = 0; j < NUM_CLOTHES; j++)
+            if(DressSet::valid_layer(j))
+                dress[j] = reader.get_uint32();
+    }}
+    count = reader.get_count();
+    {for(uint32 i = 0; i < count && !reader.failed(); i++)
+    {
+        ArmSet & arm = m_arm[reader.get_string()];
+        for(int j = 0; j < NUM_ARM; j++)
+            if(ArmSet::valid_layer(j))
+                arm[j] = reader.get_uint32();
+    }}
+    count = reader.get_count();
+    {for(uint32 i = 0; i < count && !reader.failed(); i++)
+    {
+        string name(reader.get_string());
+        m_object[name] = reader.get_uint32();
+    }}
+    if(reader.failed())
+        return false;
+    return m_hotkeys.read_snapshot(reader);
 }
 
 bool CharacterConfig::dress_set_exists(const string & key) const
@@ -1091,32 +1244,98 @@ void CharacterConfig::delete_obj(const string & name)
 ////////////////////////////////////////////////////////////////////////////////
 
 AccountConfig::AccountConfig(const string & name)
-: m_name(name)
+: m_name(name), m_snapshot(0)
 {
 }
 
 CharacterConfig * AccountConfig::get(uint32 character_serial)
+{
+    map_t::iterator i = find(character_serial);
+    (*i).second.set_in_use();
+    return &(*i).second;
+}
+
+CharacterConfig * AccountConfig::load(uint32 character_serial)
+{
+    return &(*find(character_serial)).second;
+}
+
+// private
+AccountConfig::map_t::iterator AccountConfig::find(uint32 character_serial)
 {
     map_t::iterator i = m_characters.find(character_serial);
     if(i == m_characters.end())
+    {
         i = m_characters.insert(map_t::value_type(character_serial,
                 CharacterConfig(character_serial))).first;
-    return &(*i).second;
+        // Fill in the new character from the snapshot, if it is there.
+        snapshot_chars_t::iterator si = m_snapshot_chars.find(character_serial);
+        if(si != m_snapshot_chars.end())
+        {
+            SnapshotReader reader;
+            if(!m_snapshot->read_record((*si).second, reader) ||
+                    !(*i).second.read_snapshot(reader))
+                error_printf("config snapshot: cannot read character 0x%08lx\n",
+                    character_serial);
+            m_snapshot_chars.erase(si);
+        }
+    }
+    return i;
 }
 
-void AccountConfig::save(FILE * fp) const
+uint32 AccountConfig::write_snapshot(SnapshotWriter & writer) const
 {
-    fprintf(fp, "\t\t<account name=\"%s\"\n",
+    std::vector<std::pair<uint32, uint32> > characters;
+    {for(map_t::const_iterator i = m_characters.begin(); i != m_characters.end(); i++)
+        characters.push_back(std::make_pair((*i).first,
+            (*i).second.write_snapshot(writer)));}
+
+    writer.begin_record();
+    writer.put_uint32(characters.size());
+    for(size_t i = 0; i < characters.size(); i++)
+    {
+        writer.put_uint32(characters[i].first);
+        writer.put_uint32(characters[i].second);
+    }
+    return writer.end_record();
+}
+
+bool AccountConfig::read_snapshot(const Snapshot & snapshot, uint32 offset)
+{
+    SnapshotReader reader;
+    if(!snapshot.read_record(offset, reader))
+        return false;
+    m_snapshot = &snapshot;
+    uint32 count = reader.get_count();
+    for(uint32 i = 0; i < count && !reader.failed(); i++)
+    {
+        uint32 serial = reader.get_uint32();
+        m_snapshot_chars[serial] = reader.get_uint32();
+    }
+    return !reader.failed();
+}
+
+void AccountConfig::load_all()
+{
+    while(!m_snapshot_chars.empty())
+        find((*m_snapshot_chars.begin()).first);
+    m_snapshot = 0;
+}
+
+void AccountConfig::save(string & out) const
+{
+    config_printf(out, "\t\t<account name=\"%s\"\n",
         ConfigManager::escape_attribute(m_name).c_str());
-    fprintf(fp, "\t\t\t\t>\n");
+    config_printf(out, "\t\t\t\t>\n");
     for(map_t::const_iterator i = m_characters.begin(); i != m_characters.end(); i++)
-        (*i).second.save(fp);
-    fprintf(fp, "\t\t</account>\n");
+        (*i).second.save(out);
+    config_printf(out, "\t\t</account>\n");
 }
 
 ServerConfig::ServerConfig(const string & name)
 : m_name(name), m_fixwalk(false), m_fixtalk(false), m_buy("buy"), m_sell("sell"),
-  m_filter_weather(false)
+  m_filter_weather(false), m_move_delay(500), m_live_stats(false),
+  m_snapshot(0)
 {
 }
 
@@ -1129,24 +1348,95 @@ AccountConfig * ServerConfig::get(const string & account_name)
 {
     map_t::iterator i = m_accounts.find(account_name);
     if(i == m_accounts.end())
+    {
         i= m_accounts.insert(map_t::value_type(account_name,
             AccountConfig(account_name))).first;
+        // Fill in the new account from the snapshot, if it is there.
+        snapshot_dir_t::iterator si = m_snapshot_accounts.find(account_name);
+        if(si != m_snapshot_accounts.end())
+        {
+            if(!(*i).second.read_snapshot(*m_snapshot, (*si).second))
+                error_printf("config snapshot: cannot read account %s\n",
+                    account_name.c_str());
+            m_snapshot_accounts.erase(si);
+        }
+    }
     return &(*i).second;
 }
 
-void ServerConfig::save(FILE * fp) const
+uint32 ServerConfig::write_snapshot(SnapshotWriter & writer) const
 {
-    fprintf(fp, "\t<server name=\"%s\"\n",
+    std::vector<std::pair<string, uint32> > accounts;
+    {for(map_t::const_iterator i = m_accounts.begin(); i != m_accounts.end(); i++)
+        accounts.push_back(std::make_pair((*i).first,
+            (*i).second.write_snapshot(writer)));}
+
+    writer.begin_record();
+    writer.put_bool(m_fixwalk);
+    writer.put_bool(m_fixtalk);
+    writer.put_bool(m_filter_weather);
+    writer.put_uint32(m_move_delay);
+    writer.put_bool(m_live_stats);
+    writer.put_string(m_buy);
+    writer.put_string(m_sell);
+    writer.put_uint32(accounts.size());
+    for(size_t i = 0; i < accounts.size(); i++)
+    {
+        writer.put_string(accounts[i].first);
+        writer.put_uint32(accounts[i].second);
+    }
+    return writer.end_record();
+}
+
+bool ServerConfig::read_snapshot(const Snapshot & snapshot, uint32 offset)
+{
+    SnapshotReader reader;
+    if(!snapshot.read_record(offset, reader))
+        return false;
+    m_snapshot = &snapshot;
+    m_fixwalk = reader.get_bool();
+    m_fixtalk = reader.get_bool();
+    m_filter_weather = reader.get_bool();
+    m_move_delay = reader.get_uint32();
+    m_live_stats = reader.get_bool();
+    m_buy = reader.get_string();
+    m_sell = reader.get_string();
+    uint32 count = reader.get_count();
+    for(uint32 i = 0; i < count && !reader.failed(); i++)
+    {
+        string name(reader.get_string());
+        m_snapshot_accounts[name] = reader.get_uint32();
+    }
+    return !reader.failed();
+}
+
+void ServerConfig::load_all()
+{
+    while(!m_snapshot_accounts.empty())
+    {
+        string name((*m_snapshot_accounts.begin()).first);
+        get(name);
+    }
+    m_snapshot = 0;
+    for(map_t::iterator i = m_accounts.begin(); i != m_accounts.end(); i++)
+        (*i).second.load_all();
+}
+
+void ServerConfig::save(string & out) const
+{
+    config_printf(out, "\t<server name=\"%s\"\n",
         ConfigManager::escape_attribute(m_name).c_str());
-    fprintf(fp, "\t\t\tfixwalk=\"%s\"\n", m_fixwalk ? "true" : "false");
-    fprintf(fp, "\t\t\tfixtalk=\"%s\"\n", m_fixtalk ? "true" : "false");
-    fprintf(fp, "\t\t\tfilter_weather=\"%s\"\n", m_filter_weather ? "true" : "false");
-    fprintf(fp, "\t\t\tbuy=\"%s\"\n", ConfigManager::escape_attribute(m_buy).c_str());
-    fprintf(fp, "\t\t\tsell=\"%s\"\n", ConfigManager::escape_attribute(m_sell).c_str());
-    fprintf(fp, "\t\t\t>\n");
+    config_printf(out, "\t\t\tfixwalk=\"%s\"\n", m_fixwalk ? "true" : "false");
+    config_printf(out, "\t\t\tfixtalk=\"%s\"\n", m_fixtalk ? "true" : "false");
+    config_printf(out, "\t\t\tfilter_weather=\"%s\"\n", m_filter_weather ? "true" : "false");
+    config_printf(out, "\t\t\tmove_delay=\"%lu\"\n", m_move_delay);
+    config_printf(out, "\t\t\tlive_stats=\"%s\"\n", m_live_stats ? "true" : "false");
+    config_printf(out, "\t\t\tbuy=\"%s\"\n", ConfigManager::escape_attribute(m_buy).c_str());
+    config_printf(out, "\t\t\tsell=\"%s\"\n", ConfigManager::escape_attribute(m_sell).c_str());
+    config_printf(out, "\t\t\t>\n");
     for(map_t::const_iterator i = m_accounts.begin(); i != m_accounts.end(); i++)
-        (*i).second.save(fp);
-    fprintf(fp, "\t</server>\n\n");
+        (*i).second.save(out);
+    config_printf(out, "\t</server>\n\n");
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1154,8 +1444,40 @@ void ServerConfig::save(FILE * fp) const
 //// Members of ShoppingList:
 
 ShoppingList::ShoppingList(const string & name)
-: m_name(name)
+: m_name(name), m_in_use(false)
+{
+    build_index();
+}
+
+// private static
+// The same hash as for strings in hashstr.h.
+uint32 ShoppingList::hash_name(const char * name)
+{
+    uint32 h = 0;
+    for(; *name != '\0'; name++)
+        h = (5 * h) + *name;
+    return h;
+}
+
+// private
+void ShoppingList::insert_index(int index)
 {
+    uint32 mask = m_index.size() - 1;
+    uint32 h = hash_name(m_items[index].m_name.c_str()) & mask;
+    while(m_index[h] != -1)
+        h = (h + 1) & mask;
+    m_index[h] = index;
+}
+
+// private
+void ShoppingList::build_index()
+{
+    size_t slots = 16;
+    while(slots < 2 * m_items.size())
+        slots *= 2;
+    m_index.assign(slots, -1);
+    {for(size_t i = 0; i < m_items.size(); i++)
+        insert_index(i);}
 }
 
 ShoppingItem & ShoppingList::operator[](size_t index)
@@ -1164,11 +1486,14 @@ ShoppingItem & ShoppingList::operator[](size_t index)
     return m_items[index];
 }
 
-int ShoppingList::index_of(const string & name) const
+// Items are inserted in order, so a name that is on the list twice finds
+// the first one, as a linear search would.
+int ShoppingList::index_of(const char * name) const
 {
-    for(list_t::const_iterator i = m_items.begin(); i != m_items.end(); i++)
-        if((*i).m_name == name)
-            return i - m_items.begin();
+    uint32 mask = m_index.size() - 1;
+    for(uint32 h = hash_name(name) & mask; m_index[h] != -1; h = (h + 1) & mask)
+        if(m_items[m_index[h]].m_name == name)
+            return m_index[h];
     return -1;
 }
 
@@ -1181,29 +1506,109 @@ void ShoppingList::reset()
 void ShoppingList::add(const string & name, int want)
 {
     m_items.push_back(ShoppingItem(name, want));
+    if(2 * m_items.size() > m_index.size())
+        build_index();
+    else
+        insert_index(m_items.size() - 1);
 }
 
 void ShoppingList::erase(int index)
 {
     m_items.erase(m_items.begin() + index);
+    // The items after it have moved.
+    build_index();
 }
 
-void ShoppingList::save(FILE * fp) const
+void ShoppingList::save(string & out) const
 {
-    fprintf(fp, "\t<shoplist name=\"%s\">\n",
-        ConfigManager::escape_attribute(m_name).c_str());
-    for(list_t::const_iterator i = m_items.begin(); i != m_items.end(); i++)
-        fprintf(fp, "\t\t<shopitem name=\"%s\" want=\"%d\"/>\n",
-            ConfigManager::escape_attribute((*i).m_name).c_str(), (*i).m_want);
-    fprintf(fp, "\t</shoplist>\n\n");
+    if(m_in_use || m_xml.empty())
+    {
+        m_xml.erase();
+        config_printf(m_xml, "\t<shoplist name=\"%s\">\n",
+            ConfigManager::escape_attribute(m_name).c_str());
+        for(list_t::const_iterator i = m_items.begin(); i != m_items.end(); i++)
+            config_printf(m_xml, "\t\t<shopitem name=\"%s\" want=\"%d\"/>\n",
+                ConfigManager::escape_attribute((*i).m_name).c_str(), (*i).m_want);
+        config_printf(m_xml, "\t</shoplist>\n\n");
+    }
+    out += m_xml;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //// Members of ConfigManager:
 
+class ConfigSaveJob
+{
+public:
+    string m_filename, m_snapshot_filename;
+    string m_xml;
+    SnapshotWriter m_snapshot;
+    uint32 m_root;
+    // Results, reported by finish_save() on the client thread:
+    bool m_ok, m_snapshot_ok;
+    string m_error;
+    long m_write_ms;
+};
+
+// The timer procedure has no other way to find the ConfigManager.
+static ConfigManager * autosave_config = 0;
+
+static VOID CALLBACK autosave_timer(HWND /*hwnd*/, UINT /*msg*/, UINT /*id*/,
+    DWORD /*time*/)
+{
+    if(autosave_config != 0)
+        autosave_config->autosave();
+}
+
+// Writes the files of a save job and records the results in it. It may
+// run on a background thread, so it must not log anything.
+static void write_files(ConfigSaveJob * job)
+{
+    clock_t start = clock();
+    job->m_ok = false;
+    job->m_snapshot_ok = false;
+    // Write to a temporary file, so that an interrupted save never leaves
+    // a truncated config file behind.
+    string temp_filename(job->m_filename + ".tmp");
+    FILE * fp = fopen(temp_filename.c_str(), "wt");
+    if(fp == NULL)
+    {
+        job->m_error = temp_filename + ": " + strerror(errno);
+        return;
+    }
+    bool ok = fwrite(job->m_xml.data(), 1, job->m_xml.size(), fp) ==
+        job->m_xml.size();
+    if(fclose(fp) != 0)
+        ok = false;
+    if(ok)
+        ok = replace_file(temp_filename.c_str(), job->m_filename.c_str());
+    if(!ok)
+    {
+        job->m_error = job->m_filename;
+        remove(temp_filename.c_str());
+        return;
+    }
+    job->m_ok = true;
+    job->m_snapshot_ok = job->m_snapshot.write_file(
+        job->m_snapshot_filename.c_str(), job->m_filename.c_str(),
+        job->m_root);
+    job->m_write_ms = long((clock() - start) * 1000 / CLOCKS_PER_SEC);
+}
+
+static DWORD WINAPI save_thread(LPVOID param)
+{
+    write_files(static_cast<ConfigSaveJob *>(param));
+    return 0;
+}
+
 ConfigManager::ConfigManager()
-: m_loaded(false), m_encryption(ENCRYPTION_IGNITION)
+: m_loaded(false), m_encryption(ENCRYPTION_IGNITION),
+  m_use_dirty(false), m_use_in_use(false), m_autosave(0), m_autosave_since(0),
+  m_saved_hash(0), m_saved_size(0), m_save_thread(0), m_save_job(0),
+  m_autosave_timer(0)
 {
+    ASSERT(autosave_config == 0);
+    autosave_config = this;
     m_use["cure"] = 0x0f07;
     m_use["stamina"] = 0x0f0b;
     m_use["heal"] = 0x0f0c;
@@ -1215,6 +1620,9 @@ ConfigManager::ConfigManager()
 
 ConfigManager::~ConfigManager()
 {
+    kill_autosave_timer();
+    wait_for_save();
+    autosave_config = 0;
 }
 
 // static
@@ -1256,9 +1664,155 @@ string ConfigManager::escape_attribute(const string & key)
     return esc;
 }
 
+// private
+bool ConfigManager::load_snapshot()
+{
+    if(!m_snapshot.open(m_snapshot_filename.c_str(), m_filename.c_str()))
+        return false;
+
+    // Read everything into temporaries first, so that nothing is changed
+    // if the snapshot turns out to be invalid.
+    SnapshotReader reader;
+    if(!m_snapshot.read_record(m_snapshot.get_root(), reader))
+    {
+        m_snapshot.close();
+        return false;
+    }
+    int encryption = reader.get_uint32();
+    bool flush = reader.get_bool();
+    bool verbose = reader.get_bool();
+    bool fix_caption = reader.get_bool();
+    int autosave = reader.get_uint32();
+
+    uselist_t uses;
+    uint32 count = reader.get_count();
+    {for(uint32 i = 0; i < count && !reader.failed(); i++)
+    {
+        string name(reader.get_string());
+        uses[name] = uint16(reader.get_uint32());
+    }}
+
+    shoplists_t lists;
+    count = reader.get_count();
+    {for(uint32 i = 0; i < count && !reader.failed(); i++)
+    {
+        string name(reader.get_string());
+        ShoppingList & list = (*lists.insert(shoplists_t::value_type(name,
+            ShoppingList(name))).first).second;
+        uint32 num_items = reader.get_count();
+        for(uint32 j = 0; j < num_items && !reader.failed(); j++)
+        {
+            string item_name(reader.get_string());
+            list.add(item_name, sint32(reader.get_uint32()));
+        }
+    }}
+
+    snapshot_dir_t servers;
+    count = reader.get_count();
+    {for(uint32 i = 0; i < count && !reader.failed(); i++)
+    {
+        string name(reader.get_string());
+        servers[name] = reader.get_uint32();
+    }}
+
+    if(reader.failed() || encryption < 0 || encryption > ENCRYPTION_3_0_5 ||
+            autosave < 0)
+    {
+        error_printf("config snapshot: invalid root record\n");
+        m_snapshot.close();
+        return false;
+    }
+
+    set_encryption(encryption);
+    set_log_flush(flush);
+    set_log_verbose(verbose);
+    g_FixUnicodeCaption = fix_caption;
+    set_autosave(autosave);
+    m_use = uses;
+    m_lists = lists;
+    m_snapshot_servers = servers;
+    return true;
+}
+
+// private
+uint32 ConfigManager::build_snapshot(SnapshotWriter & writer) const
+{
+    std::vector<std::pair<string, uint32> > servers;
+    {for(map_t::const_iterator i = m_servers.begin(); i != m_servers.end(); i++)
+        servers.push_back(std::make_pair((*i).first,
+            (*i).second.write_snapshot(writer)));}
+
+    writer.begin_record();
+    writer.put_uint32(m_encryption);
+    writer.put_bool(get_log_flush());
+    writer.put_bool(get_log_verbose());
+    writer.put_bool(g_FixUnicodeCaption);
+    writer.put_uint32(m_autosave);
+    writer.put_uint32(m_use.size());
+    {for(uselist_t::const_iterator i = m_use.begin(); i != m_use.end(); i++)
+    {
+        writer.put_string((*i).first);
+        writer.put_uint32((*i).second);
+    }}
+    writer.put_uint32(m_lists.size());
+    {for(shoplists_t::const_iterator i = m_lists.begin(); i != m_lists.end(); i++)
+    {
+        const ShoppingList & list = (*i).second;
+        writer.put_string(list.get_name());
+        writer.put_uint32(list.size());
+        for(ShoppingList::const_iterator j = list.begin(); j != list.end(); j++)
+        {
+            writer.put_string((*j).m_name);
+            writer.put_uint32((*j).m_want);
+        }
+    }}
+    writer.put_uint32(servers.size());
+    for(size_t i = 0; i < servers.size(); i++)
+    {
+        writer.put_string(servers[i].first);
+        writer.put_uint32(servers[i].second);
+    }
+    return writer.end_record();
+}
+
+// private
+void ConfigManager::write_snapshot() const
+{
+    SnapshotWriter writer;
+    uint32 root = build_snapshot(writer);
+    if(!writer.write_file(m_snapshot_filename.c_str(), m_filename.c_str(),
+            root))
+        warning_printf("Cannot write config snapshot: %s\n",
+            m_snapshot_filename.c_str());
+}
+
+// private
+void ConfigManager::load_all()
+{
+    while(!m_snapshot_servers.empty())
+    {
+        string name((*m_snapshot_servers.begin()).first);
+        get(name);
+    }
+    for(map_t::iterator i = m_servers.begin(); i != m_servers.end(); i++)
+        (*i).second.load_all();
+}
+
 bool ConfigManager::load(const char * filename)
 {
     m_filename = filename;
+    m_snapshot_filename = m_filename + ".snap";
+
+    clock_t start = clock();
+    if(load_snapshot())
+    {
+        trace_printf("Loaded config snapshot: %s (%ld ms)\n",
+            m_snapshot_filename.c_str(),
+            long((clock() - start) * 1000 / CLOCKS_PER_SEC));
+        m_loaded = true;
+        return true;
+    }
+
     FILE * fp = fopen(filename, "rt");
     if(fp == NULL)
     {
@@ -1283,8 +1837,11 @@ bool ConfigManager::load(const char * filename)
             parser.get_error_line(), parser.get_error_msg());
     else
     {
-        trace_printf("Loaded config file: %s\n", filename);
+        trace_printf("Loaded config file: %s (%ld ms)\n", filename,
+            long((clock() - start) * 1000 / CLOCKS_PER_SEC));
         m_loaded = true;
+        // Make the next start faster.
+        write_snapshot();
     }
 
     return success;
@@ -1299,27 +1856,39 @@ ServerConfig * ConfigManager::get(const string & server_name)
 {
     map_t::iterator i = m_servers.find(server_name);
     if(i == m_servers.end())
+    {
         i = m_servers.insert(map_t::value_type(server_name,
             ServerConfig(server_name))).first;
+        // Fill in the new server from the snapshot, if it is there.
+        snapshot_dir_t::iterator si = m_snapshot_servers.find(server_name);
+        if(si != m_snapshot_servers.end())
+        {
+            if(!(*i).second.read_snapshot(m_snapshot, (*si).second))
+                error_printf("config snapshot: cannot read server %s\n",
+                    server_name.c_str());
+            m_snapshot_servers.erase(si);
+        }
+    }
     return &(*i).second;
 }
 
-void ConfigManager::save() const
-{
-    if(!m_loaded)
-    {
-        trace_printf("Not saving configuration.\n");
-        return;
-    }
-    FILE * fp = fopen(m_filename.c_str(), "wt");
-    if(fp == NULL)
-    {
-        error_printf("Cannot create config file: %s: %s\n",
-            m_filename.c_str(), strerror(errno));
-        return;
-    }
-    fprintf(fp, "<?xml version='1.0'?>\n\n");
-    fprintf(fp, "<config\n");
+// private
+ConfigSaveJob * ConfigManager::prepare_save()
+{
+    clock_t start = clock();
+    // Everything must be read from the snapshot before it is replaced.
+    load_all();
+    m_snapshot.close();
+
+    ConfigSaveJob * job = new ConfigSaveJob;
+    string & out = job->m_xml;
+    // Characters, shopping lists and the use list that have not been
+    // changed or given out since the last save are copied from their cached
+    // XML, so this is mostly string copying. The <config> attributes and
+    // the server attributes are only a few lines, and are always rendered.
+    out.reserve(m_saved_size + 4096);
+    out += "<?xml version='1.0'?>\n\n";
+    out += "<config\n";
     const char * encryption_str;
     switch(m_encryption)
     {
@@ -1341,22 +1910,155 @@ void ConfigManager::save() const
     default:
         FATAL("m_encryption has invalid value");
     }
-    fprintf(fp, "\t\tencryption=\"%s\"\n", encryption_str);
-    fprintf(fp, "\t\tlog_flush=\"%s\"\n",
+    config_printf(out, "\t\tencryption=\"%s\"\n", encryption_str);
+    config_printf(out, "\t\tlog_flush=\"%s\"\n",
         get_log_flush() ? "true" : "false");
-    fprintf(fp, "\t\tfix_caption=\"%s\"\n", g_FixUnicodeCaption ? "true" : "false");
-    fprintf(fp, "\t\tlog_verbose=\"%s\"\n",
+    config_printf(out, "\t\tfix_caption=\"%s\"\n", g_FixUnicodeCaption ? "true" : "false");
+    config_printf(out, "\t\tlog_verbose=\"%s\"\n",
         get_log_verbose() ? "true" : "false");
-    fprintf(fp, "\t\t>\n\n");
+    if(m_autosave != 0)
+        config_printf(out, "\t\tautosave=\"%d\"\n", m_autosave);
+    out += "\t\t>\n\n";
     {for(map_t::const_iterator i = m_servers.begin(); i != m_servers.end(); i++)
-        (*i).second.save(fp);}
+        (*i).second.save(out);}
     {for(shoplists_t::const_iterator i = m_lists.begin(); i != m_lists.end(); i++)
-        (*i).second.save(fp);}
-    {for(uselist_t::const_iterator i = m_use.begin(); i != m_use.end(); i++)
-        fprintf(fp, "\t<use name=\"%s\" graphic=\"0x%04x\"/>\n",
-        ConfigManager::escape_attribute((*i).first).c_str(), (*i).second);}
-    fprintf(fp, "</config>\n\n");
-    fclose(fp);
+        (*i).second.save(out);}
+    if(m_use_dirty || m_use_in_use || m_use_xml.empty())
+    {
+        m_use_xml.erase();
+        {for(uselist_t::const_iterator i = m_use.begin(); i != m_use.end(); i++)
+            config_printf(m_use_xml, "\t<use name=\"%s\" graphic=\"0x%04x\"/>\n",
+            ConfigManager::escape_attribute((*i).first).c_str(), (*i).second);}
+        m_use_dirty = false;
+    }
+    out += m_use_xml;
+    out += "</config>\n\n";
+
+    uint32 hash = hash_bytes(out.data(), out.size());
+    if(hash == m_saved_hash && out.size() == m_saved_size)
+    {
+        trace_printf("Config file unchanged: %s (%ld ms)\n",
+            m_filename.c_str(),
+            long((clock() - start) * 1000 / CLOCKS_PER_SEC));
+        delete job;
+        return 0;
+    }
+    m_saved_hash = hash;
+    m_saved_size = out.size();
+
+    job->m_filename = m_filename;
+    job->m_snapshot_filename = m_snapshot_filename;
+    job->m_root = build_snapshot(job->m_snapshot);
+    job->m_ok = false;
+    trace_printf("Prepared config file: %s (%ld ms)\n", m_filename.c_str(),
+        long((clock() - start) * 1000 / CLOCKS_PER_SEC));
+    return job;
+}
+
+// private
+void ConfigManager::wait_for_save()
+{
+    if(m_save_thread == 0)
+        return;
+    WaitForSingleObject(m_save_thread, INFINITE);
+    CloseHandle(m_save_thread);
+    m_save_thread = 0;
+    finish_save(m_save_job);
+    m_save_job = 0;
+}
+
+// private
+void ConfigManager::finish_save(ConfigSaveJob * job)
+{
+    if(job->m_ok)
+    {
+        if(!job->m_snapshot_ok)
+            warning_printf("Cannot write config snapshot: %s\n",
+                job->m_snapshot_filename.c_str());
+        trace_printf("Wrote config file: %s (%lu bytes, %ld ms)\n",
+            job->m_filename.c_str(), (unsigned long)job->m_xml.size(),
+            job->m_write_ms);
+    }
+    else
+    {
+        error_printf("Cannot write config file: %s\n", job->m_error.c_str());
+        // Make sure that the next save writes the file again.
+        m_saved_size = 0;
+    }
+    delete job;
+}
+
+// private
+void ConfigManager::kill_autosave_timer()
+{
+    if(m_autosave_timer != 0)
+    {
+        KillTimer(NULL, m_autosave_timer);
+        m_autosave_timer = 0;
+    }
+}
+
+bool ConfigManager::save()
+{
+    if(!m_loaded)
+    {
+        trace_printf("Not saving configuration.\n");
+        return false;
+    }
+    kill_autosave_timer();
+    wait_for_save();
+    ConfigSaveJob * job = prepare_save();
+    if(job == 0)
+        return true;
+    write_files(job);
+    bool ok = job->m_ok;
+    finish_save(job);
+    return ok;
+}
+
+void ConfigManager::request_save()
+{
+    if(!m_loaded || m_autosave == 0)
+        return;
+    // Setting the timer again restarts it, so a burst of changes is only
+    // saved once. It is left to run once the first change has waited long
+    // enough, so that steady changes cannot put the save off for ever.
+    DWORD now = GetTickCount();
+    if(m_autosave_timer == 0)
+        m_autosave_since = now;
+    else if(now - m_autosave_since >=
+            DWORD(m_autosave) * (AUTOSAVE_MAX_DELAYS - 1))
+        return;
+    m_autosave_timer = SetTimer(NULL, m_autosave_timer, m_autosave,
+        autosave_timer);
+    if(m_autosave_timer == 0)
+        warning_printf("Cannot start autosave timer\n");
+}
+
+void ConfigManager::autosave()
+{
+    kill_autosave_timer();
+    wait_for_save();
+    ConfigSaveJob * job = prepare_save();
+    if(job == 0)
+        return;
+    DWORD thread_id;
+    m_save_thread = CreateThread(NULL, 0, save_thread, job, 0, &thread_id);
+    if(m_save_thread == NULL)
+    {
+        m_save_thread = 0;
+        write_files(job);
+        finish_save(job);
+    }
+    else
+        m_save_job = job;
+}
+
+void ConfigManager::poll_save()
+{
+    if(m_save_thread != 0 && WaitForSingleObject(m_save_thread, 0) ==
+            WAIT_OBJECT_0)
+        wait_for_save();
 }
 
 void ConfigManager::set_encryption(int encryption)
@@ -1365,6 +2067,14 @@ void ConfigManager::set_encryption(int encryption)
     m_encryption = encryption;
 }
 
+void ConfigManager::set_autosave(int autosave)
+{
+    ASSERT(autosave >= 0);
+    if(autosave == 0)
+        kill_autosave_timer();
+    m_autosave = autosave;
+}
+
 bool ConfigManager::get_log_flush() const
 {
     return g_logger->get_flush();
@@ -1394,6 +2104,7 @@ ShoppingList & ConfigManager::find_list(const string & name)
 {
     shoplists_t::iterator i = m_lists.find(name);
     ASSERT(i != m_lists.end());
+    (*i).second.set_in_use();
     return (*i).second;
 }
 
@@ -1429,6 +2140,14 @@ uint16 & ConfigManager::find_use(const string & name)
 {
     uselist_t::iterator i = m_use.find(name);
     ASSERT(i != m_use.end());
+    m_use_in_use = true;
+    return (*i).second;
+}
+
+uint16 ConfigManager::get_use(const string & name) const
+{
+    uselist_t::const_iterator i = m_use.find(name);
+    ASSERT(i != m_use.end());
     return (*i).second;
 }
 
@@ -1437,11 +2156,13 @@ void ConfigManager::add_use(const string & name, uint16 graphic)
     //ASSERT(ConfigManager::valid_key(name));
     ASSERT(!use_exists(name));
     m_use.insert(uselist_t::value_type(name, graphic));
+    m_use_dirty = true;
 }
 
 void ConfigManager::delete_use(const string & name)
 {
     m_use.erase(name);
+    m_use_dirty = true;
 }
 
 
@@ -36,11 +36,19 @@
 #include "common.h"
 #include "hashstr.h"
 #include "hotkeys.h"
+#include "snapshot.h"
 
 const int LIGHT_NORMAL = -1;
 const int NUM_CLOTHES = 25;
 const int NUM_ARM = 3;
 
+// Maps keys to the offsets of records in a config snapshot that have not
+// been read yet.
+typedef std::hash_map<string, uint32> snapshot_dir_t;
+
+// Appends formatted text to a string, for building the XML file in memory.
+void config_printf(string & out, const char * format, ...) GCC_PRINTF(2,3);
+
 class DressSet
 {
 private:
@@ -136,12 +144,30 @@ private:
 
     objlist_t m_object;
 
+    // The XML for this character from the last save. It is reused as long
+    // as the character has not been handed out by AccountConfig::get(),
+    // because nothing else can change it.
+    mutable string m_xml;
+    bool m_in_use;
+
+    void render(string & out) const;
+
+    // The display flags, in the order they are stored in snapshots.
+    static bool CharacterConfig::* const display_flags[];
+
 public:
     CharacterConfig(uint32 serial);
     ~CharacterConfig();
     Hotkeys m_hotkeys;
 
-    void save(FILE * fp) const;
+    void save(string & out) const;
+    // Returns the offset of the record.
+    uint32 write_snapshot(SnapshotWriter & writer) const;
+    // Returns false if the record is invalid.
+    bool read_snapshot(SnapshotReader & reader);
+    // Called when a pointer to the character is given out; from then on,
+    // the character is rendered again on every save.
+    void set_in_use() { m_in_use = true; }
 
     int get_light() const { return m_light; }
     void set_light(int light) { m_light = light; }
@@ -228,16 +254,30 @@ class AccountConfig
 {
 private:
     typedef std::hash_map<uint32, CharacterConfig> map_t;
+    typedef std::hash_map<uint32, uint32> snapshot_chars_t;
 
     map_t m_characters;
     string m_name;
+    // Characters that are still in the snapshot:
+    const Snapshot * m_snapshot;
+    snapshot_chars_t m_snapshot_chars;
+
+    // Looks up a character without marking it as in use.
+    map_t::iterator find(uint32 character_serial);
 
 public:
     AccountConfig(const string & name);
 
-    void save(FILE * fp) const;
+    void save(string & out) const;
+    uint32 write_snapshot(SnapshotWriter & writer) const;
+    bool read_snapshot(const Snapshot & snapshot, uint32 offset);
+    // Reads all characters that are still in the snapshot.
+    void load_all();
 
     CharacterConfig * get(uint32 character_serial);
+    // Like get(), but does not mark the character as in use. For filling in
+    // characters while loading.
+    CharacterConfig * load(uint32 character_serial);
 };
 
 class ServerConfig
@@ -250,13 +290,22 @@ private:
     bool m_fixwalk, m_fixtalk;
     string m_buy, m_sell; // text for buy and sell
     bool m_filter_weather;
+    uint32 m_move_delay;    // ms between item moves
+    bool m_live_stats;      // publish stats for monitoring programs
+    // Accounts that are still in the snapshot:
+    const Snapshot * m_snapshot;
+    snapshot_dir_t m_snapshot_accounts;
 
 public:
     ServerConfig(const string & name);
 
     AccountConfig * get(const string & account_name);
     AccountConfig * get(const char * account_name);
-    void save(FILE * fp) const;
+    void save(string & out) const;
+    uint32 write_snapshot(SnapshotWriter & writer) const;
+    bool read_snapshot(const Snapshot & snapshot, uint32 offset);
+    // Reads all accounts and characters that are still in the snapshot.
+    void load_all();
 
     bool get_fixwalk() const { return m_fixwalk; }
     void set_fixwalk(bool fixwalk) { m_fixwalk = fixwalk; }
@@ -267,6 +316,12 @@ public:
     bool get_filter_weather() const { return m_filter_weather; }
     void set_filter_weather(bool filter_weather) { m_filter_weather = filter_weather; }
 
+    uint32 get_move_delay() const { return m_move_delay; }
+    void set_move_delay(uint32 move_delay) { m_move_delay = move_delay; }
+
+    bool get_live_stats() const { return m_live_stats; }
+    void set_live_stats(bool live_stats) { m_live_stats = live_stats; }
+
     const char * get_buy_text() { return m_buy.c_str(); }
     const char * get_sell_text() { return m_sell.c_str(); }
     void set_buy_text(const char * buy) { m_buy = buy; }
@@ -303,18 +358,34 @@ private:
 
     string m_name;
     list_t m_items;
+    // Open hash table of indices into m_items, -1 for an empty slot. It
+    // always has at least twice as many slots as there are items.
+    std::vector<int> m_index;
+
+    static uint32 hash_name(const char * name);
+    void insert_index(int index);
+    void build_index();
+
+    // The XML for this list from the last save, reused like
+    // CharacterConfig::m_xml until the list is handed out for changing.
+    mutable string m_xml;
+    bool m_in_use;
 
 public:
     ShoppingList(const string & name);
 
     // Members for access to m_list
     typedef list_t::iterator iterator;
+    typedef list_t::const_iterator const_iterator;
     size_t size() const { return m_items.size(); }
     iterator begin() { return m_items.begin(); }
     iterator end() { return m_items.end(); }
+    const_iterator begin() const { return m_items.begin(); }
+    const_iterator end() const { return m_items.end(); }
     ShoppingItem & operator[](size_t index);
     // Returns -1 if not found:
-    int index_of(const string & name) const;
+    int index_of(const char * name) const;
+    int index_of(const string & name) const { return index_of(name.c_str()); }
 
     // Sets all of the available/got/paid fields to zero:
     void reset();
@@ -323,9 +394,18 @@ public:
     void erase(int index);
 
     const string & get_name() const { return m_name; }
-    void save(FILE * fp) const;
+    void save(string & out) const;
+    // Called when the list is given out to be changed; from then on, it is
+    // rendered again on every save.
+    void set_in_use() { m_in_use = true; }
 };
 
+// The files written by one save, which may be done by a background thread.
+class ConfigSaveJob;
+
+// Steady changes put an autosave off by at most this many autosave delays.
+const int AUTOSAVE_MAX_DELAYS = 4;
+
 class ConfigManager
 {
 public:
@@ -335,13 +415,47 @@ public:
 private:
     typedef std::hash_map<string, ServerConfig> map_t;
 
-    string m_filename;
+    string m_filename, m_snapshot_filename;
     bool m_loaded;
     map_t m_servers;
 
     int m_encryption;
     shoplists_t m_lists;
     uselist_t m_use;
+    // The XML for m_use from the last save. It is rendered again if the
+    // list changed or a reference into it was given out.
+    string m_use_xml;
+    bool m_use_dirty, m_use_in_use;
+    int m_autosave;     // delay in milliseconds, or 0 for no autosave
+    unsigned long m_autosave_since; // tick count of the first unsaved change
+
+    // The XML file as it was last saved, so that unchanged
+    // configuration is not written again:
+    uint32 m_saved_hash, m_saved_size;
+    // The background save in progress, if any:
+    void * m_save_thread;
+    ConfigSaveJob * m_save_job;
+    unsigned m_autosave_timer;
+
+    // Servers that are still in the snapshot:
+    Snapshot m_snapshot;
+    snapshot_dir_t m_snapshot_servers;
+
+    bool load_snapshot();
+    // Returns the offset of the root record.
+    uint32 build_snapshot(SnapshotWriter & writer) const;
+    void write_snapshot() const;
+    // Reads everything that is still in the snapshot.
+    void load_all();
+    // Builds the XML file and snapshot in memory. Returns 0 if the XML is
+    // the same as when it was last saved.
+    ConfigSaveJob * prepare_save();
+    // Waits for a background save to finish.
+    void wait_for_save();
+    // Reports how the save went and deletes the job. Called on the client
+    // thread, since the logging functions are not safe on others.
+    void finish_save(ConfigSaveJob * job);
+    void kill_autosave_timer();
 
 public:
     ConfigManager();
@@ -358,11 +472,22 @@ public:
     // default options will be used.
     ServerConfig * get(const string & server_name);
     ServerConfig * get(const char * server_name);
-    // Save all configuration.
-    void save() const;
+    // Save all configuration. Returns true if successful.
+    bool save();
+    // Called after the configuration may have changed. If autosave is
+    // enabled, the configuration is saved in the background once no more
+    // changes have been made for the autosave delay, or at the latest
+    // AUTOSAVE_MAX_DELAYS times the delay after the first change.
+    void request_save();
+    // Called by the autosave timer.
+    void autosave();
+    // Called regularly on the client thread to finish a background save.
+    void poll_save();
 
     int get_encryption() const { return m_encryption; }
     void set_encryption(int encryption);
+    int get_autosave() const { return m_autosave; }
+    void set_autosave(int autosave);
     bool get_log_flush() const;
     void set_log_flush(bool log_flush);
     bool get_log_verbose() const;
@@ -379,9 +504,11 @@ public:
     // *** 'name' must be a valid key.
     void create_list(const string & name);
 
-    uselist_t & get_uselist() { return m_use; }
+    const uselist_t & get_uselist() const { return m_use; }
     bool use_exists(const string & name);
+    // Returns a reference that may be kept to change the graphic.
     uint16 & find_use(const string & name);
+    uint16 get_use(const string & name) const;
     // *** 'name' must be a valid key.
     void add_use(const string & name, uint16 graphic);
     void delete_use(const string & name);
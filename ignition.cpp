@@ -102,7 +102,7 @@ static LRESULT WINAPI patch_GetMsgProc(int code, WPARAM wparam, LPARAM lparam)
                 break;
             }
             CopyMemory(reinterpret_cast<unsigned char *>(elem->m_address),
-                elem->m_buffer, elem->m_length);
+                g_patch.get_buffer(*elem), elem->m_length);
             elem++;
         }
 
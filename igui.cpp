@@ -332,7 +332,7 @@ void EditListDialog::add_buy_list(VendorBuyList & vendor_list)
     VendorBuyList::iterator vi = vendor_list.begin();
     while(vi.is_valid())
     {
-        int i = list_box.add_string(vi.get_name().c_str());
+        int i = list_box.add_string(vi.get_name());
         if(i == -1)
             error_printf("Failed adding string to list box\n");
         ++vi;
@@ -345,7 +345,7 @@ void EditListDialog::add_sell_list(VendorSellList & vendor_list)
     VendorSellList::iterator vi = vendor_list.begin();
     while(vi.is_valid())
     {
-        int i = list_box.add_string(vi.get_name().c_str());
+        int i = list_box.add_string(vi.get_name());
         if(i == -1)
             error_printf("Failed adding string to list box\n");
         ++vi;
@@ -635,7 +635,7 @@ void UseTabDialog::event_init_dialog()
 {
     // Initialise use list
     ListBoxWrapper list_box(m_hwnd, ID_LB_USE);
-    ConfigManager::uselist_t & list=(m_config.get_uselist());
+    const ConfigManager::uselist_t & list=(m_config.get_uselist());
     for(ConfigManager::uselist_t::const_iterator i = list.begin();
             i != list.end(); i++)
         if(list_box.add_string((*i).first.c_str()) == -1)
@@ -1718,6 +1718,7 @@ void InjectionWindow::disconnected()
 
 // private
 InjectionGUI * InjectionGUI::m_instance = 0;
+UINT InjectionGUI::m_idle_message = 0;
 
 InjectionGUI::InjectionGUI(GUICallbackInterface & callback,
     ConfigManager & config)
@@ -1726,6 +1727,7 @@ InjectionGUI::InjectionGUI(GUICallbackInterface & callback,
 {
     ASSERT(m_instance == 0);
     m_instance = this;
+    m_idle_message = RegisterWindowMessage("Injection idle");
 
     // Find the client window, which uses the "Ultima Online" window class.
     HWND hwnd = FindWindowEx(0, 0, "Ultima Online", 0);
@@ -1779,6 +1781,11 @@ LRESULT CALLBACK InjectionGUI::hook_window_proc(HWND hwnd, UINT msg,
 	g_ClientWindow=hwnd;
 
     static LPARAM KeyToEat=0;
+    if(msg == m_idle_message)
+    {
+        m_instance->m_callback.idle();
+        return 0;
+    }
     switch(msg)
     {
     case WM_NCPAINT:
@@ -1849,6 +1856,12 @@ void InjectionGUI::disconnected()
     m_main_window.disconnected();
 }
 
+void InjectionGUI::wake_idle()
+{
+    if(m_client_hwnd != 0)
+        PostMessage(m_client_hwnd, m_idle_message, 0, 0);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 extern "C" BOOL WINAPI DllMain(HINSTANCE hinst, DWORD reason, LPVOID reserved);
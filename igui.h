@@ -57,6 +57,8 @@ public:
     virtual bool get_object_target(ObjectTabDialog * dialog,
         object_target_handler_t handler) = 0;
     virtual void update_display() = 0;
+    // Runs the work queued for the client thread.
+    virtual void idle() = 0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -285,6 +287,8 @@ class InjectionGUI : public CounterCallbackInterface
 {
 private:
     static InjectionGUI * m_instance;
+    // Posted to the client window to make it call idle().
+    static UINT m_idle_message;
 
     static LRESULT CALLBACK hook_window_proc(HWND hwnd, UINT msg,
         WPARAM wparam, LPARAM lparam);
@@ -308,6 +312,9 @@ public:
     virtual void update_counter(const char * str);
     void connected(CharacterConfig * character);
     void disconnected();
+    // May be called from any thread. The client thread calls idle() soon,
+    // even if it is not waiting for the server at the time.
+    void wake_idle();
 };
 
 #endif
@@ -29,9 +29,15 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "crc.h"
 
+// Size of the blocks read from the file
+#define CRC_BLOCK_SIZE	65536
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -50,15 +56,26 @@ CCrc::CCrc(unsigned int polynomial)
 	int i;
 	for(i = 0; i < 256; i++)
 	{
-		m_table[i] = Reflect(i, 8) << 24;
+		m_table[0][i] = Reflect(i, 8) << 24;
 
 		int j;
 		for (j = 0; j < 8; j++)
 		{
-			m_table[i] = (m_table[i] << 1) ^ (m_table[i] & (1 << 31) ? polynomial : 0);
+			m_table[0][i] = (m_table[0][i] << 1) ^ (m_table[0][i] & (1 << 31) ? polynomial : 0);
 		}
 
-		m_table[i] = Reflect(m_table[i], 32);
+		m_table[0][i] = Reflect(m_table[0][i], 32);
+	}
+
+	// m_table[k][i] is the checksum of byte i followed by k zero bytes
+	for(i = 0; i < 256; i++)
+	{
+		int k;
+		for(k = 1; k < 8; k++)
+		{
+			unsigned int value = m_table[k - 1][i];
+			m_table[k][i] = (value >> 8) ^ m_table[0][value & 0xff];
+		}
 	}
 }
 
@@ -136,21 +153,186 @@ bool CCrc::GetCrc(const char *strFilename, unsigned int *pCrc, unsigned int *pLe
 	FILE *hFile = fopen(strFilename, "rb");
 	if(hFile == 0) return false;
 
-	unsigned int length;
-	for(length = 0; ; length++)
-	{
-		unsigned char c;
-		fread(&c, sizeof(unsigned char), 1, hFile);
+	unsigned char *pBuffer = new unsigned char[CRC_BLOCK_SIZE];
 
-		if(feof(hFile) != 0) break;
+	unsigned int length = 0;
+	for(;;)
+	{
+		size_t count = fread(pBuffer, sizeof(unsigned char), CRC_BLOCK_SIZE, hFile);
+		if(count == 0) break;
 
-		crc = (crc >> 8) ^ m_table[(crc & 0xff) ^ c];
+		crc = Update(crc, pBuffer, count);
+		length += count;
 	}
 
+	bool bError = ferror(hFile) != 0;
+
+	delete [] pBuffer;
 	fclose(hFile);
 
+	if(bError) return false;
+
 	*pCrc = crc ^ 0xffffffff;
 	if(pLength != 0) *pLength = length;
 
 	return true;
 }
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//	Update a running checksum with a block of data
+//
+//	PARAMETERS:
+//		unsigned int crc			Checksum so far (not inverted)
+//		const unsigned char *pData	Data to add to the checksum
+//		unsigned int length			Length of the data
+//
+//	RETURNS:
+//		unsigned int				New checksum (not inverted)
+//
+////////////////////////////////////////////////////////////////////////////////
+
+unsigned int CCrc::Update(unsigned int crc, const unsigned char *pData, unsigned int length)
+{
+	// Process 8 bytes at a time using the sliced tables
+	while(length >= 8)
+	{
+		unsigned int one = crc ^ (pData[0] | (pData[1] << 8) | (pData[2] << 16) | (pData[3] << 24));
+		unsigned int two = pData[4] | (pData[5] << 8) | (pData[6] << 16) | (pData[7] << 24);
+
+		crc = m_table[7][one & 0xff] ^
+			m_table[6][(one >> 8) & 0xff] ^
+			m_table[5][(one >> 16) & 0xff] ^
+			m_table[4][one >> 24] ^
+			m_table[3][two & 0xff] ^
+			m_table[2][(two >> 8) & 0xff] ^
+			m_table[1][(two >> 16) & 0xff] ^
+			m_table[0][two >> 24];
+
+		pData += 8;
+		length -= 8;
+	}
+
+	// Remaining bytes
+	while(length > 0)
+	{
+		crc = (crc >> 8) ^ m_table[0][(crc & 0xff) ^ *pData];
+
+		pData++;
+		length--;
+	}
+
+	return crc;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//	Calculate the checksum and the length of a given file (CRC32), using a
+//	cache file to avoid reading files that have not changed
+//
+//	Each line of the cache file is:
+//		<checksum> <length> <modification time> <filename>
+//	with the numbers in hexadecimal.
+//
+//	PARAMETERS:
+//		const char *strFilename			Filename
+//		const char *strCacheFilename	Filename of the checksum cache
+//		unsigned int *pCrc				Pointer to checksum buffer
+//		unsigned int *pLength			Pointer to length buffer
+//
+//	RETURNS:
+//		bool							"true" if successful, "false" if not
+//
+////////////////////////////////////////////////////////////////////////////////
+
+bool CCrc::GetCachedCrc(const char *strFilename, const char *strCacheFilename, unsigned int *pCrc, unsigned int *pLength)
+{
+	struct stat info;
+	if(stat(strFilename, &info) != 0) return false;
+
+	unsigned int length = info.st_size;
+	unsigned long mtime = info.st_mtime;
+
+	char line[CRC_CACHE_LINE_SIZE];
+
+	// Look for an up to date entry
+	FILE *hCache = fopen(strCacheFilename, "rt");
+	if(hCache != 0)
+	{
+		while(fgets(line, sizeof(line), hCache) != 0)
+		{
+			unsigned int crc, size;
+			unsigned long time;
+			int offset = 0;
+			if(sscanf(line, "%x %x %lx %n", &crc, &size, &time, &offset) < 3 || offset == 0) continue;
+
+			char *strName = line + offset;
+			strName[strcspn(strName, "\r\n")] = 0;
+
+			if(strcmp(strName, strFilename) == 0 && size == length && time == mtime)
+			{
+				fclose(hCache);
+
+				*pCrc = crc;
+				if(pLength != 0) *pLength = length;
+
+				return true;
+			}
+		}
+
+		fclose(hCache);
+	}
+
+	unsigned int crc;
+	if(!GetCrc(strFilename, &crc, &length)) return false;
+
+	*pCrc = crc;
+	if(pLength != 0) *pLength = length;
+
+	// Rewrite the cache, replacing any old entry for this file.
+	// Failing to update the cache is not an error.
+	char strTempFilename[CRC_CACHE_LINE_SIZE];
+	if(strlen(strCacheFilename) + 5 > sizeof(strTempFilename)) return true;
+	strcpy(strTempFilename, strCacheFilename);
+	strcat(strTempFilename, ".tmp");
+
+	FILE *hTemp = fopen(strTempFilename, "wt");
+	if(hTemp == 0) return true;
+
+	hCache = fopen(strCacheFilename, "rt");
+	if(hCache != 0)
+	{
+		while(fgets(line, sizeof(line), hCache) != 0)
+		{
+			unsigned int oldCrc, size;
+			unsigned long time;
+			int offset = 0;
+			if(sscanf(line, "%x %x %lx %n", &oldCrc, &size, &time, &offset) < 3 || offset == 0) continue;
+
+			char *strName = line + offset;
+			strName[strcspn(strName, "\r\n")] = 0;
+			if(strcmp(strName, strFilename) == 0) continue;
+
+			fprintf(hTemp, "%08x %08x %08lx %s\n", oldCrc, size, time, strName);
+		}
+
+		fclose(hCache);
+	}
+
+	fprintf(hTemp, "%08x %08x %08lx %s\n", crc, length, mtime, strFilename);
+
+	if(fclose(hTemp) != 0)
+	{
+		remove(strTempFilename);
+		return true;
+	}
+
+	remove(strCacheFilename);
+	rename(strTempFilename, strCacheFilename);
+
+	return true;
+}
@@ -34,10 +34,15 @@
 // Default polynomial used for the table generation
 #define CRC_DEFAULT_POLYNOMIAL	0x04c11db7
 
+// Maximum length of a line in the checksum cache file
+#define CRC_CACHE_LINE_SIZE		1024
+
 class CCrc
 {
 protected:
-	unsigned int m_table[256];
+	// m_table[0] is the normal byte table; the others are used to process
+	// 8 bytes at a time (slicing-by-8)
+	unsigned int m_table[8][256];
 
 public:
 	// Construct a checksum instance from a given polynomial
@@ -49,6 +54,13 @@ public:
 	// Calculate the checksum and the length of a given file (CRC32)
 	bool GetCrc(const char *strFilename, unsigned int *pCrc, unsigned int *pLength = 0);
 
+	// Same as GetCrc, but reuses the result stored in a cache file if the
+	// size and modification time of the file have not changed
+	bool GetCachedCrc(const char *strFilename, const char *strCacheFilename, unsigned int *pCrc, unsigned int *pLength = 0);
+
+	// Update a running checksum with a block of data
+	unsigned int Update(unsigned int crc, const unsigned char *pData, unsigned int length);
+
 protected:
 	// Mirror a number of bits in a value
 	unsigned int Reflect(unsigned int source, int c);
@@ -551,7 +551,7 @@ unsigned LaunchThread::run()
 	unsigned int checksum, length;
 	CCrc crc;
 	begin_stage(STAGE_CRC);
-	if(!crc.GetCrc(m_client_path, &checksum, &length))
+	if(!crc.GetCachedCrc(m_client_path, "ilcrc.cache", &checksum, &length))
 	{
 		crtl_error("Cannot read client executable");
 		error_stage(STAGE_CRC);
@@ -45,6 +45,7 @@
 #include "skills.h"
 #include "runebook.h"
 #include "hotkeyhook.h"
+#include "stats.h"
 
 #include "injection.h"
 #include "extdll.h"
@@ -153,6 +154,92 @@ public:
     }
 };
 
+// A command line run later by the delay command.
+class DelayedCommand : public Timer
+{
+private:
+    ClientInterface & m_client;
+    string m_command;
+
+public:
+    DelayedCommand(ClientInterface & client, const string & command)
+    : m_client(client), m_command(command)
+    {
+    }
+
+    virtual void expired()
+    {
+        m_client.do_command(m_command.c_str());
+        delete this;
+    }
+    virtual void discarded() { delete this; }
+};
+
+#ifdef USE_BENCHMARKS
+// Schedules a batch of timers and reports how late they ran, for the
+// timerbench command.
+class TimerBench
+{
+private:
+    class BenchTimer : public Timer
+    {
+    public:
+        TimerBench * m_bench;
+        uint32 m_due;       // GetTickCount() it should run at
+
+        virtual void expired() { m_bench->expired(*this); }
+    };
+
+    ClientInterface & m_client;
+    BenchTimer * m_timers;
+    int m_count, m_done;
+    uint32 m_total_late, m_max_late;
+    uint64 m_schedule_cycles;
+
+public:
+    TimerBench(ClientInterface & client, TimerWheel & wheel, int count,
+        uint32 max_delay)
+    : m_client(client), m_count(count), m_done(0), m_total_late(0),
+      m_max_late(0)
+    {
+        m_timers = new BenchTimer[count];
+        uint32 now = GetTickCount();
+        uint64 start = read_tsc();
+        for(int i = 0; i < count; i++)
+        {
+            uint32 delay = uint32(double(max_delay) * (i + 1) / count);
+            m_timers[i].m_bench = this;
+            m_timers[i].m_due = now + delay;
+            wheel.schedule(&m_timers[i], delay);
+        }
+        m_schedule_cycles = read_tsc() - start;
+    }
+    ~TimerBench()
+    {
+        delete [] m_timers;     // cancels any still waiting
+    }
+
+    void expired(BenchTimer & timer)
+    {
+        sint32 late = sint32(GetTickCount() - timer.m_due);
+        if(late < 0)
+            late = 0;
+        m_total_late += late;
+        if(uint32(late) > m_max_late)
+            m_max_late = late;
+        if(++m_done < m_count)
+            return;
+
+        char buf[200];
+        sprintf(buf, "%d timers: %.2f us each to schedule, %lu ms late on average, %lu ms at most",
+            m_count, g_traffic_stats.to_us(m_schedule_cycles) / m_count,
+            m_total_late / m_count, m_max_late);
+        m_client.client_print(buf);
+        trace_printf("timerbench: %s\n", buf);
+    }
+};
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 
 // An unknown/unverified/obsolete message type
@@ -180,7 +267,7 @@ MessageType Injection::m_message_types[NUM_MESSAGE_TYPES] =
     UMSG(0x02),
     SMSG("Attack", 0x05),
     SMSG("Double Click", 0x05),
-    SMSG("Pick Up Item", 0x07),
+    SMSGH("Pick Up Item", 0x07, handle_pick_up_item),
     SMSG("Drop Item", 0x0e), // 0x08
     SMSG("Single Click", 0x05),
     UMSG(0x0b),
@@ -212,7 +299,7 @@ MessageType Injection::m_message_types[NUM_MESSAGE_TYPES] =
     RMSGH("Open Container", 0x07, handle_open_container),  // 0x24
     RMSGH("Update Contained Item", 0x14, handle_update_contained_item), //0x25
     UMSG(0x05),
-    RMSG("Deny Move Item", 0x02),
+    RMSGH("Deny Move Item", 0x02, handle_deny_move_item),
     UMSG(0x05), // 0x28
     UMSG(0x01),
     UMSG(0x05),
@@ -349,7 +436,7 @@ MessageType Injection::m_message_types[NUM_MESSAGE_TYPES] =
     RMSG("Text Input Dialog", SIZE_VARIABLE),
     SMSG("Text Input Reply", SIZE_VARIABLE),
     SMSGH("Unicode Client Talk", SIZE_VARIABLE, handle_unicode_client_talk),
-    RMSG("Unicode Server Talk", SIZE_VARIABLE),
+    RMSGH("Unicode Server Talk", SIZE_VARIABLE, handle_unicode_server_talk),
     UMSG(0x0d),
     RMSGH("Open Dialog Gump", SIZE_VARIABLE, handle_open_gump), // 0xb0
     SMSG("Dialog Choice", SIZE_VARIABLE),
@@ -386,7 +473,9 @@ MessageType Injection::m_message_types[NUM_MESSAGE_TYPES] =
 
 #pragma warning( disable: 4355 )	// 'this' used in base member init
 Injection::Injection()
-: m_gui(*this, m_config), m_counter_manager(m_gui, m_character),
+: m_journal(m_events),
+  m_move_queue(*this, m_timers), m_auto_replies(*this, m_timers),
+  m_gui(*this, m_config), m_counter_manager(m_gui, m_character),
   m_hook(0),
   m_servers(0), m_server_id(-1), m_server(0),
   m_account(0),
@@ -398,12 +487,24 @@ Injection::Injection()
   m_targeting(false), m_client_targeting(false), m_last_target_set(false),
   m_target_handler(0),m_use_tab_dialog(0),m_use_target_handler(0),
   m_object_tab_dialog(0),m_object_target_handler(0),
-  m_receiving_container(0),  empty_speed(0), m_backpack(0), m_backpack_set(false),
+  m_receiving_container(0),  empty_speed(0),
+  m_empty_timer(*this, &Injection::empty_container_step),
+  m_live_stats_timer(*this, &Injection::publish_live_stats),
+  m_backpack(0), m_backpack_set(false),
   m_catchbag(0), m_catchbag_set(false), m_lastcaught(0)
 {
+    // Install() creates us on the client thread.
+    m_client_thread_id = GetCurrentThreadId();
+    m_in_idle = false;
+    {for(int i = 0; i < NUM_MESSAGE_TYPES; i++)
+        m_packet_lengths.set(i, m_message_types[i].size);}
     m_hook_set=new SocketHookSet(*this);
     m_spells = new Spells(*this, *m_targeting_handler);
     m_skills = new Skills(*this, *m_targeting_handler);
+#ifdef USE_BENCHMARKS
+    m_timer_bench = 0;
+#endif
+    build_command_index();
 }
 
 Injection::~Injection()
@@ -420,18 +521,23 @@ Injection::~Injection()
     delete m_servers;
     delete m_spells;
     delete m_skills;
+#ifdef USE_BENCHMARKS
+    delete m_timer_bench;
+#endif
     m_config.save();
     log_flush();    // DEBUG
 }
 
 // This function from Sniffy.cpp
-int Injection::init(unsigned int /*checksum*/, unsigned int /*length*/)
+int Injection::init(unsigned int checksum, unsigned int length)
 {
     if(!m_config.load("injection.xml"))
     {
         log_flush();
         return INJECTION_ERROR_CONFIG;
     }
+    // Without the file, messages newer than m_message_types are unknown.
+    m_packet_lengths.load("packets.cfg", checksum, length);
     m_hook_set->install();
     if(!m_gui.init())
     {
@@ -445,13 +551,6 @@ int Injection::init(unsigned int /*checksum*/, unsigned int /*length*/)
 
 //// Methods of HookCallbackInterface:
 
-int Injection::get_message_size(int code)
-{
-    if(code < 0 || code >= NUM_MESSAGE_TYPES)
-        return -1;
-    return m_message_types[code].size;
-}
-
 void Injection::disconnected(SocketHook * hook)
 {
     if(m_hook == hook)
@@ -468,6 +567,12 @@ void Injection::disconnected(SocketHook * hook)
         m_dress_handler = 0;
         m_counter_manager.disconnected();
         m_gui.disconnected();
+        m_events.set_active(EVENT_TARGET, false);
+        m_empty_items.clear();
+        m_empty_timer.cancel();
+        m_move_queue.clear();
+        m_auto_replies.clear();
+        m_world_feed.reset();
         delete m_world;
         m_world = 0;
         m_character = 0;
@@ -496,44 +601,93 @@ void Injection::handle_key(SocketHook * /*hook*/, uint8 key[4])
 
 bool Injection::handle_send_message(SocketHook * hook, uint8 * buf, int size)
 {
+    uint64 start = read_tsc();
+    uint8 code = *buf;
+    bool resend = true;
     m_hook = hook;
     trace_printf("-------------------- client --------------------\n");
-    if(*buf >= NUM_MESSAGE_TYPES)
+    if(code >= NUM_MESSAGE_TYPES)
     {
-        error_printf("Unknown message type: 0x%02x\n", *buf);
+        // Framed using packets.cfg, but there is nothing to handle it.
+        trace_printf("Message type: 0x%02x\n", code);
         trace_dump(buf, size);
     }
     else
     {
-        MessageType & type = m_message_types[*buf];
+        MessageType & type = m_message_types[code];
         trace_dump(buf, size);
         if(type.direction != DIR_SEND && type.direction != DIR_BOTH)
-            warning_printf("message direction invalid: 0x%02X\n", *buf);
+            warning_printf("message direction invalid: 0x%02X\n", code);
         else if(type.shandler != 0)
-            return (this ->* (type.shandler))(buf, size);
+            resend = (this ->* (type.shandler))(buf, size);
     }
-    return true;
+    g_traffic_stats.add_message(STATS_SEND, code, size, !resend,
+        read_tsc() - start);
+    return resend;
 }
 
 bool Injection::handle_receive_message(SocketHook * hook, uint8 * buf, int size)
 {
+    uint64 start = read_tsc();
+    uint8 code = *buf;
+    bool resend = true;
     m_hook = hook;
     trace_printf("-------------------- server --------------------\n");
-    if(*buf >= NUM_MESSAGE_TYPES)
+    if(code >= NUM_MESSAGE_TYPES)
     {
-        error_printf("Unknown message type: 0x%02x\n", *buf);
+        // Framed using packets.cfg, but there is nothing to handle it.
+        trace_printf("Message type: 0x%02x\n", code);
         trace_dump(buf, size);
     }
     else
     {
-        MessageType & type = m_message_types[*buf];
+        MessageType & type = m_message_types[code];
         trace_dump(buf, size);
         if(type.direction != DIR_RECV && type.direction != DIR_BOTH)
-            warning_printf("message direction invalid: 0x%02X\n", *buf);
+            warning_printf("message direction invalid: 0x%02X\n", code);
         else if(type.rhandler != 0)
-            return (this ->* (type.rhandler))(buf, size);
+            resend = (this ->* (type.rhandler))(buf, size);
+    }
+    g_traffic_stats.add_message(STATS_RECV, code, size, !resend,
+        read_tsc() - start);
+    return resend;
+}
+
+void Injection::idle()
+{
+    // A command or timer may get here again, e.g. through a DLL that calls
+    // DoCommand, or a message box that dispatches our wake-up message. The
+    // outer call runs whatever they queue, after the commands before it.
+    if(m_in_idle)
+        return;
+    m_in_idle = true;
+    run_queued_commands();
+    m_timers.run();
+    run_queued_commands();
+    m_world_feed.flush(m_world);
+    m_config.poll_save();
+    m_in_idle = false;
+}
+
+// private
+void Injection::run_queued_commands()
+{
+    QueuedCommand * cmd;
+    while((cmd = m_command_queue.take_all()) != 0)
+    {
+        while(cmd != 0)
+        {
+            QueuedCommand * next = cmd->m_next;
+            if(cmd->m_command != -1)
+                run_command(cmd->m_command, cmd->m_args);
+            else if(cmd->m_args.size() > 0)
+                do_command(cmd->m_args[0].c_str());
+            if(cmd->m_future != 0)
+                cmd->m_future->set();
+            delete cmd;     // releases the future
+            cmd = next;
+        }
     }
-    return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -645,6 +799,7 @@ bool Injection::handle_update_item(uint8 * buf, int size)
     obj->set_y(buf + 11);
     obj->set_z(buf + 12);
     obj->set_graphic(buf + 7);
+    m_world->changed(obj, CHANGE_POSITION | CHANGE_APPEARANCE);
 
     return true;
 }
@@ -665,6 +820,7 @@ bool Injection::handle_enter_world(uint8 * buf, int /*size*/)
     {
         ASSERT(m_vendor_handler == 0);
         m_world = new World(serial);
+        m_world->set_feed(&m_world_feed);
         m_counter_manager.connected();
         m_gui.connected(m_character);
         m_vendor_handler = new VendorHandler(m_config, *this, *m_world, *m_server);
@@ -685,6 +841,7 @@ bool Injection::handle_enter_world(uint8 * buf, int /*size*/)
     player->set_z(buf + 16);
     player->set_direction(buf + 17);
     //player->set_flags(buf + 28);
+    m_world->changed(player, CHANGE_POSITION | CHANGE_APPEARANCE);
     trace_printf("Player 0x%08lX entered the world.\n", serial);
 
     delete m_dress_handler;
@@ -710,6 +867,8 @@ bool Injection::handle_delete_object(uint8 * buf, int /*size*/)
     if(m_world != 0)
     {
         uint32 serial = unpack_big_uint32(buf + 1);
+        // A move that merges into a stack ends with the item deleted.
+        m_move_queue.confirmed(serial);
         GameObject * obj = m_world->find_object(serial);
         if(obj != 0)
             m_world->remove_object(obj);
@@ -744,6 +903,7 @@ bool Injection::handle_update_player(uint8 * buf, int /*size*/)
     player->set_y(buf + 13);
     player->set_direction(buf + 17);
     player->set_z(buf + 18);
+    m_world->changed(player, CHANGE_POSITION | CHANGE_APPEARANCE);
     return true;
 }
 
@@ -766,23 +926,41 @@ bool Injection::handle_update_contained_item(uint8 * buf, int /*size*/)
     obj->set_x(buf + 10);
     obj->set_y(buf + 12);
     obj->set_colour(buf + 18);
+    m_world->changed(obj,
+        CHANGE_QUANTITY | CHANGE_POSITION | CHANGE_APPEARANCE);
+    m_move_queue.confirmed(obj->get_serial());
+    m_events.signal(EVENT_CONTAINER_ITEM, cserial);
     // handle catchbag
     if((m_catchbag_set) && (cserial == m_backpack)){
         if(obj->get_serial() != m_lastcaught)
         {
             m_lastcaught = obj->get_serial();
-            move_container(obj->get_serial(), obj->get_quantity(), m_catchbag);
+            move_container(obj->get_serial(), obj->get_quantity(), m_catchbag,
+                MOVE_BULK);
         }
     }
     return true;
 }
 
+bool Injection::handle_pick_up_item(uint8 * /*buf*/, int /*size*/)
+{
+    m_move_queue.client_lifted();
+    return true;
+}
+
+bool Injection::handle_deny_move_item(uint8 * /*buf*/, int /*size*/)
+{
+    // The client did not pick anything up if the last lift was ours.
+    return !m_move_queue.rejected();
+}
+
 bool Injection::handle_server_equip_item(uint8 * buf, int /*size*/)
 {
     if(m_world == 0)
         return true;
     uint32 cserial = unpack_big_uint32(buf + 9);
     int layer = buf[8];
+    m_move_queue.confirmed(unpack_big_uint32(buf + 1));
     // We are only interested in what the current player is wearing,
     // and any containers used for buying/selling.
     if(layer == LAYER_VENDOR_BUY_RESTOCK || layer == LAYER_VENDOR_BUY ||
@@ -793,6 +971,7 @@ bool Injection::handle_server_equip_item(uint8 * buf, int /*size*/)
         m_counter_manager.set_object_graphic(obj, buf + 5);
         obj->set_colour(buf + 13);
         m_world->put_equipment(obj, cserial, layer);
+        m_world->changed(obj, CHANGE_APPEARANCE);
     }
     return true;
 }
@@ -887,7 +1066,10 @@ bool Injection::handle_target_s(uint8 * buf, int /*size*/)
         return false;
     }
     else if(m_client_targeting)
+    {
         m_client_targeting = false;
+        m_events.set_active(EVENT_TARGET, false);
+    }
     return true;
 }
 
@@ -896,13 +1078,21 @@ bool Injection::handle_target_r(uint8 * buf, int size)
     // If the server sends a target request, cancel our internal targeting.
     if(m_targeting)
         got_target(0);
+    if(m_auto_replies.handle_target(buf, size))
+        return false;
     m_client_targeting = true;
     // Remember the parameters in case we need to cancel it.
     memcpy(m_cancel_target, buf, sizeof(m_cancel_target));
     pack_big_uint32(buf + 7, 0);    // serial
     pack_big_uint16(buf + 11, 0xffff);    // x
     pack_big_uint16(buf + 13, 0xffff);    // y
-    return m_targeting_handler->handle_target(buf, size);
+    bool resend = m_targeting_handler->handle_target(buf, size);
+    if(resend)  // the client shows the cursor
+    {
+        m_events.set_active(EVENT_TARGET, true);
+        m_events.signal(EVENT_TARGET);
+    }
+    return resend;
 }
 
 bool Injection::handle_vendor_buy_list(uint8 * buf, int size)
@@ -938,6 +1128,8 @@ bool Injection::handle_update_contained_items(uint8 * buf, int size)
         obj->set_x(ptr + 9);
         obj->set_y(ptr + 11);
         obj->set_colour(ptr + 17);
+        m_world->changed(obj,
+            CHANGE_QUANTITY | CHANGE_POSITION | CHANGE_APPEARANCE);
         ptr += 19;
     }
     if(size != ptr - buf)
@@ -985,6 +1177,8 @@ bool Injection::handle_update_object(uint8 * buf, int size)
     //obj->set_flags(ptr);
     ptr++;
     obj->set_notoriety(ptr++);
+    m_world->changed(obj, CHANGE_POSITION | CHANGE_APPEARANCE |
+        ((serial & 0x80000000) ? CHANGE_QUANTITY : 0));
     serial = unpack_big_uint32(ptr);
     ptr += 4;
     while(serial != 0)
@@ -1000,6 +1194,7 @@ bool Injection::handle_update_object(uint8 * buf, int size)
             ptr += 2;
         }
         m_world->put_equipment(obj2, obj, layer);
+        m_world->changed(obj2, CHANGE_APPEARANCE);
         serial = unpack_big_uint32(ptr);
         ptr += 4;
     }
@@ -1010,6 +1205,9 @@ bool Injection::handle_update_object(uint8 * buf, int size)
 
 bool Injection::handle_open_menu_gump(uint8 * buf, int size)
 {
+    m_events.signal(EVENT_MENU);
+    if(m_auto_replies.handle_menu(buf, size))
+        return false;
     if(m_menu_handler != 0)
         return m_menu_handler->handle_open_menu_gump(buf, size);
     return true;
@@ -1083,6 +1281,9 @@ bool Injection::handle_relay_server(uint8 * /*buf*/, int /*size*/)
             if(!ConfigManager::valid_key(server_name))
                 warning_printf("server name has strange characters.\n");
             m_server = m_config.get(server_name);
+            m_move_queue.set_delay(m_server->get_move_delay());
+            if(m_server->get_live_stats())
+                start_live_stats();
         }
     }
     return true;
@@ -1291,8 +1492,27 @@ bool Injection::handle_unicode_client_talk(uint8 * buf, int size)
     return resend;
 }
 
+// Called for each line of text from the server.
+void Injection::add_journal_line(const char * text)
+{
+    m_journal.add_line(text);
+    m_events.signal(EVENT_JOURNAL, 0, text);
+}
+
 bool Injection::handle_server_talk(uint8 * buf, int size)
 {
+    // The text may not be terminated within the message.
+    char text[EVENT_TEXT_SIZE];
+    int length = size - 44;
+    if(length > EVENT_TEXT_SIZE - 1)
+        length = EVENT_TEXT_SIZE - 1;
+    if(length > 0)
+    {
+        memcpy(text, buf + 44, length);
+        text[length] = '\0';
+        add_journal_line(text);
+    }
+
     if(m_targeting_handler)
     {
         bool resend = m_targeting_handler->handle_server_talk(buf, size);
@@ -1303,8 +1523,33 @@ bool Injection::handle_server_talk(uint8 * buf, int size)
     return false;
 }
 
+bool Injection::handle_unicode_server_talk(uint8 * buf, int size)
+{
+    // The text is big endian Unicode from offset 48. Characters outside
+    // Latin-1 become '?', as for commands in handle_unicode_client_talk.
+    char text[EVENT_TEXT_SIZE];
+    int length = (size - 48) / 2;
+    if(length > EVENT_TEXT_SIZE - 1)
+        length = EVENT_TEXT_SIZE - 1;
+    int i = 0;
+    for(; i < length; i++)
+    {
+        uint16 uc = unpack_big_uint16(buf + 48 + i * 2);
+        if(uc == 0)
+            break;
+        text[i] = uc < 0x100 ? char(uc) : '?';
+    }
+    text[i] = '\0';
+    if(i > 0)
+        add_journal_line(text);
+    return true;
+}
+
 bool Injection::handle_open_gump(uint8 * buf, int size)
 {
+    m_events.signal(EVENT_GUMP, unpack_big_uint32(buf + 7));    // gump id
+    if(m_auto_replies.handle_gump(buf, size))
+        return false;
 //  return true;
     return m_runebook_handler->handle_runebook(buf, size);
 }
@@ -1374,44 +1619,125 @@ Command Injection::m_commands[] =
     COMMAND(useskill),
     COMMAND(poison),
     COMMAND(fixhotkeys),
+    COMMAND(stats),
+    COMMAND(delay),
+    COMMAND(movequeue),
+    COMMAND(autoreply),
+    COMMAND(journal),
+    COMMAND(livestats),
+    COMMAND(worldfeed),
+#ifdef USE_BENCHMARKS
+    COMMAND(commandbench),
+    COMMAND(timerbench),
+    COMMAND(vendorbench),
+    COMMAND(journalbench),
+    COMMAND(feedbench),
+    COMMAND(framecheck),
+    COMMAND(fragmentcheck),
+    COMMAND(decodebench),
+#endif
 };
 
-// This function is based on stringtok() from the libstdc++ documentation:
-void commandtok (arglist_t & args, string const & in)
+// Must be a power of two, and at least twice the number of commands.
+const int COMMAND_INDEX_SIZE = 256;
+
+// private static
+int Injection::m_command_index[COMMAND_INDEX_SIZE];
+
+static uint32 hash_command_name(const char * name, int length)
 {
-    const string::size_type len = in.length();
-          string::size_type i = 0;
+    uint32 h = 0;
+    for(int i = 0; i < length; i++)
+        h = (5 * h) + uint8(name[i]);
+    return h;
+}
 
-    while(i < len)
+// private static
+void Injection::build_command_index()
+{
+    const int num_commands = sizeof(m_commands) / sizeof(m_commands[0]);
+    ASSERT(num_commands * 2 <= COMMAND_INDEX_SIZE);
+    {for(int i = 0; i < COMMAND_INDEX_SIZE; i++)
+        m_command_index[i] = -1;}
+    for(int i = 0; i < num_commands; i++)
     {
-        // eat leading whitespace
-        i = in.find_first_not_of (' ', i);
-        if(i == string::npos)
-            return;   // nothing left but white space
+        const char * name = m_commands[i].name;
+        uint32 slot = hash_command_name(name, strlen(name));
+        while(m_command_index[slot & (COMMAND_INDEX_SIZE - 1)] != -1)
+            slot++;
+        m_command_index[slot & (COMMAND_INDEX_SIZE - 1)] = i;
+    }
+}
+
+// static
+int Injection::find_command(const char * name, int length)
+{
+    uint32 slot = hash_command_name(name, length);
+    for(;;)
+    {
+        int i = m_command_index[slot & (COMMAND_INDEX_SIZE - 1)];
+        if(i == -1)
+            return -1;
+        const char * command_name = m_commands[i].name;
+        if(strncmp(command_name, name, length) == 0 &&
+                command_name[length] == '\0')
+            return i;
+        slot++;
+    }
+}
+
+// This function is based on stringtok() from the libstdc++ documentation.
+int split_command(const char * cmd, CommandWord * words, int max_words)
+{
+    int num_words = 0;
+    const char * p = cmd;
 
-        // find the end of the token
-        string::size_type j;
-        if(in[i] == '\'')
+    while(*p != '\0')
+    {
+        // eat leading whitespace
+        while(*p == ' ')
+            p++;
+        if(*p == '\0')
+            break;      // nothing left but white space
+
+        // find the end of the word
+        const char * end;
+        if(*p == '\'')
         {
-            i++;
-            if(i == len)
-                return;
-            j = in.find_first_of('\'', i);
+            p++;
+            if(*p == '\0')
+                break;
+            end = strchr(p, '\'');
         }
         else
-            j = in.find_first_of(' ', i);
+            end = strchr(p, ' ');
+        if(end == 0)
+            end = p + strlen(p);
 
-        // push token
-        if(j == string::npos)
+        if(num_words < max_words)
         {
-            args.push_back(in.substr(i));
-            return;
+            words[num_words].m_text = p;
+            words[num_words].m_length = end - p;
         }
-        else
-            args.push_back(in.substr(i, j - i));
+        num_words++;
 
         // set up for next loop
-        i = j + 1;
+        if(*end == '\0')
+            break;
+        p = end + 1;
+    }
+    return num_words;
+}
+
+CommandWords::CommandWords(const char * cmd)
+{
+    m_words = m_fixed;
+    m_count = split_command(cmd, m_fixed, MAX_COMMAND_WORDS);
+    if(m_count > MAX_COMMAND_WORDS)
+    {
+        m_more.resize(m_count);
+        m_words = &m_more[0];
+        split_command(cmd, m_words, m_count);
     }
 }
 
@@ -1419,28 +1745,100 @@ void Injection::do_command(const char * cmd)
 {
     if(m_world == 0)
         return;
-    arglist_t words;
-    // Split the command into words
-    commandtok(words, cmd);
-    if(words.size() == 0)
+    CommandWords words(cmd);
+    int num_words = words.size();
+    if(num_words == 0)
     {
         client_print("Error: empty command");
         return;
     }
-    const string & cmdname = words[0];
+    int command = find_command(words[0].m_text, words[0].m_length);
+    if(command == -1)
+    {
+        // Only copy the words of commands that are run here.
+        if(!HandleCommandInDll(cmd))
+            client_print("Unknown command: " +
+                string(words[0].m_text, words[0].m_length));
+        return;
+    }
 
-    for(arglist_t::size_type i = 0; i < words.size(); i++)
-        trace_printf("words[%u]: %s\n", i, words[i].c_str());
-    // Search for the command in the table.
-    // TODO: use a hash_map<> to avoid linear search?
-    {for(unsigned i = 0; i < sizeof(m_commands) / sizeof(m_commands[0]); i++)
-        if(cmdname == m_commands[i].name)
-        {
-            (this ->* (m_commands[i].handler))(words);
-            return;
-    }}
-    if(!HandleCommandInDll(cmd))
-        client_print(string("Unknown command: ") + cmdname);
+    arglist_t args;
+    for(int i = 0; i < num_words; i++)
+    {
+        args.push_back(string(words[i].m_text, words[i].m_length));
+        trace_printf("words[%d]: %s\n", i, args[i].c_str());
+    }
+    run_command(command, args);
+}
+
+bool Injection::bind_command(const char * cmd, BoundCommand & bound)
+{
+    CommandWords words(cmd);
+    int num_words = words.size();
+    bound.m_text = cmd;
+    bound.m_args.clear();
+    if(num_words == 0)
+    {
+        bound.m_command = -1;
+        return false;
+    }
+    bound.m_command = find_command(words[0].m_text, words[0].m_length);
+    for(int i = 0; i < num_words; i++)
+        bound.m_args.push_back(string(words[i].m_text, words[i].m_length));
+    return true;
+}
+
+void Injection::run_command(const BoundCommand & bound)
+{
+    if(m_world == 0)
+        return;
+    if(bound.m_command == -1)
+    {
+        if(bound.m_args.size() == 0)
+            client_print("Error: empty command");
+        else if(!HandleCommandInDll(bound.m_text.c_str()))
+            client_print("Unknown command: " + bound.m_args[0]);
+        return;
+    }
+    run_command(bound.m_command, bound.m_args);
+}
+
+void Injection::run_command(int command, const arglist_t & args)
+{
+    if(m_world == 0)
+        return;
+    ASSERT(command >= 0 &&
+        command < int(sizeof(m_commands) / sizeof(m_commands[0])));
+    (this ->* (m_commands[command].handler))(args);
+    // Most commands don't change the configuration, but autosave
+    // finds out cheaply if nothing changed.
+    m_config.request_save();
+}
+
+void Injection::queue_command(int command, const arglist_t & args,
+    CommandFuture * future)
+{
+    // Whatever the command causes must not be missed by a wait after it.
+    m_events.mark();
+    QueuedCommand * cmd = new QueuedCommand(command, future);
+    cmd->m_args = args;
+    bool was_empty = m_command_queue.push(cmd);
+    // Keep the order when the client thread itself queues a command. If
+    // idle() is running the queue already, it takes this one in turn.
+    if(GetCurrentThreadId() == m_client_thread_id)
+        idle();
+    // The client only calls select() while it is connected, so wake it up
+    // through its window as well. Once the queue is not empty, the first
+    // command has already done that.
+    else if(was_empty)
+        m_gui.wake_idle();
+}
+
+void Injection::queue_command_line(const char * cmd, CommandFuture * future)
+{
+    arglist_t args;
+    args.push_back(cmd);
+    queue_command(-1, args, future);
 }
 
 void Injection::command_fixwalk(const arglist_t & /*args*/)
@@ -1558,7 +1956,7 @@ void Injection::use(const string & name)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             client_print("Graphic name unknown");
@@ -1597,7 +1995,7 @@ void Injection::use(const string & name, const string & color)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             client_print("Graphic name unknown");
@@ -1652,7 +2050,7 @@ void Injection::useground(const string & name)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             client_print("Graphic name unknown");
@@ -1691,7 +2089,7 @@ void Injection::useground(const string & name, const string & color)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             client_print("Graphic name unknown");
@@ -1903,7 +2301,7 @@ void Injection::targettype(const string & name)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             client_print("Graphic name unknown");
@@ -1942,7 +2340,7 @@ void Injection::targettype(const string & name, const string & color)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             client_print("Graphic name unknown");
@@ -1997,7 +2395,7 @@ void Injection::targetgroundtype(const string & name)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             client_print("Graphic name unknown");
@@ -2036,7 +2434,7 @@ void Injection::targetgroundtype(const string & name, const string & color)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             client_print("Graphic name unknown");
@@ -2191,7 +2589,7 @@ void Injection::targetobjecttype(const string & name, const string & name2)
     else
     {
         if(m_config.use_exists(name2))
-            graphic = m_config.find_use(name2);
+            graphic = m_config.get_use(name2);
         else
         {
             client_print("Graphic name unknown");
@@ -2248,7 +2646,7 @@ void Injection::targetobjecttype(const string & name, const string & name2, cons
     else
     {
         if(m_config.use_exists(name2))
-            graphic = m_config.find_use(name2);
+            graphic = m_config.get_use(name2);
         else
         {
             client_print("Graphic name unknown");
@@ -2876,16 +3274,43 @@ void Injection::target_emptycontainer(GameObject * obj)
         // find our from container
         GameObject * from_obj = m_world->find_object(obj->get_serial());
 
+        // With a pause the moves are spread out by a timer, rather than
+        // sleeping on the client thread between them. They queue up behind
+        // those of an earlier emptycontainer that is still going.
         for(GameObject::iterator i = from_obj->begin(); i != from_obj->end(); ++i)
         {
             uint32 item = i->get_serial();
-            uint16 quantity = i->get_quantity();
-            if(quantity == 0) quantity = 1;
-            if(item != to_container) move_container(item, quantity, to_container);
-            if(empty_speed >0)
-                Sleep(empty_speed);
+            if(item == to_container)
+                continue;
+            if(empty_speed <= 0)
+                move_container(item, i->get_quantity() == 0 ? 1 :
+                    i->get_quantity(), to_container, MOVE_BULK);
+            else
+                m_empty_items.push_back(EmptyMove(item, to_container,
+                    empty_speed));
         }
+        if(!m_empty_timer.is_scheduled())
+            empty_container_step();
+    }
+}
 
+// private
+void Injection::empty_container_step()
+{
+    while(!m_empty_items.empty())
+    {
+        EmptyMove move = m_empty_items.front();
+        m_empty_items.pop_front();
+        GameObject * item = m_world == 0 ? 0 :
+            m_world->find_object(move.m_item);
+        if(item == 0)
+            continue;   // gone in the meantime
+        uint16 quantity = item->get_quantity();
+        if(quantity == 0) quantity = 1;
+        move_container(move.m_item, quantity, move.m_to, MOVE_BULK);
+        if(!m_empty_items.empty())
+            m_timers.schedule(&m_empty_timer, move.m_pause);
+        return;
     }
 }
 
@@ -3384,7 +3809,7 @@ void Injection::command_poison(const arglist_t & args)
         // find a poison to use
         uint16 graphic;
         if(m_config.use_exists("poison"))
-            graphic = m_config.find_use("poison");
+            graphic = m_config.get_use("poison");
         else
         {
             client_print("poison not defined in object types");
@@ -3426,6 +3851,498 @@ void Injection::command_fixhotkeys(const arglist_t & args)
     }
 }
 
+// Shows which messages take the most bandwidth and handler time, or
+// writes all of the counters to a file.
+void Injection::command_stats(const arglist_t & args)
+{
+    if(args.size() == 2 && args[1] == "reset")
+    {
+        g_traffic_stats.reset();
+        client_print("Traffic statistics reset");
+        return;
+    }
+    if(args.size() >= 2 && args[1] == "dump")
+    {
+        const char * filename = args.size() >= 3 ? args[2].c_str() :
+            "injection_stats.txt";
+        const char * names[256];
+        {for(int i = 0; i < 256; i++)
+            names[i] = i < NUM_MESSAGE_TYPES ? m_message_types[i].name : 0;}
+        FILE * fp = fopen(filename, "wt");
+        bool ok = fp != NULL && g_traffic_stats.write(fp, names);
+        if(fp != NULL && fclose(fp) != 0)
+            ok = false;
+        client_print(ok ? string("Traffic statistics written to ") + filename :
+            string("Cannot write ") + filename);
+        return;
+    }
+    if(args.size() != 1)
+    {
+        client_print("Usage: stats [reset | dump [filename]]");
+        return;
+    }
+
+    char buf[200];
+    sprintf(buf, "Traffic in the last %.0f seconds:", g_traffic_stats.get_seconds());
+    client_print(buf);
+    {for(int i = 0; i < NUM_STATS_STAGES; i++)
+    {
+        const StageStats & st = g_traffic_stats.get_stage(stats_stage_t(i));
+        sprintf(buf, "%s: %lu calls, %.0f KB, %.1f ms",
+            TrafficStats::get_stage_name(stats_stage_t(i)), st.m_calls,
+            double(sint64(st.m_bytes)) / 1024,
+            g_traffic_stats.to_us(st.m_cycles) / 1000);
+        client_print(buf);
+    }}
+    const int NUM_TOP = 5;
+    for(int dir = 0; dir < NUM_STATS_DIRS; dir++)
+    {
+        int codes[NUM_TOP];
+        int n = g_traffic_stats.get_top(stats_dir_t(dir), codes, NUM_TOP);
+        for(int i = 0; i < n; i++)
+        {
+            const OpcodeStats & op =
+                g_traffic_stats.get_opcode(stats_dir_t(dir), codes[i]);
+            sprintf(buf, "%s 0x%02x %s: %lu msgs (%lu dropped), %.0f KB, %.1f us avg",
+                dir == STATS_SEND ? "send" : "recv", codes[i],
+                codes[i] < NUM_MESSAGE_TYPES ? m_message_types[codes[i]].name : "?",
+                op.m_messages, op.m_suppressed,
+                double(sint64(op.m_bytes)) / 1024,
+                g_traffic_stats.to_us(op.m_cycles) / op.m_messages);
+            client_print(buf);
+        }
+    }
+}
+
+// Runs a command after a pause, without blocking anything meanwhile.
+void Injection::command_delay(const arglist_t & args)
+{
+    int delay;
+    if(args.size() < 3 || !string_to_int(args[1].c_str(), delay) || delay < 0)
+    {
+        client_print("Usage: delay (milliseconds) (command)");
+        return;
+    }
+    string cmd(args[2]);
+    {for(arglist_t::size_type i = 3; i < args.size(); i++)
+        cmd += " " + args[i];}
+    m_timers.schedule(new DelayedCommand(*this, cmd), delay);
+}
+
+// Shows how item moves are paced, or changes the pace for this server.
+void Injection::command_movequeue(const arglist_t & args)
+{
+    if(args.size() == 2 && args[1] == "clear")
+    {
+        m_move_queue.clear();
+        client_print("Move queue cleared");
+        return;
+    }
+    if(args.size() == 2 && args[1] == "reset")
+    {
+        m_move_queue.reset_stats();
+        client_print("Move statistics reset");
+        return;
+    }
+    int delay;
+    if(args.size() == 3 && args[1] == "delay" &&
+        string_to_int(args[2].c_str(), delay) && delay >= 0)
+    {
+        m_move_queue.set_delay(delay);
+        if(m_server != 0)
+            m_server->set_move_delay(delay);
+        return;
+    }
+    if(args.size() != 1)
+    {
+        client_print("Usage: movequeue [clear | reset | delay (milliseconds)]");
+        return;
+    }
+
+    const MoveStats & st = m_move_queue.get_stats();
+    char buf[200];
+    sprintf(buf, "Moves: %d waiting (at most %d), %lu ms apart",
+        m_move_queue.get_depth(), st.m_max_depth, m_move_queue.get_delay());
+    client_print(buf);
+    sprintf(buf, "%lu sent, %lu confirmed, %lu refused, %lu retried, %lu failed, %lu timed out",
+        st.m_sent, st.m_confirmed, st.m_rejected, st.m_retried, st.m_failed,
+        st.m_timeouts);
+    client_print(buf);
+    sprintf(buf, "Waited %lu ms avg (%lu max), answered in %lu ms avg (%lu max)",
+        st.m_wait.get_average(), st.m_wait.m_max,
+        st.m_answer.get_average(), st.m_answer.m_max);
+    client_print(buf);
+}
+
+// Queues answers for the next targets, menus and gumps, in order.
+void Injection::command_autoreply(const arglist_t & args)
+{
+    const char * usage =
+        "Usage: autoreply [clear | reset | target (object | self | last) | "
+        "menu (prompt) (choice) | gump (gump id) (button id)] [timeout]";
+    if(args.size() == 2 && args[1] == "clear")
+    {
+        m_auto_replies.clear();
+        client_print("Auto replies cleared");
+        return;
+    }
+    if(args.size() == 2 && args[1] == "reset")
+    {
+        m_auto_replies.reset_stats();
+        client_print("Auto reply statistics reset");
+        return;
+    }
+    if(args.size() == 1)
+    {
+        char buf[200];
+        sprintf(buf, "%d auto replies queued", m_auto_replies.size());
+        client_print(buf);
+        {for(int i = 0; i < m_auto_replies.size(); i++)
+        {
+            const AutoReply & reply = m_auto_replies.get(i);
+            if(reply.m_kind == REPLY_TARGET)
+                sprintf(buf, "%d: target 0x%08lx", i + 1, reply.m_serial);
+            else if(reply.m_kind == REPLY_MENU)
+                sprintf(buf, "%d: menu '%.80s' '%.80s'", i + 1,
+                    reply.m_prompt.get_pattern().c_str(),
+                    reply.m_choice.get_pattern().c_str());
+            else
+                sprintf(buf, "%d: gump 0x%08lx button %lu", i + 1,
+                    reply.m_gump_id, reply.m_button);
+            client_print(buf);
+        }}
+        {for(int i = 0; i < NUM_REPLY_KINDS; i++)
+        {
+            const AutoReplyStats & st =
+                m_auto_replies.get_stats(auto_reply_t(i));
+            if(st.m_replies == 0 && st.m_timeouts == 0)
+                continue;
+            sprintf(buf, "%s: %lu answered, %lu timed out, waited %lu ms avg "
+                "(%lu max), answered in %.1f us avg (%.1f max)",
+                AutoReplyQueue::get_kind_name(auto_reply_t(i)),
+                st.m_replies, st.m_timeouts,
+                st.m_replies == 0 ? 0 : st.m_wait_total / st.m_replies,
+                st.m_wait_max,
+                st.m_replies == 0 ? 0 :
+                    g_traffic_stats.to_us(st.m_handler_cycles) / st.m_replies,
+                g_traffic_stats.to_us(st.m_handler_max));
+            client_print(buf);
+        }}
+        return;
+    }
+
+    // The arguments after the kind, and an optional timeout after those:
+    int needed = args[1] == "target" ? 1 :
+        (args[1] == "menu" || args[1] == "gump") ? 2 : -1;
+    int timeout = AUTO_REPLY_TIMEOUT;
+    if(needed < 0 || int(args.size()) < needed + 2 ||
+        int(args.size()) > needed + 3 ||
+        (int(args.size()) == needed + 3 &&
+            (!string_to_int(args[needed + 2].c_str(), timeout) || timeout < 0)))
+    {
+        client_print(usage);
+        return;
+    }
+
+    if(args[1] == "target")
+    {
+        AutoReply reply(REPLY_TARGET, timeout);
+        const string & name = args[2];
+        if(name == "self" && m_world != 0)
+            reply.m_serial = m_world->get_player()->get_serial();
+        else if(name == "last" && m_last_target_set)
+            reply.m_serial = m_last_target;
+        else if(name.length() > 2 && name[0] == '0' && name[1] == 'x')
+        {
+            if(!string_to_serial(name.c_str(), reply.m_serial))
+            {
+                client_print("Invalid serial index");
+                return;
+            }
+        }
+        else if(m_character != 0 && m_character->obj_exists(name))
+            reply.m_serial = m_character->find_obj(name);
+        else
+        {
+            client_print("Object name unknown");
+            return;
+        }
+        m_auto_replies.push(reply);
+    }
+    else if(args[1] == "menu")
+    {
+        AutoReply reply(REPLY_MENU, timeout);
+        reply.m_prompt.set(args[2]);
+        reply.m_choice.set(args[3]);
+        m_auto_replies.push(reply);
+    }
+    else
+    {
+        AutoReply reply(REPLY_GUMP, timeout);
+        int button;
+        if(!string_to_serial(args[2].c_str(), reply.m_gump_id) ||
+            !string_to_int(args[3].c_str(), button) || button < 0)
+        {
+            client_print(usage);
+            return;
+        }
+        reply.m_button = button;
+        m_auto_replies.push(reply);
+    }
+}
+
+// journal [clear | save [filename]]
+// Shows how many lines and patterns the journal has and how long matching
+// takes, or clears the journal, or writes the lines it keeps to a file for
+// journalbench.
+void Injection::command_journal(const arglist_t & args)
+{
+    if(args.size() == 2 && args[1] == "clear")
+    {
+        m_journal.clear();
+        client_print("Journal cleared");
+        return;
+    }
+    if(args.size() >= 2 && args.size() <= 3 && args[1] == "save")
+    {
+        const char * filename = args.size() == 3 ? args[2].c_str() :
+            "injection_journal.txt";
+        client_print(m_journal.save(filename) ?
+            string("Journal written to ") + filename :
+            string("Cannot write ") + filename);
+        return;
+    }
+    if(args.size() != 1)
+    {
+        client_print("Usage: journal [clear | save [filename]]");
+        return;
+    }
+
+    char buf[200];
+    sprintf(buf, "Journal: %lu lines, %d patterns, %d states, %.2f us per line",
+        m_journal.get_seq(), m_journal.get_num_patterns(),
+        m_journal.get_num_states(),
+        g_traffic_stats.to_us(m_journal.get_match_cycles()));
+    client_print(buf);
+}
+
+// How often the live stats are copied to shared memory, in ms:
+const int LIVE_STATS_INTERVAL = 100;
+
+// private
+void Injection::start_live_stats()
+{
+    if(m_shared_stats.open() && !m_live_stats_timer.is_scheduled())
+        publish_live_stats();
+}
+
+// private
+void Injection::stop_live_stats()
+{
+    m_live_stats_timer.cancel();
+    m_shared_stats.close();
+}
+
+// private
+void Injection::publish_live_stats()
+{
+    LiveStatsBlock * block = m_shared_stats.begin_update();
+    block->m_time = GetTickCount();
+    GameObject * player = m_world != 0 ? m_world->get_player() : 0;
+    block->m_in_world = player != 0;
+    block->m_player = player != 0 ? player->get_serial() : 0;
+    block->m_x = player != 0 ? player->get_x() : 0;
+    block->m_y = player != 0 ? player->get_y() : 0;
+    block->m_z = player != 0 ? player->get_z() : 0;
+    m_counter_manager.get_live_stats(*block);
+    {for(int dir = 0; dir < NUM_STATS_DIRS; dir++)
+        for(int code = 0; code < 256; code++)
+        {
+            const OpcodeStats & op =
+                g_traffic_stats.get_opcode(stats_dir_t(dir), code);
+            block->m_messages[dir][code] = op.m_messages;
+            block->m_bytes[dir][code] = uint32(op.m_bytes);
+            block->m_cycles[dir][code] = uint32(op.m_cycles);
+        }}
+    m_shared_stats.end_update();
+    m_timers.schedule(&m_live_stats_timer, LIVE_STATS_INTERVAL);
+}
+
+// livestats [on | off]
+// Starts or stops publishing stats for monitoring programs, and remembers
+// the choice for this server.
+void Injection::command_livestats(const arglist_t & args)
+{
+    if(args.size() == 2 && (args[1] == "on" || args[1] == "off"))
+    {
+        bool on = args[1] == "on";
+        if(m_server != 0)
+            m_server->set_live_stats(on);
+        if(on)
+            start_live_stats();
+        else
+            stop_live_stats();
+    }
+    else if(args.size() != 1)
+    {
+        client_print("Usage: livestats [on | off]");
+        return;
+    }
+    client_print(m_shared_stats.is_open() ?
+        "Live stats in " + m_shared_stats.get_filename() :
+        string("Live stats are off"));
+}
+
+// worldfeed
+// Shows how many subscribers the world change feed has and how much it has
+// merged and delivered.
+void Injection::command_worldfeed(const arglist_t & /*args*/)
+{
+    char buf[200];
+    sprintf(buf, "World feed: %d subscribers, %lu changes, %lu merged, %lu delivered, %d waiting",
+        m_world_feed.get_count(), m_world_feed.get_changes(),
+        m_world_feed.get_merged(), m_world_feed.get_delivered(),
+        m_world_feed.get_backlog());
+    client_print(buf);
+}
+
+#ifdef USE_BENCHMARKS
+
+// Measures how fast commands are looked up and split into words, without
+// running them.
+void Injection::command_commandbench(const arglist_t & args)
+{
+    int count;
+    if(args.size() < 3 || !string_to_int(args[1].c_str(), count) || count <= 0)
+    {
+        client_print("Usage: commandbench (count) (command)");
+        return;
+    }
+    string cmd(args[2]);
+    {for(arglist_t::size_type i = 3; i < args.size(); i++)
+        cmd += " " + args[i];}
+
+    int found = 0;
+    clock_t start = clock();
+    {for(int i = 0; i < count; i++)
+    {
+        CommandWords words(cmd.c_str());
+        if(words.size() > 0 &&
+                find_command(words[0].m_text, words[0].m_length) != -1)
+            found++;
+    }}
+    clock_t ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
+    if(ms == 0)
+        ms = 1;
+
+    char buf[200];
+    sprintf(buf, "%d commands in %ld ms: %ld per second (%s)", count,
+        long(ms), long(count * 1000.0 / ms),
+        found == 0 ? "not a built-in command" : "built-in command");
+    client_print(buf);
+    trace_printf("commandbench: %s\n", buf);
+}
+
+// Measures what timers cost to schedule and how late they run. How late
+// depends mostly on how often the client calls select().
+void Injection::command_timerbench(const arglist_t & args)
+{
+    int count, max_delay;
+    if(args.size() != 3 || !string_to_int(args[1].c_str(), count) ||
+            count <= 0 || !string_to_int(args[2].c_str(), max_delay) ||
+            max_delay < 0)
+    {
+        client_print("Usage: timerbench (count) (longest delay in ms)");
+        return;
+    }
+    delete m_timer_bench;
+    m_timer_bench = new TimerBench(*this, m_timers, count, max_delay);
+}
+
+// Measures how long vendor lists take to read and to match against a
+// shopping list.
+void Injection::command_vendorbench(const arglist_t & args)
+{
+    int items, list_items = 500;
+    if(args.size() < 2 || args.size() > 3 ||
+        !string_to_int(args[1].c_str(), items) || items <= 0 ||
+        items > 2000 || (args.size() == 3 &&
+            (!string_to_int(args[2].c_str(), list_items) || list_items < 0)))
+    {
+        client_print("Usage: vendorbench (vendor items, at most 2000) [shopping list items]");
+        return;
+    }
+    if(m_vendor_handler == 0)
+    {
+        client_print("vendorbench: not logged in");
+        return;
+    }
+    m_vendor_handler->benchmark(items, list_items);
+}
+
+void Injection::command_journalbench(const arglist_t & args)
+{
+    if(args.size() != 3)
+    {
+        client_print("Usage: journalbench (journal file) (pattern file)");
+        return;
+    }
+    Journal::benchmark(args[1].c_str(), args[2].c_str(), *this);
+}
+
+void Injection::command_feedbench(const arglist_t & args)
+{
+    int objects, changes;
+    if(args.size() != 3 || !string_to_int(args[1].c_str(), objects) ||
+        objects <= 0 || !string_to_int(args[2].c_str(), changes) ||
+        changes < 0)
+    {
+        client_print("Usage: feedbench (objects) (changes per flush)");
+        return;
+    }
+    WorldFeed::benchmark(objects, changes, *this);
+}
+
+void Injection::command_framecheck(const arglist_t & args)
+{
+    int messages = 2000;
+    if(args.size() > 2 || (args.size() == 2 &&
+        (!string_to_int(args[1].c_str(), messages) || messages <= 0)))
+    {
+        client_print("Usage: framecheck [messages]");
+        return;
+    }
+    SocketHook::check_framing(messages, *this);
+}
+
+void Injection::command_fragmentcheck(const arglist_t & args)
+{
+    int messages = 2000;
+    if(args.size() > 2 || (args.size() == 2 &&
+        (!string_to_int(args[1].c_str(), messages) || messages <= 0)))
+    {
+        client_print("Usage: fragmentcheck [messages]");
+        return;
+    }
+    SocketHook::check_fragments(messages, *this);
+}
+
+void Injection::command_decodebench(const arglist_t & args)
+{
+    int messages = 2000, read_size = 1460;
+    if(args.size() > 3 || (args.size() >= 2 &&
+        (!string_to_int(args[1].c_str(), messages) || messages <= 0)) ||
+        (args.size() == 3 && (!string_to_int(args[2].c_str(), read_size) ||
+            read_size <= 0 || read_size > RECV_BUF_SIZE)))
+    {
+        client_print("Usage: decodebench [messages] [read size]");
+        return;
+    }
+    SocketHook::benchmark_decode(messages, read_size, *this);
+}
+
+#endif
+
 bool Injection::get_use_target(UseTabDialog * dialog,
     use_target_handler_t handler)
 {
@@ -3478,7 +4395,7 @@ int Injection::count_object_type(const string & name)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             return -1;
@@ -3504,7 +4421,7 @@ int Injection::count_object_type(const string & name, const string & color)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             return -1;
@@ -3545,7 +4462,7 @@ int Injection::count_on_ground(const string & name)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             return -1;
@@ -3571,7 +4488,7 @@ int Injection::count_on_ground(const string & name, const string & color)
     else
     {
         if(m_config.use_exists(name))
-            graphic = m_config.find_use(name);
+            graphic = m_config.get_use(name);
         else
         {
             return -1;
@@ -3649,22 +4566,10 @@ void Injection::move_container(uint32 serial, uint32 cserial)
 }
 
 // Pick up stack of objects and drop it another container
-void Injection::move_container(uint32 serial, uint16 quantity, uint32 cserial)
+void Injection::move_container(uint32 serial, uint16 quantity, uint32 cserial,
+    move_priority_t priority)
 {
-    uint8 buf[7 + 14];
-
-    buf[0] = CODE_PICK_UP_ITEM;
-    pack_big_uint32(buf + 1, serial);
-    pack_big_uint16(buf + 5, quantity); // quantity to pick up
-
-    buf[7] = CODE_DROP_ITEM;
-    pack_big_uint32(buf + 8, serial);
-    pack_big_uint16(buf + 12, INVALID_XY);  // x
-    pack_big_uint16(buf + 14, INVALID_XY);  // y
-    buf[16] = 0;    // z
-    pack_big_uint32(buf + 17, cserial);
-
-    send_server(buf, sizeof(buf));
+    m_move_queue.push(QueuedMove(serial, quantity, cserial, -1), priority);
 }
 
 // move object quintity to player backpack
@@ -3682,21 +4587,11 @@ void Injection::move_backpack(uint32 serial)
 }
 
 
-void Injection::move_equip(uint32 serial, int layer)
+void Injection::move_equip(uint32 serial, int layer, move_priority_t priority)
 {
     ASSERT(m_world != 0);
-    uint8 buf[7 + 10];
-
-    buf[0] = CODE_PICK_UP_ITEM;
-    pack_big_uint32(buf + 1, serial);
-    pack_big_uint16(buf + 5, 1);    // quantity to pick up
-
-    buf[7] = CODE_CLIENT_EQUIP_ITEM;
-    pack_big_uint32(buf + 8, serial);
-    buf[12] = layer;
-    pack_big_uint32(buf + 13, m_world->get_player()->get_serial());
-
-    send_server(buf, sizeof(buf));
+    m_move_queue.push(QueuedMove(serial, 1,
+        m_world->get_player()->get_serial(), layer), priority);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -3727,6 +4622,7 @@ void Injection::send_target_request()
     {
         send_server(m_cancel_target, sizeof(m_cancel_target));
         m_client_targeting = false;
+        m_events.set_active(EVENT_TARGET, false);
     }
     uint8 buf[19];
     buf[0] = 0x6c;  // Target data
@@ -3769,8 +4665,10 @@ void Injection::dump_world()
 
 void Injection::save_config()
 {
-    m_config.save();
-    client_print("Configuration saved.");
+    if(m_config.save())
+        client_print("Configuration saved.");
+    else
+        client_print("Error: configuration not saved.");
 }
 
 void Injection::shop()
@@ -3782,6 +4680,8 @@ void Injection::shop()
 void Injection::update_display()
 {
     m_counter_manager.update();
+    // The display flags are part of the configuration.
+    m_config.request_save();
 }
 
 string Injection::get_version()
@@ -39,8 +39,17 @@
 #include "runebook.h"
 #include "spells.h"
 #include "skills.h"
+#include "cmdqueue.h"
+#include "events.h"
+#include "timers.h"
+#include "movequeue.h"
+#include "autoreply.h"
+#include "journal.h"
+#include "sharedstats.h"
+#include "worldfeed.h"
 
 #include <deque>
+#include <vector>
 
 const int SIZE_VARIABLE = 0;
 const int USE_DISTANCE  = 3;
@@ -64,8 +73,6 @@ public:
     msg_handler_t shandler, rhandler;
 };
 
-typedef std::deque<string> arglist_t;
-
 typedef void (Injection::*cmd_handler_t)(const arglist_t & args);
 typedef void (Injection::*target_handler_t)(GameObject * obj);
 
@@ -76,6 +83,54 @@ public:
     cmd_handler_t handler;
 };
 
+// A word of a command, pointing into the text of the command.
+class CommandWord
+{
+public:
+    const char * m_text;
+    int m_length;
+};
+
+const int MAX_COMMAND_WORDS = 64;
+
+// Splits a command into words without copying it. Words are separated by
+// spaces, or quoted with '. Returns the number of words in the command,
+// but only stores the first 'max_words'.
+int split_command(const char * cmd, CommandWord * words, int max_words);
+
+// The words of a command. Commands of up to MAX_COMMAND_WORDS words are
+// split into an array on the stack; longer ones are split again into one
+// on the heap, so that no word is lost.
+class CommandWords
+{
+private:
+    CommandWord m_fixed[MAX_COMMAND_WORDS];
+    std::vector<CommandWord> m_more;
+    CommandWord * m_words;
+    int m_count;
+
+public:
+    explicit CommandWords(const char * cmd);
+
+    int size() const { return m_count; }
+    const CommandWord & operator[](int index) const { return m_words[index]; }
+};
+
+// An item that emptycontainer still has to move. Each one keeps the
+// destination and pause of its own command, so that a second command does
+// not send the items of the first somewhere else.
+class EmptyMove
+{
+public:
+    uint32 m_item, m_to;
+    long m_pause;
+
+    EmptyMove(uint32 item, uint32 to, long pause)
+    : m_item(item), m_to(to), m_pause(pause)
+    {
+    }
+};
+
 const int NUM_MESSAGE_TYPES = 0xcd;
 const int NUM_COMMANDS = 20;
 
@@ -85,6 +140,9 @@ class World;
 class DressHandler;
 class MenuHandler;
 class VendorHandler;
+#ifdef USE_BENCHMARKS
+class TimerBench;
+#endif
 
 class SocketHook;
 class HotkeyHook;
@@ -106,10 +164,34 @@ class Injection : public HookCallbackInterface, public ClientInterface,
 private:
     static MessageType m_message_types[];
     static Command m_commands[];
+    // Open addressing hash table of indexes into m_commands:
+    static int m_command_index[];
+
+    static void build_command_index();
+    // Runs the queued commands until there are none left.
+    void run_queued_commands();
 
     Logger m_logger;
     ConfigManager m_config;
+    // Starts with the sizes in m_message_types:
+    PacketLengths m_packet_lengths;
     SocketHookSet *m_hook_set;
+    // Commands from script threads wait here for the client thread:
+    CommandQueue m_command_queue;
+    DWORD m_client_thread_id;
+    bool m_in_idle;     // idle() is running the queue
+    // What the message handlers saw, for scripts waiting on it:
+    EventBoard m_events;
+    // Recent server text and the patterns scripts look for in it:
+    Journal m_journal;
+    // Changes to m_world, for scripts and DLLs that keep their own view:
+    WorldFeed m_world_feed;
+    // Delayed work for commands, run from idle():
+    TimerWheel m_timers;
+    // Item moves, paced for the server:
+    MoveQueue m_move_queue;
+    // Queued answers for targets, menus and gumps:
+    AutoReplyQueue m_auto_replies;
     InjectionGUI m_gui;
     CounterManager m_counter_manager;
     SocketHook * m_hook;
@@ -153,6 +235,19 @@ private:
     // target container for transfer command 0 when unset and means use player's backpack
     uint32 m_receiving_container;
     long empty_speed;
+    // Items still to be moved by emptycontainer, one per timer step:
+    std::deque<EmptyMove> m_empty_items;
+    MemberTimer<Injection> m_empty_timer;
+    void empty_container_step();
+#ifdef USE_BENCHMARKS
+    TimerBench * m_timer_bench;     // for timerbench
+#endif
+    // Stats for monitoring programs, when the server has live_stats set:
+    SharedStats m_shared_stats;
+    MemberTimer<Injection> m_live_stats_timer;
+    void start_live_stats();
+    void stop_live_stats();
+    void publish_live_stats();
     uint32 m_backpack;
     bool m_backpack_set;
     uint32 m_catchbag;
@@ -162,6 +257,7 @@ private:
     // Message handlers:
     bool handle_walk_request(uint8 * buf, int size);
     bool handle_client_talk(uint8 * buf, int size);
+    bool handle_pick_up_item(uint8 * buf, int size);
     bool handle_character_status(uint8 * buf, int size);
     bool handle_update_hitpoints(uint8 * buf, int size);
     bool handle_update_mana(uint8 * buf, int size);
@@ -172,6 +268,7 @@ private:
     bool handle_update_player(uint8 * buf, int size);
     bool handle_open_container(uint8 * buf, int size);
     bool handle_update_contained_item(uint8 * buf, int size);
+    bool handle_deny_move_item(uint8 * buf, int size);
     bool handle_server_equip_item(uint8 * buf, int size);
     bool handle_pause_control(uint8 * buf, int size);
     bool handle_status_request(uint8 * buf, int size);
@@ -200,7 +297,9 @@ private:
     bool handle_character_list(uint8 * buf, int size);
     bool handle_unicode_client_talk(uint8 * buf, int size);
     bool handle_server_talk(uint8 * buf, int size);
+    bool handle_unicode_server_talk(uint8 * buf, int size);
     bool handle_open_gump(uint8 * buf, int size);
+    void add_journal_line(const char * text);
 
     // Perform a command supplied as a big endian Unicode string
     void command_fixwalk(const arglist_t & args);
@@ -286,6 +385,24 @@ private:
     void command_useskill(const arglist_t & args);
     void command_poison(const arglist_t & args);
     void command_fixhotkeys(const arglist_t & args);
+    void command_stats(const arglist_t & args);
+    void command_delay(const arglist_t & args);
+    void command_movequeue(const arglist_t & args);
+    void command_autoreply(const arglist_t & args);
+    void command_journal(const arglist_t & args);
+    void command_livestats(const arglist_t & args);
+    void command_worldfeed(const arglist_t & args);
+#ifdef USE_BENCHMARKS
+    // Benchmarks, only in builds with USE_BENCHMARKS defined:
+    void command_commandbench(const arglist_t & args);
+    void command_timerbench(const arglist_t & args);
+    void command_vendorbench(const arglist_t & args);
+    void command_journalbench(const arglist_t & args);
+    void command_feedbench(const arglist_t & args);
+    void command_framecheck(const arglist_t & args);
+    void command_fragmentcheck(const arglist_t & args);
+    void command_decodebench(const arglist_t & args);
+#endif
 
 public:
     Injection();
@@ -301,13 +418,14 @@ public:
     int count_on_ground(const string & name, const string & color);
 
     // Methods of HookCallbackInterface:
-    virtual int get_message_size(int code);
+    virtual PacketLengths & get_packet_lengths() { return m_packet_lengths; }
     virtual void disconnected(SocketHook * hook);
     virtual void handle_key(SocketHook * hook, uint8 key[4]);
     virtual bool handle_send_message(SocketHook * hook, uint8 * buf,
         int size);
     virtual bool handle_receive_message(SocketHook * hook, uint8 * buf,
         int size);
+    virtual void idle();
 
     // Methods of ClientInterface:
     virtual void send_server(uint8 * buf, int size);
@@ -316,13 +434,35 @@ public:
     virtual void client_print(const char * text);
     virtual void client_print(const string & text);
     virtual void move_container(uint32 serial, uint32 cserial);
-    virtual void move_container(uint32 serial, uint16 quantity, uint32 cserial);
+    virtual void move_container(uint32 serial, uint16 quantity, uint32 cserial,
+        move_priority_t priority = MOVE_NORMAL);
     virtual void move_backpack(uint32 serial);
     virtual void move_backpack(uint32 serial, uint16 quantity);
-    virtual void move_equip(uint32 serial, int layer);
+    virtual void move_equip(uint32 serial, int layer,
+        move_priority_t priority = MOVE_NORMAL);
     virtual void do_command(const char * cmd);
-
-    // Methods of GUICallbackInterface:
+    virtual bool bind_command(const char * cmd, BoundCommand & bound);
+    virtual void run_command(const BoundCommand & bound);
+
+    // Returns the index of a built-in command, or -1 if not found.
+    static int find_command(const char * name, int length);
+    // Runs a built-in command with words that have already been split.
+    void run_command(int command, const arglist_t & args);
+
+    // These may be called from any thread. On the client thread the command
+    // runs at once, or after the commands before it if idle() is running
+    // them; otherwise it runs at the next select() or window message, and
+    // 'future' is set when it has.
+    void queue_command(int command, const arglist_t & args,
+        CommandFuture * future = 0);
+    void queue_command_line(const char * cmd, CommandFuture * future = 0);
+    EventBoard & get_events() { return m_events; }
+    Journal & get_journal() { return m_journal; }
+    WorldFeed & get_world_feed() { return m_world_feed; }
+    // May be called from any thread.
+    int get_move_queue_depth() const { return m_move_queue.get_depth(); }
+
+    // Methods of GUICallbackInterface (and idle() above):
     virtual void dump_world();
     virtual void save_config();
     virtual void shop();
@@ -0,0 +1,449 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// journal.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The journal of server text, searched with an Aho-Corasick automaton
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "client.h"
+#include "stats.h"      // for read_tsc()
+#include "textmatch.h"
+#include "journal.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The automaton is built as a trie of the patterns; a breadth first walk
+//  then fills in the missing transitions from each state's failure state,
+//  so matching follows exactly one transition per byte and never backs up.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+PatternSet::PatternSet()
+{
+    build(std::vector<string>());
+}
+
+void PatternSet::build(const std::vector<string> & patterns)
+{
+    memset(m_class, 0, sizeof(m_class));
+    m_num_classes = 1;
+    {for(size_t i = 0; i < patterns.size(); i++)
+        for(size_t j = 0; j < patterns[i].size(); j++)
+        {
+            uint8 c = patterns[i][j];
+            if(m_class[c] == 0)
+                m_class[c] = m_num_classes++;
+        }}
+
+    // The trie, with -1 for no transition:
+    const int n = m_num_classes;
+    m_delta.assign(n, -1);
+    std::vector<std::vector<int> > out(1);
+    {for(size_t i = 0; i < patterns.size(); i++)
+    {
+        const string & pattern = patterns[i];
+        if(pattern.empty())
+            continue;
+        int state = 0;
+        for(size_t j = 0; j < pattern.size(); j++)
+        {
+            int index = state * n + m_class[uint8(pattern[j])];
+            if(m_delta[index] == -1)
+            {
+                m_delta[index] = int(out.size());
+                m_delta.resize(m_delta.size() + n, -1);
+                out.resize(out.size() + 1);
+            }
+            state = m_delta[index];
+        }
+        out[state].push_back(int(i) + 1);
+    }}
+
+    // States are visited in order of depth, so a state's failure state has
+    // always been finished before it is needed.
+    std::vector<int> fail(out.size(), 0);
+    std::vector<int> queue;
+    {for(int c = 0; c < n; c++)
+    {
+        if(m_delta[c] == -1)
+            m_delta[c] = 0;
+        else
+            queue.push_back(m_delta[c]);
+    }}
+    {for(size_t i = 0; i < queue.size(); i++)
+    {
+        int state = queue[i];
+        const std::vector<int> & inherited = out[fail[state]];
+        out[state].insert(out[state].end(), inherited.begin(),
+            inherited.end());
+        for(int c = 0; c < n; c++)
+        {
+            int & next = m_delta[state * n + c];
+            int fallback = m_delta[fail[state] * n + c];
+            if(next == -1)
+                next = fallback;
+            else
+            {
+                fail[next] = fallback;
+                queue.push_back(next);
+            }
+        }
+    }}
+
+    m_out_begin.resize(out.size() + 1);
+    m_out.clear();
+    {for(size_t i = 0; i < out.size(); i++)
+    {
+        m_out_begin[i] = int(m_out.size());
+        m_out.insert(m_out.end(), out[i].begin(), out[i].end());
+    }}
+    m_out_begin[out.size()] = int(m_out.size());
+}
+
+void PatternSet::match(const char * text, int length,
+    std::vector<int> & found) const
+{
+    const int n = m_num_classes;
+    const int * delta = &m_delta[0];
+    const int * out_begin = &m_out_begin[0];
+    int state = 0;
+    for(int i = 0; i < length; i++)
+    {
+        state = delta[state * n + m_class[uint8(text[i])]];
+        for(int j = out_begin[state]; j < out_begin[state + 1]; j++)
+            found.push_back(m_out[j]);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Journal::Journal(EventBoard & events)
+: m_events(events), m_seq(0), m_next_id(1), m_use_count(0), m_matches(0),
+  m_match_cycles(0)
+{
+    InitializeCriticalSection(&m_lock);
+    memset(m_lines, 0, sizeof(m_lines));
+}
+
+Journal::~Journal()
+{
+    DeleteCriticalSection(&m_lock);
+}
+
+// private
+// Returns false if the pattern was already found in this line.
+bool Journal::add_hit(JournalPattern & pattern, uint32 seq)
+{
+    std::deque<uint32> & hits = pattern.m_hits;
+    if(!hits.empty() && hits.back() == seq)
+        return false;
+    hits.push_back(seq);
+    while(hits.front() + JOURNAL_SIZE <= seq)
+        hits.pop_front();
+    return true;
+}
+
+// private
+JournalPattern * Journal::find_pattern(int id)
+{
+    {for(size_t i = 0; i < m_patterns.size(); i++)
+        if(m_patterns[i].m_id == id)
+            return &m_patterns[i];}
+    return 0;
+}
+
+void Journal::add_line(const char * text)
+{
+    EnterCriticalSection(&m_lock);
+    m_seq++;
+    JournalLine & line = m_lines[m_seq % JOURNAL_SIZE];
+    line.m_seq = m_seq;
+    line.m_time = GetTickCount();
+    strncpy(line.m_text, text, EVENT_TEXT_SIZE - 1);
+    line.m_text[EVENT_TEXT_SIZE - 1] = '\0';
+
+    m_found.clear();
+    uint64 start = read_tsc();
+    m_set.match(line.m_text, strlen(line.m_text), m_found);
+    m_match_cycles += read_tsc() - start;
+    m_matches++;
+    // Keep each pattern once, in the order found, by number:
+    int count = 0;
+    {for(size_t i = 0; i < m_found.size(); i++)
+    {
+        JournalPattern & pattern = m_patterns[m_found[i] - 1];
+        if(add_hit(pattern, m_seq))
+            m_found[count++] = pattern.m_id;
+    }}
+    m_found.resize(count);
+    LeaveCriticalSection(&m_lock);
+
+    // m_found is only used on the client thread.
+    {for(size_t i = 0; i < m_found.size(); i++)
+        m_events.signal(EVENT_JOURNAL_MATCH, m_found[i], text);}
+}
+
+void Journal::clear()
+{
+    EnterCriticalSection(&m_lock);
+    // The numbering goes on, so that scripts can still compare numbers.
+    {for(int i = 0; i < JOURNAL_SIZE; i++)
+        m_lines[i].m_seq = 0;}
+    {for(size_t i = 0; i < m_patterns.size(); i++)
+        m_patterns[i].m_hits.clear();}
+    LeaveCriticalSection(&m_lock);
+}
+
+int Journal::add_pattern(const char * text)
+{
+    if(*text == '\0')
+        return 0;
+    EnterCriticalSection(&m_lock);
+    int id = 0;
+    {for(size_t i = 0; i < m_patterns.size() && id == 0; i++)
+        if(m_patterns[i].m_text == text)
+        {
+            id = m_patterns[i].m_id;
+            m_patterns[i].m_used = ++m_use_count;
+        }}
+    if(id == 0)
+    {
+        // Each new pattern rebuilds the automaton, so keep it small.
+        if(int(m_patterns.size()) >= MAX_JOURNAL_PATTERNS)
+        {
+            size_t oldest = 0;
+            {for(size_t i = 1; i < m_patterns.size(); i++)
+                if(m_patterns[i].m_used < m_patterns[oldest].m_used)
+                    oldest = i;}
+            trace_printf("journal: dropping pattern %d '%s'\n",
+                m_patterns[oldest].m_id, m_patterns[oldest].m_text.c_str());
+            m_patterns.erase(m_patterns.begin() + oldest);
+        }
+        m_patterns.push_back(JournalPattern());
+        JournalPattern & pattern = m_patterns.back();
+        pattern.m_text = text;
+        pattern.m_id = id = m_next_id++;
+        pattern.m_used = ++m_use_count;
+        std::vector<string> texts(m_patterns.size());
+        {for(size_t i = 0; i < m_patterns.size(); i++)
+            texts[i] = m_patterns[i].m_text;}
+        m_set.build(texts);
+
+        TextMatcher matcher(text);
+        uint32 first = m_seq > uint32(JOURNAL_SIZE) ?
+            m_seq - JOURNAL_SIZE + 1 : 1;
+        for(uint32 seq = first; seq <= m_seq; seq++)
+        {
+            const JournalLine & line = m_lines[seq % JOURNAL_SIZE];
+            if(line.m_seq == seq &&
+                matcher.find(line.m_text, strlen(line.m_text)))
+                pattern.m_hits.push_back(seq);
+        }
+        trace_printf("journal: pattern %d '%s', %d states\n", id, text,
+            m_set.get_num_states());
+    }
+    LeaveCriticalSection(&m_lock);
+    return id;
+}
+
+uint32 Journal::find(int id, uint32 after)
+{
+    uint32 result = 0;
+    EnterCriticalSection(&m_lock);
+    JournalPattern * pattern = find_pattern(id);
+    if(pattern != 0)
+    {
+        pattern->m_used = ++m_use_count;
+        // Skip lines that are no longer kept.
+        if(m_seq > uint32(JOURNAL_SIZE) && after < m_seq - JOURNAL_SIZE)
+            after = m_seq - JOURNAL_SIZE;
+        const std::deque<uint32> & hits = pattern->m_hits;
+        std::deque<uint32>::const_iterator i =
+            std::upper_bound(hits.begin(), hits.end(), after);
+        if(i != hits.end())
+            result = *i;
+    }
+    LeaveCriticalSection(&m_lock);
+    return result;
+}
+
+bool Journal::get_line(uint32 seq, JournalLine & line)
+{
+    EnterCriticalSection(&m_lock);
+    const JournalLine & kept = m_lines[seq % JOURNAL_SIZE];
+    bool ok = seq != 0 && kept.m_seq == seq;
+    if(ok)
+        line = kept;
+    LeaveCriticalSection(&m_lock);
+    return ok;
+}
+
+uint32 Journal::get_seq()
+{
+    EnterCriticalSection(&m_lock);
+    uint32 seq = m_seq;
+    LeaveCriticalSection(&m_lock);
+    return seq;
+}
+
+int Journal::get_num_patterns()
+{
+    EnterCriticalSection(&m_lock);
+    int count = int(m_patterns.size());
+    LeaveCriticalSection(&m_lock);
+    return count;
+}
+
+uint64 Journal::get_match_cycles()
+{
+    EnterCriticalSection(&m_lock);
+    uint64 cycles = m_matches > 0 ? m_match_cycles / m_matches : 0;
+    LeaveCriticalSection(&m_lock);
+    return cycles;
+}
+
+int Journal::get_num_states()
+{
+    EnterCriticalSection(&m_lock);
+    int count = m_set.get_num_states();
+    LeaveCriticalSection(&m_lock);
+    return count;
+}
+
+bool Journal::save(const char * filename)
+{
+    FILE * fp = fopen(filename, "wt");
+    if(fp == 0)
+        return false;
+    bool ok = true;
+    EnterCriticalSection(&m_lock);
+    uint32 first = m_seq > uint32(JOURNAL_SIZE) ? m_seq - JOURNAL_SIZE + 1 : 1;
+    for(uint32 seq = first; seq <= m_seq && ok; seq++)
+    {
+        const JournalLine & line = m_lines[seq % JOURNAL_SIZE];
+        if(line.m_seq == seq && fprintf(fp, "%s\n", line.m_text) < 0)
+            ok = false;
+    }
+    LeaveCriticalSection(&m_lock);
+    if(fclose(fp) != 0)
+        ok = false;
+    return ok;
+}
+
+#ifdef USE_BENCHMARKS
+
+// Reads the non-empty lines of a file, without their line ends.
+static bool read_lines(const char * filename, std::vector<string> & lines)
+{
+    FILE * fp = fopen(filename, "rt");
+    if(fp == 0)
+        return false;
+    char buffer[EVENT_TEXT_SIZE];
+    while(fgets(buffer, EVENT_TEXT_SIZE, fp) != 0)
+    {
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        if(buffer[0] != '\0')
+            lines.push_back(buffer);
+    }
+    fclose(fp);
+    return true;
+}
+
+// static
+void Journal::benchmark(const char * journal_file, const char * pattern_file,
+    ClientInterface & client)
+{
+    const int RUNS = 100;
+    std::vector<string> lines, patterns;
+    if(!read_lines(journal_file, lines) || lines.empty())
+    {
+        client.client_print(string("journalbench: cannot read ") + journal_file);
+        return;
+    }
+    if(!read_lines(pattern_file, patterns) || patterns.empty())
+    {
+        client.client_print(string("journalbench: cannot read ") + pattern_file);
+        return;
+    }
+
+    PatternSet set;
+    uint64 start = read_tsc();
+    set.build(patterns);
+    uint64 build_cycles = read_tsc() - start;
+
+    // Count each pattern once per line, as the journal does.
+    std::vector<int> found;
+    std::vector<uint32> last(patterns.size() + 1, 0);
+    int set_hits = 0;
+    start = read_tsc();
+    {for(int run = 0; run < RUNS; run++)
+        for(size_t i = 0; i < lines.size(); i++)
+        {
+            uint32 stamp = uint32(run * lines.size() + i + 1);
+            found.clear();
+            set.match(lines[i].c_str(), lines[i].size(), found);
+            for(size_t j = 0; j < found.size(); j++)
+                if(last[found[j]] != stamp)
+                {
+                    last[found[j]] = stamp;
+                    set_hits++;
+                }
+        }}
+    uint64 set_cycles = read_tsc() - start;
+
+    int strstr_hits = 0;
+    start = read_tsc();
+    {for(int run = 0; run < RUNS; run++)
+        for(size_t i = 0; i < lines.size(); i++)
+            for(size_t j = 0; j < patterns.size(); j++)
+                if(strstr(lines[i].c_str(), patterns[j].c_str()) != 0)
+                    strstr_hits++;}
+    uint64 strstr_cycles = read_tsc() - start;
+
+    double runs = double(RUNS) * lines.size();
+    char buf[200];
+    sprintf(buf, "%d lines, %d patterns: %d states, built in %.1f us",
+        int(lines.size()), int(patterns.size()), set.get_num_states(),
+        g_traffic_stats.to_us(build_cycles));
+    client.client_print(buf);
+    trace_printf("journalbench: %s\n", buf);
+    sprintf(buf, "Per line: automaton %.2f us, strstr %.2f us; %d and %d matches",
+        g_traffic_stats.to_us(set_cycles) / runs,
+        g_traffic_stats.to_us(strstr_cycles) / runs,
+        set_hits / RUNS, strstr_hits / RUNS);
+    client.client_print(buf);
+    trace_printf("journalbench: %s\n", buf);
+}
+
+#endif
@@ -0,0 +1,160 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// journal.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The journal: recent lines of server text, and the patterns that scripts
+//  look for in them
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <deque>
+#include <vector>
+#include <string>
+using std::string;
+
+#include "common.h"
+#include "events.h"
+
+class ClientInterface;
+
+// Finds many fixed strings in one pass over the text, using an Aho-Corasick
+// automaton. Patterns are numbered from 1 in the order they were given.
+class PatternSet
+{
+private:
+    // Bytes that appear in no pattern share class 0, so the transition
+    // table only needs a column for each distinct byte:
+    uint8 m_class[256];
+    int m_num_classes;
+    std::vector<int> m_delta;       // [state * m_num_classes + class]
+    // The patterns ending at each state are
+    // m_out[m_out_begin[state]] ... m_out[m_out_begin[state + 1] - 1]:
+    std::vector<int> m_out_begin;
+    std::vector<int> m_out;
+
+public:
+    PatternSet();
+
+    // Builds the automaton, replacing any earlier patterns. Empty patterns
+    // never match.
+    void build(const std::vector<string> & patterns);
+    int get_num_states() const { return int(m_out_begin.size()) - 1; }
+
+    // Appends the number of each pattern found in the text to 'found'. A
+    // pattern that occurs more than once is added more than once.
+    void match(const char * text, int length, std::vector<int> & found) const;
+};
+
+// How many lines the journal keeps:
+const int JOURNAL_SIZE = 512;
+// How many patterns it looks for. A new pattern past this replaces the one
+// scripts used least recently.
+const int MAX_JOURNAL_PATTERNS = 256;
+
+class JournalLine
+{
+public:
+    uint32 m_seq;               // 0 if the slot was never used
+    DWORD m_time;               // GetTickCount() when it arrived
+    char m_text[EVENT_TEXT_SIZE];
+};
+
+class JournalPattern
+{
+public:
+    string m_text;
+    int m_id;                   // never reused
+    uint32 m_used;              // when a script last asked for it
+    // The lines it was found in that are still kept, oldest first:
+    std::deque<uint32> m_hits;
+};
+
+// Every line the server prints gets a sequence number starting at 1 and is
+// checked against all the patterns at once. Each pattern keeps the numbers
+// of the lines it was found in, so scripts can search the history without
+// scanning it, and a match signals EVENT_JOURNAL_MATCH with the pattern's
+// number as the argument. The number of a pattern that was dropped finds
+// nothing.
+class Journal
+{
+private:
+    CRITICAL_SECTION m_lock;
+    EventBoard & m_events;
+    uint32 m_seq;               // of the newest line
+    JournalLine m_lines[JOURNAL_SIZE];  // indexed by m_seq
+    // In the order m_set numbers them, from 1:
+    std::vector<JournalPattern> m_patterns;
+    int m_next_id;
+    uint32 m_use_count;         // for JournalPattern::m_used
+    PatternSet m_set;
+    std::vector<int> m_found;   // for add_line()
+    // Statistics:
+    uint32 m_matches;
+    uint64 m_match_cycles;
+
+    bool add_hit(JournalPattern & pattern, uint32 seq);
+    JournalPattern * find_pattern(int id);
+
+public:
+    explicit Journal(EventBoard & events);
+    ~Journal();
+
+    // Called on the client thread.
+    void add_line(const char * text);
+    void clear();
+
+    // These may be called from any thread.
+
+    // Returns the number of a pattern, adding it if it is new. Lines still
+    // in the journal are searched for a new pattern at once.
+    int add_pattern(const char * text);
+    // Returns the oldest line newer than 'after' that contains the pattern,
+    // or 0 if there is none.
+    uint32 find(int id, uint32 after);
+    // Returns false if the line is no longer kept.
+    bool get_line(uint32 seq, JournalLine & line);
+    uint32 get_seq();
+    int get_num_patterns();
+    // The average time to match a line, in TSC cycles:
+    uint64 get_match_cycles();
+    int get_num_states();
+    // Writes the lines still kept to a file, one per line.
+    bool save(const char * filename);
+
+#ifdef USE_BENCHMARKS
+    // Times the automaton against strstr() for each pattern, over lines
+    // saved by save() and patterns one per line.
+    static void benchmark(const char * journal_file,
+        const char * pattern_file, ClientInterface & client);
+#endif
+};
+
+#endif
@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// livestats.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The layout of the live statistics that each client publishes for
+//  monitoring programs, and how to read them. This file does not depend on
+//  the rest of Injection, so monitors can include it as it is, on Windows
+//  or on Linux.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _LIVESTATS_H_
+#define _LIVESTATS_H_
+
+#include <string.h>
+
+// A client with live_stats="true" for its server creates the file
+// LIVE_STATS_DIR\<process id>.stats and maps it as the named shared memory
+// LIVE_STATS_NAME<process id>. A monitor on Windows can open either; one on
+// Linux (with the clients running under Wine) can mmap() the file with
+// MAP_SHARED. The file is deleted when the client exits.
+#define LIVE_STATS_DIR "livestats"
+#define LIVE_STATS_NAME "InjectionLiveStats"
+
+const unsigned int LIVE_STATS_MAGIC = 0x534c4e49;    // "INLS"
+const unsigned int LIVE_STATS_VERSION = 1;
+
+// In the same order as the counters in DllInterface:
+enum live_counter_t
+{
+    LIVE_BM, LIVE_BP, LIVE_GA, LIVE_GS, LIVE_MR, LIVE_NS, LIVE_SA, LIVE_SS,
+    LIVE_VA, LIVE_EN, LIVE_WH, LIVE_FD, LIVE_BR,
+    LIVE_H, LIVE_C, LIVE_M, LIVE_L, LIVE_B,
+    LIVE_AR, LIVE_BT,
+    NUM_LIVE_COUNTERS
+};
+
+// Only int and unsigned int are used, which are 32 bits for every compiler
+// that matters here, so the layout is the same for all of them.
+struct LiveStatsBlock
+{
+    // Set once when the block is created:
+    unsigned int m_magic;
+    unsigned int m_version;
+    unsigned int m_size;            // sizeof(LiveStatsBlock)
+    unsigned int m_process_id;
+
+    // Odd while the client is writing the fields below. It is also bumped
+    // by two for each update, so a reader that sees the same even value
+    // before and after copying has a consistent copy.
+    volatile unsigned int m_seq;
+
+    unsigned int m_time;            // GetTickCount() of the last update
+    unsigned int m_in_world;        // 0 before login and after disconnect
+    unsigned int m_player;          // serial
+
+    int m_hp, m_max_hp;
+    int m_mana, m_max_mana;
+    int m_stamina, m_max_stamina;
+    int m_armor, m_weight, m_gold;
+    int m_counters[NUM_LIVE_COUNTERS];
+    int m_x, m_y, m_z;
+
+    // Per opcode, client to server ([0]) and server to client ([1]), since
+    // the client started or its stats were reset. The byte counts are the
+    // low 32 bits, so they wrap.
+    unsigned int m_messages[2][256];
+    unsigned int m_bytes[2][256];
+    unsigned int m_cycles[2][256];  // in the handlers, low 32 bits
+};
+
+// The block is only ever shared on x86, where the processor does not
+// reorder loads with other loads or stores with other stores, so keeping
+// the compiler from moving them is enough.
+#if defined(__GNUC__)
+#define LIVE_STATS_BARRIER() __asm__ __volatile__("" : : : "memory")
+#else
+// VC++ does not move memory accesses across inline assembly.
+#define LIVE_STATS_BARRIER() __asm { nop }
+#endif
+
+// Copies a consistent block from shared memory into 'copy'. Returns false if
+// the block is not a known version, or if it was being written every time
+// in 'tries' attempts.
+inline bool read_live_stats(const LiveStatsBlock * shared,
+    LiveStatsBlock & copy, int tries = 100)
+{
+    if(shared->m_magic != LIVE_STATS_MAGIC ||
+        shared->m_version != LIVE_STATS_VERSION ||
+        shared->m_size != sizeof(LiveStatsBlock))
+        return false;
+    for(int i = 0; i < tries; i++)
+    {
+        unsigned int seq = shared->m_seq;
+        if(seq & 1)
+            continue;
+        LIVE_STATS_BARRIER();
+        memcpy(&copy, shared, sizeof(LiveStatsBlock));
+        LIVE_STATS_BARRIER();
+        if(shared->m_seq == seq)
+            return true;
+    }
+    return false;
+}
+
+#endif
@@ -34,102 +34,88 @@
 #include "menus.h"
 
 
-class MenuOption
-{
-public:
-    uint16 m_graphic;
-    string m_description;
-};
-
 MenuHandler::MenuHandler(ClientInterface & client)
-: m_client(client), m_state(NORMAL), m_options(0)
+: m_client(client), m_state(NORMAL), m_next(0), m_count(0)
 {
 }
 
 MenuHandler::~MenuHandler()
 {
-    delete [] m_options;
 }
 
 // (private)
 // Index should be 0-based, or -1 to cancel the menu
-void MenuHandler::send_choice(int index)
+void MenuHandler::send_choice(int index, uint16 graphic)
 {
     uint8 buf[13];
     buf[0] = CODE_MENU_CHOICE;
     pack_big_uint32(buf + 1, m_id);
     pack_big_uint16(buf + 5, m_gump);
     pack_big_uint16(buf + 7, index + 1);
-    if(index == -1)
-        pack_big_uint16(buf + 9, 0);
-    else
-        pack_big_uint16(buf + 9, m_options[index].m_graphic);
+    pack_big_uint16(buf + 9, index == -1 ? 0 : graphic);
     pack_big_uint16(buf + 11, 0);
     m_client.send_server(buf, sizeof(buf));
 }
 
 // private
-void MenuHandler::choose_menu(const char * desc)
+// Index is -1 if no option matched.
+void MenuHandler::choose_option(int index, uint16 graphic)
 {
-    if(m_state == CHOOSING)
+    ASSERT(m_state == CHOOSING);
+    if(index == -1)
     {
-        for(int i = 0; i < m_num_options; i++)
-            if(m_options[i].m_description.find(desc) != string::npos)
-            {
-                m_client.client_print("Menu choice successful.");
-                if(m_has_third_menu)
-                {
-                    m_menu_prompt = m_menu_prompt2;
-                    m_menu_choice = m_menu_choice2;
-                    m_menu_prompt2 = m_menu_prompt3;
-                    m_menu_choice2 = m_menu_choice3;
-                    m_has_third_menu = false;
-                    m_has_second_menu = true;
-                    m_state = WAITING;
-                    send_choice(i);
-                    return;
-                }
-                else if(m_has_second_menu)
-                {
-                    m_menu_prompt = m_menu_prompt2;
-                    m_menu_choice = m_menu_choice2;
-                    m_has_second_menu = false;
-                    m_state = WAITING;
-                    send_choice(i);
-                    return;
-                }
-                else
-                {
-                    send_choice(i);
-                    m_state = NORMAL;
-                    return;
-                }
-            }
         m_client.client_print("Menu choice not found: menu cancelled.");
-        send_choice(-1);
+        send_choice(-1, 0);
         m_state = NORMAL;
+        return;
     }
-    else if(m_state == WAITING)
+    m_client.client_print("Menu choice successful.");
+    m_next++;
+    m_state = m_next < m_count ? WAITING : NORMAL;
+    send_choice(index, graphic);
+}
+
+// private
+// 'menus' holds a prompt and a choice for each menu.
+void MenuHandler::wait_menus(const char * const * menus, int count)
+{
+    ASSERT(count <= MAX_MENUS);
+    if(m_state == WAITING)
+        m_client.client_print(string("Previous waitmenu cancelled: ") +
+            m_prompts[m_next].get_pattern());
+    else if(m_state == CHOOSING)
     {
-        m_client.client_print("Cannot choose: no menu open, waiting cancelled.");
-        m_state = NORMAL;
+        m_client.client_print(string("Previous menu gump cancelled: ") +
+            m_prompts[m_next].get_pattern());
+        send_choice(-1, 0);
+    }
+    // The skip tables are built here, not for every menu.
+    for(int i = 0; i < count; i++)
+    {
+        m_prompts[i].set(menus[2 * i]);
+        m_choices[i].set(menus[2 * i + 1]);
     }
-    else
-        m_client.client_print("Cannot choose: no menu open.");
+    m_next = 0;
+    m_count = count;
+    m_state = WAITING;
+    m_client.client_print("Now waiting for menu...");
 }
 
 // This function is called for 0x7c messages
-bool MenuHandler::handle_open_menu_gump(uint8 * buf, int /*size*/)
+bool MenuHandler::handle_open_menu_gump(uint8 * buf, int size)
 {
     bool resend = true;
     if(m_state == WAITING)
     {
         int prompt_length = buf[9];
-        string prompt(reinterpret_cast<char *>(buf + 10), prompt_length);
+        uint8 * end = buf + size;
+        if(buf + 10 + prompt_length > end)
+            prompt_length = end - buf - 10;
         // Look for the desired substring within the prompt
-        if(prompt.find(m_menu_prompt) == string::npos)
+        if(!m_prompts[m_next].find(buf + 10, prompt_length))
         {
-            m_client.client_print(string("Warning: menu '") + prompt +
+            m_client.client_print(string("Warning: menu '") +
+                string(reinterpret_cast<char *>(buf + 10), prompt_length) +
                 string("' opened, waiting cancelled"));
             m_state = NORMAL;
         }
@@ -137,28 +123,33 @@ bool MenuHandler::handle_open_menu_gump(uint8 * buf, int /*size*/)
         {
             m_id = unpack_big_uint32(buf + 3);
             m_gump = unpack_big_uint16(buf + 7);
+            // The options are read where they are in the message.
             uint8 * ptr = buf + 10 + prompt_length;
-            m_num_options = *ptr++;
-            delete [] m_options;
-            m_options = new MenuOption[m_num_options];
-            for(int i = 0; i < m_num_options; i++)
+            int num_options = ptr < end ? *ptr++ : 0;
+            int index = -1;
+            uint16 graphic = 0;
+            for(int i = 0; i < num_options && ptr + 5 <= end; i++)
             {
-                m_options[i].m_graphic = unpack_big_uint16(ptr);
                 int desc_len = ptr[4];
-                ptr += 5;
-                m_options[i].m_description.assign(
-                    reinterpret_cast<char *>(ptr), desc_len);
-                ptr += desc_len;
+                if(ptr + 5 + desc_len > end)
+                    desc_len = end - ptr - 5;
+                if(m_choices[m_next].find(ptr + 5, desc_len))
+                {
+                    index = i;
+                    graphic = unpack_big_uint16(ptr);
+                    break;
+                }
+                ptr += 5 + desc_len;
             }
             m_state = CHOOSING;
-            choose_menu(m_menu_choice.c_str());
+            choose_option(index, graphic);
             resend = false;
         }
     }
     else if(m_state == CHOOSING)
     {
         m_client.client_print("Warning: menu opened, choosing cancelled");
-        send_choice(-1);
+        send_choice(-1, 0);
         m_state = NORMAL;
     }
     // In state NORMAL, silently pass the menu to the client.
@@ -167,63 +158,20 @@ bool MenuHandler::handle_open_menu_gump(uint8 * buf, int /*size*/)
 
 void MenuHandler::wait_menu(const char * prompt, const char * choice)
 {
-    if(m_state == WAITING)
-        m_client.client_print(string("Previous waitmenu cancelled: ") +
-            m_menu_prompt);
-    else if(m_state == CHOOSING)
-    {
-        m_client.client_print(string("Previous menu gump cancelled: ") +
-            m_menu_prompt);
-        send_choice(-1);
-    }
-    m_state = WAITING;
-    m_menu_prompt = prompt;
-    m_menu_choice = choice;
-    m_has_second_menu = false;
-    m_client.client_print("Now waiting for menu...");
+    const char * menus[] = { prompt, choice };
+    wait_menus(menus, 1);
 }
 
 void MenuHandler::wait_menu(const char * prompt, const char * choice, const char * prompt2, const char * choice2)
 {
-    if(m_state == WAITING)
-        m_client.client_print(string("Previous waitmenu cancelled: ") +
-            m_menu_prompt);
-    else if(m_state == CHOOSING)
-    {
-        m_client.client_print(string("Previous menu gump cancelled: ") +
-            m_menu_prompt);
-        send_choice(-1);
-    }
-    m_state = WAITING;
-    m_menu_prompt = prompt;
-    m_menu_choice = choice;
-    m_has_second_menu = true;
-    m_menu_prompt2 = prompt2;
-    m_menu_choice2 = choice2;
-    m_client.client_print("Now waiting for menu...");
+    const char * menus[] = { prompt, choice, prompt2, choice2 };
+    wait_menus(menus, 2);
 }
 
 void MenuHandler::wait_menu(const char * prompt, const char * choice, const char * prompt2, const char * choice2, const char * prompt3, const char * choice3)
 {
-    if(m_state == WAITING)
-        m_client.client_print(string("Previous waitmenu cancelled: ") +
-            m_menu_prompt);
-    else if(m_state == CHOOSING)
-    {
-        m_client.client_print(string("Previous menu gump cancelled: ") +
-            m_menu_prompt);
-        send_choice(-1);
-    }
-    m_state = WAITING;
-    m_menu_prompt = prompt;
-    m_menu_choice = choice;
-    m_has_second_menu = true;
-    m_menu_prompt2 = prompt2;
-    m_menu_choice2 = choice2;
-    m_has_third_menu = true;
-    m_menu_prompt3 = prompt3;
-    m_menu_choice3 = choice3;
-    m_client.client_print("Now waiting for menu...");
+    const char * menus[] = { prompt, choice, prompt2, choice2, prompt3, choice3 };
+    wait_menus(menus, 3);
 }
 
 void MenuHandler::cancel_menu()
@@ -231,11 +179,13 @@ void MenuHandler::cancel_menu()
     if(m_state == NORMAL)
         m_client.client_print("Error: no menu to cancel");
     else if(m_state == WAITING)
-        m_client.client_print(string("waitmenu cancelled: ") + m_menu_prompt);
+        m_client.client_print(string("waitmenu cancelled: ") +
+            m_prompts[m_next].get_pattern());
     else if(m_state == CHOOSING)
     {
-        m_client.client_print(string("Menu gump cancelled: ") + m_menu_prompt);
-        send_choice(-1);
+        m_client.client_print(string("Menu gump cancelled: ") +
+            m_prompts[m_next].get_pattern());
+        send_choice(-1, 0);
     }
     m_state = NORMAL;
 }
@@ -33,37 +33,33 @@
 #define _MENUS_H_
 
 #include "common.h"
+#include "textmatch.h"
 
 #include <string>
 using std::string;
 
 
 class ClientInterface;
-class MenuOption;
 
 // This class used for handling the menus used to select objects to create,
 // etc.
 class MenuHandler
 {
 private:
+    enum { MAX_MENUS = 3 };
+
     ClientInterface & m_client;
     enum { NORMAL, WAITING, CHOOSING } m_state;
-    string m_menu_prompt;
-    string m_menu_choice;
-    string m_menu_prompt2;
-    string m_menu_choice2;
-    string m_menu_prompt3;
-    string m_menu_choice3;
-    bool m_has_second_menu;
-    bool m_has_third_menu;
+    // The menus to wait for, in order; m_next is the one waited for now.
+    TextMatcher m_prompts[MAX_MENUS];
+    TextMatcher m_choices[MAX_MENUS];
+    int m_next, m_count;
     uint32 m_id;
     uint16 m_gump;
-    int m_num_options;
-    MenuOption * m_options;
 
-    void send_choice(int index);
-    void choose_menu(const char * desc);
-    void choose_menu(const char * desc, const char * prompt);
+    void send_choice(int index, uint16 graphic);
+    void choose_option(int index, uint16 graphic);
+    void wait_menus(const char * const * menus, int count);
 
 public:
     MenuHandler(ClientInterface & client);
@@ -0,0 +1,175 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// movequeue.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "world.h"      // for INVALID_XY
+#include "movequeue.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+MoveQueue::MoveQueue(ClientInterface & client, TimerWheel & timers)
+: m_client(client), m_timers(timers), m_in_flight(0, 0, 0, -1),
+  m_busy(false), m_own_lift(false), m_last_sent(0), m_next_time(GetTickCount()), m_delay(0),
+  m_depth(0)
+{
+}
+
+// private
+void MoveQueue::send(const QueuedMove & move)
+{
+    uint8 buf[7 + 14];
+    int size;
+
+    buf[0] = CODE_PICK_UP_ITEM;
+    pack_big_uint32(buf + 1, move.m_serial);
+    pack_big_uint16(buf + 5, move.m_quantity);  // quantity to pick up
+
+    if(move.m_layer == -1)
+    {
+        buf[7] = CODE_DROP_ITEM;
+        pack_big_uint32(buf + 8, move.m_serial);
+        pack_big_uint16(buf + 12, INVALID_XY);  // x
+        pack_big_uint16(buf + 14, INVALID_XY);  // y
+        buf[16] = 0;    // z
+        pack_big_uint32(buf + 17, move.m_container);
+        size = 7 + 14;
+    }
+    else
+    {
+        buf[7] = CODE_CLIENT_EQUIP_ITEM;
+        pack_big_uint32(buf + 8, move.m_serial);
+        buf[12] = move.m_layer;
+        pack_big_uint32(buf + 13, move.m_container);
+        size = 7 + 10;
+    }
+    m_own_lift = true;
+    m_client.send_server(buf, size);
+}
+
+// private
+// Sends the next move if nothing is in flight and the delay has passed.
+void MoveQueue::pump()
+{
+    int depth = m_busy ? 1 : 0;
+    {for(int i = 0; i < NUM_MOVE_PRIORITIES; i++)
+        depth += m_queues[i].size();}
+    m_depth = depth;
+    if(depth > m_stats.m_max_depth)
+        m_stats.m_max_depth = depth;
+
+    if(m_busy)
+        return;
+    int p = 0;
+    while(p < NUM_MOVE_PRIORITIES && m_queues[p].empty())
+        p++;
+    if(p == NUM_MOVE_PRIORITIES)
+        return;
+
+    uint32 now = GetTickCount();
+    sint32 wait = sint32(m_next_time - now);
+    if(wait > 0)
+    {
+        m_timers.schedule(this, wait);
+        return;
+    }
+
+    m_in_flight = m_queues[p].front();
+    m_queues[p].pop_front();
+    if(m_in_flight.m_tries == 0)
+        m_stats.m_wait.add(now - m_in_flight.m_queued);
+    m_in_flight.m_tries++;
+    m_busy = true;
+    m_last_sent = now;
+    m_next_time = now + m_delay;
+    m_stats.m_sent++;
+    send(m_in_flight);
+    m_timers.schedule(this, MOVE_TIMEOUT);
+}
+
+// private
+void MoveQueue::expired()
+{
+    if(m_busy)
+    {
+        // No answer; it probably worked, so don't move it twice.
+        m_stats.m_timeouts++;
+        m_busy = false;
+    }
+    pump();
+}
+
+void MoveQueue::push(const QueuedMove & move, move_priority_t priority)
+{
+    std::deque<QueuedMove> & queue = m_queues[priority];
+    queue.push_back(move);
+    queue.back().m_priority = priority;
+    queue.back().m_queued = GetTickCount();
+    pump();
+}
+
+void MoveQueue::confirmed(uint32 serial)
+{
+    if(!m_busy || serial != m_in_flight.m_serial)
+        return;
+    m_stats.m_confirmed++;
+    m_stats.m_answer.add(GetTickCount() - m_last_sent);
+    m_busy = false;
+    cancel();
+    pump();
+}
+
+bool MoveQueue::rejected()
+{
+    // If the client lifted something after our move, the refusal is for
+    // the client's lift and ours is still waiting for its answer.
+    if(!m_busy || !m_own_lift)
+        return false;
+    m_stats.m_rejected++;
+    m_busy = false;
+    cancel();
+    if(m_in_flight.m_tries < MOVE_TRIES)
+    {
+        // Probably too soon after the last action; wait longer each time.
+        m_stats.m_retried++;
+        m_queues[m_in_flight.m_priority].push_front(m_in_flight);
+        m_next_time = GetTickCount() + (m_delay + 100) * m_in_flight.m_tries;
+    }
+    else
+        m_stats.m_failed++;
+    pump();
+    return true;
+}
+
+void MoveQueue::clear()
+{
+    for(int i = 0; i < NUM_MOVE_PRIORITIES; i++)
+        m_queues[i].clear();
+    m_busy = false;
+    m_depth = 0;
+    cancel();
+}
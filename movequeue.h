@@ -0,0 +1,146 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// movequeue.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Sends item moves one at a time, no faster than the server allows, and
+//  tries again when the server refuses one.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _MOVEQUEUE_H_
+#define _MOVEQUEUE_H_
+
+#include <deque>
+
+#include "common.h"
+#include "client.h"
+#include "timers.h"
+
+// How long to wait for the server to answer a move:
+const uint32 MOVE_TIMEOUT = 2000;
+// How often a refused move is tried:
+const int MOVE_TRIES = 3;
+
+class QueuedMove
+{
+public:
+    uint32 m_serial;
+    uint16 m_quantity;
+    uint32 m_container;     // the player when equipping
+    int m_layer;            // -1 to drop into m_container
+    move_priority_t m_priority;
+    uint32 m_queued;        // GetTickCount() when queued
+    int m_tries;
+
+    QueuedMove(uint32 serial, uint16 quantity, uint32 container, int layer)
+    : m_serial(serial), m_quantity(quantity), m_container(container),
+      m_layer(layer), m_priority(MOVE_NORMAL), m_queued(0), m_tries(0)
+    {
+    }
+};
+
+// Latency of one stage of a move, in ms:
+class MoveLatency
+{
+public:
+    uint32 m_count, m_total, m_max;
+
+    MoveLatency() : m_count(0), m_total(0), m_max(0) {}
+    void add(uint32 ms)
+    {
+        m_count++;
+        m_total += ms;
+        if(ms > m_max)
+            m_max = ms;
+    }
+    uint32 get_average() const { return m_count == 0 ? 0 : m_total / m_count; }
+};
+
+class MoveStats
+{
+public:
+    uint32 m_sent, m_confirmed, m_rejected, m_retried, m_failed, m_timeouts;
+    int m_max_depth;
+    MoveLatency m_wait;     // from queued to sent
+    MoveLatency m_answer;   // from sent to confirmed
+
+    MoveStats()
+    : m_sent(0), m_confirmed(0), m_rejected(0), m_retried(0), m_failed(0),
+      m_timeouts(0), m_max_depth(0)
+    {
+    }
+};
+
+// Only one move is in flight at a time, since the player can only hold one
+// item. It is done when the server shows the item in its new place, or
+// refuses it with a Deny Move Item message; if the server says neither, it
+// is assumed done after MOVE_TIMEOUT. The next move is sent at least
+// 'delay' ms after the last one, and longer after a refusal.
+//
+// Only the client thread uses it.
+class MoveQueue : private Timer
+{
+private:
+    ClientInterface & m_client;
+    TimerWheel & m_timers;
+    std::deque<QueuedMove> m_queues[NUM_MOVE_PRIORITIES];
+    QueuedMove m_in_flight;
+    bool m_busy;
+    bool m_own_lift;        // whether the last 0x07 to the server was ours
+    uint32 m_last_sent;     // GetTickCount()
+    uint32 m_next_time;     // GetTickCount() the next move may be sent at
+    uint32 m_delay;
+    MoveStats m_stats;
+    volatile int m_depth;   // for get_depth() on other threads
+
+    void send(const QueuedMove & move);
+    void pump();
+    virtual void expired();
+
+public:
+    MoveQueue(ClientInterface & client, TimerWheel & timers);
+
+    void push(const QueuedMove & move, move_priority_t priority);
+    // Called for every item the server puts in a container or on a body.
+    void confirmed(uint32 serial);
+    // Called when the client picks up an item itself.
+    void client_lifted() { m_own_lift = false; }
+    // Called when the server denies a move. Returns false if it was not
+    // one of ours.
+    bool rejected();
+    // Forgets all moves, e.g. on disconnecting.
+    void clear();
+
+    void set_delay(uint32 delay) { m_delay = delay; }
+    uint32 get_delay() const { return m_delay; }
+    // The number of moves waiting, including one in flight. May be called
+    // from any thread.
+    int get_depth() const { return m_depth; }
+    const MoveStats & get_stats() const { return m_stats; }
+    void reset_stats() { m_stats = MoveStats(); }
+};
+
+#endif
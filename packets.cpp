@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// packets.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "packets.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  This module loads the message length table.
+//
+//  A definition file is made of sections. "[*]" starts a section that
+//  applies to every client, and "[checksum length]" starts one that only
+//  applies to the client with that checksum and length, in hex as in
+//  Ignition.cfg. Later sections override earlier ones. Each line in a
+//  section has the form:
+//
+//      code = size
+//
+//  where the code and size are in hex. The size may also be "var" for a
+//  message that carries its own length, or "?" if it is not known. Lines
+//  starting with '#' are comments.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+const int PACKETS_LINE_MAX = 256;
+
+PacketLengths::PacketLengths()
+{
+    {for(int i = 0; i < 256; i++)
+    {
+        m_sizes[i] = PACKET_UNKNOWN;
+        m_reported[i] = false;
+    }}
+}
+
+// Returns false if the line is not a valid section header.
+static bool parse_section(char * line, uint32 checksum, uint32 length,
+    bool & matches)
+{
+    line += strspn(line, " \t");
+    if(line[0] == '*' && line[1] == ']')
+    {
+        matches = true;
+        return true;
+    }
+    unsigned int section_checksum, section_length;
+    char end;
+    if(sscanf(line, "%x %x %c", &section_checksum, &section_length, &end) != 3
+            || end != ']')
+        return false;
+    matches = section_checksum == checksum && section_length == length;
+    return true;
+}
+
+// Returns false if the line is not a valid entry.
+static bool parse_entry(char * line, int & code, int & size)
+{
+    unsigned int value;
+    int n = 0;
+    if(sscanf(line, " %x = %n", &value, &n) != 1 || n == 0 || value > 0xff)
+        return false;
+    code = int(value);
+    line += n;
+    char * end = line + strcspn(line, " \t\r\n#");
+    if(end == line)
+        return false;
+    char * rest = end + strspn(end, " \t\r\n");
+    if(*rest != 0 && *rest != '#')
+        return false;
+    *end = 0;
+
+    if(strcmp(line, "var") == 0)
+        size = PACKET_VARIABLE;
+    else if(strcmp(line, "?") == 0)
+        size = PACKET_UNKNOWN;
+    else
+    {
+        char * num_end;
+        unsigned long bytes = strtoul(line, &num_end, 16);
+        // A size must include the code byte.
+        if(*num_end != 0 || bytes < 1 || bytes > 0xffff)
+            return false;
+        size = int(bytes);
+    }
+    return true;
+}
+
+bool PacketLengths::load(const char * filename, uint32 checksum,
+    uint32 length)
+{
+    FILE * fp = fopen(filename, "rt");
+    if(fp == 0)
+    {
+        warning_printf("cannot read %s\n", filename);
+        return false;
+    }
+
+    bool ok = true, matches = false;
+    char buffer[PACKETS_LINE_MAX];
+    int line_number = 0;
+    while(fgets(buffer, PACKETS_LINE_MAX, fp) != 0)
+    {
+        line_number++;
+        char * line = buffer + strspn(buffer, " \t\r\n");
+        if(*line == 0 || *line == '#')
+            continue;
+        if(*line == '[')
+        {
+            if(!parse_section(line + 1, checksum, length, matches))
+            {
+                error_printf("%s(%d): invalid section header\n", filename,
+                    line_number);
+                ok = false;
+                matches = false;
+            }
+            continue;
+        }
+        int code, size;
+        if(!parse_entry(line, code, size))
+        {
+            error_printf("%s(%d): invalid message length\n", filename,
+                line_number);
+            ok = false;
+        }
+        else if(matches)
+            m_sizes[code] = size;
+    }
+    fclose(fp);
+    return ok;
+}
+
+void PacketLengths::report_unknown(uint8 code)
+{
+    if(m_reported[code])
+        return;
+    m_reported[code] = true;
+    error_printf("Length unknown for message 0x%02X\n", code);
+}
+
+int PacketLengths::guess_size(const uint8 * buf, int size) const
+{
+    if(size < 3)
+        return size;
+    int msg_size = (buf[1] << 8) | buf[2];
+    if(msg_size < 3 || msg_size >= size)
+        return size;
+    const uint8 * ptr = buf + msg_size, * end = buf + size;
+    while(ptr < end)
+    {
+        int next_size = m_sizes[*ptr];
+        if(next_size == PACKET_UNKNOWN)
+            return size;
+        if(next_size == PACKET_VARIABLE)
+        {
+            if(ptr + 3 > end)
+                return size;
+            next_size = (ptr[1] << 8) | ptr[2];
+            if(next_size < 3)
+                return size;
+        }
+        ptr += next_size;
+    }
+    return ptr == end ? msg_size : size;
+}
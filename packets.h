@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// packets.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The length of every message code, for finding message boundaries.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PACKETS_H_
+#define _PACKETS_H_
+
+#include "common.h"
+
+// The message carries its length in the two bytes after the code.
+const int PACKET_VARIABLE = 0;
+// The length is not known, so the stream cannot be framed.
+const int PACKET_UNKNOWN = -1;
+
+class PacketLengths
+{
+private:
+    int m_sizes[256];
+    bool m_reported[256];
+
+public:
+    PacketLengths();
+
+    int get(uint8 code) const { return m_sizes[code]; }
+    void set(uint8 code, int size) { m_sizes[code] = size; }
+
+    // Reads a definition file, applying every section that matches the
+    // client with this checksum and length. Returns false if the file could
+    // not be read or had errors.
+    bool load(const char * filename, uint32 checksum, uint32 length);
+
+    // Logs an unknown message code, but only the first time it is seen.
+    void report_unknown(uint8 code);
+    // Returns the size of the message with an unknown code at the start of
+    // 'buf'. Most such messages carry their length, so that is taken if
+    // the rest of 'buf' is then made of whole messages of known lengths.
+    // Otherwise it is all of 'buf'.
+    int guess_size(const uint8 * buf, int size) const;
+};
+
+#endif
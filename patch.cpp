@@ -25,9 +25,19 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <windows.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
 #include "patch.h"
 
+using std::string;
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -35,6 +45,103 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+/*
+    Layout of a compiled patch database (all values are 32 bit, in the
+    byte order of the machine that wrote it):
+
+    PatchDBHeader
+    PatchDBIndex[m_count]       sorted by (checksum, length)
+    records:
+        name length, name (not null terminated)
+        number of elements
+        for each element: address, length, data (padded to 4 bytes)
+*/
+
+#define PATCH_DB_VERSION    1
+
+struct PatchDBHeader
+{
+    char m_magic[4];
+    unsigned int m_version;
+    unsigned int m_source_size;
+    unsigned int m_source_time;
+    unsigned int m_count;
+};
+
+struct PatchDBIndex
+{
+    unsigned int m_checksum;
+    unsigned int m_length;
+    unsigned int m_offset;      // from the start of the file
+};
+
+static const char g_patch_db_magic[4] = { 'I', 'P', 'D', 'B' };
+
+// Index entry with the record data, used while compiling
+struct PatchDBEntry
+{
+    unsigned int m_checksum;
+    unsigned int m_length;
+    string m_record;
+
+    bool operator < (const PatchDBEntry & other) const
+    {
+        if(m_checksum != other.m_checksum)
+            return m_checksum < other.m_checksum;
+        return m_length < other.m_length;
+    }
+};
+
+static bool operator < (const PatchDBIndex & a, const PatchDBIndex & b)
+{
+    if(a.m_checksum != b.m_checksum)
+        return a.m_checksum < b.m_checksum;
+    return a.m_length < b.m_length;
+}
+
+static void append_uint32(string & str, unsigned int value)
+{
+    str.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Split a configuration line into the name, checksum, length and patch
+//
+//  PARAMETERS:
+//      char * line                     Configuration line (modified)
+//      char *& name                    Set to the name of the patch
+//      unsigned int & checksum         Set to the checksum of the target
+//      unsigned int & length           Set to the length of the target
+//      char *& patch                   Set to the patch elements
+//
+//  RETURNS:
+//      bool                            "true" if successful, "false" if not
+//
+////////////////////////////////////////////////////////////////////////////////
+
+static bool parse_header(char * line, char *& name, unsigned int & checksum,
+    unsigned int & length, char *& patch)
+{
+    char *pToken = &line[strspn(line, " \t\n\r")];
+
+    if(*pToken++ != '\"') return false;
+
+    name = pToken;
+
+    if((pToken = strchr(pToken, '\"')) == 0) return false;
+
+    *pToken++ = 0;
+
+    if(sscanf(pToken, "%x %x", &checksum, &length) != 2) return false;
+
+    if((pToken = strchr(pToken, ':')) == 0) return false;
+
+    patch = pToken + 1;
+    return true;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -51,6 +158,7 @@
 bool Patch::load_line(char * line)
 {
     m_num_elements = 0;
+    m_data_size = 0;
     char *pToken = strtok(line, ",\n\r");
 
     while(pToken != 0)
@@ -66,8 +174,10 @@ bool Patch::load_line(char * line)
 
         pToken += strspn(pToken, " \t");
 
+        if(m_num_elements >= PATCH_ELEMENTS_MAX) return false;
+
         unsigned int length = 0;
-        unsigned char * buffer = m_list[m_num_elements].m_buffer;
+        unsigned char * buffer = m_data + m_data_size;
 
         while(*pToken != 0)
         {
@@ -75,7 +185,9 @@ bool Patch::load_line(char * line)
 
             if(sscanf(pToken, "%x", &value) != 1) return false;
 
-            if((value > 255) || (length >= PATCH_ELEMENT_MAX)) return false;
+            if((value > 255) || (length >= PATCH_ELEMENT_MAX) ||
+                (m_data_size + length >= PATCH_DATA_MAX))
+                return false;
 
             buffer[length++] = (unsigned char)value;
 
@@ -87,7 +199,9 @@ bool Patch::load_line(char * line)
         {
             m_list[m_num_elements].m_address = address;
             m_list[m_num_elements].m_length = length;
+            m_list[m_num_elements].m_offset = m_data_size;
             m_num_elements++;
+            m_data_size += length;
         }
         pToken = strtok(0, ",\n\r");
     }
@@ -95,10 +209,20 @@ bool Patch::load_line(char * line)
     return true;
 }
 
+// private
+bool Patch::set_name(const char * name, unsigned int length)
+{
+    if(length >= PATCH_NAME_MAX) return false;
+    memcpy(m_name, name, length);
+    m_name[length] = 0;
+    return true;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Load patch information for a given checksum/length pair
+//  Load patch information for a given checksum/length pair by scanning
+//  the text configuration file
 //
 //  PARAMETERS:
 //      const char * filename           Filename of configuration file
@@ -110,49 +234,289 @@ bool Patch::load_line(char * line)
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-bool Patch::load(const char * filename, unsigned int checksum,
+bool Patch::load_text(const char * filename, unsigned int checksum,
     unsigned int length)
 {
     FILE *hFile;
     if((hFile = fopen(filename, "rb")) == 0) return false;
 
-    while(true)
+    char buffer[PATCH_LINE_MAX];
+    while(fgets(buffer, PATCH_LINE_MAX, hFile) != 0)
     {
-        char buffer[PATCH_LINE_MAX];
-        fgets(buffer, PATCH_LINE_MAX, hFile);
+        char *strName, *strPatch;
+        unsigned int currentChecksum;
+        unsigned int currentLength;
 
-        if(feof(hFile)) break;
+        if(!parse_header(buffer, strName, currentChecksum, currentLength,
+                strPatch))
+            continue;
 
-        char *pToken = &buffer[strspn(buffer, " \t\n\r")];
+        if((currentChecksum != checksum) || (currentLength != length)) continue;
 
-        if(*pToken++ != '\"') continue;
+        if(!load_line(strPatch)) continue;
 
-        char *strName = pToken;
+        if(!set_name(strName, strlen(strName))) continue;
 
-        if((pToken = strchr(pToken, '\"')) == 0) continue;
+        fclose(hFile);
+        return true;
+    }
 
-        *pToken++ = 0;
+    fclose(hFile);
 
-        unsigned int currentChecksum;
-        unsigned int currentLength;
+    return false;
+}
 
-        if(sscanf(pToken, "%x %x", &currentChecksum, &currentLength) != 2) continue;
 
-        if((currentChecksum != checksum) || (currentLength != length)) continue;
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Look up patch information in a compiled patch database
+//
+//  PARAMETERS:
+//      const char * filename           Filename of configuration file
+//      const char * db_filename        Filename of the database
+//      unsigned int checksum           Checksum of target
+//      unsigned int length             Length of target
+//
+//  RETURNS:
+//      int                             1 if found, 0 if not found, -1 if
+//                                      the database is missing or out of
+//                                      date
+//
+////////////////////////////////////////////////////////////////////////////////
 
-        if((pToken = strchr(pToken, ':')) == 0) continue;
+int Patch::load_compiled(const char * filename, const char * db_filename,
+    unsigned int checksum, unsigned int length)
+{
+    struct stat info;
+    if(stat(filename, &info) != 0) return -1;
 
-        if(!load_line(pToken + 1)) continue;
+    HANDLE hFile = CreateFile(db_filename, GENERIC_READ, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hFile == INVALID_HANDLE_VALUE) return -1;
 
-        strcpy(m_name, strName);
+    DWORD size = GetFileSize(hFile, NULL);
+    if(size == 0xffffffff || size < sizeof(PatchDBHeader))
+    {
+        CloseHandle(hFile);
+        return -1;
+    }
 
-        fclose(hFile);
-        return true;
+    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0,
+        NULL);
+    CloseHandle(hFile);
+    if(hMapping == NULL) return -1;
+
+    const unsigned char * view = reinterpret_cast<const unsigned char *>(
+        MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(hMapping);
+    if(view == 0) return -1;
+
+    int result = -1;
+    const unsigned char * end = view + size;
+    const PatchDBHeader * header =
+        reinterpret_cast<const PatchDBHeader *>(view);
+    const PatchDBIndex * index =
+        reinterpret_cast<const PatchDBIndex *>(header + 1);
+
+    if(memcmp(header->m_magic, g_patch_db_magic, 4) != 0 ||
+        header->m_version != PATCH_DB_VERSION ||
+        header->m_source_size != (unsigned int)info.st_size ||
+        header->m_source_time != (unsigned int)info.st_mtime ||
+        header->m_count > (size - sizeof(PatchDBHeader)) / sizeof(PatchDBIndex))
+    {
+        UnmapViewOfFile(view);
+        return -1;
+    }
+
+    // Binary search of the index
+    PatchDBIndex key;
+    key.m_checksum = checksum;
+    key.m_length = length;
+    const PatchDBIndex * index_end = index + header->m_count;
+    const PatchDBIndex * found = std::lower_bound(index, index_end, key);
+
+    result = 0;
+    if(found != index_end && found->m_checksum == checksum &&
+        found->m_length == length && found->m_offset < size)
+    {
+        // Decode the record, checking that it lies within the file.
+        const unsigned int * ptr =
+            reinterpret_cast<const unsigned int *>(view + found->m_offset);
+        bool ok = false;
+        do
+        {
+            if(reinterpret_cast<const unsigned char *>(ptr + 1) > end) break;
+            unsigned int name_length = *ptr++;
+            const char * name = reinterpret_cast<const char *>(ptr);
+            ptr += (name_length + 3) / 4;
+            if(reinterpret_cast<const unsigned char *>(ptr + 1) > end) break;
+            if(!set_name(name, name_length)) break;
+
+            unsigned int num_elements = *ptr++;
+            if(num_elements > PATCH_ELEMENTS_MAX) break;
+            m_num_elements = 0;
+            m_data_size = 0;
+            unsigned int i;
+            for(i = 0; i < num_elements; i++)
+            {
+                if(reinterpret_cast<const unsigned char *>(ptr + 2) > end)
+                    break;
+                unsigned int address = *ptr++;
+                unsigned int elem_length = *ptr++;
+                if(elem_length >= PATCH_ELEMENT_MAX ||
+                    elem_length > PATCH_DATA_MAX - m_data_size ||
+                    reinterpret_cast<const unsigned char *>(ptr) +
+                        elem_length > end)
+                    break;
+                m_list[i].m_address = address;
+                m_list[i].m_length = elem_length;
+                m_list[i].m_offset = m_data_size;
+                memcpy(m_data + m_data_size, ptr, elem_length);
+                m_data_size += elem_length;
+                ptr += (elem_length + 3) / 4;
+                m_num_elements++;
+            }
+            ok = i == num_elements;
+        } while(false);
+        // A corrupt record means the database must be rebuilt.
+        result = ok ? 1 : -1;
     }
 
+    UnmapViewOfFile(view);
+    return result;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Compile a text patch file into a database file
+//
+//  PARAMETERS:
+//      const char * filename           Filename of configuration file
+//      const char * db_filename        Filename of the database to write
+//
+//  RETURNS:
+//      bool                            "true" if successful, "false" if not
+//
+////////////////////////////////////////////////////////////////////////////////
+
+bool Patch::compile(const char * filename, const char * db_filename)
+{
+    struct stat info;
+    if(stat(filename, &info) != 0) return false;
+
+    FILE *hFile;
+    if((hFile = fopen(filename, "rb")) == 0) return false;
+
+    std::vector<PatchDBEntry> entries;
+    Patch * patch = new Patch;
+    char buffer[PATCH_LINE_MAX];
+    while(fgets(buffer, PATCH_LINE_MAX, hFile) != 0)
+    {
+        char *strName, *strPatch;
+        PatchDBEntry entry;
+
+        if(!parse_header(buffer, strName, entry.m_checksum, entry.m_length,
+                strPatch))
+            continue;
+
+        // Skip the same lines that load_text() would skip.
+        if(!patch->load_line(strPatch)) continue;
+
+        unsigned int name_length = strlen(strName);
+        if(name_length >= PATCH_NAME_MAX) continue;
+
+        string & rec = entry.m_record;
+        append_uint32(rec, name_length);
+        rec.append(strName, name_length);
+        rec.append((4 - name_length % 4) % 4, '\0');
+        append_uint32(rec, patch->m_num_elements);
+        for(int i = 0; i < patch->m_num_elements; i++)
+        {
+            const PatchElement & elem = patch->m_list[i];
+            append_uint32(rec, elem.m_address);
+            append_uint32(rec, elem.m_length);
+            rec.append(reinterpret_cast<const char *>(patch->get_buffer(elem)),
+                elem.m_length);
+            rec.append((4 - elem.m_length % 4) % 4, '\0');
+        }
+        entries.push_back(entry);
+    }
+    delete patch;
     fclose(hFile);
 
-    return false;
+    // The first line for a given checksum/length must stay first.
+    std::stable_sort(entries.begin(), entries.end());
+
+    PatchDBHeader header;
+    memcpy(header.m_magic, g_patch_db_magic, 4);
+    header.m_version = PATCH_DB_VERSION;
+    header.m_source_size = info.st_size;
+    header.m_source_time = info.st_mtime;
+    header.m_count = entries.size();
+
+    // Write to a temporary file first, so a failed write never leaves a
+    // truncated database behind.
+    string temp_filename(db_filename);
+    temp_filename += ".tmp";
+    if((hFile = fopen(temp_filename.c_str(), "wb")) == 0) return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, hFile) == 1;
+    unsigned int offset = sizeof(header) + entries.size() * sizeof(PatchDBIndex);
+    std::vector<PatchDBEntry>::const_iterator i;
+    for(i = entries.begin(); ok && i != entries.end(); ++i)
+    {
+        PatchDBIndex index;
+        index.m_checksum = i->m_checksum;
+        index.m_length = i->m_length;
+        index.m_offset = offset;
+        ok = fwrite(&index, sizeof(index), 1, hFile) == 1;
+        offset += i->m_record.size();
+    }
+    for(i = entries.begin(); ok && i != entries.end(); ++i)
+        ok = fwrite(i->m_record.data(), 1, i->m_record.size(), hFile) ==
+            i->m_record.size();
+
+    if(fclose(hFile) != 0) ok = false;
+    if(ok)
+    {
+        remove(db_filename);
+        ok = rename(temp_filename.c_str(), db_filename) == 0;
+    }
+    if(!ok) remove(temp_filename.c_str());
+
+    return ok;
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Load patch information for a given checksum/length pair
+//
+//  PARAMETERS:
+//      const char * filename           Filename of configuration file
+//      unsigned int checksum           Checksum of target
+//      unsigned int length             Length of target
+//
+//  RETURNS:
+//      bool                            "true" if successful, "false" if not
+//
+////////////////////////////////////////////////////////////////////////////////
+
+bool Patch::load(const char * filename, unsigned int checksum,
+    unsigned int length)
+{
+    string db_filename(filename);
+    db_filename += ".db";
+
+    int result = load_compiled(filename, db_filename.c_str(), checksum,
+        length);
+    if(result == -1 && compile(filename, db_filename.c_str()))
+        result = load_compiled(filename, db_filename.c_str(), checksum,
+            length);
+
+    // If the database cannot be used, the text file still works.
+    if(result == -1)
+        return load_text(filename, checksum, length);
+    return result == 1;
+}
@@ -37,6 +37,10 @@
 #define PATCH_ELEMENTS_MAX  20
 #define PATCH_LINE_MAX      4096
 #define PATCH_ELEMENT_MAX   4096
+// Total size of the data of all elements of a patch. Every byte takes at
+// least one character of the line, so a line read with a PATCH_LINE_MAX
+// buffer always fits.
+#define PATCH_DATA_MAX      PATCH_LINE_MAX
 #define PATCH_NAME_MAX      100
 
 class PatchElement
@@ -44,28 +48,49 @@ class PatchElement
 public:
     unsigned int m_address;
     unsigned int m_length;
-    unsigned char m_buffer[PATCH_ELEMENT_MAX + 1];
+    // Offset of the data in Patch::m_data
+    unsigned int m_offset;
 };
 
+/*
+    Patch information is stored in text files (Ignition.cfg, ilpatch.cfg)
+    with one line per client version. The text file is compiled into a
+    database file (the same filename with ".db" appended) with an index
+    sorted by (checksum, length). The database is rebuilt whenever the size
+    or modification time of the text file changes, and load() falls back to
+    reading the text file if the database cannot be written.
+*/
 class Patch
 {
 public:
     char m_name[PATCH_NAME_MAX];
     int m_num_elements;
+    unsigned int m_data_size;
     PatchElement m_list[PATCH_ELEMENTS_MAX];
+    unsigned char m_data[PATCH_DATA_MAX];
 
 private:
     // Create patch information from a configuration line
     bool load_line(char * line);
+    bool set_name(const char * name, unsigned int length);
+    bool load_text(const char * filename, unsigned int checksum,
+        unsigned int length);
+    // Returns 1 if found, 0 if not found, or -1 if the database is missing
+    // or out of date.
+    int load_compiled(const char * filename, const char * db_filename,
+        unsigned int checksum, unsigned int length);
 
 public:
     bool load(const char * filename, unsigned int checksum,
         unsigned int length);
+    // Compile a text patch file into a database file
+    static bool compile(const char * filename, const char * db_filename);
 
     const char * get_name() const { return m_name; }
     int get_num_elements() const { return m_num_elements; }
     const PatchElement * get_elements() const { return m_list; }
+    const unsigned char * get_buffer(const PatchElement & elem) const
+    { return m_data + elem.m_offset; }
 };
 
 #endif
-
@@ -26,6 +26,24 @@
 #include "Editor.h"
 #pragma package(smart_init)
 //---------------------------------------------------------------------------
+// Wait without blocking the other scripts of the worker. The script may be
+// woken early for an event it no longer waits for, so wait out the rest.
+static void ScriptSleep(Sasha::TParser *Parser, int Msec)
+{
+    DWORD Start=GetTickCount();
+    int Left=Msec;
+    do
+    {
+        if(!Parser->Wait(Left))
+        {
+            if(Left>=0)
+                Sleep(Left);
+            return;
+        }
+        Left=Msec-(int)(GetTickCount()-Start);
+    } while(Left>0 && !Parser->Terminated);
+}
+
 TVariable __cdecl DoPrint(TVariable *v[], int ParamCount,Sasha::TParser *Parser)
 {
     UO->ClientPrint(v[0]->Data.AsString.c_str());
@@ -34,9 +52,8 @@ TVariable __cdecl DoPrint(TVariable *v[], int ParamCount,Sasha::TParser *Parser)
 
 TVariable __cdecl DoExec(TVariable *v[], int ParamCount,Sasha::TParser *Parser)
 {
-//    UO->DoCommand(v[0]->Data.AsString.c_str());
-// The command should be executed from the main thread. So use SendMessage to synchronize
-    SendMessage(MainForm->Handle,WM_USER+0x1000,0,(int)v[0]->Data.AsString.c_str());
+// The command is queued for the main thread, which runs it at a safe point
+    UO->DoCommand(v[0]->Data.AsString.c_str());
     return TVariable(true);
 }
 
@@ -71,7 +88,7 @@ TVariable __cdecl DoSendKey(TVariable *v[], int ParamCount,Sasha::TParser *Parse
     {
         SendMessageW(UOWindow,WM_KEYDOWN,v[0]->Data.AsNumber,1);
         SendMessageW(UOWindow,WM_KEYUP,v[0]->Data.AsNumber,1|(3<<30));
-        Sleep(SleepT);
+        ScriptSleep(Parser,SleepT);
     }
 
     return TVariable(true);
@@ -149,7 +166,7 @@ TVariable __cdecl DoDrag(TVariable *v[], int ParamCount,Sasha::TParser *Parser)
     SendMessage(UOWindow,WM_LBUTTONDOWN,MK_LBUTTON,MAKELPARAM(X1,Y1));
     SendMessage(UOWindow,WM_SETCURSOR,(int)UOWindow,MAKELPARAM(HTCLIENT,WM_MOUSEMOVE));
     SendMessage(UOWindow,WM_MOUSEMOVE,0,MAKELPARAM(X1,Y1));
-    Sleep(400);
+    ScriptSleep(Parser,400);
     SendMessage(UOWindow,WM_LBUTTONUP,MK_LBUTTON,MAKELPARAM(X1,Y1));
 
     for(int i=0; i<Str.Length(); i++)
@@ -182,7 +199,7 @@ TVariable __cdecl DoASC(TVariable *v[], int ParamCount,Sasha::TParser *Parser)
 
 TVariable __cdecl DoWait(TVariable *v[], int ParamCount,Sasha::TParser *Parser)
 {
-    Sleep(v[0]->Data.AsNumber);
+    ScriptSleep(Parser,v[0]->Data.AsNumber);
     return TVariable(true);
 }
 
@@ -311,29 +328,541 @@ Sasha::TParser::PropTable UOProperties[]=
     0,0,0
 };
 
-__fastcall TRunner::TRunner(bool CreateSuspended, const char* Nam)
-    : TThread(CreateSuspended),Name(Nam)
+//---------------------------------------------------------------------------
+// .    fiber-   .
+// Scripts run as fibers on a few worker threads instead of a thread each.
+
+const int NumWorkers=2;
+const DWORD TimeSlice=20;   // ms a script may run before the next one gets a turn
+
+static TWorker *Workers[NumWorkers];
+static TWorker *Abandoned=0;    // see AbandonRunner()
+// ScriptWake() reads Workers[] on the client thread while the main thread
+// changes it, so both hold this lock for it. A worker is taken out of
+// Workers[] under the lock before it is deleted.
+class TWorkersLock
 {
-    FreeOnTerminate=true;
+    CRITICAL_SECTION Lock;
+public:
+    TWorkersLock() {InitializeCriticalSection(&Lock);}
+    ~TWorkersLock() {DeleteCriticalSection(&Lock);}
+    void Enter() {EnterCriticalSection(&Lock);}
+    void Leave() {LeaveCriticalSection(&Lock);}
+};
+static TWorkersLock WorkersLock;
+// __thread does not work in a LoadLibrary'd DLL
+static DWORD WorkerIndex=TLS_OUT_OF_INDEXES;
+
+static void WaitInWorker(Sasha::TParser &P, int Msec)
+{
+    TWorker *W=TWorker::GetCurrent();
+    if(W)
+        W->Wait(Msec);
+    else if(Msec>0)
+        Sleep(Msec);
 }
+
 //---------------------------------------------------------------------------
-void __fastcall TRunner::Execute()
+//   .       
+//      .
+// The parsed editor text. Starting a script from the same text again only
+// copies its globals instead of parsing the whole script. The lock also
+// serialises the Code reference counts, which the parsers change on
+// several threads.
+class TCodeCache
+{
+    CRITICAL_SECTION Lock;
+    unsigned long Hash;
+    AnsiString Text;
+    Sasha::TParser::Code *Code;
+
+    static unsigned long HashText(const AnsiString &T)
+    {
+        unsigned long h=0;
+        const char *p=T.c_str();
+        for(int i=0; i<T.Length(); i++)
+            h=h*31+(unsigned char)p[i];
+        return h;
+    }
+public:
+    TCodeCache() : Hash(0),Code(0) {InitializeCriticalSection(&Lock);}
+    ~TCodeCache() {Clear(); DeleteCriticalSection(&Lock);}
+
+// Sets up P from the cached code if it was made from T
+    bool Load(Sasha::TParser &P, const AnsiString &T)
+    {
+        unsigned long h=HashText(T);
+        bool Found=false;
+        EnterCriticalSection(&Lock);
+        if(Code && Hash==h && Text==T)
+        {
+            P.SetCode(Code);
+            Found=true;
+        }
+        LeaveCriticalSection(&Lock);
+        return Found;
+    }
+// Remembers the code of P, which has just preprocessed T
+    void Store(Sasha::TParser &P, const AnsiString &T)
+    {
+        EnterCriticalSection(&Lock);
+        Sasha::TParser::Code *C=P.GetCode();
+        if(C)
+        {
+            if(Code)
+                Code->Release();
+            Code=C;
+            Hash=HashText(T);
+            Text=T;
+        }
+        LeaveCriticalSection(&Lock);
+    }
+    void Free(Sasha::TParser *P)
+    {
+        EnterCriticalSection(&Lock);
+        delete P;
+        LeaveCriticalSection(&Lock);
+    }
+    void Clear()
+    {
+        EnterCriticalSection(&Lock);
+        if(Code)
+            Code->Release();
+        Code=0;
+        Text="";
+        LeaveCriticalSection(&Lock);
+    }
+};
+
+static TCodeCache CodeCache;
+
+#ifdef USE_BENCHMARKS
+//---------------------------------------------------------------------------
+//  : ,  property  ,  
+// Checks that a script whose top level reads a property is parsed again on
+// every run, so that the second run does not get the first run's value.
+static int TestCounter=0;
+
+static TVariable __cdecl GetTestCounter(TVariable *v[], int ParamCount,Sasha::TParser *Parser)
+{
+    return TVariable((double)++TestCounter);
+}
+
+static Sasha::TParser::PropTable TestProperties[]=
+{
+    "Counter",GetTestCounter,Invalid,
+    0,0,0
+};
+
+static double RunCacheTest(TCodeCache &Cache, const AnsiString &Text)
+{
+    Sasha::TParser *P=new Sasha::TParser;
+    P->SetProperties("TestClass",TestProperties);
+    TVariable T;
+    T.Type=(TVariable::VarType)T_Class; T.Data.AsString="TestClass";
+    P->SetGlobalVariable("T",T);
+    if(!Cache.Load(*P,Text))
+    {
+        P->SetScript(Text.c_str(),Text.Length());
+        P->PreProcess();
+        if(!P->Error)
+            Cache.Store(*P,Text);
+    }
+    double Result=-1;
+    if(!P->Error)
+        Result=P->Execute("main").Data.AsNumber;
+    Cache.Free(P);
+    return Result;
+}
+
+// Returns 0, or what went wrong
+const char *CheckCodeCache()
+{
+    TCodeCache Cache;
+    AnsiString Plain="VAR Start = 5\r\nsub main()\r\n  return Start\r\nend sub\r\n";
+    if(RunCacheTest(Cache,Plain)!=5 || RunCacheTest(Cache,Plain)!=5)
+        return "a script without properties at the top level gave a wrong value";
+    AnsiString Prop="VAR Start = T.Counter\r\nsub main()\r\n  return Start\r\nend sub\r\n";
+    TestCounter=0;
+    if(RunCacheTest(Cache,Prop)!=1)
+        return "the first run of a property read gave a wrong value";
+    if(RunCacheTest(Cache,Prop)!=2)
+        return "the second run of a property read got the first run's value";
+    return 0;
+}
+#endif
+
+// Waits for a worker thread to end. A script in a message box sends
+// messages to its owner window on this thread, so sent messages are
+// handled meanwhile, but nothing posted is dispatched.
+static void WaitForWorker(TWorker *W)
+{
+    HANDLE H=(HANDLE)W->Handle;
+    while(MsgWaitForMultipleObjects(1,&H,false,INFINITE,QS_SENDMESSAGE)==
+            WAIT_OBJECT_0+1)
+    {
+        MSG Msg;
+        PeekMessage(&Msg,0,0,0,PM_NOREMOVE);
+    }
+}
+
+// Frees the abandoned workers whose threads have ended, or waits for all
+static void FreeAbandoned(bool Wait)
+{
+    TWorker **P=&Abandoned;
+    while(*P)
+    {
+        TWorker *W=*P;
+        if(Wait)
+            WaitForWorker(W);
+        if(WaitForSingleObject((HANDLE)W->Handle,0)==WAIT_OBJECT_0)
+        {
+            *P=W->NextAbandoned;
+            delete W;
+        }
+        else
+            P=&W->NextAbandoned;
+    }
+}
+
+void StartRunner(TRunner *R)
+{
+    if(WorkerIndex==TLS_OUT_OF_INDEXES)
+        WorkerIndex=TlsAlloc();
+    FreeAbandoned(false);
+    int Best=0;
+    WorkersLock.Enter();
+    for(int i=0; i<NumWorkers; i++)
+    {
+        if(!Workers[i])
+            Workers[i]=new TWorker(MainForm->Handle);
+        if(Workers[i]->GetCount()<Workers[Best]->GetCount())
+            Best=i;
+    }
+    Workers[Best]->Add(R);
+    WorkersLock.Leave();
+}
+
+bool AbandonRunner(TRunner *R)
+{
+    int i;
+    WorkersLock.Enter();
+    for(i=0; i<NumWorkers; i++)
+        if(Workers[i] && Workers[i]==R->Worker)
+            break;
+    TRunner *Others;
+    if(i==NumWorkers || !Workers[i]->Abandon(R,Others))
+    {
+        WorkersLock.Leave();
+        return false;
+    }
+    Workers[i]->NextAbandoned=Abandoned;
+    Abandoned=Workers[i];
+    Workers[i]=0;
+    WorkersLock.Leave();
+    R->RemoveFromList();
+    while(Others)
+    {
+        TRunner *Next=Others->Next;
+        StartRunner(Others);
+        Others=Next;
+    }
+    return true;
+}
+
+void StopWorkers()
+{
+    int i;
+    WorkersLock.Enter();
+    for(i=0; i<NumWorkers; i++)
+        if(Workers[i])
+            Workers[i]->Stop();
+    WorkersLock.Leave();
+// Wait for them all, even a script stuck in a MessageBox, because their code
+// goes away with the DLL. The lock is not held while waiting, since
+// ScriptWake() may be waiting for it on the client thread.
+    for(i=0; i<NumWorkers; i++)
+    {
+        WorkersLock.Enter();
+        TWorker *W=Workers[i];
+        Workers[i]=0;
+        WorkersLock.Leave();
+        if(W)
+        {
+            WaitForWorker(W);
+            delete W;
+        }
+    }
+    FreeAbandoned(true);
+// Scripts that ended before the workers did were posted to the main form
+    MSG Msg;
+    while(PeekMessage(&Msg,MainForm->Handle,WM_SCRIPTDONE,WM_SCRIPTDONE,
+            PM_REMOVE))
+        delete (TRunner*)Msg.lParam;
+    CodeCache.Clear();
+    if(WorkerIndex!=TLS_OUT_OF_INDEXES)
+        TlsFree(WorkerIndex);
+    WorkerIndex=TLS_OUT_OF_INDEXES;
+}
+
+// Lets injection.dll keep the event marks of each script apart, since
+// many scripts share a thread.
+extern "C" unsigned long * __export __cdecl ScriptEventMark()
+{
+    TWorker *W=TWorker::GetCurrent();
+    if(!W || !W->GetCurrentRunner())
+        return 0;
+    return &W->GetCurrentRunner()->EventMark;
+}
+
+// Lets injection.dll wake a waiting script when its event happens or its
+// command has run, instead of the script checking again and again.
+extern "C" void * __export __cdecl ScriptCurrent()
+{
+    TWorker *W=TWorker::GetCurrent();
+    return W?W->GetCurrentRunner():0;
+}
+
+// The script may have ended since, so look for it first. This runs on the
+// client thread.
+extern "C" void __export __cdecl ScriptWake(void *Script)
+{
+    WorkersLock.Enter();
+    for(int i=0; i<NumWorkers; i++)
+        if(Workers[i] && Workers[i]->WakeRunner((TRunner*)Script))
+            break;
+    WorkersLock.Leave();
+}
+
+//---------------------------------------------------------------------------
+__fastcall TWorker::TWorker(HWND O)
+    : TThread(true),Owner(O),MainFiber(0),Runners(0),Current(0),Count(0),
+      NextAbandoned(0)
+{
+    InitializeCriticalSection(&Lock);
+    WakeUp=CreateEvent(0,false,false,0);
+    Resume();
+}
+
+__fastcall TWorker::~TWorker()
+{
+// Scripts left here could not be stopped; just free them
+    while(Runners)
+    {
+        TRunner *R=Runners;
+        Runners=R->Next;
+        delete R;
+    }
+    CloseHandle(WakeUp);
+    DeleteCriticalSection(&Lock);
+}
+
+TWorker *TWorker::GetCurrent()
+{
+    if(WorkerIndex==TLS_OUT_OF_INDEXES)
+        return 0;
+    return (TWorker*)TlsGetValue(WorkerIndex);
+}
+
+void TWorker::Add(TRunner *R)
+{
+    R->Worker=this;
+    R->WakeTime=GetTickCount();
+    EnterCriticalSection(&Lock);
+    R->Next=Runners;
+    Runners=R;
+    Count++;
+    LeaveCriticalSection(&Lock);
+    Wake();
+}
+
+// Returns a script that can run, or 0 and how long to sleep
+TRunner *TWorker::PickReady(DWORD &Timeout)
+{
+    DWORD Now=GetTickCount();
+    TRunner *Ready=0;
+    Timeout=INFINITE;
+    EnterCriticalSection(&Lock);
+// The scripts of a stopped worker are all terminated, so all are ready
+    for(TRunner *R=Runners; R; R=R->Next)
+    {
+        long Left=(long)(R->WakeTime-Now);
+        if(Left<=0 || R->Woken || R->Parser->Terminated)
+            Ready=R;    // the last one is the one that waited longest
+        else if((DWORD)Left<Timeout)
+            Timeout=Left;
+    }
+    if(Ready)
+    {
+        Ready->Woken=false;
+// Move it to the front, so that the others get their turn first next time
+        TRunner **P=&Runners;
+        while(*P!=Ready)
+            P=&(*P)->Next;
+        *P=Ready->Next;
+        Ready->Next=Runners;
+        Runners=Ready;
+    }
+// Set under the lock for Abandon()
+    Current=Ready;
+    LeaveCriticalSection(&Lock);
+    return Ready;
+}
+
+void __fastcall TWorker::Execute()
+{
+    TlsSetValue(WorkerIndex,this);
+    MainFiber=ConvertThreadToFiber(0);
+    for(;;)
+    {
+        DWORD Timeout;
+        TRunner *R=PickReady(Timeout);
+        if(!R)
+        {
+            if(Terminated)
+                break;
+            WaitForSingleObject(WakeUp,Timeout);
+            continue;
+        }
+
+        SliceStart=GetTickCount();
+        SwitchToFiber(R->Fiber);
+
+        EnterCriticalSection(&Lock);
+        Current=0;
+        if(R->Finished)
+        {
+            TRunner **P=&Runners;
+            while(*P!=R)
+                P=&(*P)->Next;
+            *P=R->Next;
+            Count--;
+        }
+        LeaveCriticalSection(&Lock);
+// The main form takes it off the list. Synchronize() would deadlock with
+// StopWorkers(), which waits for this thread on the main thread.
+        if(R->Finished)
+            if(Terminated || !PostMessage(Owner,WM_SCRIPTDONE,0,(LPARAM)R))
+                delete R;
+    }
+}
+
+void TWorker::Stop()
+{
+    EnterCriticalSection(&Lock);
+    for(TRunner *R=Runners; R; R=R->Next)
+        R->Parser->Terminate();
+    Terminate();
+    LeaveCriticalSection(&Lock);
+    Wake();
+}
+
+bool TWorker::Abandon(TRunner *R, TRunner *&Others)
+{
+    Others=0;
+    EnterCriticalSection(&Lock);
+    bool Stuck=Current==R;
+    if(Stuck)
+    {
+        Terminate();
+        TRunner **P=&Runners;
+        while(*P)
+        {
+            TRunner *Next=(*P)->Next;
+            if(*P==R)
+                P=&R->Next;
+            else
+            {
+                (*P)->Next=Others;
+                Others=*P;
+                *P=Next;
+                Count--;
+            }
+        }
+    }
+    LeaveCriticalSection(&Lock);
+    return Stuck;
+}
+
+bool TWorker::WakeRunner(TRunner *R)
+{
+    EnterCriticalSection(&Lock);
+    TRunner *P=Runners;
+    while(P && P!=R)
+        P=P->Next;
+    if(P)
+        P->Woken=true;
+    LeaveCriticalSection(&Lock);
+    if(P)
+        Wake();
+    return P!=0;
+}
+
+void TWorker::Wait(int Msec)
+{
+    DWORD Now=GetTickCount();
+    if(Current->Parser->Terminated)
+        return;     // let it finish
+// At the end of a line only switch when the time slice is used up
+    if(Msec<=0 && Now-SliceStart<TimeSlice)
+        return;
+    if(Msec<0)
+        Msec=0;
+    Current->WakeTime=Now+Msec;
+    SwitchToFiber(MainFiber);
+}
+
+//---------------------------------------------------------------------------
+TRunner::TRunner(const char* Nam)
+    : Name(Nam),Worker(0),Next(0),WakeTime(0),Woken(false),Finished(false),
+      EventMark(0)
 {
-  __try {
     Parser=new Sasha::TParser;
+    Fiber=CreateFiber(0,FiberProc,this);
+}
+
+TRunner::~TRunner()
+{
+// Let injection.dll close what the script left open
+    if(UO && UO->ScriptEnded)
+        UO->ScriptEnded(this);
+    if(Fiber)
+        DeleteFiber(Fiber);
+    CodeCache.Free(Parser);
+}
+
+void __stdcall TRunner::FiberProc(LPVOID Param)
+{
+    TRunner *R=(TRunner*)Param;
+    R->Run();
+    R->Finished=true;
+// A fiber must not return, so go back to the worker for good
+    SwitchToFiber(R->Worker->MainFiber);
+}
+
+void TRunner::Run()
+{
+  __try {
     Sasha::TParser &P=*Parser;
 
     P.SetClass("InternalUoClass",UOFunctions);
     P.SetProperties("InternalUoClass",UOProperties);
     P.SetFunctions(Func);
+    P.SetWaitFunction(WaitInWorker);
     TVariable UO;
     UO.Type=(TVariable::VarType)T_Class; UO.Data.AsString="InternalUoClass";
     P.SetGlobalVariable("UO",UO);
 
     ::UO->AddClasses((ParserObject*)Parser,GetLibraryFunctions());
 
-    P.SetScript(EditForm->Script->Text.c_str(),EditForm->Script->Text.Length());
-    P.PreProcess();
+    AnsiString Text=EditForm->Script->Text;
+    if(!CodeCache.Load(P,Text))
+    {
+        P.SetScript(Text.c_str(),Text.Length());
+        P.PreProcess();
+        if(!P.Error)
+            CodeCache.Store(P,Text);
+    }
     if(P.Error)
         MessageBox(MainForm->Handle,P.ErrString,(AnsiString("SetScript at ")+P.GetErrorLine()).c_str(),0);
     else
@@ -343,7 +872,6 @@ void __fastcall TRunner::Execute()
             MessageBox(MainForm->Handle,P.ErrString,(AnsiString("Execute at ")+P.GetErrorLine()).c_str(),0);
     }
   } __except(EXCEPTION_EXECUTE_HANDLER) {MessageBox(0,"Unhandled exception in parser.",0,0);}
-  Synchronize(RemoveFromList);
 }
 //---------------------------------------------------------------------------
 void __fastcall TRunner::RemoveFromList()
@@ -351,12 +879,12 @@ void __fastcall TRunner::RemoveFromList()
     int t=MainForm->RunList->Items->IndexOf(IntToHex((int)this,8)+" "+Name);
     if(t!=-1)
         MainForm->RunList->Items->Delete(t);
-    delete Parser;
 }
 
-void __fastcall TRunner::StopRunning()
+// The script stops at the end of its current line, or when its wait ends
+void TRunner::StopRunning()
 {
     Parser->Terminate();
-    Terminate();
+    if(Worker)
+        Worker->Wake();
 }
-
@@ -25,18 +25,87 @@
 //---------------------------------------------------------------------------
 #include "myparser.h"
 
-class TRunner : public TThread
+class TWorker;
+
+// A running script. It has no thread of its own but runs as a fiber on one
+// of the scheduler's workers, and gives the worker back whenever it waits.
+class TRunner
 {
+    friend class TWorker;
+    friend bool AbandonRunner(TRunner *R);
 private:
     AnsiString Name;
+    LPVOID Fiber;
+    TWorker *Worker;
+    TRunner *Next;          // in the worker's list
+    DWORD WakeTime;         // GetTickCount() to run again at
+    bool Woken;             // by ScriptWake(), before WakeTime
+    bool Finished;
+
+    static void __stdcall FiberProc(LPVOID Param);
+    void Run();
+public:
+    Sasha::TParser *Parser;
+    unsigned long EventMark;    // for injection.dll, see ScriptEventMark()
+
+    TRunner(const char* Nam);
+    ~TRunner();
+    void __fastcall RemoveFromList();
+    void StopRunning();
+    bool IsTerminated() {return Parser->Terminated;}
+};
+
+// Runs the fibers of its scripts one at a time. A script runs until it
+// waits or its time slice ends at the end of a line.
+class TWorker : public TThread
+{
+private:
+    CRITICAL_SECTION Lock;
+    HANDLE WakeUp;          // set when a script is added, stopped or woken
+    HWND Owner;             // gets WM_SCRIPTDONE
+    LPVOID MainFiber;
+    TRunner *Runners;
+    TRunner *Current;
+    DWORD SliceStart;
+    int Count;
+
+    TRunner *PickReady(DWORD &Timeout);
 protected:
     void __fastcall Execute();
 public:
-    Sasha::TParser *Parser;
-    __fastcall TRunner::TRunner(bool CreateSuspended, const char* Nam);
-    void __fastcall TRunner::RemoveFromList();
-    void __fastcall StopRunning();
-    bool IsTerminated() {return Terminated;}
+    TWorker *NextAbandoned;
+
+    __fastcall TWorker(HWND O);
+    __fastcall ~TWorker();
+    void Add(TRunner *R);
+    // Stops all the scripts; the thread ends once they have
+    void Stop();
+    // Gives up the worker if R is running on it now: the thread is left
+    // to R alone and ends after it. Returns the other scripts in Others.
+    bool Abandon(TRunner *R, TRunner *&Others);
+    void Wake() {SetEvent(WakeUp);}
+    // Runs R as soon as possible, if it is one of ours
+    bool WakeRunner(TRunner *R);
+    int GetCount() {return Count;}
+    // Called on a script's fiber by TParser::Wait()
+    void Wait(int Msec);
+    static TWorker *GetCurrent();
+    TRunner *GetCurrentRunner() {return Current;}
 };
+
+// Starts a script on the least busy worker.
+void StartRunner(TRunner *R);
+// Gives up on a script that does not stop, because it is stuck in a
+// message box or a call into another DLL. Its worker is left to it and
+// the other scripts move to a new one. Returns false if the script is not
+// running right now, and so will stop by itself.
+bool AbandonRunner(TRunner *R);
+// Stops all scripts and waits for them, before the DLL is unloaded.
+void StopWorkers();
+#ifdef USE_BENCHMARKS
+// Runs scripts twice through the parsed text cache. Returns 0 if they
+// gave the right values, else what went wrong.
+const char *CheckCodeCache();
+#endif
 //---------------------------------------------------------------------------
 #endif
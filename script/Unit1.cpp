@@ -23,6 +23,7 @@
 #pragma hdrstop
 
 #include "UnitFrm.h"
+#include "ScrRun.h"
 
 #pragma argsused
 int WINAPI DllEntryPoint(HINSTANCE hinst, unsigned long reason, void* lpReserved)
@@ -46,10 +47,15 @@ extern "C" void __export __cdecl Init(DllInterface *intf)
     GetClientRect(Tab,&R);
     MainForm->Left=0; MainForm->Top=0;
     MainForm->Height=R.right; MainForm->Width=R.bottom;
+#ifdef USE_BENCHMARKS
+    if(const char *Err=CheckCodeCache())
+        MessageBox(0,Err,"Script cache check failed",MB_OK|MB_ICONSTOP);
+#endif
 }
 
 extern "C" void __export __cdecl Cleanup()
 {
+    StopWorkers();
     if(MainForm)
     {
         delete MainForm;
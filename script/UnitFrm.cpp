@@ -41,6 +41,13 @@ void __fastcall TMainForm::OnMessage(TMessage &M)
     UO->DoCommand((char*)M.LParam);
 }
 
+void __fastcall TMainForm::OnScriptDone(TMessage &M)
+{
+    TRunner *R=(TRunner*)M.LParam;
+    R->RemoveFromList();
+    delete R;
+}
+
 void __fastcall TMainForm::Button1Click(TObject *Sender)
 {
     if(OD->Execute())
@@ -61,9 +68,9 @@ void __fastcall TMainForm::Button3Click(TObject *Sender)
 //---------------------------------------------------------------------------
 extern "C" void __export __cdecl RunFunction(const char *Name)
 {
-    TRunner *tmp=new TRunner(true,Name);
+    TRunner *tmp=new TRunner(Name);
     MainForm->RunList->Items->Add(IntToHex((int)tmp,8)+" "+Name);
-    tmp->Resume();
+    StartRunner(tmp);
 }
 
 void __fastcall TMainForm::Button4Click(TObject *Sender)
@@ -113,18 +120,16 @@ void __fastcall TMainForm::Button5Click(TObject *Sender)
         return;
     }
 
-    __try {
-        if(R->IsTerminated())
-        {
-            if(IDYES!=MessageBox(Handle,"Function does not respond. Really terminate it?","Warning",MB_YESNO|MB_ICONQUESTION))
-                return;
-            R->Suspend();   // I don't call TerminateThread because it may crash 9x
-            R->RemoveFromList();
-            delete R;
-        }
-        else
-            R->StopRunning();
-    } __except(EXCEPTION_EXECUTE_HANDLER) {}
+    // Scripts stop at the end of a line or a wait, and are removed from the
+    // list then. One that is stuck in a message box or another DLL can only
+    // be left to its thread.
+    if(!R->IsTerminated())
+        R->StopRunning();
+    else if(IDYES==MessageBox(Handle,"Function does not respond. Abandon it?\n"
+            "It keeps its thread, and other functions move to a new one.",
+            "Warning",MB_YESNO|MB_ICONQUESTION))
+        if(!AbandonRunner(R))
+            MessageBox(Handle,"Function is busy and will stop as soon as it can.","Warning",MB_ICONSTOP);
 }
 //---------------------------------------------------------------------------
 void __fastcall TMainForm::Button2Click(TObject *Sender)
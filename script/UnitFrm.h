@@ -28,6 +28,9 @@
 #include <Dialogs.hpp>
 #include "..\extdll.h"
 //---------------------------------------------------------------------------
+// Posted by a worker when a script has ended, with its TRunner in LParam
+const UINT WM_SCRIPTDONE=WM_USER+0x1001;
+
 class TMainForm : public TForm
 {
 __published:    // IDE-managed Components
@@ -53,9 +56,11 @@ private:    // User declarations
 public:     // User declarations
     __fastcall TMainForm(TComponent* Owner);
     void __fastcall OnMessage(TMessage &Message);
+    void __fastcall OnScriptDone(TMessage &Message);
 #pragma warn -inl    
 BEGIN_MESSAGE_MAP
   MESSAGE_HANDLER(WM_USER+0x1000, TMessage, OnMessage)
+  MESSAGE_HANDLER(WM_SCRIPTDONE, TMessage, OnScriptDone)
 END_MESSAGE_MAP(TForm)
 };
 //---------------------------------------------------------------------------
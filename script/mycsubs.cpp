@@ -67,6 +67,7 @@ static void __cdecl SetNumber(const ParserVariable *v, double Num)
     TVariable *Var=(TVariable*)v;
     Var->Type=TVariable::T_Number;
     Var->Data.AsNumber=Num;
+    Var->Data.AsString.Clear();
 }
 
 static void __cdecl SetUserData(const ParserVariable *v, const void *Data)
@@ -143,6 +144,16 @@ static void __cdecl PSetProperties(ParserObject *Parser, const char * Class, con
     ((TParser*)Parser)->SetCProperties(Class,Prop);
 }
 
+static bool __cdecl PWait(ParserObject *Parser, int Msec)
+{
+    return ((TParser*)Parser)->Wait(Msec);
+}
+
+static bool __cdecl PIsTerminated(ParserObject *Parser)
+{
+    return ((TParser*)Parser)->Terminated;
+}
+
 static ParserVariable* __cdecl PGetGlobVar(ParserObject *Parser, const char* Name)
 {
     TVariable v=((TParser*)Parser)->GetGlobalVariable(Name);
@@ -174,7 +185,9 @@ LibraryFunctions *GetLibraryFunctions()
         PSetClass,
         PSetProperties,
         PGetGlobVar,
-        CError
+        CError,
+        PWait,
+        PIsTerminated
     };
     return &Fun;
 }
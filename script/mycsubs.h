@@ -85,6 +85,8 @@ typedef bool __cdecl __RtlPex(ParserObject *Parser, ParserVariable *Result,
 typedef void __cdecl __RtlPv(ParserObject *Parser);
 typedef void __cdecl __RtlPcp(ParserObject *Parser, const char* Name, const ParserVariable *Val);
 typedef ParserVariable* __cdecl __RtlPcg(ParserObject *Parser, const char* Name);
+typedef bool __cdecl __RtlPw(ParserObject *Parser, int Msec);
+typedef bool __cdecl __RtlPt(ParserObject *Parser);
 
 typedef void __cdecl __RtlPpf(ParserObject *Parser, const struct CFuncTable *Table);
 typedef void __cdecl __RtlPcf(ParserObject *Parser, const char *Class,const struct CFuncTable *Table);
@@ -149,6 +151,16 @@ struct LibraryFunctions
 
 //  TVariable   
     __RtlFss *Error;
+
+//  Msec ,    .  false, 
+//      -    .
+// Waits without holding up other scripts. Returns false if the parser has
+// no wait function, in which case the caller has to block by itself.
+    __RtlPw *Wait;
+
+//  ,     .
+// True if the script is being stopped and should stop waiting.
+    __RtlPt *IsTerminated;
 };
 
 #include <poppack.h>
@@ -57,18 +57,19 @@ const char *TParser::ErrorStrings[] =
 TParser::TParser() : Script(0), ScriptSize(0), Error(0), ScriptPos(0),
     FinishedSub(false), Terminated(false)
 {
+    Prog=new Code;
     ErrPos=0;
     ReturnCR=false;
     TmpErrorString=0;
     CycleDepth=0;
     FatalError=0.0;
     DbgFun=0;
+    WaitFun=0;
 }
 
 TParser::~TParser()
 {
-    if(Script)
-        delete Script;
+    Prog->Release();
     if(TmpErrorString)
         free(TmpErrorString);
 }
@@ -116,6 +117,10 @@ void TParser::SetVar (TVariable &Dest, const TVariable &Source)
     {
         if(IsPreprocessing&&FunctionName.Length())
             return;
+// Property   - PreProcess    (. CallSub)
+// An external property, so SetCode cannot stand in for this (see CallSub)
+        if(IsPreprocessing)
+            Prog->Shareable=false;
 
         TString VarName=New.Data.AsString;
         //   ,   : (  )
@@ -213,6 +218,10 @@ int i,j,i1;
             t.Data.AsNumber=0;
             return t;
         }
+//  property (UO.Gold)   ,    
+// A property value (UO.Gold) depends on the run, like a function call
+        if(IsPreprocessing)
+            Prog->Shareable=false;
 
         TString VarName=New.Data.AsString;
         //   ,   :
@@ -264,9 +273,9 @@ int i,j,i1;
 
 //       ,   
 //            
-    for(i=0; i<Functions.Count; i++)
-        if(Functions[i].Name == New.Data.AsString)
-            return Functions[i].Name.c_str();
+    for(i=0; i<Prog->Functions.Count; i++)
+        if(Prog->Functions[i].Name == New.Data.AsString)
+            return Prog->Functions[i].Name.c_str();
 
     SetError(P_VarUndefined,0,New.Data.AsString.c_str());
     return ::Error();
@@ -328,8 +337,8 @@ void TParser::SetParserError(char *Err)
 
 bool TParser::SetScript(const char *Scr, int ScrSize)
 {
-    if(Script)
-        delete Script;
+    Prog->Release();
+    Prog=new Code;
     Script = new char [ScrSize+10]; // +10,     
                                     //     
     memcpy(Script, Scr, ScrSize);
@@ -337,6 +346,8 @@ bool TParser::SetScript(const char *Scr, int ScrSize)
     Script[ScrSize+1]=0;  //   ...
     Script[ScrSize+2]=0;  //   ...
     ScriptSize = ScrSize+1;
+    Prog->Script=Script;
+    Prog->ScriptSize=ScriptSize;
 
     InitFunctions();
     InitClasses();
@@ -344,6 +355,19 @@ bool TParser::SetScript(const char *Scr, int ScrSize)
     return true;
 }
 
+void TParser::SetCode(Code *C)
+{
+    C->AddRef();
+    Prog->Release();
+    Prog=C;
+    Script=C->Script;
+    ScriptSize=C->ScriptSize;
+    Variables=C->Globals;
+
+    InitFunctions();
+    InitClasses();
+}
+
 TVariable TParser::Execute(const char *Func)
 {
     return Execute(Func, 0, 0);
@@ -355,8 +379,8 @@ TVariable TParser::Execute(const char *Func, TVariable *Params[], int ParamCount
 
     TString Tmp=Func;
     Tmp.Uppercase();
-    for(int i=0; i<Functions.Count; i++)
-        if(Functions[i].Name == Tmp)
+    for(int i=0; i<Prog->Functions.Count; i++)
+        if(Prog->Functions[i].Name == Tmp)
             Position=i;
 
     if(Position==-1)
@@ -365,7 +389,7 @@ TVariable TParser::Execute(const char *Func, TVariable *Params[], int ParamCount
         return ::Error();
     }
 
-    if(ParamCount!=Functions[Position].Arguments.Count)
+    if(ParamCount!=Prog->Functions[Position].Arguments.Count)
     {
         SetError(P_BadArgsCount,0,Func);
         return ::Error();
@@ -405,7 +429,7 @@ TVariable TParser::Execute(const char *Func, TVariable *Params[], int ParamCount
     {
         TVariable Tmp;
         Tmp.Type=TVariable::T_Identifier;
-        Tmp.Data.AsString=Functions[Position].Arguments[i];
+        Tmp.Data.AsString=Prog->Functions[Position].Arguments[i];
         AddVar(Tmp);
         TVariable Var=*Params[i];
         if(Var.Type==TVariable::T_Array)
@@ -413,7 +437,7 @@ TVariable TParser::Execute(const char *Func, TVariable *Params[], int ParamCount
         SetVar(Tmp,Var);
     }
     }    
-    ScriptPos = Functions[Position].Position;
+    ScriptPos = Prog->Functions[Position].Position;
     if(yyparse((void*)this)&&!Error)
         SetError(P_InternalError,"Execute - yyparse returned error. Maybe external function returned error?");
     EndSub();
@@ -441,8 +465,9 @@ TVariable TParser::Execute(const char *Func, TVariable *Params[], int ParamCount
     Fors=_Fors;
     CycleDepth=_CycleDepth;
 
-    TVariable tmp1=Result;
-    Result="Result is undefined";     
+    TVariable tmp1;
+    tmp1.Swap(Result);
+    Result="Result is undefined";
     return tmp1;
 }
 
@@ -462,6 +487,11 @@ bool TParser::PreProcess()
         SetError(P_InternalError,"PreProcess - yyparse returned error");
     IsPreprocessing=false;
 
+    if(Error)
+        Prog->Shareable=false;
+    if(Prog->Shareable)
+        Prog->Globals=Variables;
+
     return Error;
 }
 
@@ -487,7 +517,7 @@ void TParser::AddSub (TVariable &New)
     f.Name=New.Data.AsString;
     f.Position=ScriptPos;
     f.Arguments=Parameters;
-    Functions.Add(f);
+    Prog->Functions.Add(f);
     FunctionName="";
 }
 
@@ -556,34 +586,41 @@ void TParser::AddLabel(TVariable &New)
 
     New.Data.AsString.Uppercase();
     TString Tmp=FunctionName+"::"+New.Data.AsString;
-    for(int i=0; i<Labels.Count; i++)
+    for(int i=0; i<Prog->Labels.Count; i++)
     {
-        if(Labels[i].Name == Tmp)
+        if(Prog->Labels[i].Name == Tmp)
         {
             //   - Ok,      
-            if(Labels[i].Position!=ScriptPos)
+            if(Prog->Labels[i].Position!=ScriptPos)
                 SetError(P_LabelDefined,0,Tmp.c_str());
             return;
         }
     }
 
+//    PreProcess,  Code    
+// PreProcess finds every label, and the Code is read-only after it
+    if(!IsPreprocessing)
+    {
+        SetError(P_InternalError,"TParser::AddLabel - new label after PreProcess");
+        return;
+    }
+
     Label L;
     L.Name = FunctionName+"::"+New.Data.AsString;
     L.Position = ScriptPos;
     L.Depth = CycleDepth;
 
-    Labels.Add(L);
+    Prog->Labels.Add(L);
 }
 
 void TParser::BeginCollectingParameters()
 {
-    ArgStk.Push(Arguments);
-    Arguments.Clear();
+    ArgStk.PushMove(Arguments);
 }
 
 void TParser::EndCollectingParameters()
 {
-    Arguments=ArgStk.Pop();
+    ArgStk.PopMove(Arguments);
 }
 
 void TParser::StoreParameter(TVariable &Var)
@@ -610,6 +647,10 @@ TVariable TParser::CallSub(TVariable &Sub)
         t.Data.AsNumber=0;
         return t;
     }
+//      - PreProcess   
+// The globals depend on this call, so they cannot be reused by SetCode
+    if(IsPreprocessing)
+        Prog->Shareable=false;
 
     if(Sub.Type!=TVariable::T_Identifier)
     {
@@ -617,9 +658,9 @@ TVariable TParser::CallSub(TVariable &Sub)
         return ::Error();
     }
 
-    for(int i=0; i<Functions.Count; i++)
+    for(int i=0; i<Prog->Functions.Count; i++)
     {
-        if(Functions[i].Name == Sub.Data.AsString)
+        if(Prog->Functions[i].Name == Sub.Data.AsString)
         {
             TVariable v=Execute(Sub.Data.AsString.c_str(),Arguments.Items,Arguments.Count);
             return v;
@@ -727,19 +768,19 @@ void TParser::GoTo(const TVariable &Var)
 
     TString Tmp=FunctionName+"::"+Var.Data.AsString;
     Tmp.Uppercase();
-    for(int i=0; i<Labels.Count; i++)
+    for(int i=0; i<Prog->Labels.Count; i++)
     {
-        if(Labels[i].Name == Tmp)
+        if(Prog->Labels[i].Name == Tmp)
         {
-            if(CycleDepth == Labels[i].Depth)
-                ScriptPos = Labels[i].Position;
-            else if(CycleDepth < Labels[i].Depth)
+            if(CycleDepth == Prog->Labels[i].Depth)
+                ScriptPos = Prog->Labels[i].Position;
+            else if(CycleDepth < Prog->Labels[i].Depth)
             {
                 SetError(P_GotoError);
             }
             else  // > -   .   
             {
-                while(CycleDepth!=Labels[i].Depth)
+                while(CycleDepth!=Prog->Labels[i].Depth)
                 {
                     // 1.     (..     )
                     int w=99999999;
@@ -773,7 +814,7 @@ void TParser::GoTo(const TVariable &Var)
                         
                     CycleDepth--;
                 }
-                ScriptPos = Labels[i].Position;
+                ScriptPos = Prog->Labels[i].Position;
             }
             return;
         }
@@ -932,17 +973,17 @@ const char * TParser::GetParameterName(const char * Func, int ParamNo)
 
     TString Tmp=Func;
     Tmp.Uppercase();
-    for(int i=0; i<Functions.Count; i++)
-        if(Functions[i].Name == Tmp)
+    for(int i=0; i<Prog->Functions.Count; i++)
+        if(Prog->Functions[i].Name == Tmp)
             Position=i;
 
     if(Position==-1)
         return 0;
 
-    if(ParamNo>=Functions[Position].Arguments.Count)
+    if(ParamNo>=Prog->Functions[Position].Arguments.Count)
         return 0;
 
-    return Functions[Position].Arguments[ParamNo].c_str();
+    return Prog->Functions[Position].Arguments[ParamNo].c_str();
 }
 
 void TParser::PushRepeat()
@@ -104,7 +104,7 @@ class TParser
 
 //   .
 // List of all active variables
-    TList <Variable> Variables;
+    TVector <Variable> Variables;
 
 //          
 // Struct describing one script function
@@ -121,10 +121,6 @@ class TParser
             Position(f.Position), Arguments(f.Arguments) {}
     };
 
-//       
-// List of all functions & their params
-    TList <Function> Functions;
-
 //   
 // info about label 
     struct Label
@@ -155,9 +151,47 @@ class TParser
         Label(const Label &L) : Name(L.Name), Position(L.Position), Depth(L.Depth) {}
     };
 
+public:
+//  : , ,      
+// ,     PreProcess.  PreProcess   
+//    ,      , 
+//  Code      (. GetCode/SetCode).
+// AddRef/Release   -     .
+// The parsed script: its text, functions, labels, and the global variables
+// as PreProcess left them. PreProcess precompiles every keyword in the text
+// and nothing here changes afterwards, so one Code can be shared by several
+// parsers (see GetCode/SetCode). AddRef/Release are not thread safe; the
+// host has to serialise them.
+    struct Code
+    {
+        char *Script;
+        int ScriptSize;
+//       
+// List of all functions & their params
+        TVector <Function> Functions;
 //     
 // List of all labels
-    TList <Label> Labels;
+        TVector <Label> Labels;
+//   PreProcess.     .
+// Variables after PreProcess. Each parser gets a copy of its own.
+        TVector <Variable> Globals;
+// false,  PreProcess    property  ( 
+//       )   
+// false if PreProcess called functions or used class properties (their
+// results might differ on the next run) or failed
+        bool Shareable;
+        int RefCount;
+
+        Code() : Script(0), ScriptSize(0), Shareable(true), RefCount(1) {}
+        ~Code() {delete[] Script;}
+        void AddRef() {RefCount++;}
+        void Release() {if(--RefCount==0) delete this;}
+    };
+private:
+
+//   .   0.
+// The current parsed script. Never 0.
+    Code *Prog;
 
 //         
 // (      )
@@ -275,8 +309,8 @@ public:
 // Made this stuff public because C++Builder4's support for namespaces & friends
 // is not so perfect as in GCC. So all these vars should be considered private
 
-//    .    SetScript.
-// Script text. Allocated in SetScript.
+//     (Prog->Script).    SetScript.
+// Script text (Prog->Script). Allocated in SetScript.
     char *Script;
 //   
 // Script size in bytes
@@ -430,6 +464,28 @@ public:
 // Sets the script text. Functions makes a copy of a passed buffer.
     bool SetScript(const char *Script, int ScriptSize);
 
+//         SetCode.
+//    PreProcess.  0,   
+//  (Code::Shareable).    Release().
+// Returns the parsed script, for passing to other parsers with SetCode.
+// Call it after a successful PreProcess. Returns 0 if the script cannot be
+// shared (see Code::Shareable). The caller must Release() it.
+    Code *GetCode()
+    {
+        if(!Prog->Shareable)
+            return 0;
+        Prog->AddRef();
+        return Prog;
+    }
+
+//      SetScript+PreProcess. 
+//  ( ..  SetGlobalVariable)  , 
+//   PreProcess  ,  Code.
+// Use an already parsed script instead of SetScript+PreProcess. The global
+// variables, including those from SetGlobalVariable, are replaced with the
+// ones the parser that made the Code had after PreProcess.
+    void SetCode(Code *C);
+
 //       .
 // . false == 
 // Preprocess script. Returns false on syntax error.
@@ -556,6 +612,21 @@ public:
     typedef bool DebuggerFunction(TParser &P, int Line);
     void SetDebuggerFunction(DebuggerFunction *F) {DbgFun=F;}
 
+//   .   Wait(),   yylex  Msec==0
+//    ,     .
+//   Wait()      false.
+// Set the function used by Wait(). yylex also calls it with Msec==0 at the
+// end of every line, so that a scheduler can switch to another script.
+    typedef void WaitFunction(TParser &P, int Msec);
+    void SetWaitFunction(WaitFunction *F) {WaitFun=F;}
+    bool Wait(int Msec)
+    {
+        if(!WaitFun)
+            return false;
+        WaitFun(*this,Msec);
+        return true;
+    }
+
 //   
     void ClearError();
 
@@ -571,6 +642,7 @@ public: // had to make this public to access from yyparse generated with BISON
 // void DbgFun(TParser *THIS,int CurrentLine);
 // ,    (  -  )   CurrentLine
     DebuggerFunction *DbgFun;
+    WaitFunction *WaitFun;
 
 //        Script[] 
 // Returns the line number from position in script
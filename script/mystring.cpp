@@ -84,93 +84,124 @@ bool MyIsAlpha(int c)
 // Sasha::TString
 //
 
-TString::TString(const TString &o)
+//    Len ,  
+// Makes room for Len characters, keeping the contents. Grows geometrically
+// so that appending one character at a time is cheap.
+void TString::Reserve(int Len)
 {
-    Buff=strdup(o.c_str());
-    StringLen = strlen(Buff);
-    BuffSize=StringLen+1;
+    if(Len < (Buff ? BuffSize : int(LocalSize)))
+        return;
+    int NewSize=Buff ? BuffSize*2 : LocalSize*2;
+    if(NewSize < Len+1)
+        NewSize=Len+1;
+    if(Buff)
+        Buff=(char*)realloc(Buff,NewSize);
+    else
+    {
+        Buff=(char*)malloc(NewSize);
+        memcpy(Buff,Local,StringLen+1);
+    }
+    BuffSize=NewSize;
 }
 
-TString::TString(const char * s)
+void TString::Assign(const char *s, int Len)
 {
-    Buff=strdup(s);
-    StringLen = strlen(s);
-    BuffSize=StringLen+1;
+    Reserve(Len);
+    char *Dest=(char*)c_str();
+    memmove(Dest,s,Len);    // s may point into this string
+    Dest[Len]=0;
+    StringLen=Len;
 }
 
-TString::TString(const double d, int z)
+void TString::Append(const char *s, int Len)
 {
-    Buff=(char*)malloc(50);
-    gcvt(d,z,Buff);
-    StringLen = strlen(Buff);
-    BuffSize=50;
+    if(s>=c_str() && s<=c_str()+StringLen)  // s is part of this string
+    {
+        TString Tmp(s,Len);
+        Append(Tmp.c_str(),Len);
+        return;
+    }
+    Reserve(StringLen+Len);
+    char *Dest=(char*)c_str()+StringLen;
+    memcpy(Dest,s,Len);
+    Dest[Len]=0;
+    StringLen+=Len;
 }
 
-TString::TString(const char c)
+void TString::Swap(TString &Other)
 {
-    Buff=(char*)malloc(2);
-    Buff[0]=c;
-    Buff[1]=0;
-    StringLen = 1;
-    BuffSize=StringLen+1;
+    char Tmp[sizeof(TString)];
+    memcpy(Tmp,this,sizeof(TString));
+    memcpy(this,&Other,sizeof(TString));
+    memcpy(&Other,Tmp,sizeof(TString));
 }
 
-TString &TString::operator=(const TString &o)
+TString::TString(const TString &o) : StringLen(0), Buff(0), BuffSize(0)
 {
-    if(Buff)
-        free(Buff);
-    Buff=strdup(o.c_str());
-    StringLen = strlen(Buff);
-    BuffSize=StringLen+1;
-    return *this;
+    Local[0]=0;
+    Assign(o.c_str(),o.Length());
 }
 
-TString &Sasha::operator+=(TString &i, const TString &o)
+TString::TString(const char * s) : StringLen(0), Buff(0), BuffSize(0)
 {
-    int NewLen=i.Length()+o.Length()+1;
-    char *Tmp=(char*)malloc(NewLen);
+    Local[0]=0;
+    Assign(s,strlen(s));
+}
 
-    strcpy(Tmp,i.c_str());
-    if(i.Buff)
-        free(i.Buff);
+TString::TString(const char * s, int Len) : StringLen(0), Buff(0), BuffSize(0)
+{
+    Local[0]=0;
+    Assign(s,Len);
+}
 
-    i.Buff=Tmp;
-    strcat(Tmp,o.c_str());
+TString::TString(const double d, int z) : StringLen(0), Buff(0), BuffSize(0)
+{
+    char Tmp[50];
+    gcvt(d,z,Tmp);
+    Assign(Tmp,strlen(Tmp));
+}
 
-    i.StringLen = strlen(i.Buff);
+TString::TString(const char c) : StringLen(1), Buff(0), BuffSize(0)
+{
+    Local[0]=c;
+    Local[1]=0;
+}
 
+TString &TString::operator=(const TString &o)
+{
+    if(&o!=this)
+        Assign(o.c_str(),o.Length());
+    return *this;
+}
+
+TString &TString::operator=(const char *o)
+{
+    Assign(o,strlen(o));
+    return *this;
+}
+
+TString &Sasha::operator+=(TString &i, const TString &o)
+{
+    i.Append(o.c_str(),o.Length());
     return i;
 }
 
 TString Sasha::operator+(const TString &i, const char *o)
 {
+    int Len=strlen(o);
     TString Str;
-    int NewLen=i.Length()+strlen(o)+1;
-    char *Tmp=(char*)malloc(NewLen);
-
-    strcpy(Tmp,i.c_str());
-
-    Str.Buff=Tmp;
-    strcat(Tmp,o);
-
-    Str.StringLen = strlen(Str.Buff);
-
+    Str.Reserve(i.Length()+Len);
+    Str.Append(i.c_str(),i.Length());
+    Str.Append(o,Len);
     return Str;
 }
 
 TString Sasha::operator+(const TString &i, const TString &o)
 {
     TString Str;
-    int NewLen=i.Length()+o.Length()+1;
-    char *Tmp=(char*)malloc(NewLen);
-
-    strcpy(Tmp,i.c_str());
-
-    Str.Buff=Tmp;
-    strcat(Tmp,o.c_str());
-
-    Str.StringLen = strlen(Str.Buff);
-
+    Str.Reserve(i.Length()+o.Length());
+    Str.Append(i.c_str(),i.Length());
+    Str.Append(o.c_str(),o.Length());
     return Str;
 }
 
@@ -50,13 +50,21 @@ bool MyIsAlpha(int c);    // true - 
 class TString
 {
 private:
+// Short strings are kept inside the object, so most names and values never
+// call malloc. Buff is 0 while the string is in Local; Local has no pointers
+// to itself, so a TString may still be moved with memcpy.
+    enum {LocalSize=16};
     int StringLen;  //   0
     char *Buff;
     int BuffSize;
+    char Local[LocalSize];
+
+    void Reserve(int Len);
 public:
-    TString() : StringLen(0), BuffSize(0)    { Buff=0; }
+    TString() : StringLen(0), Buff(0), BuffSize(0)    { Local[0]=0; }
     TString(const TString &Other);
     TString(const char * s);
+    TString(const char * s, int Len);
     TString(const double d, int z=8);
     TString(const char c);
     ~TString() {if(Buff) free(Buff);}
@@ -67,13 +75,17 @@ public:
 
     const char * c_str() const
     {
-        if(Buff)
-            return Buff;
-        else
-            return ""; 
+        return Buff ? Buff : Local;
     }
     int Length() const {return StringLen;}
-    void Uppercase() {MyToUpper(Buff);}
+    void Clear() {StringLen=0; *(char*)c_str()=0;}
+    void Uppercase() {MyToUpper((char*)c_str());}
+// Replaces the contents with Len characters from s.
+    void Assign(const char *s, int Len);
+    void Append(const char *s, int Len);
+// Exchanges the contents of two strings without copying any heap buffers.
+// Use instead of an assignment when the source is not needed any more.
+    void Swap(TString &Other);
 
 //
 //   - 
@@ -84,6 +96,7 @@ public:
         return ((char*)c_str())[V];
     }
     TString &operator= (const TString &o);
+    TString &operator= (const char *o);
 friend TString &operator+= (TString &,const TString &);
 friend TString operator+ (const TString &,const TString &);
 friend TString &operator+= (TString &i,const char *o);
@@ -111,7 +124,7 @@ inline
 bool operator> (const TString &i,const TString &o) {return !(i<=o);}
 
 inline
-TString &operator+= (TString &i,const char *o) {return (i += TString(o));}
+TString &operator+= (TString &i,const char *o) {i.Append(o,strlen(o)); return i;}
 //TString operator+ (const TString &i,const char *o);
 
 }; // namespace
@@ -25,6 +25,11 @@
 
 #include <malloc.h>
 #include <string.h>
+#ifdef __GNUC__
+#include <new>
+#else
+#include <new.h>
+#endif
 
 //
 //    ... 
@@ -173,38 +178,173 @@ public:
 };
 
 //
-// TStack. .   TList
+// TVector.  ,       .
+//    TList        
+//  2 ,    128 .
+// A contiguous array: elements live in one block that grows twice as large
+// when full, so Add does not allocate per element.
+//
+//   ,   TList.
+//
+//      memcpy-,   
+//        (TString, TVariable, TList
+//  ).
+// Elements are relocated with memcpy when the block grows, so T must not
+// point into itself (TString, TVariable and TList are fine).
+
+template <class T> class TVector
+{
+    int Size;
+    void Reserve(int Len)
+    {
+        if(Len<=Size)
+            return;
+        int NewSize=Size ? Size : 16;
+        while(NewSize<Len)
+            NewSize*=2;
+        Items=(T*)realloc(Items,NewSize*sizeof(T));
+        Size=NewSize;
+    }
+public:
+    T *Items;
+    int Count;
+    TVector()
+    {
+      Count=0;
+      Size=0; Items=0;
+    }
+    TVector(const TVector &t)
+    {
+      Count=0;
+      Size=0; Items=0;
+      Reserve(t.Count);
+      for(int i=0; i<t.Count; i++)
+        Add(t[i]);
+    }
+    TVector &operator=(const TVector &t)
+    {
+      if(this==&t)
+        return *this;
+      Clear();
+      Reserve(t.Count);
+      for(int i=0; i<t.Count; i++)
+        Add(t[i]);
+      return *this;
+    }
+    void Add(const T &w)
+    {
+      if(Count==Size)
+      {
+// w       -   realloc
+          T tmp(w);
+          Reserve(Count+1);
+          new(&Items[Count]) T(tmp);
+      } else
+          new(&Items[Count]) T(w);
+      Count++;
+    }
+//  w     , w  
+// moves w to the end without copying; w is left default-constructed
+    void AddMove(T &w)
+    {
+      Reserve(Count+1);
+      memcpy((void*)&Items[Count],(void*)&w,sizeof(T));
+      new(&w) T();
+      Count++;
+    }
+//     Dest  
+// moves the last element into Dest without copying
+    void RemoveLast(T &Dest)
+    {
+      Dest.~T();
+      Count--;
+      memcpy((void*)&Dest,(void*)&Items[Count],sizeof(T));
+    }
+    void Delete(int Who)
+    {
+      if(Who>=Count||Who<0)
+          return;
+      Items[Who].~T();
+      memmove((void*)&Items[Who],(void*)&Items[Who+1],(Count-Who-1)*sizeof(T));
+      Count--;
+    }
+    int Find(const T & Who)
+    {
+        for (int i=0; i<Count; i++)
+            if(Items[i]==Who)
+                return i;
+        return -1;
+    }
+    int IndexOf(const T & Who) {return Find(Who);}
+    int FindFrom(int Pos, const T & Who)
+    {
+        for (int i=Pos; i<Count; i++)
+            if(Items[i]==Who)
+                return i;
+        return -1;
+    }
+    void Clear()
+    {
+        for (int i=0; i<Count; i++)
+            Items[i].~T();
+        Count=0;
+    }
+    ~TVector()
+    {
+      Clear();
+      free(Items);
+    }
+    bool IsEmpty() {return !Count;}
+    T& operator[](int V) const
+    {
+        return Items[V];
+    }
+    T& Last()
+    {
+        if(IsEmpty())
+            throw "Sasha::TVector - taking last value from empty list!!!";
+        return Items[Count-1];
+    }
+};
+
+//
+// TStack. .   TVector
 //
 // 
 //  Push(T &w)
 //  Pop()
+//  PushMove(T &w) -  w  , w  
+//  PopMove(T &w) -    w  
 
-template <class T> class TStack : protected TList <T>
+template <class T> class TStack : protected TVector <T>
 {
 public:
-    TList<T>::Count;
+    TVector<T>::Count;
 
-    TStack () : TList<T>() {}
-    TStack (TStack &s) : TList<T> (s) {}
+    TStack () : TVector<T>() {}
+    TStack (const TStack &s) : TVector<T> (s) {}
 
     bool IsEmpty() {return !Count;}
 
-    void Push(const T &w) {Add(w);}
-    T Pop()
+    void Push(const T &w) {this->Add(w);}
+    void PushMove(T &w) {this->AddMove(w);}
+    void PopMove(T &w)
     {
-        if(!IsEmpty())
-        {
-            T t=(*this)[Count-1];
-            Delete(Count-1);
-            return t;
-        } else
+        if(IsEmpty())
             throw "Sasha::TStack - popping from empty stack!!!";
+        this->RemoveLast(w);
+    }
+    T Pop()
+    {
+        T t;
+        PopMove(t);
+        return t;
     }
     T& Last()
     {
         if(IsEmpty())
             throw "Sasha::TStack - taking last value from empty stack!!!";
-        return (*this)[Count-1];
+        return this->Items[Count-1];
     }
 };
 
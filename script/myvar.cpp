@@ -22,6 +22,8 @@
 
 TVariable operator+ (const TVariable &i,const TVariable &v)
 {
+    if(i.Type==TVariable::T_Number && v.Type==TVariable::T_Number)
+        return TVariable(i.Data.AsNumber + v.Data.AsNumber);
     TVariable Temp=i;
     if(i.Type==v.Type)
     {
@@ -36,6 +38,8 @@ TVariable operator+ (const TVariable &i,const TVariable &v)
 
 TVariable operator- (const TVariable &i,const TVariable &v)
 {
+    if(i.Type==TVariable::T_Number && v.Type==TVariable::T_Number)
+        return TVariable(i.Data.AsNumber - v.Data.AsNumber);
     TVariable Temp=i;
     if(i.Type==v.Type)
     {
@@ -50,6 +54,8 @@ TVariable operator- (const TVariable &i,const TVariable &v)
 
 TVariable operator* (const TVariable &i,const TVariable &v)
 {
+    if(i.Type==TVariable::T_Number && v.Type==TVariable::T_Number)
+        return TVariable(i.Data.AsNumber * v.Data.AsNumber);
     TVariable Temp=i;
     if(i.Type==v.Type)
     {
@@ -64,6 +70,8 @@ TVariable operator* (const TVariable &i,const TVariable &v)
 
 TVariable operator/ (const TVariable &i,const TVariable &v)
 {
+    if(i.Type==TVariable::T_Number && v.Type==TVariable::T_Number)
+        return TVariable(i.Data.AsNumber / v.Data.AsNumber);
     TVariable Temp=i;
     if(i.Type==v.Type)
     {
@@ -78,12 +86,9 @@ TVariable operator/ (const TVariable &i,const TVariable &v)
 
 TVariable operator- (const TVariable &i)
 {
-    TVariable Temp=i;
     if(i.Type==TVariable::T_Number)
-        Temp.Data.AsNumber=-Temp.Data.AsNumber;
-    else
-        return ::Error("Invalid operation for this type");
-    return Temp;
+        return TVariable(-i.Data.AsNumber);
+    return ::Error("Invalid operation for this type");
 }
 
 bool operator== (const TVariable &i,const TVariable &v)
@@ -98,7 +98,13 @@ public:
         Data.UserData=0;
     }
 
-    TVariable (const TVariable &v) {  *this=v; }
+    TVariable (const TVariable &v) : Type(v.Type)
+    {
+        Data.AsNumber=v.Data.AsNumber;
+        if(v.Type!=T_Number)
+            Data.AsString=v.Data.AsString;
+        Data.UserData=v.Data.UserData;
+    }
 
     TVariable (const bool &v)
     {
@@ -132,6 +138,8 @@ public:
 
     bool Error() {return Type==T_Error;}
 
+    bool IsNumber() const {return Type==T_Number;}
+
     int ErrorCode() {return Type==T_Error?(int)Data.AsNumber:0;}
 
     bool IsTrue()
@@ -145,15 +153,29 @@ public:
 //
 
 //  . .    - 
+// The string of a T_Number is not used, so it is not copied.
     TVariable& operator= (const TVariable &v)
     {
         Type=v.Type;
         Data.AsNumber=v.Data.AsNumber;
-        Data.AsString=v.Data.AsString;
+        if(v.Type==T_Number)
+            Data.AsString.Clear();
+        else
+            Data.AsString=v.Data.AsString;
         Data.UserData=v.Data.UserData;
         return *this;
     }
 
+// Exchanges two variables without copying their strings. Use instead of an
+// assignment when the source is a temporary.
+    void Swap(TVariable &v)
+    {
+        VarType t=Type; Type=v.Type; v.Type=t;
+        double d=Data.AsNumber; Data.AsNumber=v.Data.AsNumber; v.Data.AsNumber=d;
+        Data.AsString.Swap(v.Data.AsString);
+        void *u=Data.UserData; Data.UserData=v.Data.UserData; v.Data.UserData=u;
+    }
+
 //
 // 
 //
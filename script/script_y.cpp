@@ -1171,7 +1171,7 @@ case 76:
     }
 #endif
 
-  *++yyvsp = yyval;
+  (++yyvsp)->Swap(yyval);   /* yyval is set again before it is used */
 
 #ifdef YYLSP_NEEDED
   yylsp++;
@@ -175,12 +175,11 @@ Loop:
     {
         int tmp=THIS->ScriptPos;
 
-        TString VarName;
         do {
-            VarName += TString((char)c);
             c = THIS->Script[++THIS->ScriptPos];
         } while((MyIsAlpha(c) || isdigit(c) || c=='.' || c=='_'
             || c=='$')&&THIS->ScriptPos<THIS->ScriptSize);
+        TString VarName(THIS->Script+tmp,THIS->ScriptPos-tmp);
 
         while (((c=THIS->Script[THIS->ScriptPos]) == ' ' || c == '\t' || c == '\r')
             &&THIS->ScriptPos<THIS->ScriptSize)
@@ -191,7 +190,7 @@ Loop:
             TVariable Temp;
 
             Temp.Type = TVariable::T_Identifier;
-            Temp.Data.AsString = VarName;
+            Temp.Data.AsString.Swap(VarName);
             THIS->ScriptPos++;
             THIS->AddLabel(Temp);
             goto Loop;
@@ -420,12 +419,11 @@ Loop:
     {
         int tmp=THIS->ScriptPos;
 
-        TString VarName;
         do {
-            VarName += TString((char)c);
             c = THIS->Script[++THIS->ScriptPos];
         } while((MyIsAlpha(c) || isdigit(c) || c=='.' || c=='_'
             || c=='$')&&THIS->ScriptPos<THIS->ScriptSize);
+        TString VarName(THIS->Script+tmp,THIS->ScriptPos-tmp);
 
         while (((c=THIS->Script[THIS->ScriptPos]) == ' ' || c == '\t' || c == '\r')
             &&THIS->ScriptPos<THIS->ScriptSize)
@@ -436,7 +434,7 @@ Loop:
             TVariable Temp;
 
             Temp.Type = TVariable::T_Identifier;
-            Temp.Data.AsString = VarName;
+            Temp.Data.AsString.Swap(VarName);
             THIS->ScriptPos++;
             THIS->AddLabel(Temp);
             goto Loop;
@@ -550,12 +548,11 @@ Loop:
     {
         int tmp=THIS->ScriptPos;
 
-        TString VarName;
         do {
-            VarName += TString((char)c);
             c = THIS->Script[++THIS->ScriptPos];
         } while((MyIsAlpha(c) || isdigit(c) || c=='.' || c=='_'
             || c=='$')&&THIS->ScriptPos<THIS->ScriptSize);
+        TString VarName(THIS->Script+tmp,THIS->ScriptPos-tmp);
 
         while (((c=THIS->Script[THIS->ScriptPos]) == ' ' || c == '\t' || c == '\r')
             &&THIS->ScriptPos<THIS->ScriptSize)
@@ -566,7 +563,7 @@ Loop:
             TVariable Temp;
 
             Temp.Type = TVariable::T_Identifier;
-            Temp.Data.AsString = VarName;
+            Temp.Data.AsString.Swap(VarName);
             THIS->ScriptPos++;
             THIS->AddLabel(Temp);
             goto Loop;
@@ -712,17 +709,17 @@ Restart:
 //  ?
     if(MyIsAlpha(c))
     {
-        TString VarName;
+        int Start=THIS->ScriptPos;
         do {
-            VarName += TString((char)c);
             c = THIS->Script[++THIS->ScriptPos];
         } while((MyIsAlpha(c) || isdigit(c) || c=='.' || c=='_'
             || c=='$')&&THIS->ScriptPos<THIS->ScriptSize);
+        TString VarName(THIS->Script+Start,THIS->ScriptPos-Start);
 
         VarName.Uppercase();
         Temp.Type = TVariable::T_Identifier;
-        Temp.Data.AsString = VarName;
-        *lval = Temp;
+        Temp.Data.AsString.Swap(VarName);
+        lval->Swap(Temp);
         return IDENTIFIER;
     }
 
@@ -735,14 +732,14 @@ Restart:
     	    char *ep;
         	Temp.Data.AsNumber = strtoul (THIS->Script+THIS->ScriptPos,&ep,0);
 	        THIS->ScriptPos = ep-THIS->Script;
-    	    *lval = Temp;
+    	    lval->Swap(Temp);
     	} else
     	{
 	        Temp.Type = TVariable::T_Number;
     	    char *ep;
         	Temp.Data.AsNumber = strtod (THIS->Script+THIS->ScriptPos,&ep);
 	        THIS->ScriptPos = ep-THIS->Script;
-    	    *lval = Temp;
+    	    lval->Swap(Temp);
     	}
         return NUM;
     }
@@ -750,34 +747,30 @@ Restart:
 //  ?
     if(c=='\"')
     {
-        TString Var;
+        int Start=THIS->ScriptPos+1;
         c = THIS->Script[++THIS->ScriptPos];
         while(c!='\"'&&THIS->ScriptPos<THIS->ScriptSize)
-        {
-            Var += TString((char)c);
             c = THIS->Script[++THIS->ScriptPos];
-        }
+        TString Var(THIS->Script+Start,THIS->ScriptPos-Start);
         ++THIS->ScriptPos;
 
         Temp.Type = TVariable::T_String;
-        Temp.Data.AsString = Var;
-        *lval = Temp;
+        Temp.Data.AsString.Swap(Var);
+        lval->Swap(Temp);
         return NUM;
     }
     if(c=='\'')
     {
-        TString Var;
+        int Start=THIS->ScriptPos+1;
         c = THIS->Script[++THIS->ScriptPos];
         while(c!='\''&&THIS->ScriptPos<THIS->ScriptSize)
-        {
-            Var += TString((char)c);
             c = THIS->Script[++THIS->ScriptPos];
-        }
+        TString Var(THIS->Script+Start,THIS->ScriptPos-Start);
         ++THIS->ScriptPos;
 
         Temp.Type = TVariable::T_String;
-        Temp.Data.AsString = Var;
-        *lval = Temp;
+        Temp.Data.AsString.Swap(Var);
+        lval->Swap(Temp);
         return NUM;
     }
 
@@ -795,6 +788,8 @@ Restart:
 
     if(!THIS->IsPreprocessing && THIS->DbgFun)
         THIS->DbgFun(*THIS,THIS->GetLineFromPos(THIS->ScriptPos));
+    if(c=='\n' && !THIS->IsPreprocessing && THIS->WaitFun)
+        THIS->WaitFun(*THIS,0);
 
     /* return single chars */
     return c&255;
@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sharedstats.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdio.h>
+#include <string.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "sharedstats.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The block is a file mapped into memory rather than just a named mapping,
+//  so that monitors that cannot open Windows objects can still map the file.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+SharedStats::SharedStats()
+: m_file(INVALID_HANDLE_VALUE), m_mapping(0), m_block(0)
+{
+}
+
+SharedStats::~SharedStats()
+{
+    close();
+}
+
+bool SharedStats::open()
+{
+    if(m_block != 0)
+        return true;
+
+    DWORD process_id = GetCurrentProcessId();
+    char name[MAX_PATH];
+    CreateDirectory(LIVE_STATS_DIR, 0);     // fails if it already exists
+    sprintf(name, "%s\\%lu.stats", LIVE_STATS_DIR, process_id);
+    m_filename = name;
+    m_file = CreateFile(name, GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, 0, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, 0);
+    if(m_file == INVALID_HANDLE_VALUE)
+    {
+        error_printf("cannot create %s: error %lu\n", name, GetLastError());
+        return false;
+    }
+    sprintf(name, "%s%lu", LIVE_STATS_NAME, process_id);
+    m_mapping = CreateFileMapping(m_file, 0, PAGE_READWRITE, 0,
+        sizeof(LiveStatsBlock), name);
+    if(m_mapping != 0)
+        m_block = reinterpret_cast<LiveStatsBlock *>(MapViewOfFile(m_mapping,
+            FILE_MAP_WRITE, 0, 0, sizeof(LiveStatsBlock)));
+    if(m_block == 0)
+    {
+        error_printf("cannot map %s: error %lu\n", m_filename.c_str(),
+            GetLastError());
+        close();
+        return false;
+    }
+
+    memset(m_block, 0, sizeof(LiveStatsBlock));
+    m_block->m_version = LIVE_STATS_VERSION;
+    m_block->m_size = sizeof(LiveStatsBlock);
+    m_block->m_process_id = process_id;
+    // Readers check the magic number first, so it goes in last.
+    InterlockedExchange(reinterpret_cast<LONG *>(&m_block->m_magic),
+        LONG(LIVE_STATS_MAGIC));
+    trace_printf("live stats in %s\n", m_filename.c_str());
+    return true;
+}
+
+void SharedStats::close()
+{
+    if(m_block != 0)
+    {
+        m_block->m_magic = 0;
+        UnmapViewOfFile(m_block);
+        m_block = 0;
+    }
+    if(m_mapping != 0)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = 0;
+    }
+    if(m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+        DeleteFile(m_filename.c_str());
+    }
+}
+
+// The interlocked increments keep both the compiler and the processor from
+// moving the writes in between outside of the odd sequence number.
+LiveStatsBlock * SharedStats::begin_update()
+{
+    ASSERT(m_block != 0);
+    InterlockedIncrement(reinterpret_cast<LONG *>(
+        const_cast<unsigned int *>(&m_block->m_seq)));
+    return m_block;
+}
+
+void SharedStats::end_update()
+{
+    ASSERT(m_block != 0);
+    InterlockedIncrement(reinterpret_cast<LONG *>(
+        const_cast<unsigned int *>(&m_block->m_seq)));
+}
@@ -0,0 +1,70 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sharedstats.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Publishes this client's live statistics in shared memory
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SHAREDSTATS_H_
+#define _SHAREDSTATS_H_
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <string>
+using std::string;
+
+#include "common.h"
+#include "livestats.h"
+
+// The writing side of a LiveStatsBlock; see livestats.h for the reading
+// side. Monitors never take a lock: they copy the block and check that its
+// sequence number did not change meanwhile.
+class SharedStats
+{
+private:
+    HANDLE m_file, m_mapping;
+    LiveStatsBlock * m_block;
+    string m_filename;
+
+public:
+    SharedStats();
+    ~SharedStats();
+
+    // Creates the file and the mapping. Returns true if they are open.
+    bool open();
+    // Unmaps and deletes the file.
+    void close();
+    bool is_open() const { return m_block != 0; }
+    const string & get_filename() const { return m_filename; }
+
+    // Readers retry until end_update(), so fill the block in quickly. Only
+    // call these while the block is open.
+    LiveStatsBlock * begin_update();
+    void end_update();
+};
+
+#endif
@@ -0,0 +1,291 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// snapshot.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "snapshot.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  This module reads and writes binary snapshots of the configuration.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+const uint32 SNAPSHOT_VERSION = 4;
+static const char snapshot_magic[4] = { 'I', 'C', 'F', 'S' };
+
+struct SnapshotHeader
+{
+    char m_magic[4];
+    uint32 m_version;
+    uint32 m_source_size;
+    uint32 m_source_time;
+    uint32 m_root;
+    uint32 m_body_size;
+};
+
+// Each record starts with: size of contents, hash of contents
+const uint32 RECORD_HEADER_SIZE = 8;
+
+// FNV-1a
+uint32 hash_bytes(const void * data, uint32 size)
+{
+    const uint8 * p = static_cast<const uint8 *>(data);
+    uint32 h = 2166136261UL;
+    for(uint32 i = 0; i < size; i++)
+    {
+        h ^= p[i];
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+static bool get_source_info(const char * filename, uint32 & size,
+    uint32 & time)
+{
+    struct stat info;
+    if(stat(filename, &info) != 0)
+        return false;
+    size = info.st_size;
+    time = info.st_mtime;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SnapshotWriter::SnapshotWriter()
+: m_record_start(0)
+{
+}
+
+void SnapshotWriter::begin_record()
+{
+    m_record_start = m_data.size();
+    // Space for the size and hash
+    put_uint32(0);
+    put_uint32(0);
+}
+
+uint32 SnapshotWriter::end_record()
+{
+    uint32 start = m_record_start;
+    uint32 size = m_data.size() - start - RECORD_HEADER_SIZE;
+    uint32 hash = hash_bytes(
+        reinterpret_cast<const uint8 *>(m_data.data()) + start +
+            RECORD_HEADER_SIZE, size);
+    m_data.replace(start, 4, reinterpret_cast<const char *>(&size), 4);
+    m_data.replace(start + 4, 4, reinterpret_cast<const char *>(&hash), 4);
+    return start;
+}
+
+void SnapshotWriter::put_uint32(uint32 x)
+{
+    m_data.append(reinterpret_cast<const char *>(&x), sizeof(x));
+}
+
+void SnapshotWriter::put_string(const string & s)
+{
+    put_uint32(s.length());
+    m_data.append(s);
+    // Keep the following fields aligned
+    m_data.append((4 - s.length() % 4) % 4, '\0');
+}
+
+bool SnapshotWriter::write_file(const char * filename,
+    const char * source_filename, uint32 root)
+{
+    SnapshotHeader header;
+    memcpy(header.m_magic, snapshot_magic, sizeof(header.m_magic));
+    header.m_version = SNAPSHOT_VERSION;
+    if(!get_source_info(source_filename, header.m_source_size,
+            header.m_source_time))
+        return false;
+    header.m_root = root;
+    header.m_body_size = m_data.size();
+
+    // Write to a temporary file, so that a partly written snapshot is
+    // never used.
+    string temp_filename(filename);
+    temp_filename += ".tmp";
+    FILE * fp = fopen(temp_filename.c_str(), "wb");
+    if(fp == NULL)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+        fwrite(m_data.data(), 1, m_data.size(), fp) == m_data.size();
+    if(fclose(fp) != 0)
+        ok = false;
+    if(ok)
+        ok = replace_file(temp_filename.c_str(), filename);
+    if(!ok)
+        remove(temp_filename.c_str());
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SnapshotReader::SnapshotReader()
+: m_ptr(0), m_end(0), m_error(true)
+{
+}
+
+SnapshotReader::SnapshotReader(const uint8 * ptr, const uint8 * end)
+: m_ptr(ptr), m_end(end), m_error(false)
+{
+}
+
+uint32 SnapshotReader::get_uint32()
+{
+    if(m_end - m_ptr < 4)
+    {
+        m_error = true;
+        m_ptr = m_end;
+        return 0;
+    }
+    uint32 x;
+    memcpy(&x, m_ptr, sizeof(x));
+    m_ptr += sizeof(x);
+    return x;
+}
+
+string SnapshotReader::get_string()
+{
+    uint32 length = get_uint32();
+    uint32 padded = length + (4 - length % 4) % 4;
+    if(padded < length || uint32(m_end - m_ptr) < padded)
+    {
+        m_error = true;
+        m_ptr = m_end;
+        return string();
+    }
+    string s(reinterpret_cast<const char *>(m_ptr), length);
+    m_ptr += padded;
+    return s;
+}
+
+uint32 SnapshotReader::get_count()
+{
+    uint32 count = get_uint32();
+    if(count > uint32(m_end - m_ptr) / 4)
+    {
+        m_error = true;
+        m_ptr = m_end;
+        return 0;
+    }
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Snapshot::Snapshot()
+: m_mapping(0), m_view(0), m_body(0), m_body_size(0), m_root(0)
+{
+}
+
+Snapshot::~Snapshot()
+{
+    close();
+}
+
+bool Snapshot::open(const char * filename, const char * source_filename)
+{
+    close();
+
+    uint32 source_size, source_time;
+    if(!get_source_info(source_filename, source_size, source_time))
+        return false;
+
+    HANDLE file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+    DWORD size = GetFileSize(file, NULL);
+    if(size == 0xffffffff || size < sizeof(SnapshotHeader))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(mapping == NULL)
+        return false;
+    m_view = reinterpret_cast<const uint8 *>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(m_view == 0)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    m_mapping = mapping;
+
+    const SnapshotHeader * header =
+        reinterpret_cast<const SnapshotHeader *>(m_view);
+    if(memcmp(header->m_magic, snapshot_magic, sizeof(header->m_magic)) != 0 ||
+        header->m_version != SNAPSHOT_VERSION ||
+        header->m_source_size != source_size ||
+        header->m_source_time != source_time ||
+        header->m_body_size != size - sizeof(SnapshotHeader))
+    {
+        close();
+        return false;
+    }
+    m_body = m_view + sizeof(SnapshotHeader);
+    m_body_size = header->m_body_size;
+    m_root = header->m_root;
+    return true;
+}
+
+void Snapshot::close()
+{
+    if(m_view != 0)
+        UnmapViewOfFile(m_view);
+    if(m_mapping != 0)
+        CloseHandle(reinterpret_cast<HANDLE>(m_mapping));
+    m_view = m_body = 0;
+    m_mapping = 0;
+    m_body_size = 0;
+}
+
+bool Snapshot::read_record(uint32 offset, SnapshotReader & reader) const
+{
+    if(m_body == 0 || offset > m_body_size ||
+        m_body_size - offset < RECORD_HEADER_SIZE)
+        return false;
+    uint32 size, hash;
+    memcpy(&size, m_body + offset, 4);
+    memcpy(&hash, m_body + offset + 4, 4);
+    const uint8 * start = m_body + offset + RECORD_HEADER_SIZE;
+    if(size > m_body_size - offset - RECORD_HEADER_SIZE ||
+        hash_bytes(start, size) != hash)
+    {
+        error_printf("config snapshot: bad record at offset %lu\n", offset);
+        return false;
+    }
+    reader = SnapshotReader(start, start + size);
+    return true;
+}
@@ -0,0 +1,126 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// snapshot.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Binary snapshots of the configuration, for fast loading.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "common.h"
+#include "hashstr.h"
+
+/*
+    A snapshot file is written next to the XML configuration file after it
+    has been loaded or saved. It records the size and modification time of
+    the XML file, and is ignored if they no longer match.
+
+    The body of the file is a sequence of records. Each record starts with
+    its size and a hash of its contents, which is checked when the record
+    is read. Records refer to each other by offset, so that a character's
+    record is only read when that character is first used.
+*/
+
+// Returns a hash of a block of memory.
+uint32 hash_bytes(const void * data, uint32 size);
+
+// Builds the contents of a snapshot file in memory.
+class SnapshotWriter
+{
+private:
+    string m_data;
+    uint32 m_record_start;
+
+public:
+    SnapshotWriter();
+
+    // Records cannot be nested: a record that refers to other records must
+    // be written after them.
+    void begin_record();
+    // Returns the offset of the record.
+    uint32 end_record();
+
+    void put_uint32(uint32 x);
+    void put_bool(bool b) { put_uint32(b ? 1 : 0); }
+    void put_string(const string & s);
+
+    // Returns true if successful.
+    bool write_file(const char * filename, const char * source_filename,
+        uint32 root);
+};
+
+// Reads the fields of one record. Reading past the end of the record
+// sets the error flag and returns zero/empty values.
+class SnapshotReader
+{
+private:
+    const uint8 * m_ptr, * m_end;
+    bool m_error;
+
+public:
+    SnapshotReader();
+    SnapshotReader(const uint8 * ptr, const uint8 * end);
+
+    uint32 get_uint32();
+    bool get_bool() { return get_uint32() != 0; }
+    string get_string();
+    // Reads the number of entries that follow, each taking at least
+    // 4 bytes.
+    uint32 get_count();
+
+    bool failed() const { return m_error; }
+};
+
+// A memory mapped snapshot file.
+class Snapshot
+{
+private:
+    void * m_mapping;
+    const uint8 * m_view;
+    const uint8 * m_body;
+    uint32 m_body_size;
+    uint32 m_root;
+
+    // The assignment operator and copy constructor are never defined.
+    Snapshot(const Snapshot & other);
+    void operator = (const Snapshot & other);
+
+public:
+    Snapshot();
+    ~Snapshot();
+
+    // Returns false if the file does not exist, is not a valid snapshot,
+    // or does not match the size and time of the source file.
+    bool open(const char * filename, const char * source_filename);
+    void close();
+    bool is_open() const { return m_view != 0; }
+
+    uint32 get_root() const { return m_root; }
+    // Returns false if the record is invalid.
+    bool read_record(uint32 offset, SnapshotReader & reader) const;
+};
+
+#endif
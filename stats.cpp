@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// stats.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdio.h>
+#include <string.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "stats.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  This module keeps per-opcode message counters and pipeline timings.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+TrafficStats g_traffic_stats;
+
+static sint64 read_counter()
+{
+    LARGE_INTEGER counter;
+    if(!QueryPerformanceCounter(&counter))
+        return 0;
+    return counter.QuadPart;
+}
+
+// VC++ 6 cannot convert an unsigned 64 bit integer to double.
+static double to_double(uint64 x)
+{
+    return double(sint64(x));
+}
+
+TrafficStats::TrafficStats()
+{
+    reset();
+}
+
+void TrafficStats::reset()
+{
+    memset(m_opcodes, 0, sizeof(m_opcodes));
+    memset(m_stages, 0, sizeof(m_stages));
+    m_start_tsc = read_tsc();
+    m_start_counter = read_counter();
+}
+
+// static
+const char * TrafficStats::get_stage_name(stats_stage_t stage)
+{
+    static const char * names[NUM_STATS_STAGES] =
+    {
+        "decrypt", "decompress", "recompress", "encrypt"
+    };
+    ASSERT(stage >= 0 && stage < NUM_STATS_STAGES);
+    return names[stage];
+}
+
+double TrafficStats::get_seconds() const
+{
+    LARGE_INTEGER frequency;
+    if(!QueryPerformanceFrequency(&frequency) || frequency.QuadPart == 0)
+        return 0;
+    return double(read_counter() - m_start_counter) /
+        double(frequency.QuadPart);
+}
+
+double TrafficStats::get_cycles_per_us() const
+{
+    double seconds = get_seconds();
+    if(seconds <= 0)
+        return 0;
+    return to_double(read_tsc() - m_start_tsc) / (seconds * 1000000.0);
+}
+
+double TrafficStats::to_us(uint64 cycles) const
+{
+    double cycles_per_us = get_cycles_per_us();
+    if(cycles_per_us <= 0)
+        cycles_per_us = 1;
+    return to_double(cycles) / cycles_per_us;
+}
+
+int TrafficStats::get_top(stats_dir_t dir, int * codes, int max_codes) const
+{
+    int n = 0;
+    for(int code = 0; code < 256; code++)
+    {
+        if(m_opcodes[dir][code].m_messages == 0)
+            continue;
+        // Insertion sort, keeping only the first max_codes.
+        uint64 bytes = m_opcodes[dir][code].m_bytes;
+        int i = n < max_codes ? n++ : max_codes;
+        while(i > 0 && m_opcodes[dir][codes[i - 1]].m_bytes < bytes)
+        {
+            if(i < max_codes)
+                codes[i] = codes[i - 1];
+            i--;
+        }
+        if(i < max_codes)
+            codes[i] = code;
+    }
+    return n;
+}
+
+bool TrafficStats::write(FILE * fp, const char * const * names) const
+{
+    fprintf(fp, "# seconds\t%.3f\n", get_seconds());
+    fprintf(fp, "# cycles_per_us\t%.1f\n", get_cycles_per_us());
+
+    fprintf(fp, "# stage\tcalls\tbytes\tus\n");
+    {for(int i = 0; i < NUM_STATS_STAGES; i++)
+    {
+        const StageStats & st = m_stages[i];
+        fprintf(fp, "stage\t%s\t%lu\t%.0f\t%.0f\n",
+            get_stage_name(stats_stage_t(i)), st.m_calls,
+            to_double(st.m_bytes), to_us(st.m_cycles));
+    }}
+
+    fprintf(fp, "# dir\tcode\tname\tmessages\tsuppressed\tbytes\tus");
+    {for(int b = 0; b < NUM_LATENCY_BUCKETS - 1; b++)
+        fprintf(fp, "\tlt%.0fus", to_us(1 << (b + 10)));}
+    fprintf(fp, "\tge%.0fus", to_us(1 << (NUM_LATENCY_BUCKETS + 8)));
+    fprintf(fp, "\n");
+    for(int dir = 0; dir < NUM_STATS_DIRS; dir++)
+        for(int code = 0; code < 256; code++)
+        {
+            const OpcodeStats & op = m_opcodes[dir][code];
+            if(op.m_messages == 0)
+                continue;
+            const char * name = names != 0 ? names[code] : 0;
+            fprintf(fp, "%s\t0x%02x\t%s\t%lu\t%lu\t%.0f\t%.0f",
+                dir == STATS_SEND ? "send" : "recv", code,
+                name != 0 ? name : "-", op.m_messages, op.m_suppressed,
+                to_double(op.m_bytes), to_us(op.m_cycles));
+            for(int b = 0; b < NUM_LATENCY_BUCKETS; b++)
+                fprintf(fp, "\t%lu", op.m_latency[b]);
+            fprintf(fp, "\n");
+        }
+    return !ferror(fp);
+}
@@ -0,0 +1,154 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// stats.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Counters for the traffic through the socket hooks.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "common.h"
+
+// Reads the processor's time stamp counter. This costs a few cycles, so it
+// can be left on all the time.
+inline uint64 read_tsc()
+{
+#ifdef __GNUC__
+    uint64 t;
+    __asm__ __volatile__("rdtsc" : "=A" (t));
+    return t;
+#else
+    uint32 lo, hi;
+    __asm
+    {
+        rdtsc
+        mov lo, eax
+        mov hi, edx
+    }
+    return (uint64(hi) << 32) | lo;
+#endif
+}
+
+enum stats_dir_t
+{
+    STATS_SEND,     // client to server
+    STATS_RECV,     // server to client
+    NUM_STATS_DIRS
+};
+
+// The parts of the socket hook pipeline that are timed:
+enum stats_stage_t
+{
+    STAGE_DECRYPT,
+    STAGE_DECOMPRESS,
+    STAGE_RECOMPRESS,
+    STAGE_ENCRYPT,
+    NUM_STATS_STAGES
+};
+
+// Histogram bucket i counts handler times below 2^(i + 10) cycles; the last
+// bucket counts everything longer.
+const int NUM_LATENCY_BUCKETS = 16;
+
+class OpcodeStats
+{
+public:
+    uint32 m_messages, m_suppressed;
+    uint64 m_bytes, m_cycles;
+    uint32 m_latency[NUM_LATENCY_BUCKETS];
+};
+
+class StageStats
+{
+public:
+    uint32 m_calls;
+    uint64 m_bytes, m_cycles;
+};
+
+// Has a fixed size, so counting never allocates memory.
+class TrafficStats
+{
+private:
+    OpcodeStats m_opcodes[NUM_STATS_DIRS][256];
+    StageStats m_stages[NUM_STATS_STAGES];
+    // For converting cycles to time:
+    uint64 m_start_tsc;
+    sint64 m_start_counter;
+
+public:
+    TrafficStats();
+
+    void reset();
+
+    void add_message(stats_dir_t dir, uint8 code, int size, bool suppressed,
+        uint64 cycles)
+    {
+        OpcodeStats & op = m_opcodes[dir][code];
+        op.m_messages++;
+        if(suppressed)
+            op.m_suppressed++;
+        op.m_bytes += size;
+        op.m_cycles += cycles;
+        int bucket = 0;
+        for(uint64 limit = 1 << 10; cycles >= limit &&
+                bucket < NUM_LATENCY_BUCKETS - 1; limit <<= 1)
+            bucket++;
+        op.m_latency[bucket]++;
+    }
+    void add_stage(stats_stage_t stage, int size, uint64 cycles)
+    {
+        StageStats & st = m_stages[stage];
+        st.m_calls++;
+        st.m_bytes += size;
+        st.m_cycles += cycles;
+    }
+
+    const OpcodeStats & get_opcode(stats_dir_t dir, int code) const
+        { return m_opcodes[dir][code]; }
+    const StageStats & get_stage(stats_stage_t stage) const
+        { return m_stages[stage]; }
+    static const char * get_stage_name(stats_stage_t stage);
+
+    // Measured since the last reset.
+    double get_cycles_per_us() const;
+    // Converts TSC cycles to microseconds at that rate. Until there is a
+    // rate, returns the cycles.
+    double to_us(uint64 cycles) const;
+    double get_seconds() const;
+    // Fills 'codes' with the opcodes that have the most bytes, most first.
+    // Returns the number of opcodes filled in.
+    int get_top(stats_dir_t dir, int * codes, int max_codes) const;
+
+    // Writes every counter as tab separated text, one line per opcode and
+    // stage, for processing by other programs. 'names' has 256 entries,
+    // which may be 0.
+    bool write(FILE * fp, const char * const * names) const;
+};
+
+extern TrafficStats g_traffic_stats;
+
+#endif
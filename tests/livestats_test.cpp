@@ -0,0 +1,152 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// livestats_test.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Checks read_live_stats() from livestats.h on Linux, the way a monitor
+//  uses it. One thread updates a block as SharedStats does, making the
+//  sequence number odd, writing every field and making it even again. The
+//  other reads it as fast as it can and fails if it ever gets a copy whose
+//  fields come from two different updates. It is not part of the MinGW
+//  build; run "make" in this directory.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "livestats.h"
+
+const int UPDATES = 2000000;
+
+static LiveStatsBlock g_block;
+static volatile int g_done = 0;
+
+// Every field after the sequence number is set to the update number, so a
+// consistent copy has the same value in all of them.
+static void fill(LiveStatsBlock & block, int value)
+{
+    int * first = &block.m_hp;
+    int * end = reinterpret_cast<int *>(&block + 1);
+    block.m_time = block.m_in_world = block.m_player = value;
+    for(int * p = first; p != end; p++)
+        *p = value;
+}
+
+// Returns the number of fields that differ from m_time.
+static int count_torn(const LiveStatsBlock & block)
+{
+    const int * first = &block.m_hp;
+    const int * end = reinterpret_cast<const int *>(&block + 1);
+    int value = block.m_time, torn = 0;
+    if(int(block.m_in_world) != value)
+        torn++;
+    if(int(block.m_player) != value)
+        torn++;
+    for(const int * p = first; p != end; p++)
+        if(*p != value)
+            torn++;
+    return torn;
+}
+
+// As SharedStats::begin_update() and end_update(), with the GCC builtin
+// standing in for InterlockedIncrement().
+static void * writer(void *)
+{
+    for(int i = 1; i <= UPDATES; i++)
+    {
+        __sync_fetch_and_add(&g_block.m_seq, 1);
+        fill(g_block, i);
+        __sync_fetch_and_add(&g_block.m_seq, 1);
+    }
+    g_done = 1;
+    return 0;
+}
+
+static bool check(bool ok, const char * what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    LiveStatsBlock copy;
+
+    memset(&g_block, 0, sizeof(g_block));
+    g_block.m_magic = LIVE_STATS_MAGIC;
+    g_block.m_version = LIVE_STATS_VERSION;
+    g_block.m_size = sizeof(LiveStatsBlock);
+
+    ok &= check(read_live_stats(&g_block, copy) && count_torn(copy) == 0,
+        "an idle block is read");
+    g_block.m_seq = 1;
+    ok &= check(!read_live_stats(&g_block, copy),
+        "a block left half written is refused");
+    g_block.m_seq = 0;
+    g_block.m_version = LIVE_STATS_VERSION + 1;
+    ok &= check(!read_live_stats(&g_block, copy),
+        "a block of another version is refused");
+    g_block.m_version = LIVE_STATS_VERSION;
+
+    pthread_t thread;
+    if(pthread_create(&thread, 0, writer, 0) != 0)
+    {
+        printf("FAILED: cannot start the writer thread\n");
+        return 1;
+    }
+    int reads = 0, busy = 0, torn = 0, unchecked_torn = 0, last = 0;
+    bool backwards = false;
+    while(!g_done)
+    {
+        if(read_live_stats(&g_block, copy))
+        {
+            reads++;
+            if(count_torn(copy) != 0)
+                torn++;
+            if(int(copy.m_time) < last)
+                backwards = true;
+            last = copy.m_time;
+        }
+        else
+            busy++;
+        // What a reader that ignored the sequence number would get:
+        memcpy(&copy, &g_block, sizeof(LiveStatsBlock));
+        if(count_torn(copy) != 0)
+            unchecked_torn++;
+    }
+    pthread_join(thread, 0);
+
+    printf("%d copies while writing, %d gave up; %d copies torn without "
+        "the sequence check\n", reads, busy, unchecked_torn);
+    ok &= check(reads > 0, "copies are read while the block is updated");
+    ok &= check(torn == 0, "no copy is torn");
+    ok &= check(!backwards, "copies never go back to an older update");
+    ok &= check(read_live_stats(&g_block, copy) &&
+        int(copy.m_time) == UPDATES && count_torn(copy) == 0,
+        "the last update is read");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// textmatch.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Substring search with the pattern prepared in advance
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "textmatch.h"
+
+TextMatcher::TextMatcher()
+{
+    set("");
+}
+
+TextMatcher::TextMatcher(const string & pattern)
+{
+    set(pattern);
+}
+
+void TextMatcher::set(const string & pattern)
+{
+    m_pattern = pattern;
+    int length = m_pattern.length();
+    int skip = length < 255 ? length : 255;
+    memset(m_skip, skip, sizeof(m_skip));
+    // The last character is not included, so that a match moves on.
+    for(int i = 0; i < length - 1; i++)
+    {
+        int s = length - 1 - i;
+        m_skip[uint8(m_pattern[i])] = s < 255 ? s : 255;
+    }
+}
+
+bool TextMatcher::find(const char * text, int length) const
+{
+    int m = m_pattern.length();
+    if(m == 0)
+        return true;
+    const char * pattern = m_pattern.data();
+    const char * last = pattern + m - 1;
+    int pos = 0;
+    while(pos + m <= length)
+    {
+        const char * t = text + pos + m - 1;
+        char c = *t;
+        if(c == *last)
+        {
+            const char * p = last;
+            while(p != pattern && *(p - 1) == *(t - 1))
+            {
+                p--;
+                t--;
+            }
+            if(p == pattern)
+                return true;
+        }
+        pos += m_skip[uint8(c)];
+    }
+    return false;
+}
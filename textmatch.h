@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// textmatch.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Substring search with the pattern prepared in advance
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TEXTMATCH_H_
+#define _TEXTMATCH_H_
+
+#include <string>
+using std::string;
+
+#include "common.h"
+
+// Finds a fixed string in text that is not null terminated, such as a
+// name in a message buffer, using the Horspool skip table built by
+// set(). Build one when the pattern is given, not for every search.
+class TextMatcher
+{
+private:
+    string m_pattern;
+    uint8 m_skip[256];  // at most 255, which only shortens long jumps
+
+public:
+    TextMatcher();
+    explicit TextMatcher(const string & pattern);
+
+    void set(const string & pattern);
+    const string & get_pattern() const { return m_pattern; }
+    // Returns true if the pattern is found anywhere in the text. An empty
+    // pattern is found in any text.
+    bool find(const char * text, int length) const;
+    bool find(const uint8 * text, int length) const
+    { return find(reinterpret_cast<const char *>(text), length); }
+};
+
+#endif
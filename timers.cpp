@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// timers.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "timers.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+TimerWheel::TimerWheel()
+: m_tick(0), m_tick_time(GetTickCount())
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+    for(int i = 0; i < NUM_SLOTS; i++)
+        while(m_slots[i].is_linked())
+        {
+            Timer * timer = static_cast<Timer *>(m_slots[i].m_next);
+            timer->cancel();
+            timer->discarded();
+        }
+}
+
+void TimerWheel::schedule(Timer * timer, uint32 delay)
+{
+    uint32 now = GetTickCount();
+    // Count from the start of the current tick, and round up, so that the
+    // timer never runs early.
+    uint32 ticks = (now - m_tick_time + delay + TICK_MS - 1) / TICK_MS;
+    if(ticks == 0)
+        ticks = 1;
+    timer->cancel();
+    timer->m_expires = m_tick + ticks;
+    timer->insert_before(&m_slots[timer->m_expires % NUM_SLOTS]);
+}
+
+int TimerWheel::run()
+{
+    uint32 ticks = (GetTickCount() - m_tick_time) / TICK_MS;
+    if(ticks == 0)
+        return 0;
+    m_tick_time += ticks * TICK_MS;
+    uint32 last = m_tick + ticks;
+
+    // Take the due timers off first, since expired() may schedule or cancel
+    // timers in the slots being looked at.
+    TimerLink due;
+    uint32 num_slots = ticks < uint32(NUM_SLOTS) ? ticks : uint32(NUM_SLOTS);
+    for(uint32 i = 1; i <= num_slots; i++)
+    {
+        TimerLink & slot = m_slots[(m_tick + i) % NUM_SLOTS];
+        TimerLink * link = slot.m_next;
+        while(link != &slot)
+        {
+            TimerLink * next = link->m_next;
+            if(sint32(static_cast<Timer *>(link)->m_expires - last) <= 0)
+            {
+                link->unlink();
+                link->insert_before(&due);
+            }
+            link = next;
+        }
+    }
+    m_tick = last;
+
+    int count = 0;
+    while(due.is_linked())
+    {
+        Timer * timer = static_cast<Timer *>(due.m_next);
+        timer->cancel();
+        timer->expired();
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// timers.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  A hashed timer wheel, so that commands can do something later without
+//  blocking the thread they run on.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TIMERS_H_
+#define _TIMERS_H_
+
+#include "common.h"
+
+// The links of a timer in a wheel slot. Slots are circular lists with a
+// TimerLink as the head, so a timer can unlink itself without knowing which
+// slot it is in.
+class TimerLink
+{
+public:
+    TimerLink * m_next;
+    TimerLink * m_prev;
+
+    TimerLink() : m_next(this), m_prev(this) {}
+    void unlink()
+    {
+        m_prev->m_next = m_next;
+        m_next->m_prev = m_prev;
+        m_next = m_prev = this;
+    }
+    void insert_before(TimerLink * pos)
+    {
+        m_next = pos;
+        m_prev = pos->m_prev;
+        m_prev->m_next = this;
+        pos->m_prev = this;
+    }
+    bool is_linked() const { return m_next != this; }
+};
+
+// Derive from this and implement expired(). A timer may be rescheduled from
+// its own expired().
+class Timer : private TimerLink
+{
+    friend class TimerWheel;
+private:
+    uint32 m_expires;       // in wheel ticks
+
+public:
+    Timer() : m_expires(0) {}
+    virtual ~Timer() { cancel(); }
+
+    virtual void expired() = 0;
+    // Called instead of expired() if the wheel is destroyed first.
+    virtual void discarded() {}
+
+    bool is_scheduled() const { return is_linked(); }
+    void cancel() { unlink(); }
+};
+
+// A timer that calls a member function of its owner.
+template<class T> class MemberTimer : public Timer
+{
+public:
+    typedef void (T::*handler_t)();
+
+private:
+    T & m_owner;
+    handler_t m_handler;
+
+public:
+    MemberTimer(T & owner, handler_t handler)
+    : m_owner(owner), m_handler(handler)
+    {
+    }
+
+    virtual void expired() { (m_owner .* m_handler)(); }
+};
+
+// Timers are kept in the slot for the tick they expire on, modulo the
+// number of slots, so scheduling and cancelling cost the same however many
+// timers there are. run() only looks at the slots for the ticks that have
+// passed; a timer more than one turn away just stays in its slot until its
+// turn comes round.
+//
+// Not thread safe: only the client thread uses it.
+class TimerWheel
+{
+public:
+    enum { TICK_MS = 10, NUM_SLOTS = 4096 };    // one turn is 41 seconds
+
+private:
+    TimerLink m_slots[NUM_SLOTS];
+    uint32 m_tick;          // the last tick run() has done
+    uint32 m_tick_time;     // GetTickCount() at the start of m_tick
+
+public:
+    TimerWheel();
+    ~TimerWheel();
+
+    // Expires 'timer' after at least 'delay' ms. Reschedules it if it was
+    // already scheduled.
+    void schedule(Timer * timer, uint32 delay);
+    // Runs the timers that are due. Returns how many ran.
+    int run();
+};
+
+#endif
@@ -505,52 +505,65 @@ void DecompressingCopier::initialise()
 void DecompressingCopier::operator () (char * dest, const char * src,
     int & dest_size, int & src_size)
 {
-    unsigned char * pdest = reinterpret_cast<unsigned char *>(dest);
-    const unsigned char * src2 = reinterpret_cast<const unsigned char *>(src);
-    const unsigned char * psrc = src2;
+    const unsigned char * psrc = reinterpret_cast<const unsigned char *>(src);
     int len = src_size; // len will decrease
+
+    dest_size = decompress(reinterpret_cast<unsigned char *>(dest),
+        dest_size, psrc, len);
+    src_size -= len;
+}
+
+int DecompressingCopier::decompress(unsigned char * dest, int dest_size,
+    const unsigned char * & src, int & src_size, bool * flushed)
+{
+    // Work on local copies of the decoder state; they are stored back
+    // before returning.
+    int cur_value = value, cur_mask = mask, cur_bit = bit_num;
+    int pos = treepos;
     int dest_index = 0;
+    if(flushed != 0)
+        *flushed = false;
 
-    while(true)
+    while(dest_index < dest_size)
     {
-        if(bit_num == 8)
+        if(cur_bit == 8)
         {
             // End of input.
-            if(len == 0)
-            {
-                dest_size = dest_index;
-                // src_size is unchanged
-                return;
-            }
-            len--;
-            value = *psrc++;
-            bit_num = 0;
-            mask = 0x80;
+            if(src_size == 0)
+                break;
+            src_size--;
+            cur_value = *src++;
+            cur_bit = 0;
+            cur_mask = 0x80;
         }
-        if(value & mask)
-            treepos = tree[treepos * 2];
+        if(cur_value & cur_mask)
+            pos = tree[pos * 2];
         else
-            treepos = tree[treepos * 2 + 1];
-        mask >>= 1; // shift on reck
-        bit_num++;
+            pos = tree[pos * 2 + 1];
+        cur_mask >>= 1; // shift on reck
+        cur_bit++;
 
-        if(treepos <= 0) // this is a leaf.
+        if(pos <= 0) // this is a leaf.
         {
-            if(treepos == -256) // special flush character
+            if(pos == -256) // special flush character
             {
-                bit_num = 8; // flush rest of byte
-                treepos = 0; // start on tree top again
+                cur_bit = 8;    // flush rest of byte
+                pos = 0;        // start on tree top again
+                if(flushed != 0)
+                {
+                    *flushed = true;
+                    break;
+                }
                 continue;
             }
-            if(dest_index == dest_size) // Buffer full
-            {
-                dest_size = dest_index;
-                src_size = psrc - src2;
-                return;
-            }
-            pdest[dest_index++] = -treepos;   // data is negative value
-            treepos = 0;      // start on tree top again
+            dest[dest_index++] = -pos;  // data is negative value
+            pos = 0;        // start on tree top again
         }
     }
-}
 
+    value = cur_value;
+    mask = cur_mask;
+    bit_num = cur_bit;
+    treepos = pos;
+    return dest_index;
+}
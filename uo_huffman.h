@@ -97,6 +97,16 @@ public:
 
     virtual void operator () (char * dest, const char * src, int & dest_size,
         int & src_size);
+    // Decompresses into 'dest' until either 'dest_size' bytes have been
+    // output or the input runs out. 'src' and 'src_size' are advanced past
+    // the input consumed. Returns the number of bytes output.
+    // The decoder state is kept between calls, so this can be used to
+    // decompress directly into several small destinations in turn.
+    // If 'flushed' is not 0, this also stops after a flush code, which the
+    // server sends at the end of each message, and sets *flushed to whether
+    // it did.
+    int decompress(unsigned char * dest, int dest_size,
+        const unsigned char * & src, int & src_size, bool * flushed = 0);
 };
 
 
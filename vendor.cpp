@@ -33,6 +33,7 @@
 #include "hotkeyhook.h"
 #include "igui.h"
 #include "iconfig.h"
+#include "stats.h"      // for read_tsc()
 
 #include "vendor.h"
 
@@ -121,32 +122,44 @@ void VendorBuyIterator::operator++()
     }
 }
 
-void VendorBuyItem::set_name(char * name, int name_len)
+// Copies a name from a vendor list message into 'names', up to the first
+// null byte, and returns where the next name goes. The names never need
+// more space than the message they come from.
+static char * copy_name(char * names, const uint8 * name, int name_len)
 {
-    m_name.assign(name, name_len);
-    // NOTE: must remove null bytes at end of string
-    string::size_type null = m_name.find_first_of((char)'\0');
-    if(null != string::npos)
-        m_name.erase(null);
+    int i = 0;
+    while(i < name_len && name[i] != 0)
+    {
+        names[i] = name[i];
+        i++;
+    }
+    names[i] = '\0';
+    return names + i + 1;
 }
-    
+
 VendorBuyList::VendorBuyList(GameObject & container, uint8 * buf, int size)
 : m_container(container)
 {
     // Store buy list
     m_length = buf[7];
-    trace_printf("number of items: %d\n", m_length);
     m_list = new VendorBuyItem[m_length];
+    m_names = new char[size];
+    char * names = m_names;
     uint8 * ptr = buf + 8;
+    uint8 * end = buf + size;
     for(int i = 0; i < m_length; i++)
     {
+        if(ptr + 5 > end || ptr + 5 + ptr[4] > end)
+        {
+            m_length = i;
+            break;
+        }
         m_list[i].m_price = unpack_big_sint32(ptr);
         ptr += 4;
         int name_len = *ptr++;
-        m_list[i].set_name(reinterpret_cast<char *>(ptr), name_len);
+        m_list[i].m_name = names;
+        names = copy_name(names, ptr, name_len);
         ptr += name_len;
-        trace_printf("#%d: %s  $%ld\n",
-            i, m_list[i].get_name(), m_list[i].m_price);
     }
     // Check message size
     if(ptr - buf != size)
@@ -155,6 +168,7 @@ VendorBuyList::VendorBuyList(GameObject & container, uint8 * buf, int size)
 
 VendorBuyList::~VendorBuyList()
 {
+    delete [] m_names;
     delete [] m_list;
 }
 
@@ -185,30 +199,29 @@ void VendorSellIterator::operator++()
         m_item = 0;
 }
 
-void VendorSellItem::set_name(char * name, int name_len)
-{
-    m_name.assign(name, name_len);
-    // NOTE: must remove null bytes at end of string
-    string::size_type null = m_name.find_first_of((char)'\0');
-    if(null != string::npos)
-        m_name.erase(null);
-}
-
 VendorSellList::VendorSellList(uint8 * buf, int size)
 {
     // Store sell list
     m_length = unpack_big_uint16(buf + 7);
-    trace_printf("number of items: %d\n", m_length);
     m_list = new VendorSellItem[m_length];
+    m_names = new char[size];
+    char * names = m_names;
     uint8 * ptr = buf + 9;
+    uint8 * end = buf + size;
     for(int i = 0; i < m_length; i++)
     {
+        if(ptr + 14 > end || ptr + 14 + unpack_big_uint16(ptr + 12) > end)
+        {
+            m_length = i;
+            break;
+        }
         m_list[i].m_serial = unpack_big_uint32(ptr);
         m_list[i].m_quantity = unpack_big_uint16(ptr + 8);
         m_list[i].m_price = unpack_big_uint16(ptr + 10);
         int name_len = unpack_big_uint16(ptr + 12);
         ptr += 14;
-        m_list[i].set_name(reinterpret_cast<char *>(ptr), name_len);
+        m_list[i].m_name = names;
+        names = copy_name(names, ptr, name_len);
         ptr += name_len;
     }
     // Check message size
@@ -218,6 +231,7 @@ VendorSellList::VendorSellList(uint8 * buf, int size)
 
 VendorSellList::~VendorSellList()
 {
+    delete [] m_names;
     delete [] m_list;
 }
 
@@ -251,7 +265,7 @@ VendorHandler::VendorHandler(ConfigManager & config, ClientInterface & client,
     World & world, ServerConfig & server)
 : m_config(config), m_client(client), m_world(world), m_server(server),
   m_state(NORMAL), m_buying(false), m_selling(false), m_vendor(0),
-  m_buy_restock(0), m_buy_nonrestock(0), m_list(0),
+  m_buy_restock(0), m_buy_nonrestock(0), m_list(0), m_trace(true),
   m_choose_dialog(0), m_edit_dialog(0), m_shop_dialog(0)
 {
 }
@@ -321,184 +335,159 @@ void VendorHandler::ignore_buy()
     }
 }
 
+// private static
+// Decides how many of a vendor's item to buy or sell, and adds them to the
+// shopping list's counts.
+int VendorHandler::take(ShoppingItem & item, int quantity, sint32 price)
+{
+    item.m_available += quantity;
+    int n = quantity;
+    if(item.m_want != WANT_ALL && item.m_want - item.m_got < quantity)
+        n = item.m_want - item.m_got;
+    item.m_got += n;
+    item.m_paid += n * price;
+    return n;
+}
+
 // private
-void VendorHandler::do_buy(VendorBuyList & vendor_list)
+// Writes an entry of the Vendor Buy Reply at 'ptr' for each item to buy,
+// and returns the end of them. Does not write past 'end'.
+uint8 * VendorHandler::do_buy(VendorBuyList & vendor_list, uint8 * ptr,
+    uint8 * end)
 {
     ASSERT(m_list != 0);
+    int layer = vendor_list.get_layer();
     VendorBuyList::iterator vi = vendor_list.begin();
     while(vi.is_valid())
     {
-        int quantity = vi.get_quantity();
-        uint32 serial = vi.get_serial();
-        sint32 price = vi.get_price();
-        // No newline printed yet:
-        trace_printf("%s: q:%d, $%ld, 0x%08lx  ", vi.get_name().c_str(),
-            quantity, vi.get_price(), serial);
         // Check for the item on the 'shopping list':
         int index = m_list->index_of(vi.get_name());
-        if(index == -1)
-            trace_printf("(not wanted)\n");
-        else
+        if(index != -1)
         {
-            ShoppingItem & item=((*m_list)[index]);
-            item.m_available += quantity;
-            if(item.m_want == item.m_got)
-                trace_printf("(bought enough)\n");
-            else if(item.m_want == WANT_ALL)
+            int quantity = take((*m_list)[index], vi.get_quantity(),
+                vi.get_price());
+            if(m_trace)
+                trace_printf("%s: q:%d, $%ld, 0x%08lx, buying %d\n",
+                    vi.get_name(), vi.get_quantity(), vi.get_price(),
+                    vi.get_serial(), quantity);
+            if(quantity > 0)
             {
-                trace_printf("(want all, %u available)\n", quantity);
-                m_reply_list.push_back(ReplyItem(vendor_list.get_layer(),
-                    serial, quantity));
-                item.m_got += quantity;
-                item.m_paid += quantity * price;
-            }
-            else
-            {
-                int want = item.m_want - item.m_got;
-                trace_printf("(want %d, %u available)\n", want, quantity);
-                if(want <= quantity)
+                if(ptr + 7 > end)
                 {
-                    item.m_got += want;
-                    item.m_paid += want * price;
-                    // We can buy what the player wanted.
-                    m_reply_list.push_back(ReplyItem(vendor_list.get_layer(),
-                        serial, want));
-                }
-                else    // not enough available
-                {
-                    item.m_got += quantity;
-                    item.m_paid += quantity * price;
-                    m_reply_list.push_back(ReplyItem(vendor_list.get_layer(),
-                        serial, quantity));
+                    error_printf("more items to buy than in the buy lists\n");
+                    break;
                 }
+                ptr[0] = layer;
+                pack_big_uint32(ptr + 1, vi.get_serial());
+                pack_big_uint16(ptr + 5, quantity);
+                ptr += 7;
             }
         }
         ++vi;
     }
+    return ptr;
 }
 
 // private
-void VendorHandler::do_sell(VendorSellList & vendor_list)
+// Writes an entry of the Vendor Sell Reply at 'ptr' for each item to sell,
+// and returns the end of them. There is room for every item in the list.
+uint8 * VendorHandler::do_sell(VendorSellList & vendor_list, uint8 * ptr)
 {
     ASSERT(m_list != 0);
     VendorSellList::iterator vi = vendor_list.begin();
     while(vi.is_valid())
     {
-        int quantity = vi.get_quantity();
-        uint32 serial = vi.get_serial();
-        sint32 price = vi.get_price();
-        // No newline printed yet:
-        trace_printf("%s: q:%d, $%ld, 0x%08lx  ", vi.get_name().c_str(),
-            quantity, vi.get_price(), serial);
         // Check for the item on the 'shopping list':
         int index = m_list->index_of(vi.get_name());
-        if(index == -1)
-            trace_printf("(not for sale)\n");
-        else
+        if(index != -1)
         {
-            ShoppingItem & item=((*m_list)[index]);
-            item.m_available += quantity;
-            if(item.m_want == item.m_got)
-                trace_printf("(sold enough)\n");
-            else if(item.m_want == WANT_ALL)
+            int quantity = take((*m_list)[index], vi.get_quantity(),
+                vi.get_price());
+            if(m_trace)
+                trace_printf("%s: q:%d, $%ld, 0x%08lx, selling %d\n",
+                    vi.get_name(), vi.get_quantity(), vi.get_price(),
+                    vi.get_serial(), quantity);
+            if(quantity > 0)
             {
-                trace_printf("(want to sell all, selling %u)\n", quantity);
-                m_reply_list.push_back(ReplyItem(serial, quantity));
-                item.m_got += quantity;
-                item.m_paid += quantity * price;
-            }
-            else
-            {
-                int want = item.m_want - item.m_got;
-                trace_printf("(want to sell %d, selling %u)\n", want, quantity);
-                if(want <= quantity)
-                {
-                    item.m_got += want;
-                    item.m_paid += want * price;
-                    // We can sell what the player wanted.
-                    m_reply_list.push_back(ReplyItem(serial, want));
-                }
-                else    // not enough available
-                {
-                    item.m_got += quantity;
-                    item.m_paid += quantity * price;
-                    m_reply_list.push_back(ReplyItem(serial, quantity));
-                }
+                pack_big_uint32(ptr, vi.get_serial());
+                pack_big_uint16(ptr + 4, quantity);
+                ptr += 6;
             }
         }
         ++vi;
     }
+    return ptr;
+}
+
+// private
+// Returns a buffer for a reply of at least 'size' bytes. It is kept for
+// the next reply.
+uint8 * VendorHandler::get_reply_buffer(int size)
+{
+    if(int(m_reply.size()) < size)
+        m_reply.resize(size);
+    return &m_reply[0];
 }
 
 // private
 void VendorHandler::finish_buy()
 {
-    m_reply_list.clear();
     m_list->reset();
+    int max_items = 0;
+    if(m_buy_restock != 0)
+        max_items += m_buy_restock->get_length();
+    if(m_buy_nonrestock != 0)
+        max_items += m_buy_nonrestock->get_length();
+    uint8 * buf = get_reply_buffer(8 + 7 * max_items);
+    uint8 * end = buf + 8 + 7 * max_items;
+    uint8 * ptr = buf + 8;
     if(m_buy_restock == 0)
         warning_printf("no buy list received for restock layer\n");
     else
-        do_buy(*m_buy_restock);
+        ptr = do_buy(*m_buy_restock, ptr, end);
     if(m_buy_nonrestock == 0)
         warning_printf("no buy list received for non-restock layer\n");
     else
-        do_buy(*m_buy_nonrestock);
+        ptr = do_buy(*m_buy_nonrestock, ptr, end);
 
-    if(m_reply_list.size() == 0)
+    int count = (ptr - buf - 8) / 7;
+    if(count == 0)
         m_client.client_print("No items bought.");
-    else if(m_reply_list.size() > 255)  // Can this happen?
+    else if(count > 255)    // Can this happen?
         m_client.client_print("Cannot buy: more than 255 items.");
     else
     {
         m_client.client_print("Items bought.");
-        // Construct a Vendor Buy Reply message
-        int size = 8 + 7 * m_reply_list.size();
-        uint8 * buf = new uint8[size];
+        // Fill in the header of the Vendor Buy Reply message
+        int size = ptr - buf;
         buf[0] = CODE_VENDOR_BUY_REPLY;
         pack_big_uint16(buf + 1, size);
         pack_big_uint32(buf + 3, m_vendor->get_serial());
-        buf[7] = m_reply_list.size();
-        uint8 * ptr = buf + 8;
-        for(list_t::iterator i = m_reply_list.begin(); i != m_reply_list.end(); i++)
-        {
-            ptr[0] = (*i).m_layer;
-            pack_big_uint32(ptr + 1, (*i).m_serial);
-            pack_big_uint16(ptr + 5, (*i).m_quantity);
-            ptr += 7;
-        }
+        buf[7] = count;
         m_client.send_server(buf, size);
-        delete /*[]*/ buf;
     }
 }
 
 // private
 void VendorHandler::finish_sell(VendorSellList & sell_list)
 {
-    m_reply_list.clear();
     m_list->reset();
-    do_sell(sell_list);
+    uint8 * buf = get_reply_buffer(9 + 6 * sell_list.get_length());
+    uint8 * ptr = do_sell(sell_list, buf + 9);
 
-    if(m_reply_list.size() == 0)
+    int count = (ptr - buf - 9) / 6;
+    if(count == 0)
         m_client.client_print("No items sold.");
     else
     {
         m_client.client_print("Items sold.");
-        // Construct a Vendor Sell Reply message
-        int size = 9 + 6 * m_reply_list.size();
-        uint8 * buf = new uint8[size];
+        // Fill in the header of the Vendor Sell Reply message
+        int size = ptr - buf;
         buf[0] = 0x9f;  // Vendor Sell Reply
         pack_big_uint16(buf + 1, size);
         pack_big_uint32(buf + 3, m_vendor->get_serial());
-        pack_big_uint16(buf + 7, m_reply_list.size());
-        uint8 * ptr = buf + 9;
-        for(list_t::iterator i = m_reply_list.begin(); i != m_reply_list.end(); i++)
-        {
-            pack_big_uint32(ptr, (*i).m_serial);
-            pack_big_uint16(ptr + 4, (*i).m_quantity);
-            ptr += 6;
-        }
+        pack_big_uint16(buf + 7, count);
         m_client.send_server(buf, size);
-        delete /*[]*/ buf;
     }
 }
 
@@ -584,6 +573,110 @@ void VendorHandler::shop()
     m_choose_dialog->create();
 }
 
+#ifdef USE_BENCHMARKS
+
+void VendorHandler::benchmark(int vendor_items, int list_items)
+{
+    const int RUNS = 1000;
+    const int MATCH_RUNS = 100;
+    const int MAX_NAME = 40;
+    // Made-up Vendor Sell List and Vendor Buy List messages, with names
+    // like real ones. A buy list has at most 255 items.
+    int buy_items = vendor_items < 255 ? vendor_items : 255;
+    uint8 * sell = new uint8[9 + vendor_items * (14 + MAX_NAME)];
+    uint8 * buy = new uint8[8 + buy_items * (5 + MAX_NAME)];
+    uint8 * sell_ptr = sell + 9;
+    uint8 * buy_ptr = buy + 8;
+    {for(int i = 0; i < vendor_items; i++)
+    {
+        char name[MAX_NAME];
+        int len = sprintf(name, "%d magic reagent%s", i + 1, i > 0 ? "s" : "");
+        pack_big_uint32(sell_ptr, 0x40000000 + i);
+        pack_big_uint16(sell_ptr + 4, 0x0f7a);  // graphic
+        pack_big_uint16(sell_ptr + 6, 0);       // colour
+        pack_big_uint16(sell_ptr + 8, i + 1);   // quantity
+        pack_big_uint16(sell_ptr + 10, 5);      // price
+        pack_big_uint16(sell_ptr + 12, len);
+        memcpy(sell_ptr + 14, name, len);
+        sell_ptr += 14 + len;
+        if(i < buy_items)
+        {
+            // Buy list names end with a null byte.
+            pack_big_uint32(buy_ptr, 5);
+            buy_ptr[4] = len + 1;
+            memcpy(buy_ptr + 5, name, len + 1);
+            buy_ptr += 5 + len + 1;
+        }
+    }}
+    int sell_size = sell_ptr - sell;
+    sell[0] = 0x9e;
+    pack_big_uint16(sell + 1, sell_size);
+    pack_big_uint32(sell + 3, 0x00001234);
+    pack_big_uint16(sell + 7, vendor_items);
+    int buy_size = buy_ptr - buy;
+    buy[0] = 0x74;
+    pack_big_uint16(buy + 1, buy_size);
+    pack_big_uint32(buy + 3, 0x40001234);
+    buy[7] = buy_items;
+    GameObject container(0x40001234);
+
+    uint64 start = read_tsc();
+    {for(int i = 0; i < RUNS; i++)
+        VendorSellList list(sell, sell_size);}
+    uint64 sell_cycles = read_tsc() - start;
+    start = read_tsc();
+    {for(int i = 0; i < RUNS; i++)
+        VendorBuyList list(container, buy, buy_size);}
+    uint64 buy_cycles = read_tsc() - start;
+
+    // Half of the shopping list is on sale, spread over the vendor's list.
+    ShoppingList shopping_list("vendorbench");
+    {for(int i = 0; i < list_items; i++)
+    {
+        char name[MAX_NAME];
+        if(i % 2 == 0)
+        {
+            int n = (i / 2) % vendor_items + 1;
+            sprintf(name, "%d magic reagent%s", n, n > 1 ? "s" : "");
+        }
+        else
+            sprintf(name, "%d bottles of ale", i);
+        if(shopping_list.index_of(name) == -1)
+            shopping_list.add(name, WANT_ALL);
+    }}
+    VendorSellList sell_list(sell, sell_size);
+    ShoppingList * saved_list = m_list;
+    m_list = &shopping_list;
+    m_trace = false;
+    int count = 0;
+    start = read_tsc();
+    {for(int i = 0; i < MATCH_RUNS; i++)
+    {
+        m_list->reset();
+        uint8 * buf = get_reply_buffer(9 + 6 * sell_list.get_length());
+        count = (do_sell(sell_list, buf + 9) - buf - 9) / 6;
+    }}
+    uint64 match_cycles = read_tsc() - start;
+    m_trace = true;
+    m_list = saved_list;
+    delete [] sell;
+    delete [] buy;
+
+    char buf[200];
+    sprintf(buf, "Reading: sell list of %d items %.1f us, buy list of %d items %.1f us",
+        vendor_items, g_traffic_stats.to_us(sell_cycles) / RUNS,
+        buy_items, g_traffic_stats.to_us(buy_cycles) / RUNS);
+    m_client.client_print(buf);
+    trace_printf("vendorbench: %s\n", buf);
+    sprintf(buf, "Selling with a list of %d items: %.1f us, %d items in the reply",
+        int(shopping_list.size()),
+        g_traffic_stats.to_us(match_cycles) / MATCH_RUNS, count);
+    m_client.client_print(buf);
+    trace_printf("vendorbench: %s\n", buf);
+}
+
+#endif
+
 bool VendorHandler::handle_open_container(uint8 * buf, int /*size*/)
 {
     if(!m_buying)
@@ -695,7 +788,11 @@ bool VendorHandler::handle_vendor_buy_list(uint8 * buf, int size)
     {
         trace_printf("Buy List layer: restock\n");
         if(m_buy_restock == 0)
+        {
             m_buy_restock = new VendorBuyList(*container, buf, size);
+            trace_printf("number of items: %d\n",
+                m_buy_restock->get_length());
+        }
         else
             warning_printf("duplicate buy list ignored (restock)\n");
     }
@@ -703,7 +800,11 @@ bool VendorHandler::handle_vendor_buy_list(uint8 * buf, int size)
     {
         trace_printf("Buy List layer: non-restock\n");
         if(m_buy_nonrestock == 0)
+        {
             m_buy_nonrestock = new VendorBuyList(*container, buf, size);
+            trace_printf("number of items: %d\n",
+                m_buy_nonrestock->get_length());
+        }
         else
             warning_printf("duplicate buy list ignored (non-restock)\n");
     }
@@ -727,6 +828,7 @@ bool VendorHandler::handle_vendor_sell_list(uint8 * buf, int size)
     uint32 vserial = unpack_big_uint32(buf + 3);
     m_vendor = m_world.get_object(vserial);
     VendorSellList list(buf, size);
+    trace_printf("number of items: %d\n", list.get_length());
 
     if(m_list != 0)     // m_state == WAITING
         finish_sell(list);
@@ -36,7 +36,7 @@
 
 #include "world.h"  // for GameObject::iterator
 
-#include <deque>
+#include <vector>
 
 class ClientInterface;
 class World;
@@ -47,10 +47,7 @@ class VendorBuyItem
 {
 public:
     sint32 m_price;
-    string m_name;
-
-    void set_name(char * name, int name_len);
-    const char * get_name() const { return m_name.c_str(); }
+    const char * m_name;    // in the list's name buffer
 };
 
 class VendorBuyIterator
@@ -73,7 +70,7 @@ public:
     void operator++();
     bool is_valid() const { return m_item != 0; }
 
-    const string & get_name() const
+    const char * get_name() const
     {
         ASSERT(m_item != 0);
         return m_item->m_name;
@@ -109,6 +106,7 @@ private:
     GameObject & m_container;
     int m_length;
     VendorBuyItem * m_list;
+    char * m_names;     // all of the names, each null terminated
 
     friend class VendorBuyIterator;
 
@@ -117,6 +115,7 @@ public:
     ~VendorBuyList();
 
     int get_layer() const { return m_container.get_layer(); }
+    int get_length() const { return m_length; }
     iterator begin();
 };
 
@@ -130,10 +129,7 @@ public:
     uint32 m_serial;
     uint16 m_quantity;
     sint32 m_price;
-    string m_name;
-
-    void set_name(char * name, int name_len);
-    const char * get_name() const { return m_name.c_str(); }
+    const char * m_name;    // in the list's name buffer
 };
 
 class VendorSellIterator
@@ -152,7 +148,7 @@ public:
     void operator++();
     bool is_valid() const { return m_item != 0; }
 
-    const string & get_name() const
+    const char * get_name() const
     {
         ASSERT(m_item != 0);
         return m_item->m_name;
@@ -182,6 +178,7 @@ public:
 private:
     int m_length;
     VendorSellItem * m_list;
+    char * m_names;     // all of the names, each null terminated
 
     friend class VendorSellIterator;
 
@@ -189,34 +186,18 @@ public:
     VendorSellList(uint8 * buf, int size);
     ~VendorSellList();
 
+    int get_length() const { return m_length; }
     iterator begin();
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
 class ShoppingList;
+class ShoppingItem;
 class ChooseListDialog;
 class EditListDialog;
 class ShopListDialog;
 
-class ReplyItem
-{
-public:
-    int m_layer;
-    uint32 m_serial;
-    uint16 m_quantity;
-
-    ReplyItem(int layer, uint32 serial, uint16 quantity)
-    : m_layer(layer), m_serial(serial), m_quantity(quantity)
-    {
-    }
-    // Selling doesn't use a layer:
-    ReplyItem(uint32 serial, uint16 quantity)
-    : m_layer(0), m_serial(serial), m_quantity(quantity)
-    {
-    }
-};
-
 class ConfigManager;
 
 class VendorHandler
@@ -224,8 +205,6 @@ class VendorHandler
 public:
 
 private:
-    typedef std::deque<ReplyItem> list_t;
-
     ConfigManager & m_config;
     ClientInterface & m_client;
     World & m_world;
@@ -239,8 +218,10 @@ private:
     bool m_buying, m_selling, m_error;
     GameObject * m_vendor;
     VendorBuyList * m_buy_restock, * m_buy_nonrestock;
-    list_t m_reply_list;    // Items that we have selected to buy/sell
+    // The Vendor Buy Reply or Vendor Sell Reply being built:
+    std::vector<uint8> m_reply;
     ShoppingList * m_list;
+    bool m_trace;   // whether do_buy/do_sell log each item
 
     ChooseListDialog * m_choose_dialog;
     EditListDialog * m_edit_dialog;
@@ -251,8 +232,10 @@ private:
     void begin_buy(const string & npc_name);
     void begin_sell(const string & npc_name);
     void ignore_buy();
-    void do_buy(VendorBuyList & vendor_list);
-    void do_sell(VendorSellList & vendor_list);
+    static int take(ShoppingItem & item, int quantity, sint32 price);
+    uint8 * do_buy(VendorBuyList & vendor_list, uint8 * ptr, uint8 * end);
+    uint8 * do_sell(VendorSellList & vendor_list, uint8 * ptr);
+    uint8 * get_reply_buffer(int size);
     void finish_buy();
     void finish_sell(VendorSellList & sell_list);
 
@@ -264,6 +247,11 @@ public:
     void buy(const string & name, const string & npc_name);
     void sell(const string & name, const string & npc_name);
     void shop();
+#ifdef USE_BENCHMARKS
+    // Times reading a made-up vendor list and matching a shopping list
+    // against it.
+    void benchmark(int vendor_items, int list_items);
+#endif
 
     bool handle_open_container(uint8 * buf, int size);
     bool handle_vendor_buy_list(uint8 * buf, int size);
@@ -34,6 +34,8 @@
 #include "common.h"
 #include "world.h"
 #include "iconfig.h"
+#include "livestats.h"
+#include "worldfeed.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -162,6 +164,31 @@ void CounterManager::set_object_graphic(GameObject * obj, uint16 graphic)
     }
 }
 
+void CounterManager::get_live_stats(LiveStatsBlock & block) const
+{
+    block.m_hp = m_hp;
+    block.m_max_hp = m_max_hp;
+    block.m_mana = m_mana;
+    block.m_max_mana = m_max_mana;
+    block.m_stamina = m_stamina;
+    block.m_max_stamina = m_max_stamina;
+    block.m_armor = m_ar;
+    block.m_weight = m_weight;
+    block.m_gold = m_gold;
+    const Counter * counters[NUM_LIVE_COUNTERS] =
+    {
+        &m_bm_counter, &m_bp_counter, &m_ga_counter, &m_gs_counter,
+        &m_mr_counter, &m_ns_counter, &m_sa_counter, &m_ss_counter,
+        &m_va_counter, &m_en_counter, &m_wh_counter, &m_fd_counter,
+        &m_br_counter,
+        &m_h_counter, &m_c_counter, &m_m_counter, &m_l_counter,
+        &m_b_counter,
+        &m_ar_counter, &m_bt_counter
+    };
+    {for(int i = 0; i < NUM_LIVE_COUNTERS; i++)
+        block.m_counters[i] = counters[i]->get_value();}
+}
+
 void CounterManager::update() const
 {
 
@@ -636,6 +663,7 @@ int GameObject::count_graphic(uint16 graphic, uint16 color)
 ////////////////////////////////////////////////////////////////////////////////
 
 World::World(uint32 player_serial)
+: m_feed(0)
 {
     m_player = get_object(player_serial);
     m_player->set_interesting(true);
@@ -666,6 +694,7 @@ GameObject * World::find_object(uint32 serial)
     {
         obj = new GameObject(serial);
         m_map[serial] = obj;
+        changed(obj, CHANGE_ADDED);
     }
     else
         obj = (*i).second;
@@ -797,6 +826,7 @@ void World::remove_object(GameObject * obj)
 
     if(obj->m_container != INVALID_SERIAL)
 		remove_container(obj);
+    changed(obj, CHANGE_REMOVED);
 
 	if(obj->is_empty())
 		m_map.erase(obj->get_serial());
@@ -815,6 +845,7 @@ void World::remove_container(GameObject * obj)
 
         obj->m_container = INVALID_SERIAL;
         obj->set_interesting(false);
+        changed(obj, CHANGE_CONTAINER);
 	}
 }
 
@@ -837,6 +868,37 @@ void World::put_container(GameObject * obj, GameObject * container)
     }
     container->add(obj);
     obj->set_interesting(container->get_interesting());
+    changed(obj, CHANGE_CONTAINER);
+}
+
+void World::put_equipment(GameObject * obj, GameObject * container, int layer)
+{
+    put_container(obj, container);
+    obj->set_layer(layer);
+    changed(obj, CHANGE_CONTAINER);
+}
+
+void World::set_feed(WorldFeed * feed)
+{
+    m_feed = feed;
+    for(map_t::iterator i = m_map.begin(); i != m_map.end(); i++)
+        changed((*i).second, CHANGE_ADDED);
+}
+
+void World::changed(GameObject * obj, uint32 what)
+{
+    if(m_feed != 0)
+        m_feed->changed(obj, what);
+}
+
+void World::describe_all(ChangeBatch & batch)
+{
+    WorldChange change;
+    for(map_t::iterator i = m_map.begin(); i != m_map.end(); i++)
+    {
+        WorldFeed::describe((*i).second, CHANGE_ADDED, change);
+        batch.add(change);
+    }
 }
 
 void World::dump()
@@ -95,6 +95,9 @@ public:
 };
 
 class InjectionGUI;
+struct LiveStatsBlock;
+class WorldFeed;
+class ChangeBatch;
 
 class CounterManager
 {
@@ -128,6 +131,8 @@ public:
     void set_object_graphic(GameObject * obj, uint8 * buf);
     void set_object_graphic(GameObject * obj, uint16 graphic);
     void update() const;
+    // Copies the stats and counters for monitoring programs.
+    void get_live_stats(LiveStatsBlock & block) const;
 
     void connected();
     void disconnected();
@@ -255,6 +260,7 @@ private:
     map_t m_map;
     uint32 m_player_serial;
     GameObject * m_player;
+    WorldFeed * m_feed;     // may be 0
 
 public:
     World(uint32 player_serial);
@@ -263,6 +269,14 @@ public:
     GameObject * get_player() { return m_player; }
     void set_player(uint32 serial);
 
+    // Reports the objects there are already as added.
+    void set_feed(WorldFeed * feed);
+    // Tells the feed, if any, that a message set some of the object's
+    // fields. 'what' is a set of CHANGE_ flags from worldfeed.h.
+    void changed(GameObject * obj, uint32 what);
+    // Adds every object to the batch as CHANGE_ADDED.
+    void describe_all(ChangeBatch & batch);
+
     // Find an existing object, or return 0 if the serial was not found
     GameObject * find_object(uint32 serial);
     // Find an existing object, or create one if the serial was not found
@@ -292,11 +306,7 @@ public:
     {
         put_equipment(obj, get_object(container_serial), layer);
     }
-    void put_equipment(GameObject * obj, GameObject * container, int layer)
-    {
-        put_container(obj, container);
-        obj->set_layer(layer);
-    }
+    void put_equipment(GameObject * obj, GameObject * container, int layer);
 
     void dump();
 };
@@ -0,0 +1,401 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// worldfeed.cpp
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The world change feed
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "common.h"
+#include "client.h"
+#include "stats.h"      // for read_tsc()
+#include "world.h"
+#include "worldfeed.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool ChangeBatch::add(const WorldChange & change)
+{
+    std::hash_map<uint32, int>::iterator i = m_index.find(change.m_serial);
+    if(i == m_index.end())
+    {
+        m_index[change.m_serial] = int(m_changes.size());
+        m_changes.push_back(change);
+        return true;
+    }
+    WorldChange & old = m_changes[(*i).second];
+    uint32 what = old.m_what | change.m_what;
+    if((change.m_what & CHANGE_REMOVED) == 0)
+        what &= ~CHANGE_REMOVED;
+    old = change;
+    old.m_what = what;
+    return false;
+}
+
+void ChangeBatch::clear()
+{
+    // Clearing a hash_map visits every bucket, even when it is empty.
+    if(m_changes.empty())
+        return;
+    m_changes.clear();
+    m_index.clear();
+}
+
+void ChangeBatch::remove_front(int count)
+{
+    if(count == 0)
+        return;
+    m_changes.erase(m_changes.begin(), m_changes.begin() + count);
+    m_index.clear();
+    {for(int i = 0; i < int(m_changes.size()); i++)
+        m_index[m_changes[i].m_serial] = i;}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The writer publishes m_head and the reader m_tail with an interlocked
+//  exchange, and each reads the other's with an interlocked add of 0, so
+//  the slots are always written before the reader can see them and read
+//  before the writer can reuse them.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+FeedSubscriber::FeedSubscriber(int capacity, void * owner)
+: m_refs(1), m_owner(owner), m_mask(capacity - 1), m_head(0), m_tail(0),
+  m_needs_snapshot(true)
+{
+    m_slots = new WorldChange[capacity];
+}
+
+// private
+FeedSubscriber::~FeedSubscriber()
+{
+    delete [] m_slots;
+}
+
+// private
+void FeedSubscriber::release()
+{
+    if(InterlockedDecrement(&m_refs) == 0)
+        delete this;
+}
+
+// private
+int FeedSubscriber::push(const ChangeBatch & batch, int first)
+{
+    DWORD head = DWORD(m_head);
+    DWORD tail = DWORD(InterlockedExchangeAdd(&m_tail, 0));
+    int count = batch.size() - first;
+    int space = int(DWORD(m_mask) + 1 - (head - tail));
+    if(count > space)
+        count = space;
+    {for(int i = 0; i < count; i++)
+        m_slots[(head + i) & m_mask] = batch[first + i];}
+    InterlockedExchange(&m_head, LONG(head + count));
+    return count;
+}
+
+// private
+int FeedSubscriber::push_backlog()
+{
+    int count = push(m_backlog, 0);
+    m_backlog.remove_front(count);
+    return count;
+}
+
+int FeedSubscriber::read(WorldChange * changes, int max_changes)
+{
+    DWORD head = DWORD(InterlockedExchangeAdd(&m_head, 0));
+    DWORD tail = DWORD(m_tail);
+    int count = int(head - tail);
+    if(count > max_changes)
+        count = max_changes;
+    {for(int i = 0; i < count; i++)
+        changes[i] = m_slots[(tail + i) & m_mask];}
+    InterlockedExchange(&m_tail, LONG(tail + count));
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+WorldFeed::WorldFeed()
+: m_count(0), m_changes(0), m_merged(0), m_delivered(0)
+{
+    InitializeCriticalSection(&m_lock);
+    {for(int i = 0; i < MAX_FEED_SUBSCRIBERS; i++)
+        m_subscribers[i] = 0;}
+}
+
+WorldFeed::~WorldFeed()
+{
+    {for(int i = 0; i < MAX_FEED_SUBSCRIBERS; i++)
+        if(m_subscribers[i] != 0)
+            m_subscribers[i]->release();}
+    DeleteCriticalSection(&m_lock);
+}
+
+// static
+void WorldFeed::describe(GameObject * obj, uint32 what, WorldChange & change)
+{
+    change.m_serial = obj->get_serial();
+    change.m_what = what;
+    change.m_container = obj->m_container;
+    change.m_graphic = obj->get_graphic();
+    change.m_colour = obj->get_colour();
+    change.m_quantity = obj->get_quantity();
+    change.m_x = obj->get_x();
+    change.m_y = obj->get_y();
+    change.m_z = short(obj->get_z());
+    change.m_layer = uint8(obj->get_layer());
+}
+
+int WorldFeed::subscribe(int capacity, void * owner)
+{
+    int size = 16;
+    while(size < capacity && size < 0x10000)
+        size <<= 1;
+    FeedSubscriber * subscriber = new FeedSubscriber(size, owner);
+    int id = 0;
+    EnterCriticalSection(&m_lock);
+    {for(int i = 0; i < MAX_FEED_SUBSCRIBERS && id == 0; i++)
+        if(m_subscribers[i] == 0)
+        {
+            m_subscribers[i] = subscriber;
+            m_count++;
+            id = i + 1;
+        }}
+    LeaveCriticalSection(&m_lock);
+    if(id == 0)
+        subscriber->release();
+    return id;
+}
+
+void WorldFeed::unsubscribe(int id)
+{
+    if(id < 1 || id > MAX_FEED_SUBSCRIBERS)
+        return;
+    EnterCriticalSection(&m_lock);
+    if(m_subscribers[id - 1] != 0)
+    {
+        m_subscribers[id - 1]->release();
+        m_subscribers[id - 1] = 0;
+        m_count--;
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+void WorldFeed::unsubscribe_owner(void * owner)
+{
+    if(owner == 0)
+        return;
+    EnterCriticalSection(&m_lock);
+    {for(int i = 0; i < MAX_FEED_SUBSCRIBERS; i++)
+        if(m_subscribers[i] != 0 && m_subscribers[i]->m_owner == owner)
+        {
+            trace_printf("worldfeed: closed %d, its script ended\n", i + 1);
+            m_subscribers[i]->release();
+            m_subscribers[i] = 0;
+            m_count--;
+        }}
+    LeaveCriticalSection(&m_lock);
+}
+
+int WorldFeed::read(int id, WorldChange * changes, int max_changes)
+{
+    if(id < 1 || id > MAX_FEED_SUBSCRIBERS)
+        return -1;
+    // The reference keeps it alive if it is closed meanwhile.
+    EnterCriticalSection(&m_lock);
+    FeedSubscriber * subscriber = m_subscribers[id - 1];
+    if(subscriber != 0)
+        subscriber->add_ref();
+    LeaveCriticalSection(&m_lock);
+    if(subscriber == 0)
+        return -1;
+    int count = subscriber->read(changes, max_changes);
+    subscriber->release();
+    return count;
+}
+
+void WorldFeed::changed(GameObject * obj, uint32 what)
+{
+    // A new subscriber gets a snapshot, so nothing is lost by this.
+    if(m_count == 0)
+        return;
+    WorldChange change;
+    describe(obj, what, change);
+    m_changes++;
+    if(!m_batch.add(change))
+        m_merged++;
+}
+
+void WorldFeed::reset()
+{
+    m_batch.clear();
+    EnterCriticalSection(&m_lock);
+    {for(int i = 0; i < MAX_FEED_SUBSCRIBERS; i++)
+        if(m_subscribers[i] != 0)
+        {
+            m_subscribers[i]->m_backlog.clear();
+            m_subscribers[i]->m_needs_snapshot = false;
+        }}
+    LeaveCriticalSection(&m_lock);
+    if(m_count == 0)
+        return;
+    WorldChange change;
+    memset(&change, 0, sizeof(change));
+    change.m_what = CHANGE_RESET;
+    m_batch.add(change);
+}
+
+void WorldFeed::flush(World * world)
+{
+    if(m_count == 0)
+    {
+        m_batch.clear();
+        return;
+    }
+    EnterCriticalSection(&m_lock);
+    {for(int i = 0; i < MAX_FEED_SUBSCRIBERS; i++)
+    {
+        FeedSubscriber * subscriber = m_subscribers[i];
+        if(subscriber == 0)
+            continue;
+        ChangeBatch & backlog = subscriber->m_backlog;
+        if(subscriber->m_needs_snapshot)
+        {
+            subscriber->m_needs_snapshot = false;
+            if(world != 0)
+                world->describe_all(backlog);
+        }
+        if(backlog.empty())
+        {
+            int count = subscriber->push(m_batch, 0);
+            m_delivered += count;
+            {for(int j = count; j < m_batch.size(); j++)
+                backlog.add(m_batch[j]);}
+        }
+        else
+        {
+            {for(int j = 0; j < m_batch.size(); j++)
+                backlog.add(m_batch[j]);}
+            m_delivered += subscriber->push_backlog();
+        }
+    }}
+    LeaveCriticalSection(&m_lock);
+    m_batch.clear();
+}
+
+int WorldFeed::get_backlog()
+{
+    int count = 0;
+    EnterCriticalSection(&m_lock);
+    {for(int i = 0; i < MAX_FEED_SUBSCRIBERS; i++)
+        if(m_subscribers[i] != 0)
+            count += m_subscribers[i]->m_backlog.size();}
+    LeaveCriticalSection(&m_lock);
+    return count;
+}
+
+#ifdef USE_BENCHMARKS
+
+// static
+void WorldFeed::benchmark(int objects, int changes, ClientInterface & client)
+{
+    const int FRAMES = 200;
+    const int READ_SIZE = 256;
+    World world(1);
+    WorldFeed feed;
+    world.set_feed(&feed);
+    int id = feed.subscribe();
+    WorldChange * changes_read = new WorldChange[READ_SIZE];
+
+    // Items on the ground around the player, as in a busy town:
+    {for(int i = 0; i < objects; i++)
+    {
+        GameObject * obj = world.get_object(0x40000000 + i);
+        obj->set_graphic(uint16(0x0eed + i % 8));
+        obj->m_x = uint16(1000 + i % 40);
+        obj->m_y = uint16(1000 + i / 40);
+        world.changed(obj, CHANGE_POSITION | CHANGE_APPEARANCE);
+    }}
+    feed.flush(&world);
+    while(feed.read(id, changes_read, READ_SIZE) > 0)
+        ;
+    uint32 merged = feed.get_merged();
+    uint32 delivered = feed.get_delivered();
+
+    // Then random objects move, some of them several times a frame.
+    uint32 seed = 1;
+    uint64 change_cycles = 0, flush_cycles = 0, read_cycles = 0;
+    int read_count = 0;
+    {for(int frame = 0; frame < FRAMES; frame++)
+    {
+        uint64 start = read_tsc();
+        for(int i = 0; i < changes; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            GameObject * obj = world.get_object(
+                0x40000000 + (seed >> 8) % uint32(objects));
+            obj->m_x++;
+            world.changed(obj, CHANGE_POSITION);
+        }
+        uint64 flushed = read_tsc();
+        feed.flush(&world);
+        uint64 read = read_tsc();
+        int count;
+        while((count = feed.read(id, changes_read, READ_SIZE)) > 0)
+            read_count += count;
+        change_cycles += flushed - start;
+        flush_cycles += read - flushed;
+        read_cycles += read_tsc() - read;
+    }}
+    merged = feed.get_merged() - merged;
+    delivered = feed.get_delivered() - delivered;
+    delete [] changes_read;
+
+    double total_us = g_traffic_stats.to_us(change_cycles + flush_cycles +
+        read_cycles);
+    char buf[200];
+    sprintf(buf, "%d changes to %d objects: %.3f us each, %lu merged, %lu delivered, %d read",
+        FRAMES * changes, objects,
+        g_traffic_stats.to_us(change_cycles) / (FRAMES * changes),
+        merged, delivered, read_count);
+    client.client_print(buf);
+    trace_printf("feedbench: %s\n", buf);
+    sprintf(buf, "Per frame: flush %.1f us, read %.1f us; %.0f changes per second in, %.0f out",
+        g_traffic_stats.to_us(flush_cycles) / FRAMES,
+        g_traffic_stats.to_us(read_cycles) / FRAMES,
+        FRAMES * changes / total_us * 1e6, read_count / total_us * 1e6);
+    client.client_print(buf);
+    trace_printf("feedbench: %s\n", buf);
+}
+
+#endif
@@ -0,0 +1,180 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// worldfeed.h
+//
+// Copyright (C) 2001 Luke 'Infidel' Dunstan
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  A stream of changes to the world, for scripts and external DLLs that
+//  keep their own view of it
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WORLDFEED_H_
+#define _WORLDFEED_H_
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <hash_map>
+#include <vector>
+
+#include "common.h"
+
+class GameObject;
+class World;
+class ClientInterface;
+
+// What a message set for an object. These are the fields the message
+// carried, which may be the same as before.
+const uint32 CHANGE_ADDED = 0x01;       // first seen
+const uint32 CHANGE_POSITION = 0x02;    // x, y or z
+const uint32 CHANGE_CONTAINER = 0x04;   // put in a container or on a body
+const uint32 CHANGE_QUANTITY = 0x08;
+const uint32 CHANGE_APPEARANCE = 0x10;  // graphic or colour
+const uint32 CHANGE_REMOVED = 0x20;     // deleted by the server
+// The player left the world: forget every object. The serial is 0.
+const uint32 CHANGE_RESET = 0x40;
+
+// An object's state after a change. When an object changes again before a
+// subscriber reads it, the two are merged: the flags are combined and the
+// state is the newer one, except that CHANGE_REMOVED is only kept if the
+// newer change removed the object.
+struct WorldChange
+{
+    uint32 m_serial;
+    uint32 m_what;          // CHANGE_ flags
+    uint32 m_container;     // INVALID_SERIAL if none
+    uint16 m_graphic;
+    uint16 m_colour;
+    uint16 m_quantity;
+    uint16 m_x, m_y;        // INVALID_XY if contained
+    short m_z;
+    uint8 m_layer;
+};
+
+// Changes in the order they happened, at most one per object.
+class ChangeBatch
+{
+private:
+    std::vector<WorldChange> m_changes;
+    std::hash_map<uint32, int> m_index;     // serial -> index in m_changes
+
+public:
+    // Returns false if the change was merged into an earlier one.
+    bool add(const WorldChange & change);
+    void clear();
+    bool empty() const { return m_changes.empty(); }
+    int size() const { return int(m_changes.size()); }
+    const WorldChange & operator[](int index) const { return m_changes[index]; }
+    // Removes the first 'count' changes.
+    void remove_front(int count);
+};
+
+// A ring of changes with one writer, the client thread, and one reader.
+// Changes that do not fit wait in the backlog, where they go on being
+// merged, so a slow reader gets the latest state rather than losing any.
+// It is deleted when the feed has let go of it and no read is using it.
+class FeedSubscriber
+{
+    friend class WorldFeed;
+private:
+    LONG m_refs;
+    void * m_owner;         // the script that opened it, or 0
+    WorldChange * m_slots;
+    LONG m_mask;            // the capacity, a power of two, minus one
+    // These only grow, and wrap around:
+    LONG m_head;            // changes written; only the writer changes it
+    LONG m_tail;            // changes read; only the reader changes it
+    ChangeBatch m_backlog;
+    bool m_needs_snapshot;  // send every object before anything else
+
+    ~FeedSubscriber();
+    void add_ref() { InterlockedIncrement(&m_refs); }
+    void release();
+    // Called on the client thread. Return how many changes were written.
+    int push(const ChangeBatch & batch, int first);
+    int push_backlog();
+
+public:
+    FeedSubscriber(int capacity, void * owner);
+
+    // Called by the reader. Returns the number of changes copied.
+    int read(WorldChange * changes, int max_changes);
+};
+
+const int MAX_FEED_SUBSCRIBERS = 16;
+const int DEFAULT_FEED_CAPACITY = 1024;
+
+// Collects the changes made while the client thread handles messages, and
+// hands them to the subscribers in one go from Injection::idle().
+// Subscribers are numbered from 1.
+class WorldFeed
+{
+private:
+    CRITICAL_SECTION m_lock;    // for m_subscribers
+    FeedSubscriber * m_subscribers[MAX_FEED_SUBSCRIBERS];
+    int m_count;                // of subscribers
+    ChangeBatch m_batch;
+    // Statistics:
+    uint32 m_changes;           // reported by the world
+    uint32 m_merged;            // of those, merged into an earlier change
+    uint32 m_delivered;         // written to a ring
+
+public:
+    WorldFeed();
+    ~WorldFeed();
+
+    static void describe(GameObject * obj, uint32 what, WorldChange & change);
+
+    // These may be called from any thread. A new subscriber first gets
+    // every object in the world as added. Returns 0 if there are too many
+    // subscribers. 'owner' is the script that opens it, if any.
+    int subscribe(int capacity = DEFAULT_FEED_CAPACITY, void * owner = 0);
+    void unsubscribe(int id);
+    // Closes every subscriber a script opened, when the script ends.
+    void unsubscribe_owner(void * owner);
+    // Only one thread may read each subscriber. Returns the number of
+    // changes copied, or -1 if there is no such subscriber.
+    int read(int id, WorldChange * changes, int max_changes);
+
+    // These are called on the client thread.
+    void changed(GameObject * obj, uint32 what);
+    // The world is about to be deleted.
+    void reset();
+    // Delivers the changes so far. 'world' may be 0.
+    void flush(World * world);
+
+    int get_count() const { return m_count; }
+    uint32 get_changes() const { return m_changes; }
+    uint32 get_merged() const { return m_merged; }
+    uint32 get_delivered() const { return m_delivered; }
+    int get_backlog();
+
+#ifdef USE_BENCHMARKS
+    // Times the feed with a made-up world of 'objects' items on the ground
+    // and 'changes' item updates between flushes.
+    static void benchmark(int objects, int changes, ClientInterface & client);
+#endif
+};
+
+#endif